@@ -164,6 +164,10 @@ Settings config = {
     .drun_use_desktop_cache = FALSE,
     .drun_reload_desktop_cache = FALSE,
 
+    /** icon cache */
+    .icon_cache = TRUE,
+    .icon_memory_limit = 64,
+
     /** Benchmarks */
     .benchmark_ui = FALSE,
 
@@ -173,8 +177,6 @@ Settings config = {
     .steal_focus = FALSE,
     /** fallback icon */
     .application_fallback_icon = NULL,
-    /** refilter limit in ms*/
-    .refilter_timeout_limit = 300,
     /** workaround for broken xserver (#300 on xserver, #611) */
     .xserver_i300_workaround = FALSE,
     /** What browser to use for completion */
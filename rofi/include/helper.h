@@ -137,6 +137,36 @@ int find_arg(const char *const key);
  * @returns TRUE when matches, FALSE otherwise
  */
 int helper_token_match(rofi_int_matcher *const *tokens, const char *input);
+
+/**
+ * Normalized strings matched for each row of a list, with normalize-match
+ * enabled. It is built while filtering and dropped when the rows change.
+ */
+typedef struct rofi_normalize_cache_t rofi_normalize_cache;
+
+/**
+ * @param num_rows The number of rows of the list.
+ *
+ * @returns a new, empty cache, free with rofi_normalize_cache_free.
+ */
+rofi_normalize_cache *rofi_normalize_cache_new(unsigned int num_rows);
+
+/**
+ * @param cache The cache to free, or NULL.
+ *
+ * Free the cache and the normalized strings in it.
+ */
+void rofi_normalize_cache_free(rofi_normalize_cache *cache);
+
+/**
+ * @param cache The cache of the list, or NULL to stop caching.
+ * @param row The row that is matched next on this thread.
+ *
+ * Let helper_token_match() on this thread keep normalized strings with the
+ * row. A row should only be matched by one thread at a time.
+ */
+void helper_token_match_set_row(rofi_normalize_cache *cache,
+                                unsigned int row);
 /**
  * @param cmd The command to execute.
  *
@@ -231,6 +261,67 @@ char *rofi_force_utf8(const gchar *data, ssize_t length);
  */
 char *rofi_latin_to_utf8_strdup(const char *input, gssize length);
 
+/**
+ * Chunked allocator for many small strings that share a lifetime, like the
+ * rows of a mode. Strings are packed into large blocks and released all at
+ * once.
+ */
+typedef struct rofi_string_arena_t rofi_string_arena;
+
+/**
+ * Create an empty string arena.
+ *
+ * @returns a new arena, free with rofi_string_arena_free.
+ */
+rofi_string_arena *rofi_string_arena_new(void);
+
+/**
+ * @param arena The arena to allocate from.
+ * @param str The string to copy.
+ * @param length The number of bytes to copy, or -1 if nul-terminated.
+ *
+ * Copy the string into the arena and nul-terminate it.
+ *
+ * @returns the copy, owned by the arena.
+ */
+char *rofi_string_arena_add(rofi_string_arena *arena, const char *str,
+                            gssize length);
+
+/**
+ * @param arena The arena to allocate from.
+ * @param data The unvalidated character array holding possible UTF-8 data.
+ * @param length The length of the data array.
+ *
+ * Like rofi_force_utf8, but the result is owned by the arena.
+ *
+ * @returns the converted UTF-8 string.
+ */
+char *rofi_string_arena_add_utf8(rofi_string_arena *arena, const char *data,
+                                 gssize length);
+
+/**
+ * @param arena The arena to move the strings into.
+ * @param other The arena to take the strings from, freed.
+ *
+ * Move all strings of other into arena, the strings keep their address.
+ */
+void rofi_string_arena_merge(rofi_string_arena *arena,
+                             rofi_string_arena *other);
+
+/**
+ * @param arena The arena to query.
+ *
+ * @returns the number of bytes allocated by the arena.
+ */
+gsize rofi_string_arena_get_size(const rofi_string_arena *arena);
+
+/**
+ * @param arena The arena to free, or NULL.
+ *
+ * Free the arena and all strings allocated from it.
+ */
+void rofi_string_arena_free(rofi_string_arena *arena);
+
 /**
  * @param pattern   The user input to match against.
  * @param plen      Pattern length.
@@ -267,6 +358,55 @@ char *rofi_latin_to_utf8_strdup(const char *input, gssize length);
  */
 int rofi_scorer_fuzzy_evaluate(const char *pattern, glong plen, const char *str,
                                glong slen, const int case_sensitive);
+
+/**
+ * A pattern prepared for scoring many strings against it.
+ */
+typedef struct rofi_scorer_t rofi_scorer;
+
+/**
+ * @param pattern The user input to score against, or NULL.
+ * @param plen Pattern length, or -1 if nul-terminated.
+ * @param case_sensitive Whether case is significant.
+ *
+ * Decode the pattern once for rofi_scorer_levenshtein and rofi_scorer_fuzzy.
+ * The scorer keeps scratch buffers between calls, so scoring does not
+ * allocate. It is not thread safe, each thread should create its own.
+ *
+ * @returns a new scorer, free with rofi_scorer_free.
+ */
+rofi_scorer *rofi_scorer_create(const char *pattern, glong plen,
+                                int case_sensitive);
+
+/**
+ * @param scorer The scorer to free.
+ *
+ * Free the scorer.
+ */
+void rofi_scorer_free(rofi_scorer *scorer);
+
+/**
+ * @param scorer The scorer holding the pattern.
+ * @param str The string to score.
+ * @param slen Length of str, or -1 if nul-terminated.
+ *
+ * Same as levenshtein, with the pattern of scorer as needle.
+ *
+ * @returns the levenshtein distance between pattern and str.
+ */
+unsigned int rofi_scorer_levenshtein(rofi_scorer *scorer, const char *str,
+                                     glong slen);
+
+/**
+ * @param scorer The scorer holding the pattern.
+ * @param str The string to score.
+ * @param slen Length of str, or -1 if nul-terminated.
+ *
+ * Same as rofi_scorer_fuzzy_evaluate, with the pattern of scorer.
+ *
+ * @returns the sorting weight.
+ */
+int rofi_scorer_fuzzy(rofi_scorer *scorer, const char *str, glong slen);
 /*@}*/
 
 /**
@@ -343,6 +483,18 @@ gboolean helper_execute_command(const char *wd, const char *cmd,
 cairo_surface_t *cairo_image_surface_create_from_svg(const gchar *file,
                                                      int height);
 
+/**
+ * @param surface The ARGB32 image surface to blur.
+ * @param radius The radius of the blur.
+ * @param deviation The deviation of the gaussian, 0 to derive it from radius.
+ *
+ * Blur the content of the surface with radius and deviation. The gaussian
+ * is approximated with box blurs, so the cost does not depend on the radius.
+ * Rows and columns are split over the worker pool.
+ */
+void cairo_image_surface_blur(cairo_surface_t *surface, int radius,
+                              double deviation);
+
 /**
  * Ranges.
  */
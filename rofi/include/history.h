@@ -34,6 +34,9 @@
  *
  * Implements a very simple history module that can be used by a #Mode.
  *
+ * Updates are appended to a journal next to the history file, that gets
+ * folded back into the history file once it grows too large.
+ *
  * This uses the following options from the #config object:
  * * #Settings::disable_history
  * * #Settings::ignored_prefixes
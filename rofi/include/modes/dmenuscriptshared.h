@@ -2,6 +2,7 @@
 #define ROFI_MODES_DMENU_SCRIPT_SHARED_H
 
 #include <glib.h>
+#include <helper.h>
 #include <mode.h>
 #include <stdint.h>
 
@@ -14,35 +15,37 @@ typedef struct {
 
   /** Icon name to display. */
   char *icon_name;
-  /** Async icon fetch handler. */
-  uint32_t icon_fetch_uid;
-  uint32_t icon_fetch_size;
   /** Hidden meta keywords. */
   char *meta;
 
   /** info */
   char *info;
 
+  /** Async icon fetch handler. */
+  uint32_t icon_fetch_uid;
+  uint32_t icon_fetch_size;
+
   /** non-selectable */
-  gboolean nonselectable;
+  unsigned int nonselectable : 1;
 
   /** permanent */
-  gboolean permanent;
+  unsigned int permanent : 1;
 
   /** urgent */
-  gboolean urgent;
+  unsigned int urgent : 1;
   /** active */
-  gboolean active;
+  unsigned int active : 1;
 } DmenuScriptEntry;
 /**
  * @param sw Unused
  * @param entry The entry to update.
  * @param buffer The buffer to parse.
  * @param length The buffer length.
+ * @param arena The arena the values are allocated from.
  *
  * Updates entry with the parsed values from buffer.
  */
 void dmenuscript_parse_entry_extras(G_GNUC_UNUSED Mode *sw,
                                     DmenuScriptEntry *entry, char *buffer,
-                                    size_t length);
+                                    size_t length, rofi_string_arena *arena);
 #endif // ROFI_MODES_DMENU_SCRIPT_SHARED_H
@@ -81,5 +81,19 @@ gboolean rofi_icon_fetcher_get_ex(const uint32_t uid,
  * @returns true if image, false otherwise.
  */
 gboolean rofi_icon_fetcher_file_is_image(const char *const path);
+
+/**
+ * Called before the view is drawn.
+ *
+ * Icons requested while drawing are the ones shown, they are fetched before
+ * icons requested earlier. Icons that are not requested in two frames are
+ * dropped from the queue, and queued again when requested.
+ */
+void rofi_icon_fetcher_frame_start(void);
+
+/**
+ * Called after the view is drawn, queues the icons requested in this frame.
+ */
+void rofi_icon_fetcher_frame_end(void);
 /** @} */
 #endif // ROFI_ICON_FETCHER_H
@@ -352,12 +352,19 @@ typedef struct rofi_range_pair {
   int stop;
 } rofi_range_pair;
 
+/**
+ * Matcher that does not need the regex engine, opaque.
+ */
+typedef struct rofi_int_native_matcher_t rofi_int_native_matcher;
+
 /**
  * Internal structure for matching.
  */
 typedef struct rofi_int_matcher_t {
   GRegex *regex;
   gboolean invert;
+  /** If set, used for matching instead of the regex. */
+  rofi_int_native_matcher *native;
 } rofi_int_matcher;
 
 /**
@@ -189,6 +189,11 @@ typedef struct {
   gboolean drun_use_desktop_cache;
   gboolean drun_reload_desktop_cache;
 
+  /** icon cache */
+  gboolean icon_cache;
+  /** Memory, in MiB, used to keep decoded icons. (0 for no limit) */
+  unsigned int icon_memory_limit;
+
   /** Benchmark */
   gboolean benchmark_ui;
 
@@ -198,10 +203,6 @@ typedef struct {
   /** fallback icon */
   char *application_fallback_icon;
 
-  /** refilter timeout limit, when more then these entries,go into timeout mode.
-   */
-  unsigned int refilter_timeout_limit;
-
   /** workaround for broken xserver (#300 on xserver, #611) */
   gboolean xserver_i300_workaround;
   /** completer mode */
@@ -27,8 +27,10 @@
 
 #ifndef ROFI_VIEW_INTERNAL_H
 #define ROFI_VIEW_INTERNAL_H
+#include "helper.h"
 #include "keyb.h"
 #include "mode.h"
+#include "settings.h"
 #include "theme.h"
 #include "widgets/box.h"
 #include "widgets/container.h"
@@ -78,6 +80,8 @@ struct RofiViewState {
 
   /** number of (filtered) elements to show. */
   unsigned int filtered_lines;
+  /** number of leading (filtered) elements that are in their final order. */
+  unsigned int ranked_lines;
 
   /** Previously called key action. */
   KeyBindingAction prev_action;
@@ -146,6 +150,24 @@ struct RofiViewState {
   rofi_int_matcher **tokens;
   /** For case-sensitivity */
   gboolean case_sensitive;
+  /** Normalized strings of the rows, with normalize-match enabled. */
+  rofi_normalize_cache *normalize;
+
+  /** Input of the last filter pass, used to narrow down the result set. */
+  struct {
+    /** If line_map holds the result of this filter. */
+    gboolean valid;
+    /** #Mode the filter was run against. */
+    Mode *sw;
+    /** User input. */
+    char *input;
+    /** Input after mode preprocessing. */
+    char *pattern;
+    /** Matching method used. */
+    MatchingMethod matching_method;
+    /** Case-sensitivity used. */
+    gboolean case_sensitive;
+  } last_filter;
 };
 /** @} */
 #endif
@@ -258,6 +258,13 @@ Mode *rofi_view_get_mode(RofiViewState *state);
  */
 void rofi_view_hide(void);
 
+/**
+ * Indicate icons finished loading and the view should be redrawn.
+ * Safe to call from any thread, calls within one frame are merged into a
+ * single redraw.
+ */
+void rofi_view_queue_icon_redraw(void);
+
 /**
  * Indicate the current view needs to reload its data.
  * This can only be done when *more* information is available.
@@ -266,6 +273,12 @@ void rofi_view_hide(void);
  */
 void rofi_view_reload(void);
 
+/**
+ * Stop the filter pass running in the background, and filter again on the
+ * next update. Modes call this before changing the rows the filter reads.
+ */
+void rofi_view_cancel_filter(void);
+
 /**
  * @param state The handle to the view
  * @param mode The new mode to display
@@ -266,6 +266,15 @@ void listview_set_fixed_num_lines(listview *lv);
  */
 void listview_set_max_lines(listview *lv, unsigned int max_lines);
 
+/**
+ * @param lv Handler to the listview object.
+ *
+ * Get the number of rows that fit in the listview.
+ *
+ * @returns the number of visible rows.
+ */
+unsigned int listview_get_max_elements(listview *lv);
+
 /**
  * @param lv Handler to the listview object.
  *
@@ -69,6 +69,28 @@ xcb_window_t xcb_stuff_get_root_window(void);
  */
 char *window_get_text_prop(xcb_window_t w, xcb_atom_t atom);
 
+/**
+ * @param w The xcb_window_t to read property from.
+ * @param atom The property identifier
+ *
+ * Send the request for a text property, without waiting for the reply.
+ * Used to fetch many properties in a single round trip.
+ *
+ * @returns the cookie to pass to window_get_text_prop_reply.
+ */
+xcb_get_property_cookie_t window_get_text_prop_request(xcb_window_t w,
+                                                       xcb_atom_t atom);
+
+/**
+ * @param c The cookie returned by window_get_text_prop_request.
+ *
+ * Wait for the text property requested with window_get_text_prop_request.
+ * Support utf8.
+ *
+ * @returns a newly allocated string with the result or NULL
+ */
+char *window_get_text_prop_reply(xcb_get_property_cookie_t c);
+
 /**
  * @param w The xcb_window_t to set property on
  * @param prop Atom of the property to change
@@ -221,25 +243,15 @@ extern WindowManagerQuirk current_window_manager;
  * @param window the window the screenshot
  * @param size   Size of the thumbnail
  *
- * Creates a thumbnail of the window.
+ * Creates a thumbnail of the window. It only uses the connection and image
+ * surfaces, so it can be called from a worker thread.
  *
  * @returns NULL if window was not found, or unmapped, otherwise returns a
  * cairo_surface.
  */
-
 cairo_surface_t *x11_helper_get_screenshot_surface_window(xcb_window_t window,
                                                           int size);
 
-/**
- * @param surface
- * @param radius
- * @param deviation
- *
- * Blur the content of the surface with radius and deviation.
- */
-void cairo_image_surface_blur(cairo_surface_t *surface, int radius,
-                              double deviation);
-
 #ifdef XCB_IMDKIT
 /**
  * IME Forwarding
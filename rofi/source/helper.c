@@ -43,6 +43,7 @@
 #include <glib.h>
 #include <glib/gstdio.h>
 #include <limits.h>
+#include <math.h>
 #include <pango/pango-fontmap.h>
 #include <pango/pango.h>
 #include <pango/pangocairo.h>
@@ -144,9 +145,12 @@ int helper_parse_setup(char *string, char ***output, int *length, ...) {
   return FALSE;
 }
 
+static void native_matcher_free(rofi_int_native_matcher *m);
+
 void helper_tokenize_free(rofi_int_matcher **tokens) {
   for (size_t i = 0; tokens && tokens[i]; i++) {
     g_regex_unref((GRegex *)tokens[i]->regex);
+    native_matcher_free(tokens[i]->native);
     g_free(tokens[i]);
   }
   g_free(tokens);
@@ -227,6 +231,295 @@ static char *utf8_helper_simplify_string(const char *os) {
   return str;
 }
 
+/**
+ * Type of native matcher.
+ */
+typedef enum {
+  /** Plain substring, like MM_NORMAL. */
+  NATIVE_MATCHER_SUBSTRING,
+  /** Substring starting at a word boundary, like MM_PREFIX. */
+  NATIVE_MATCHER_PREFIX,
+  /** Substrings separated by '*', '?' matches one non-space, like MM_GLOB. */
+  NATIVE_MATCHER_GLOB,
+} NativeMatcherType;
+
+/**
+ * Matcher for the non-regex matching methods.
+ * This avoids running the regex engine for every token on every entry.
+ */
+struct rofi_int_native_matcher_t {
+  /** Type of match to do. */
+  NativeMatcherType type;
+  /** Case sensitive match, if not the segments are ascii and lower case. */
+  gboolean case_sensitive;
+  /**
+   * PCRE folds 'k' and 's' with non-ascii characters, fall back to the regex
+   * for non-ascii input.
+   */
+  gboolean fold_non_ascii;
+  /** Literal segments, only one unless glob. */
+  char **segments;
+  /** Length in bytes of each segment. */
+  size_t *segment_lengths;
+  /** If the segment contains a '?' wildcard. */
+  gboolean *segment_wildcard;
+  /** Number of segments. */
+  unsigned int num_segments;
+};
+
+static void native_matcher_free(rofi_int_native_matcher *m) {
+  if (m == NULL) {
+    return;
+  }
+  g_strfreev(m->segments);
+  g_free(m->segment_lengths);
+  g_free(m->segment_wildcard);
+  g_free(m);
+}
+
+/**
+ * @param input The (normalized) token.
+ * @param type The type of match.
+ * @param case_sensitive If the match is case sensitive.
+ *
+ * Case insensitive matching is only done natively for ascii tokens, other
+ * tokens are left to the regex engine for proper unicode case folding.
+ *
+ * @returns a native matcher, or NULL if the token needs the regex engine.
+ */
+static rofi_int_native_matcher *
+native_matcher_create(const char *input, NativeMatcherType type,
+                      int case_sensitive) {
+  gboolean fold_non_ascii = FALSE;
+  for (const char *iter = input; *iter != '\0'; iter++) {
+    if ((unsigned char)(*iter) >= 0x80 && !case_sensitive) {
+      return NULL;
+    }
+    if (!case_sensitive && (g_ascii_tolower(*iter) == 'k' ||
+                            g_ascii_tolower(*iter) == 's')) {
+      fold_non_ascii = TRUE;
+    }
+  }
+  // '\b' on an empty string is not a substring test.
+  if (type == NATIVE_MATCHER_PREFIX && input[0] == '\0') {
+    return NULL;
+  }
+  rofi_int_native_matcher *m = g_malloc0(sizeof(rofi_int_native_matcher));
+  m->type = type;
+  m->case_sensitive = case_sensitive;
+  m->fold_non_ascii = fold_non_ascii;
+  if (type == NATIVE_MATCHER_GLOB) {
+    m->segments = g_strsplit(input, "*", -1);
+  } else {
+    m->segments = g_malloc0(2 * sizeof(char *));
+    m->segments[0] = g_strdup(input);
+  }
+  m->num_segments = g_strv_length(m->segments);
+  m->segment_lengths = g_malloc0_n(m->num_segments, sizeof(size_t));
+  m->segment_wildcard = g_malloc0_n(m->num_segments, sizeof(gboolean));
+  for (unsigned int i = 0; i < m->num_segments; i++) {
+    if (!case_sensitive) {
+      for (char *iter = m->segments[i]; *iter != '\0'; iter++) {
+        *iter = g_ascii_tolower(*iter);
+      }
+    }
+    m->segment_lengths[i] = strlen(m->segments[i]);
+    m->segment_wildcard[i] =
+        (type == NATIVE_MATCHER_GLOB && strchr(m->segments[i], '?') != NULL);
+  }
+  return m;
+}
+
+/**
+ * @param c The character to test.
+ *
+ * @returns TRUE if c is a word character like regex '\w' (unicode aware).
+ */
+static inline gboolean native_matcher_is_word_char(gunichar c) {
+  return c == '_' || g_unichar_isalnum(c);
+}
+
+/**
+ * @param seg The segment to match.
+ * @param seg_len The length of the segment in bytes.
+ * @param case_sensitive If the match is case sensitive.
+ * @param h The position in the haystack to match.
+ * @param hend The end of the haystack.
+ *
+ * Match a segment containing '?' wildcards at position h.
+ *
+ * @returns the end of the match, or NULL if there is no match.
+ */
+static const char *native_matcher_wildcard_at(const char *seg, size_t seg_len,
+                                              gboolean case_sensitive,
+                                              const char *h,
+                                              const char *hend) {
+  for (size_t i = 0; i < seg_len; i++) {
+    if (h >= hend) {
+      return NULL;
+    }
+    if (seg[i] == '?') {
+      // Like regex '\S', one character that is not a space.
+      gunichar c = g_utf8_get_char(h);
+      if (g_unichar_isspace(c) || c == '\v' || c == 0x85) {
+        return NULL;
+      }
+      h = g_utf8_next_char(h);
+    } else {
+      char c = case_sensitive ? *h : g_ascii_tolower(*h);
+      if (c != seg[i]) {
+        return NULL;
+      }
+      h++;
+    }
+  }
+  return h;
+}
+
+/**
+ * @param m The matcher.
+ * @param index The segment to find.
+ * @param h The start of the haystack.
+ * @param hend The end of the haystack.
+ * @param match_end Set to the end of the match.
+ *
+ * Find the first occurrence of segment index in the haystack.
+ * Candidates are located with memchr on the first byte (both cases if case
+ * insensitive), so most of the haystack is skipped by the vectorized libc
+ * scan.
+ *
+ * @returns the start of the match, or NULL if not found.
+ */
+static const char *native_matcher_find(const rofi_int_native_matcher *m,
+                                       unsigned int index, const char *h,
+                                       const char *hend,
+                                       const char **match_end) {
+  const char *seg = m->segments[index];
+  size_t seg_len = m->segment_lengths[index];
+  if (seg_len == 0) {
+    *match_end = h;
+    return h;
+  }
+  if (m->segment_wildcard[index]) {
+    for (const char *p = h; p < hend; p++) {
+      // Only start on character boundaries.
+      if (((unsigned char)*p & 0xC0) == 0x80) {
+        continue;
+      }
+      const char *e =
+          native_matcher_wildcard_at(seg, seg_len, m->case_sensitive, p, hend);
+      if (e != NULL) {
+        *match_end = e;
+        return p;
+      }
+    }
+    return NULL;
+  }
+  char first = seg[0];
+  char first_upper = m->case_sensitive ? first : g_ascii_toupper(first);
+  gboolean two_cases = (first_upper != first);
+  // Next candidate for both cases, only the consumed one is rescanned.
+  const char *next_lower = h, *next_upper = h;
+  gboolean scan_lower = TRUE, scan_upper = two_cases;
+  const char *p = h;
+  while ((size_t)(hend - p) >= seg_len) {
+    if (scan_lower || next_lower < p) {
+      next_lower = memchr(p, first, hend - p);
+      if (next_lower == NULL) {
+        next_lower = hend;
+      }
+      scan_lower = FALSE;
+    }
+    if (two_cases && (scan_upper || next_upper < p)) {
+      next_upper = memchr(p, first_upper, hend - p);
+      if (next_upper == NULL) {
+        next_upper = hend;
+      }
+      scan_upper = FALSE;
+    }
+    p = next_lower;
+    if (two_cases && next_upper < p) {
+      p = next_upper;
+    }
+    if ((size_t)(hend - p) < seg_len) {
+      return NULL;
+    }
+    gboolean match = TRUE;
+    if (m->case_sensitive) {
+      match = memcmp(p + 1, seg + 1, seg_len - 1) == 0;
+    } else {
+      for (size_t i = 1; match && i < seg_len; i++) {
+        match = g_ascii_tolower(p[i]) == seg[i];
+      }
+    }
+    if (match) {
+      *match_end = p + seg_len;
+      return p;
+    }
+    p++;
+  }
+  return NULL;
+}
+
+/**
+ * @param m The matcher.
+ * @param input The string to match against.
+ *
+ * @returns TRUE on match, FALSE on no match and -1 if the input should be
+ * matched by the regex engine.
+ */
+static int native_matcher_match(const rofi_int_native_matcher *m,
+                                const char *input) {
+  size_t len = strlen(input);
+  const char *hend = input + len;
+  if (m->fold_non_ascii) {
+    for (const char *iter = input; iter < hend; iter++) {
+      if ((unsigned char)(*iter) >= 0x80) {
+        return -1;
+      }
+    }
+  }
+  const char *end = NULL;
+  switch (m->type) {
+  case NATIVE_MATCHER_PREFIX: {
+    gboolean first_word =
+        native_matcher_is_word_char(g_utf8_get_char(m->segments[0]));
+    for (const char *p = input;
+         (p = native_matcher_find(m, 0, p, hend, &end)) != NULL; p++) {
+      gboolean prev_word =
+          (p > input) &&
+          native_matcher_is_word_char(g_utf8_get_char(g_utf8_prev_char(p)));
+      if (prev_word != first_word) {
+        return TRUE;
+      }
+    }
+    return FALSE;
+  }
+  case NATIVE_MATCHER_GLOB:
+    // '.*' does not cross line boundaries, match each line on its own.
+    for (const char *line = input; line <= hend;) {
+      const char *lend = memchr(line, '\n', hend - line);
+      if (lend == NULL) {
+        lend = hend;
+      }
+      unsigned int i = 0;
+      for (const char *h = line; i < m->num_segments; i++, h = end) {
+        if (native_matcher_find(m, i, h, lend, &end) == NULL) {
+          break;
+        }
+      }
+      if (i == m->num_segments) {
+        return TRUE;
+      }
+      line = lend + 1;
+    }
+    return FALSE;
+  case NATIVE_MATCHER_SUBSTRING:
+  default:
+    return native_matcher_find(m, 0, input, hend, &end) != NULL;
+  }
+}
+
 // Macro for quickly generating regex for matching.
 static inline GRegex *R(const char *s, int case_sensitive) {
   if (config.normalize_match) {
@@ -243,6 +536,27 @@ static inline GRegex *R(const char *s, int case_sensitive) {
       s, G_REGEX_OPTIMIZE | ((case_sensitive) ? 0 : G_REGEX_CASELESS), 0, NULL);
 }
 
+/**
+ * @param input The token.
+ * @param type The type of native matcher.
+ * @param case_sensitive If the match is case sensitive.
+ *
+ * Create a native matcher for the token, normalized if required.
+ *
+ * @returns a native matcher, or NULL if the token needs the regex engine.
+ */
+static rofi_int_native_matcher *N(const char *input, NativeMatcherType type,
+                                  int case_sensitive) {
+  if (config.normalize_match) {
+    char *str = utf8_helper_simplify_string(input);
+    rofi_int_native_matcher *m =
+        native_matcher_create(str, type, case_sensitive);
+    g_free(str);
+    return m;
+  }
+  return native_matcher_create(input, type, case_sensitive);
+}
+
 static rofi_int_matcher *create_regex(const char *input, int case_sensitive) {
   GRegex *retv = NULL;
   gchar *r;
@@ -251,11 +565,13 @@ static rofi_int_matcher *create_regex(const char *input, int case_sensitive) {
     rv->invert = 1;
     input++;
   }
+  // The regex is always created, it is used for highlighting.
   switch (config.matching_method) {
   case MM_GLOB:
     r = glob_to_regex(input);
     retv = R(r, case_sensitive);
     g_free(r);
+    rv->native = N(input, NATIVE_MATCHER_GLOB, case_sensitive);
     break;
   case MM_REGEX:
     retv = R(input, case_sensitive);
@@ -274,11 +590,13 @@ static rofi_int_matcher *create_regex(const char *input, int case_sensitive) {
     r = prefix_regex(input);
     retv = R(r, case_sensitive);
     g_free(r);
+    rv->native = N(input, NATIVE_MATCHER_PREFIX, case_sensitive);
     break;
   default:
     r = g_regex_escape_string(input, -1);
     retv = R(r, case_sensitive);
     g_free(r);
+    rv->native = N(input, NATIVE_MATCHER_SUBSTRING, case_sensitive);
     break;
   }
   rv->regex = retv;
@@ -539,20 +857,136 @@ PangoAttrList *helper_token_match_get_pango_attr(RofiHighlightColorStyle th,
   return retv;
 }
 
+/**
+ * Normalized form of one string matched for a row. A row can match several
+ * strings, like the fields of a drun entry, so they form a list.
+ */
+typedef struct rofi_normalize_entry {
+  /** Next string of the same row. */
+  struct rofi_normalize_entry *next;
+  /** The normalized string. */
+  char *normalized;
+  /** The original string. */
+  char input[];
+} rofi_normalize_entry;
+
+struct rofi_normalize_cache_t {
+  /** Number of rows. */
+  unsigned int num_rows;
+  /** Per row, the strings matched so far. */
+  rofi_normalize_entry **rows;
+};
+
+/**
+ * The row the filter on this thread is matching, set with
+ * helper_token_match_set_row(). Each row is matched by one thread at a time,
+ * so its entries are used without locking.
+ */
+static GPrivate normalize_row = G_PRIVATE_INIT(NULL);
+
+rofi_normalize_cache *rofi_normalize_cache_new(unsigned int num_rows) {
+  rofi_normalize_cache *cache = g_malloc0(sizeof(rofi_normalize_cache));
+  cache->num_rows = num_rows;
+  cache->rows = g_malloc0_n(MAX(1, num_rows), sizeof(rofi_normalize_entry *));
+  return cache;
+}
+
+void rofi_normalize_cache_free(rofi_normalize_cache *cache) {
+  if (cache == NULL) {
+    return;
+  }
+  for (unsigned int i = 0; i < cache->num_rows; i++) {
+    rofi_normalize_entry *e = cache->rows[i];
+    while (e != NULL) {
+      rofi_normalize_entry *next = e->next;
+      g_free(e->normalized);
+      g_free(e);
+      e = next;
+    }
+  }
+  g_free(cache->rows);
+  g_free(cache);
+}
+
+void helper_token_match_set_row(rofi_normalize_cache *cache,
+                                unsigned int row) {
+  if (cache == NULL || row >= cache->num_rows) {
+    g_private_set(&normalize_row, NULL);
+  } else {
+    g_private_set(&normalize_row, &(cache->rows[row]));
+  }
+}
+
+/**
+ * @param input The string to normalize.
+ * @param tmp Set to the normalized string if the caller has to free it.
+ *
+ * Look up the normalized form of input in the row being matched, normalizing
+ * and storing it on the first lookup. Ascii strings are already in normalized
+ * form and are returned as is.
+ *
+ * @returns the normalized string.
+ */
+static const char *helper_token_match_normalize(const char *input,
+                                                char **tmp) {
+  const char *iter = input;
+  while (*iter != '\0' && (unsigned char)(*iter) < 0x80) {
+    iter++;
+  }
+  if (*iter == '\0') {
+    return input;
+  }
+  rofi_normalize_entry **row = g_private_get(&normalize_row);
+  if (row == NULL) {
+    *tmp = utf8_helper_simplify_string(input);
+    return *tmp;
+  }
+  for (rofi_normalize_entry *e = *row; e != NULL; e = e->next) {
+    if (strcmp(e->input, input) == 0) {
+      return e->normalized;
+    }
+  }
+  size_t len = strlen(input);
+  rofi_normalize_entry *e = g_malloc(sizeof(rofi_normalize_entry) + len + 1);
+  memcpy(e->input, input, len + 1);
+  e->normalized = utf8_helper_simplify_string(input);
+  e->next = *row;
+  *row = e;
+  return e->normalized;
+}
+
+/**
+ * @param token The token to match.
+ * @param input The (normalized) string to match against.
+ *
+ * @returns TRUE if the token matches, not taking inversion into account.
+ */
+static inline int helper_token_match_single(const rofi_int_matcher *token,
+                                            const char *input) {
+  if (token->native != NULL) {
+    int match = native_matcher_match(token->native, input);
+    if (match >= 0) {
+      return match;
+    }
+  }
+  return g_regex_match(token->regex, input, 0, NULL);
+}
+
 int helper_token_match(rofi_int_matcher *const *tokens, const char *input) {
   int match = TRUE;
   // Do a tokenized match.
   if (tokens) {
     if (config.normalize_match) {
-      char *r = utf8_helper_simplify_string(input);
+      char *tmp = NULL;
+      const char *r = helper_token_match_normalize(input, &tmp);
       for (int j = 0; match && tokens[j]; j++) {
-        match = g_regex_match(tokens[j]->regex, r, 0, NULL);
+        match = helper_token_match_single(tokens[j], r);
         match ^= tokens[j]->invert;
       }
-      g_free(r);
+      g_free(tmp);
     } else {
       for (int j = 0; match && tokens[j]; j++) {
-        match = g_regex_match(tokens[j]->regex, input, 0, NULL);
+        match = helper_token_match_single(tokens[j], input);
         match ^= tokens[j]->invert;
       }
     }
@@ -810,43 +1244,98 @@ char *rofi_expand_path(const char *input) {
 #define MIN3(a, b, c)                                                          \
   ((a) < (b) ? ((a) < (c) ? (a) : (c)) : ((b) < (c) ? (b) : (c)))
 
-unsigned int levenshtein(const char *needle, const glong needlelen,
-                         const char *haystack, const glong haystacklen,
-                         int case_sensitive) {
-  if (needlelen == G_MAXLONG) {
-    // String to long, we cannot handle this.
-    return UINT_MAX;
-  }
-  unsigned int column[needlelen + 1];
-  for (glong y = 0; y < needlelen; y++) {
+/** Longest pattern handled by the bit-parallel levenshtein. */
+#define LEVENSHTEIN_BITS 64
+
+/**
+ * @param needle The decoded needle.
+ * @param needlelen The length of the needle.
+ * @param haystack The decoded haystack.
+ * @param haystacklen The length of the haystack.
+ * @param column Scratch space for needlelen + 1 entries.
+ *
+ * Levenshtein distance by filling the matrix one column at a time.
+ *
+ * @returns the levenshtein distance between needle and haystack
+ */
+static unsigned int levenshtein_columns(const gunichar *needle, glong needlelen,
+                                        const gunichar *haystack,
+                                        glong haystacklen,
+                                        unsigned int *column) {
+  for (glong y = 0; y <= needlelen; y++) {
     column[y] = y;
   }
-  // Removed out of the loop, otherwise static code analyzers think it is
-  // unset.. silly but true. old loop: for ( glong y = 0; y <= needlelen; y++)
-  column[needlelen] = needlelen;
   for (glong x = 1; x <= haystacklen; x++) {
-    const char *needles = needle;
+    gunichar haystackc = haystack[x - 1];
     column[0] = x;
-    gunichar haystackc = g_utf8_get_char(haystack);
-    if (!case_sensitive) {
-      haystackc = g_unichar_tolower(haystackc);
-    }
     for (glong y = 1, lastdiag = x - 1; y <= needlelen; y++) {
-      gunichar needlec = g_utf8_get_char(needles);
-      if (!case_sensitive) {
-        needlec = g_unichar_tolower(needlec);
-      }
       unsigned int olddiag = column[y];
       column[y] = MIN3(column[y] + 1, column[y - 1] + 1,
-                       lastdiag + (needlec == haystackc ? 0 : 1));
+                       lastdiag + (needle[y - 1] == haystackc ? 0 : 1));
       lastdiag = olddiag;
-      needles = g_utf8_next_char(needles);
     }
-    haystack = g_utf8_next_char(haystack);
   }
   return column[needlelen];
 }
 
+/**
+ * @param peq_ascii Match mask of each ASCII character.
+ * @param peq_chars The non-ASCII characters in the needle.
+ * @param peq_masks Match mask of each character in peq_chars.
+ * @param peq_num_chars Number of entries in peq_chars.
+ * @param needlelen The length of the needle, at most LEVENSHTEIN_BITS.
+ * @param haystack The decoded haystack.
+ * @param haystacklen The length of the haystack.
+ *
+ * Levenshtein distance with the bit-parallel algorithm of Myers, in the
+ * formulation of Hyyrö. A column of the matrix is kept as bit vectors of the
+ * vertical deltas, so each haystack character costs a few word operations.
+ * Bit i of a match mask is set when needle character i equals the character.
+ *
+ * @returns the levenshtein distance between needle and haystack
+ */
+static unsigned int levenshtein_bitparallel(
+    const guint64 *peq_ascii, const gunichar *peq_chars,
+    const guint64 *peq_masks, unsigned int peq_num_chars, glong needlelen,
+    const gunichar *haystack, glong haystacklen) {
+  if (needlelen == 0) {
+    return haystacklen;
+  }
+  const guint64 last = G_GUINT64_CONSTANT(1) << (needlelen - 1);
+  guint64 pv = ~G_GUINT64_CONSTANT(0);
+  guint64 mv = 0;
+  unsigned int score = needlelen;
+  for (glong x = 0; x < haystacklen; x++) {
+    gunichar c = haystack[x];
+    guint64 eq = 0;
+    if (c < 128) {
+      eq = peq_ascii[c];
+    } else {
+      for (unsigned int i = 0; i < peq_num_chars; i++) {
+        if (peq_chars[i] == c) {
+          eq = peq_masks[i];
+          break;
+        }
+      }
+    }
+    guint64 xv = eq | mv;
+    guint64 xh = (((eq & pv) + pv) ^ pv) | eq;
+    guint64 ph = mv | ~(xh | pv);
+    guint64 mh = pv & xh;
+    if (ph & last) {
+      score++;
+    } else if (mh & last) {
+      score--;
+    }
+    // The top row of the matrix grows by one each column.
+    ph = (ph << 1) | 1;
+    mh = mh << 1;
+    pv = mh | ~(xv | ph);
+    mv = ph & xv;
+  }
+  return score;
+}
+
 char *rofi_latin_to_utf8_strdup(const char *input, gssize length) {
   gsize slength = 0;
   return g_convert_with_fallback(input, length, "UTF-8", "latin1", "\uFFFD",
@@ -881,6 +1370,123 @@ char *rofi_force_utf8(const gchar *data, ssize_t length) {
   return g_string_free(string, FALSE);
 }
 
+/** Size of the blocks a #rofi_string_arena packs strings into. */
+#define ROFI_STRING_ARENA_BLOCK_SIZE (64 * 1024)
+
+/** Block of memory strings are packed into. */
+typedef struct _rofi_string_arena_block {
+  /** Next (older) block. */
+  struct _rofi_string_arena_block *next;
+  /** Size of data. */
+  gsize size;
+  /** Bytes of data in use. */
+  gsize used;
+  /** The strings. */
+  char data[];
+} rofi_string_arena_block;
+
+struct rofi_string_arena_t {
+  /** List of blocks, strings are added to the first one. */
+  rofi_string_arena_block *blocks;
+  /** Total bytes allocated. */
+  gsize size;
+};
+
+rofi_string_arena *rofi_string_arena_new(void) {
+  return g_malloc0(sizeof(rofi_string_arena));
+}
+
+static char *rofi_string_arena_alloc(rofi_string_arena *arena, gsize size) {
+  rofi_string_arena_block *block = arena->blocks;
+  if (block == NULL || (block->size - block->used) < size) {
+    // Large strings get a block of their own, so the current block can still
+    // be filled up.
+    gboolean own = (block != NULL && size > ROFI_STRING_ARENA_BLOCK_SIZE / 4);
+    gsize bsize = own ? size : MAX(size, ROFI_STRING_ARENA_BLOCK_SIZE);
+    rofi_string_arena_block *nb =
+        g_malloc(sizeof(rofi_string_arena_block) + bsize);
+    nb->size = bsize;
+    nb->used = 0;
+    arena->size += sizeof(rofi_string_arena_block) + bsize;
+    if (own) {
+      nb->next = block->next;
+      block->next = nb;
+      nb->used = size;
+      return nb->data;
+    }
+    nb->next = block;
+    arena->blocks = block = nb;
+  }
+  char *retv = block->data + block->used;
+  block->used += size;
+  return retv;
+}
+
+char *rofi_string_arena_add(rofi_string_arena *arena, const char *str,
+                            gssize length) {
+  if (str == NULL) {
+    return NULL;
+  }
+  gsize len = (length < 0) ? strlen(str) : (gsize)length;
+  char *retv = rofi_string_arena_alloc(arena, len + 1);
+  memcpy(retv, str, len);
+  retv[len] = '\0';
+  return retv;
+}
+
+char *rofi_string_arena_add_utf8(rofi_string_arena *arena, const char *data,
+                                 gssize length) {
+  if (data == NULL) {
+    return NULL;
+  }
+  if (length < 0) {
+    length = strlen(data);
+  }
+  if (g_utf8_validate(data, length, NULL)) {
+    return rofi_string_arena_add(arena, data, length);
+  }
+  char *utf8 = rofi_force_utf8(data, length);
+  char *retv = rofi_string_arena_add(arena, utf8, -1);
+  g_free(utf8);
+  return retv;
+}
+
+void rofi_string_arena_merge(rofi_string_arena *arena,
+                             rofi_string_arena *other) {
+  if (other->blocks != NULL) {
+    if (arena->blocks == NULL) {
+      arena->blocks = other->blocks;
+    } else {
+      // Keep filling the current block of arena.
+      rofi_string_arena_block *last = other->blocks;
+      while (last->next != NULL) {
+        last = last->next;
+      }
+      last->next = arena->blocks->next;
+      arena->blocks->next = other->blocks;
+    }
+    arena->size += other->size;
+  }
+  g_free(other);
+}
+
+gsize rofi_string_arena_get_size(const rofi_string_arena *arena) {
+  return arena->size;
+}
+
+void rofi_string_arena_free(rofi_string_arena *arena) {
+  if (arena == NULL) {
+    return;
+  }
+  rofi_string_arena_block *block = arena->blocks;
+  while (block != NULL) {
+    rofi_string_arena_block *next = block->next;
+    g_free(block);
+    block = next;
+  }
+  g_free(arena);
+}
+
 /****
  * FZF like scorer
  */
@@ -959,44 +1565,44 @@ static int rofi_scorer_get_score_for(enum CharClass prev, enum CharClass curr) {
   return 0;
 }
 
-int rofi_scorer_fuzzy_evaluate(const char *pattern, glong plen, const char *str,
-                               glong slen, int case_sensitive) {
-  if (slen > FUZZY_SCORER_MAX_LENGTH) {
-    return -MIN_SCORE;
-  }
+/**
+ * @param pattern The decoded pattern.
+ * @param plen Pattern length.
+ * @param str The decoded string.
+ * @param score Score of each position in str.
+ * @param slen Length of str, at most FUZZY_SCORER_MAX_LENGTH.
+ *
+ * See rofi_scorer_fuzzy_evaluate.
+ *
+ * @returns the sorting weight.
+ */
+static int rofi_scorer_fuzzy_kernel(const gunichar *pattern, glong plen,
+                                    const gunichar *str, const int *score,
+                                    glong slen) {
   glong pi, si;
   // whether we are aligning the first character of pattern
   gboolean pfirst = TRUE;
   // whether the start of a word in pattern
   gboolean pstart = TRUE;
-  // score for each position
-  int *score = g_malloc_n(slen, sizeof(int));
   // dp[i]: maximum value by aligning pattern[0..pi] to str[0..si]
-  int *dp = g_malloc_n(slen, sizeof(int));
+  int dp[FUZZY_SCORER_MAX_LENGTH];
   // uleft: value of the upper left cell; ulefts: maximum value of uleft and
   // cells on the left. The arbitrary initial values suppress warnings.
   int uleft = 0, ulefts = 0, left, lefts;
-  const gchar *pit = pattern, *sit;
-  enum CharClass prev = NON_WORD;
-  for (si = 0, sit = str; si < slen; si++, sit = g_utf8_next_char(sit)) {
-    enum CharClass cur = rofi_scorer_get_character_class(g_utf8_get_char(sit));
-    score[si] = rofi_scorer_get_score_for(prev, cur);
-    prev = cur;
+  for (si = 0; si < slen; si++) {
     dp[si] = MIN_SCORE;
   }
-  for (pi = 0; pi < plen; pi++, pit = g_utf8_next_char(pit)) {
-    gunichar pc = g_utf8_get_char(pit), sc;
+  for (pi = 0; pi < plen; pi++) {
+    gunichar pc = pattern[pi];
     if (g_unichar_isspace(pc)) {
       pstart = TRUE;
       continue;
     }
     lefts = MIN_SCORE;
-    for (si = 0, sit = str; si < slen; si++, sit = g_utf8_next_char(sit)) {
+    for (si = 0; si < slen; si++) {
       left = dp[si];
       lefts = MAX(lefts + GAP_SCORE, left);
-      sc = g_utf8_get_char(sit);
-      if (case_sensitive ? pc == sc
-                         : g_unichar_tolower(pc) == g_unichar_tolower(sc)) {
+      if (pc == str[si]) {
         int t = score[si] * (pstart ? PATTERN_START_MULTIPLIER
                                     : PATTERN_NON_START_MULTIPLIER);
         dp[si] = pfirst ? LEADING_GAP_SCORE * si + t
@@ -1013,11 +1619,178 @@ int rofi_scorer_fuzzy_evaluate(const char *pattern, glong plen, const char *str,
   for (si = 0; si < slen; si++) {
     lefts = MAX(lefts + GAP_SCORE, dp[si]);
   }
-  g_free(score);
-  g_free(dp);
   return -lefts;
 }
 
+/**
+ * A pattern decoded once for scoring many strings, with the scratch space
+ * the scoring needs. Not thread safe, each thread needs its own.
+ */
+struct rofi_scorer_t {
+  /** Decoded pattern, lower-cased unless case sensitive. */
+  gunichar *pattern;
+  /** Length of pattern. */
+  glong plen;
+  /** Whether case is significant. */
+  int case_sensitive;
+  /** Match mask of each ASCII character, for the bit-parallel levenshtein. */
+  guint64 peq_ascii[128];
+  /** The non-ASCII characters in the pattern. */
+  gunichar peq_chars[LEVENSHTEIN_BITS];
+  /** Match mask of each character in peq_chars. */
+  guint64 peq_masks[LEVENSHTEIN_BITS];
+  /** Number of entries in peq_chars. */
+  unsigned int peq_num_chars;
+  /** Column for the levenshtein of long patterns, plen + 1 entries. */
+  unsigned int *column;
+  /** Decoded string being scored. */
+  gunichar *str;
+  /** Size of str. */
+  gsize str_size;
+  /** Score of each position in str, for the fuzzy scorer. */
+  int score[FUZZY_SCORER_MAX_LENGTH + 1];
+};
+
+rofi_scorer *rofi_scorer_create(const char *pattern, glong plen,
+                                int case_sensitive) {
+  rofi_scorer *scorer = g_malloc0(sizeof(rofi_scorer));
+  if (pattern == NULL) {
+    pattern = "";
+  }
+  if (plen < 0) {
+    plen = g_utf8_strlen(pattern, -1);
+  }
+  scorer->case_sensitive = case_sensitive;
+  scorer->plen = plen;
+  scorer->pattern = g_malloc_n(MAX(1, plen), sizeof(gunichar));
+  const char *pit = pattern;
+  for (glong pi = 0; pi < plen; pi++, pit = g_utf8_next_char(pit)) {
+    if (*pit == '\0') {
+      scorer->plen = plen = pi;
+      break;
+    }
+    gunichar pc = g_utf8_get_char(pit);
+    scorer->pattern[pi] = case_sensitive ? pc : g_unichar_tolower(pc);
+  }
+  if (plen <= LEVENSHTEIN_BITS) {
+    for (glong pi = 0; pi < plen; pi++) {
+      gunichar pc = scorer->pattern[pi];
+      guint64 bit = G_GUINT64_CONSTANT(1) << pi;
+      if (pc < 128) {
+        scorer->peq_ascii[pc] |= bit;
+        continue;
+      }
+      unsigned int i = 0;
+      while (i < scorer->peq_num_chars && scorer->peq_chars[i] != pc) {
+        i++;
+      }
+      if (i == scorer->peq_num_chars) {
+        scorer->peq_chars[i] = pc;
+        scorer->peq_num_chars++;
+      }
+      scorer->peq_masks[i] |= bit;
+    }
+  } else {
+    scorer->column = g_malloc_n(plen + 1, sizeof(unsigned int));
+  }
+  return scorer;
+}
+
+void rofi_scorer_free(rofi_scorer *scorer) {
+  if (scorer == NULL) {
+    return;
+  }
+  g_free(scorer->pattern);
+  g_free(scorer->column);
+  g_free(scorer->str);
+  g_free(scorer);
+}
+
+/**
+ * @param scorer The scorer.
+ * @param str The string to decode.
+ * @param slen Length of str, or -1 if nul-terminated.
+ * @param max Maximum number of characters to decode.
+ * @param score If the fuzzy score of each position should be computed.
+ *
+ * Decode str into the scratch space of scorer, folding case unless case
+ * sensitive.
+ *
+ * @returns the number of characters decoded.
+ */
+static glong rofi_scorer_decode(rofi_scorer *scorer, const char *str,
+                                glong slen, glong max, gboolean score) {
+  // A character takes at least one byte.
+  gsize size = (slen < 0) ? strlen(str) : (gsize)slen;
+  size = MIN(size, (gsize)max);
+  if (size > scorer->str_size) {
+    scorer->str_size = MAX(size, 2 * scorer->str_size);
+    scorer->str = g_realloc_n(scorer->str, scorer->str_size, sizeof(gunichar));
+  }
+  enum CharClass prev = NON_WORD;
+  glong n = 0;
+  for (const char *sit = str; (gsize)n < size && *sit != '\0';
+       n++, sit = g_utf8_next_char(sit)) {
+    gunichar sc = g_utf8_get_char(sit);
+    if (score) {
+      enum CharClass cur = rofi_scorer_get_character_class(sc);
+      scorer->score[n] = rofi_scorer_get_score_for(prev, cur);
+      prev = cur;
+    }
+    scorer->str[n] = scorer->case_sensitive ? sc : g_unichar_tolower(sc);
+  }
+  return n;
+}
+
+unsigned int rofi_scorer_levenshtein(rofi_scorer *scorer, const char *str,
+                                     glong slen) {
+  glong n = rofi_scorer_decode(scorer, str, slen, G_MAXLONG, FALSE);
+  if (scorer->plen <= LEVENSHTEIN_BITS) {
+    return levenshtein_bitparallel(scorer->peq_ascii, scorer->peq_chars,
+                                   scorer->peq_masks, scorer->peq_num_chars,
+                                   scorer->plen, scorer->str, n);
+  }
+  return levenshtein_columns(scorer->pattern, scorer->plen, scorer->str, n,
+                             scorer->column);
+}
+
+int rofi_scorer_fuzzy(rofi_scorer *scorer, const char *str, glong slen) {
+  if (slen > FUZZY_SCORER_MAX_LENGTH) {
+    return -MIN_SCORE;
+  }
+  glong n =
+      rofi_scorer_decode(scorer, str, slen, FUZZY_SCORER_MAX_LENGTH + 1, TRUE);
+  if (n > FUZZY_SCORER_MAX_LENGTH) {
+    return -MIN_SCORE;
+  }
+  return rofi_scorer_fuzzy_kernel(scorer->pattern, scorer->plen, scorer->str,
+                                  scorer->score, n);
+}
+
+unsigned int levenshtein(const char *needle, const glong needlelen,
+                         const char *haystack, const glong haystacklen,
+                         int case_sensitive) {
+  if (needlelen == G_MAXLONG) {
+    // String to long, we cannot handle this.
+    return UINT_MAX;
+  }
+  rofi_scorer *scorer = rofi_scorer_create(needle, needlelen, case_sensitive);
+  unsigned int retv = rofi_scorer_levenshtein(scorer, haystack, haystacklen);
+  rofi_scorer_free(scorer);
+  return retv;
+}
+
+int rofi_scorer_fuzzy_evaluate(const char *pattern, glong plen, const char *str,
+                               glong slen, int case_sensitive) {
+  if (slen > FUZZY_SCORER_MAX_LENGTH) {
+    return -MIN_SCORE;
+  }
+  rofi_scorer *scorer = rofi_scorer_create(pattern, plen, case_sensitive);
+  int retv = rofi_scorer_fuzzy(scorer, str, slen);
+  rofi_scorer_free(scorer);
+  return retv;
+}
+
 /**
  * @param a    UTF-8 string to compare
  * @param b    UTF-8 string to compare
@@ -1459,3 +2232,233 @@ char *helper_string_replace_if_exists_v(char *string, GHashTable *h) {
   }
   return res;
 }
+
+/**
+ * A slice of the image blurred by one worker.
+ */
+typedef struct {
+  /** Worker pool job, must be first. */
+  thread_state st;
+  /** The pixels. */
+  uint8_t *data;
+  /** Scratch image, same size as data. */
+  uint8_t *tmp;
+  /** Size of the image. */
+  int width;
+  int height;
+  int stride;
+  /** Radius of each box blur. */
+  int radii[3];
+  /** First row or column of the slice. */
+  int start;
+  /** End of the slice (exclusive). */
+  int end;
+  GMutex *mutex;
+  GCond *cond;
+  unsigned int *acount;
+} BlurJob;
+
+/**
+ * @param in The pixels to blur, with at least r transparent pixels on either
+ * side.
+ * @param out Where to store the result.
+ * @param width The number of pixels.
+ * @param r The radius of the box.
+ *
+ * Box blur a row of pixels, using a running sum.
+ */
+static void blur_box_row(const uint8_t *in, uint8_t *out, int width, int r) {
+  const uint32_t mul = 65536 / (2 * r + 1);
+  uint32_t sum[4] = {0, 0, 0, 0};
+  for (int x = -r; x < r; x++) {
+    for (int c = 0; c < 4; c++) {
+      sum[c] += in[x * 4 + c];
+    }
+  }
+  for (int x = 0; x < width; x++) {
+    for (int c = 0; c < 4; c++) {
+      sum[c] += in[(x + r) * 4 + c];
+      out[x * 4 + c] = (sum[c] * mul + 32768) >> 16;
+      sum[c] -= in[(x - r) * 4 + c];
+    }
+  }
+}
+
+/**
+ * @param in The first byte of the columns to blur.
+ * @param out Where to store the result.
+ * @param sum Scratch space of n sums.
+ * @param zero n zero bytes, used for the rows outside the image.
+ * @param n The number of bytes in a row of the slice.
+ * @param height The number of rows.
+ * @param stride The stride of in and out.
+ * @param r The radius of the box.
+ *
+ * Box blur a slice of columns. This walks the rows in order and keeps a
+ * running sum per byte, so the inner loop can be vectorized.
+ */
+static void blur_box_columns(const uint8_t *in, uint8_t *out, uint32_t *sum,
+                             const uint8_t *zero, int n, int height,
+                             int stride, int r) {
+  const uint32_t mul = 65536 / (2 * r + 1);
+  memset(sum, 0, n * sizeof(uint32_t));
+  for (int y = 0; y < MIN(r, height); y++) {
+    const uint8_t *row = in + (size_t)y * stride;
+    for (int b = 0; b < n; b++) {
+      sum[b] += row[b];
+    }
+  }
+  for (int y = 0; y < height; y++) {
+    const uint8_t *add =
+        (y + r < height) ? (in + (size_t)(y + r) * stride) : zero;
+    const uint8_t *sub = (y - r >= 0) ? (in + (size_t)(y - r) * stride) : zero;
+    uint8_t *dst = out + (size_t)y * stride;
+    for (int b = 0; b < n; b++) {
+      sum[b] += add[b];
+      dst[b] = (sum[b] * mul + 32768) >> 16;
+      sum[b] -= sub[b];
+    }
+  }
+}
+
+static void blur_job_done(BlurJob *job) {
+  g_mutex_lock(job->mutex);
+  (*(job->acount))--;
+  g_cond_signal(job->cond);
+  g_mutex_unlock(job->mutex);
+}
+
+static void blur_rows(thread_state *t, G_GNUC_UNUSED gpointer data) {
+  BlurJob *job = (BlurJob *)t;
+  // Two rows with transparent padding, to blur back and forth.
+  const int pad = MAX(job->radii[0], MAX(job->radii[1], job->radii[2]));
+  const size_t size = (size_t)(job->width + 2 * pad) * 4;
+  uint8_t *a = g_malloc0(size);
+  uint8_t *b = g_malloc0(size);
+  uint8_t *a_row = a + pad * 4;
+  uint8_t *b_row = b + pad * 4;
+  for (int y = job->start; y < job->end; y++) {
+    const size_t offset = (size_t)y * job->stride;
+    memcpy(a_row, job->data + offset, job->width * 4);
+    blur_box_row(a_row, b_row, job->width, job->radii[0]);
+    blur_box_row(b_row, a_row, job->width, job->radii[1]);
+    // The column pass picks it up from the scratch image.
+    blur_box_row(a_row, job->tmp + offset, job->width, job->radii[2]);
+  }
+  g_free(a);
+  g_free(b);
+  blur_job_done(job);
+}
+
+static void blur_columns(thread_state *t, G_GNUC_UNUSED gpointer data) {
+  BlurJob *job = (BlurJob *)t;
+  const int n = (job->end - job->start) * 4;
+  const size_t offset = job->start * 4;
+  uint8_t *data_ptr = job->data + offset;
+  uint8_t *tmp_ptr = job->tmp + offset;
+  uint32_t *sum = g_malloc(n * sizeof(uint32_t));
+  uint8_t *zero = g_malloc0(n);
+  blur_box_columns(tmp_ptr, data_ptr, sum, zero, n, job->height, job->stride,
+                   job->radii[0]);
+  blur_box_columns(data_ptr, tmp_ptr, sum, zero, n, job->height, job->stride,
+                   job->radii[1]);
+  blur_box_columns(tmp_ptr, data_ptr, sum, zero, n, job->height, job->stride,
+                   job->radii[2]);
+  g_free(zero);
+  g_free(sum);
+  blur_job_done(job);
+}
+
+/**
+ * @param jobs The jobs to run.
+ * @param njobs The number of jobs.
+ * @param length The number of rows or columns to split over the jobs.
+ * @param callback The function running a job.
+ *
+ * Split the rows or columns over the jobs, run them on the worker pool and
+ * wait for them to finish.
+ */
+static void blur_run(BlurJob *jobs, unsigned int njobs, int length,
+                     void (*callback)(thread_state *, gpointer)) {
+  GMutex mutex;
+  GCond cond;
+  unsigned int count = njobs;
+  g_mutex_init(&mutex);
+  g_cond_init(&cond);
+  for (unsigned int i = 0; i < njobs; i++) {
+    jobs[i].st.callback = callback;
+    jobs[i].st.free = NULL;
+    jobs[i].st.priority = G_PRIORITY_HIGH;
+    jobs[i].start = (int)(((int64_t)length * i) / njobs);
+    jobs[i].end = (int)(((int64_t)length * (i + 1)) / njobs);
+    jobs[i].mutex = &mutex;
+    jobs[i].cond = &cond;
+    jobs[i].acount = &count;
+    if (i > 0 && tpool != NULL) {
+      g_thread_pool_push(tpool, &(jobs[i]), NULL);
+    }
+  }
+  // Do the first job in this thread, all of them if there are no workers.
+  for (unsigned int i = 0; i < (tpool != NULL ? 1 : njobs); i++) {
+    callback((thread_state *)&(jobs[i]), NULL);
+  }
+  g_mutex_lock(&mutex);
+  while (count > 0) {
+    g_cond_wait(&cond, &mutex);
+  }
+  g_mutex_unlock(&mutex);
+  g_cond_clear(&cond);
+  g_mutex_clear(&mutex);
+}
+
+void cairo_image_surface_blur(cairo_surface_t *surface, int radius,
+                              double deviation) {
+  if (cairo_surface_status(surface) ||
+      cairo_image_surface_get_format(surface) != CAIRO_FORMAT_ARGB32 ||
+      radius <= 0) {
+    return;
+  }
+  cairo_surface_flush(surface);
+  uint8_t *data = cairo_image_surface_get_data(surface);
+  const int width = cairo_image_surface_get_width(surface);
+  const int height = cairo_image_surface_get_height(surface);
+  const int stride = cairo_image_surface_get_stride(surface);
+  if (data == NULL || width == 0 || height == 0) {
+    return;
+  }
+
+  // Three box blurs in a row approximate a gaussian, and cost the same for
+  // any radius. Pick the boxes matching the deviation of the gaussian.
+  if (deviation == 0.0) {
+    double radiusf = radius + 1.0;
+    deviation = sqrt(-(radiusf * radiusf) / (2.0 * log(1.0 / 255.0)));
+  }
+  double wideal = sqrt(4.0 * deviation * deviation + 1.0);
+  int wl = (int)floor(wideal);
+  if (wl % 2 == 0) {
+    wl--;
+  }
+  double mideal =
+      (12.0 * deviation * deviation - 3.0 * wl * wl - 12.0 * wl - 9.0) /
+      (-4.0 * wl - 4.0);
+  int m = (int)round(mideal);
+
+  unsigned int njobs = MAX(1, MIN(config.threads, 64));
+  BlurJob *jobs = g_malloc0_n(njobs, sizeof(BlurJob));
+  uint8_t *tmp = g_malloc((size_t)height * stride);
+  for (unsigned int i = 0; i < njobs; i++) {
+    jobs[i].data = data;
+    jobs[i].tmp = tmp;
+    jobs[i].width = width;
+    jobs[i].height = height;
+    jobs[i].stride = stride;
+    for (int j = 0; j < 3; j++) {
+      jobs[i].radii[j] = (j < m) ? (wl - 1) / 2 : (wl + 1) / 2;
+    }
+  }
+  blur_run(jobs, MIN(njobs, (unsigned int)height), height, blur_rows);
+  blur_run(jobs, MIN(njobs, (unsigned int)width), width, blur_columns);
+  g_free(tmp);
+  g_free(jobs);
+  cairo_surface_mark_dirty(surface);
+}
@@ -25,114 +25,158 @@
  *
  */
 #include "config.h"
-
 #include "history.h"
 #include "rofi.h"
 #include "settings.h"
 #include <errno.h>
+#include <fcntl.h>
 #include <glib.h>
 #include <glib/gstdio.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/stat.h>
 #include <sys/types.h>
 #include <unistd.h>
 
+/**
+ * The history file holds a snapshot of the list, changes made since are
+ * appended as records to a journal next to it. Recording a use is a single
+ * append; once the journal grows past #HISTORY_JOURNAL_MAX_SIZE it is folded
+ * back into the history file.
+ */
+#define HISTORY_JOURNAL_SUFFIX ".journal"
+/** Size (in bytes) of the journal that triggers a compaction. */
+#define HISTORY_JOURNAL_MAX_SIZE (16 * 1024)
+/** Journal record that adds/increments an entry. */
+#define HISTORY_OP_SET '+'
+/** Journal record that removes an entry. */
+#define HISTORY_OP_REMOVE '-'
+
 /**
  * History element
  */
 typedef struct __element {
   /** Index in history */
   long int index;
+  /** When the element reached its current index, orders equal indexes. */
+  unsigned long int seq;
   /** Entry */
   char *name;
 } _element;
 
+/**
+ * History list, indexed on the entry.
+ */
+typedef struct {
+  /** Hash table mapping the entry on its #_element. */
+  GHashTable *entries;
+  /** Index that is subtracted from the entries when writing them out. */
+  long int base;
+  /** Last handed out sequence number. */
+  unsigned long int seq;
+} _history;
+
+static void __element_free(gpointer data) {
+  _element *e = (_element *)data;
+  g_free(e->name);
+  g_free(e);
+}
+
+/**
+ * Orders on index (highest first), equal indexes on the order they got
+ * reached in. This is the order the repeated stable sort of the list used to
+ * produce.
+ */
+static int __element_cmp(const _element *a, const _element *b) {
+  if (a->index != b->index) {
+    return (a->index > b->index) ? -1 : 1;
+  }
+  if (a->seq != b->seq) {
+    return (a->seq < b->seq) ? -1 : 1;
+  }
+  return 0;
+}
+
 static int __element_sort_func(const void *ea, const void *eb,
                                void *data __attribute__((unused))) {
   _element *a = *(_element **)ea;
   _element *b = *(_element **)eb;
-  return b->index - a->index;
+  return __element_cmp(a, b);
 }
 
-static void __history_write_element_list(FILE *fd, _element **list,
-                                         unsigned int length) {
-  if (list == NULL || length == 0) {
-    return;
-  }
-  // Sort the list before writing out.
-  g_qsort_with_data(list, length, sizeof(_element *), __element_sort_func,
-                    NULL);
-
-  // Get minimum index.
-  int min_value = list[length - 1]->index;
-
-  // Set the max length of the list.
-  length =
-      (length > config.max_history_size) ? config.max_history_size : length;
+static void __history_init(_history *h) {
+  h->entries = g_hash_table_new_full(g_str_hash, g_str_equal, NULL,
+                                     __element_free);
+  h->base = 0;
+  h->seq = 0;
+}
 
-  // Write out entries.
-  for (unsigned int iter = 0; iter < length; iter++) {
-    fprintf(fd, "%ld %s\n", list[iter]->index - min_value, list[iter]->name);
-  }
+static void __history_clear(_history *h) {
+  g_hash_table_destroy(h->entries);
+  h->entries = NULL;
 }
 
-static char **__history_get_element_list_fields(FILE *fd,
-                                                unsigned int *length) {
-  unsigned int real_length = 0;
-  char **retv = NULL;
-  ;
-  if (length == NULL) {
-    return NULL;
-  }
-  *length = 0;
+static void __history_insert(_history *h, const char *name, long int index) {
+  _element *e = g_malloc(sizeof(_element));
+  e->index = index;
+  e->seq = ++(h->seq);
+  e->name = g_strdup(name);
+  g_hash_table_insert(h->entries, e->name, e);
+}
 
-  if (fd == NULL) {
-    return NULL;
-  }
-  char *buffer = NULL;
-  size_t buffer_length = 0;
-  ssize_t l = 0;
-  while ((l = getline(&buffer, &buffer_length, fd)) > 0) {
-    // Jump to the first space.
-    const char *start = strchr(buffer, ' ');
-    // not found, skip.
-    if (start == NULL) {
-      continue;
+/**
+ * Does what writing out the list used to do: rebase the index on the lowest
+ * entry and drop the lowest entries over the maximum size.
+ */
+static void __history_update(_history *h) {
+  gboolean rebase = TRUE;
+  while (TRUE) {
+    GHashTableIter iter;
+    gpointer value;
+    _element *last = NULL;
+    g_hash_table_iter_init(&iter, h->entries);
+    while (g_hash_table_iter_next(&iter, NULL, &value)) {
+      _element *e = (_element *)value;
+      if (last == NULL || __element_cmp(e, last) > 0) {
+        last = e;
+      }
     }
-    start++;
-    // remove trailing \n
-    buffer[l - 1] = '\0';
-    if (real_length < (*length + 2)) {
-      real_length += 15;
-      // Resize and check.
-      retv = g_realloc(retv, (real_length) * sizeof(char *));
+    if (last == NULL) {
+      return;
     }
-    // Parse the number of times.
-    retv[(*length)] = g_strndup(start, l - 1 - (start - buffer));
-    // Force trailing '\0'
-    retv[(*length) + 1] = NULL;
-
-    (*length)++;
-  }
-  if (buffer_length > 0) {
-    g_free(buffer);
+    if (rebase) {
+      h->base = last->index;
+      rebase = FALSE;
+    }
+    if (g_hash_table_size(h->entries) <= config.max_history_size) {
+      return;
+    }
+    g_hash_table_remove(h->entries, last->name);
   }
-  return retv;
 }
 
-static _element **__history_get_element_list(FILE *fd, unsigned int *length) {
-  unsigned int real_length = 0;
-  _element **retv = NULL;
-
-  if (length == NULL) {
-    return NULL;
+static void __history_apply(_history *h, char op, const char *name) {
+  _element *e = g_hash_table_lookup(h->entries, name);
+  if (op == HISTORY_OP_SET) {
+    if (e != NULL) {
+      e->index++;
+      e->seq = ++(h->seq);
+    } else {
+      __history_insert(h, name, h->base + 1);
+    }
+  } else if (op == HISTORY_OP_REMOVE && e != NULL) {
+    g_hash_table_remove(h->entries, name);
+  } else {
+    return;
   }
-  *length = 0;
+  __history_update(h);
+}
 
-  if (fd == NULL) {
-    return NULL;
-  }
+/**
+ * Reads the history file, in the format: `<index> <entry>` per line.
+ */
+static void __history_read_list(_history *h, FILE *fd) {
   char *buffer = NULL;
   size_t buffer_length = 0;
   ssize_t l = 0;
@@ -151,29 +195,151 @@ static _element **__history_get_element_list(FILE *fd, unsigned int *length) {
     if ((l - (start - buffer)) < 2) {
       continue;
     }
-    if (real_length < (*length + 2)) {
-      real_length += 15;
-      // Resize and check.
-      retv = g_realloc(retv, (real_length) * sizeof(_element *));
+    // remove trailing \n
+    if (buffer[l - 1] == '\n') {
+      buffer[l - 1] = '\0';
     }
+    // Keep the first, like the lookup did.
+    if (g_hash_table_contains(h->entries, start)) {
+      continue;
+    }
+    __history_insert(h, start, index);
+  }
+  free(buffer);
+}
 
-    retv[(*length)] = g_malloc(sizeof(_element));
-
-    // remove trailing \n
+/**
+ * Replays the journal, in the format: `<op> <entry>` per line.
+ */
+static void __history_read_journal(_history *h, FILE *fd) {
+  char *buffer = NULL;
+  size_t buffer_length = 0;
+  ssize_t l = 0;
+  while ((l = getline(&buffer, &buffer_length, fd)) > 0) {
+    // Skip malformed and partially written records.
+    if (l < 4 || buffer[1] != ' ' || buffer[l - 1] != '\n') {
+      continue;
+    }
     buffer[l - 1] = '\0';
-    // Parse the number of times.
-    retv[(*length)]->index = index;
-    retv[(*length)]->name = g_strndup(start, l - 1 - (start - buffer));
-    // Force trailing '\0'
-    retv[(*length) + 1] = NULL;
+    __history_apply(h, buffer[0], buffer + 2);
+  }
+  free(buffer);
+}
 
-    (*length)++;
+static FILE *__history_open(const char *filename) {
+  FILE *fd = g_fopen(filename, "r");
+  // File that does not exists is not an error, so ignore it.
+  // Everything else? panic.
+  if (fd == NULL && errno != ENOENT) {
+    g_warning("Failed to open file: %s", g_strerror(errno));
   }
-  if (buffer != NULL) {
-    free(buffer);
-    buffer = NULL;
+  return fd;
+}
+
+static void __history_close(FILE *fd) {
+  // Close file, if fails let user know on stderr.
+  if (fclose(fd) != 0) {
+    g_warning("Failed to close history file: %s", g_strerror(errno));
   }
-  return retv;
+}
+
+static void __history_load(_history *h, const char *filename,
+                           const char *journal) {
+  FILE *fd = __history_open(filename);
+  if (fd != NULL) {
+    __history_read_list(h, fd);
+    __history_close(fd);
+  }
+  fd = __history_open(journal);
+  if (fd != NULL) {
+    __history_read_journal(h, fd);
+    __history_close(fd);
+  }
+}
+
+static _element **__history_get_element_list(_history *h,
+                                             unsigned int *length) {
+  *length = g_hash_table_size(h->entries);
+  if (*length == 0) {
+    return NULL;
+  }
+  _element **list = g_malloc_n(*length, sizeof(_element *));
+  GHashTableIter iter;
+  gpointer value;
+  unsigned int i = 0;
+  g_hash_table_iter_init(&iter, h->entries);
+  while (g_hash_table_iter_next(&iter, NULL, &value)) {
+    list[i++] = (_element *)value;
+  }
+  g_qsort_with_data(list, *length, sizeof(_element *), __element_sort_func,
+                    NULL);
+  return list;
+}
+
+/**
+ * Folds the journal into the history file. The journal is moved aside first,
+ * so records appended in the meantime end up in a new journal.
+ */
+static void __history_compact(const char *filename, const char *journal) {
+  char *aside = g_strdup_printf("%s.%d", journal, (int)getpid());
+  if (g_rename(journal, aside) != 0) {
+    // Other instance got to it first.
+    g_free(aside);
+    return;
+  }
+  _history h;
+  __history_init(&h);
+  __history_load(&h, filename, aside);
+
+  unsigned int length = 0;
+  _element **list = __history_get_element_list(&h, &length);
+  GString *data = g_string_new(NULL);
+  for (unsigned int iter = 0; iter < length; iter++) {
+    g_string_append_printf(data, "%ld %s\n", list[iter]->index - h.base,
+                           list[iter]->name);
+  }
+  GError *error = NULL;
+  if (g_file_set_contents(filename, data->str, data->len, &error)) {
+    g_unlink(aside);
+  } else {
+    g_warning("Failed to write history file: %s", error->message);
+    g_error_free(error);
+    g_rename(aside, journal);
+  }
+  g_string_free(data, TRUE);
+  g_free(list);
+  __history_clear(&h);
+  g_free(aside);
+}
+
+static void __history_append(const char *filename, char op, const char *entry) {
+  char *journal = g_strconcat(filename, HISTORY_JOURNAL_SUFFIX, NULL);
+  int fd = g_open(journal, O_WRONLY | O_APPEND | O_CREAT | O_CLOEXEC, 0666);
+  if (fd < 0) {
+    g_warning("Failed to open file: %s", g_strerror(errno));
+    g_free(journal);
+    return;
+  }
+  // One write, so concurrent instances do not interleave records.
+  char *record = g_strdup_printf("%c %s\n", op, entry);
+  size_t length = strlen(record);
+  gboolean compact = FALSE;
+  ssize_t l = write(fd, record, length);
+  if (l != (ssize_t)length) {
+    g_warning("Failed to write history file: %s",
+              l < 0 ? g_strerror(errno) : "short write");
+  } else {
+    struct stat st;
+    compact = fstat(fd, &st) == 0 && st.st_size > HISTORY_JOURNAL_MAX_SIZE;
+  }
+  if (close(fd) != 0) {
+    g_warning("Failed to close history file: %s", g_strerror(errno));
+  }
+  if (compact) {
+    __history_compact(filename, journal);
+  }
+  g_free(record);
+  g_free(journal);
 }
 
 void history_set(const char *filename, const char *entry) {
@@ -197,128 +363,14 @@ void history_set(const char *filename, const char *entry) {
     }
   }
 
-  int found = 0;
-  unsigned int curr = 0;
-  unsigned int length = 0;
-  _element **list = NULL;
-  // Open file for reading and writing.
-  FILE *fd = g_fopen(filename, "r");
-  if (fd != NULL) {
-    // Get list.
-    list = __history_get_element_list(fd, &length);
-    // Close file, if fails let user know on stderr.
-    if (fclose(fd) != 0) {
-      g_warning("Failed to close history file: %s", g_strerror(errno));
-    }
-  }
-  // Look if the entry exists.
-  for (unsigned int iter = 0; !found && iter < length; iter++) {
-    if (strcmp(list[iter]->name, entry) == 0) {
-      curr = iter;
-      found = 1;
-    }
-  }
-
-  if (found) {
-    // If exists, increment list index number
-    list[curr]->index++;
-  } else {
-    // If not exists, add it.
-    // Increase list by one
-    list = g_realloc(list, (length + 2) * sizeof(_element *));
-    list[length] = g_malloc(sizeof(_element));
-    // Copy name
-    if (list[length] != NULL) {
-      list[length]->name = g_strdup(entry);
-      // set # hits
-      list[length]->index = 1;
-
-      length++;
-      list[length] = NULL;
-    }
-  }
-
-  fd = fopen(filename, "w");
-  if (fd == NULL) {
-    g_warning("Failed to open file: %s", g_strerror(errno));
-  } else {
-    // Write list.
-    __history_write_element_list(fd, list, length);
-    // Close file, if fails let user know on stderr.
-    if (fclose(fd) != 0) {
-      g_warning("Failed to close history file: %s", g_strerror(errno));
-    }
-  }
-  // Free the list.
-  for (unsigned int iter = 0; iter < length; iter++) {
-    g_free(list[iter]->name);
-    g_free(list[iter]);
-  }
-  g_free(list);
+  __history_append(filename, HISTORY_OP_SET, entry);
 }
 
 void history_remove(const char *filename, const char *entry) {
   if (config.disable_history) {
     return;
   }
-  _element **list = NULL;
-  int found = 0;
-  unsigned int curr = 0;
-  unsigned int length = 0;
-  // Open file for reading and writing.
-  FILE *fd = g_fopen(filename, "r");
-  if (fd == NULL) {
-    g_warning("Failed to open file: %s", g_strerror(errno));
-    return;
-  }
-  // Get list.
-  list = __history_get_element_list(fd, &length);
-
-  // Close file, if fails let user know on stderr.
-  if (fclose(fd) != 0) {
-    g_warning("Failed to close history file: %s", g_strerror(errno));
-  }
-  // Find entry.
-  for (unsigned int iter = 0; !found && iter < length; iter++) {
-    if (strcmp(list[iter]->name, entry) == 0) {
-      curr = iter;
-      found = 1;
-    }
-  }
-
-  // If found, remove it and write out new file.
-  if (found) {
-    // Remove the entry.
-    g_free(list[curr]->name);
-    g_free(list[curr]);
-    // Swap last to here (if list is size 1, we just swap empty sets).
-    list[curr] = list[length - 1];
-    // Empty last.
-    list[length - 1] = NULL;
-    length--;
-
-    fd = g_fopen(filename, "w");
-    // Clear list.
-    if (fd != NULL) {
-      // Write list.
-      __history_write_element_list(fd, list, length);
-      // Close file, if fails let user know on stderr.
-      if (fclose(fd) != 0) {
-        g_warning("Failed to close history file: %s", g_strerror(errno));
-      }
-    } else {
-      g_warning("Failed to open file: %s", g_strerror(errno));
-    }
-  }
-
-  // Free the list.
-  for (unsigned int iter = 0; iter < length; iter++) {
-    g_free(list[iter]->name);
-    g_free(list[iter]);
-  }
-  if (list != NULL) {
-    g_free(list);
-  }
+  __history_append(filename, HISTORY_OP_REMOVE, entry);
 }
 
 char **history_get_list(const char *filename, unsigned int *length) {
@@ -327,23 +379,24 @@ char **history_get_list(const char *filename, unsigned int *length) {
   if (config.disable_history) {
     return NULL;
   }
+  char *journal = g_strconcat(filename, HISTORY_JOURNAL_SUFFIX, NULL);
+  _history h;
+  __history_init(&h);
+  __history_load(&h, filename, journal);
+  g_free(journal);
+
+  _element **list = __history_get_element_list(&h, length);
   char **retv = NULL;
-  // Open file.
-  FILE *fd = g_fopen(filename, "r");
-  if (fd == NULL) {
-    // File that does not exists is not an error, so ignore it.
-    // Everything else? panic.
-    if (errno != ENOENT) {
-      g_warning("Failed to open file: %s", g_strerror(errno));
+  if (list != NULL) {
+    retv = g_malloc_n(*length + 1, sizeof(char *));
+    for (unsigned int iter = 0; iter < *length; iter++) {
+      // Take over the name, the element is freed with the list.
+      retv[iter] = list[iter]->name;
+      list[iter]->name = NULL;
     }
-    return NULL;
-  }
-  // Get list.
-  retv = __history_get_element_list_fields(fd, length);
-
-  // Close file, if fails let user know on stderr.
-  if (fclose(fd) != 0) {
-    g_warning("Failed to close history file: %s", g_strerror(errno));
+    retv[*length] = NULL;
+    g_free(list);
   }
+  __history_clear(&h);
   return retv;
 }
@@ -43,11 +43,13 @@
 #include <gio/gio.h>
 #include <gio/gunixinputstream.h>
 #include <glib-unix.h>
+#include <poll.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <strings.h>
+#include <sys/mman.h>
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <unistd.h>
@@ -91,6 +93,8 @@ typedef struct {
   unsigned int do_markup;
   // List with entries.
   DmenuScriptEntry *cmd_list;
+  /** Strings of the entries, filled by the reading thread. */
+  rofi_string_arena *arena;
   unsigned int cmd_list_real_length;
   unsigned int cmd_list_length;
   unsigned int only_selected;
@@ -109,11 +113,18 @@ typedef struct {
   int pipefd2[2];
   guint wake_source;
   gboolean loading;
+  /** Regular input file mapped read-only, entries can point into it. */
+  char *map;
+  gsize map_size;
+  /** Offset of the first line in the mapping. */
+  gsize map_offset;
 
   char *ballot_selected;
   char *ballot_unselected;
 } DmenuModePrivateData;
 
+/** Number of bytes read from the input in one go. */
+#define DMENU_READ_SIZE 65536
 /** Maximum number of lines rofi parses async before it pushes it to the main
  * thread. */
 #define BLOCK_LINES_SIZE 2048
@@ -147,9 +158,9 @@ static void read_add_block(DmenuModePrivateData *pd, Block **block, char *data,
   if (end != data + len) {
     data_len = end - data;
     dmenuscript_parse_entry_extras(NULL, &((*block)->values[(*block)->length]),
-                                   end + 1, len - data_len);
+                                   end + 1, len - data_len, pd->arena);
   }
-  char *utfstr = rofi_force_utf8(data, data_len);
+  char *utfstr = rofi_string_arena_add_utf8(pd->arena, data, data_len);
   (*block)->values[(*block)->length].entry = utfstr;
   (*block)->values[(*block)->length + 1].entry = NULL;
 
@@ -180,9 +191,9 @@ static void read_add(DmenuModePrivateData *pd, char *data, gsize len) {
   if (end != data + len) {
     data_len = end - data;
     dmenuscript_parse_entry_extras(NULL, &(pd->cmd_list[pd->cmd_list_length]),
-                                   end + 1, len - data_len);
+                                   end + 1, len - data_len, pd->arena);
   }
-  char *utfstr = rofi_force_utf8(data, data_len);
+  char *utfstr = rofi_string_arena_add_utf8(pd->arena, data, data_len);
   pd->cmd_list[pd->cmd_list_length].entry = utfstr;
   pd->cmd_list[pd->cmd_list_length + 1].entry = NULL;
 
@@ -214,7 +225,10 @@ static gboolean dmenu_async_read_proc(gint fd, GIOCondition condition,
       // Empty out the AsyncQueue (that is thread safe) from all blocks pushed
       // into it.
       while ((block = g_async_queue_try_pop(pd->async_queue)) != NULL) {
-
+        if (!changed) {
+          // The filter reads cmd_list, stop it before it moves.
+          rofi_view_cancel_filter();
+        }
         if (pd->cmd_list_real_length < (pd->cmd_list_length + block->length)) {
           pd->cmd_list_real_length = MAX(pd->cmd_list_real_length * 2, 4096);
           pd->cmd_list = g_realloc(pd->cmd_list, sizeof(DmenuScriptEntry) *
@@ -285,35 +299,38 @@ static gpointer read_input_thread(gpointer userdata) {
       //  Input data is available.
       if (FD_ISSET(fd, &rfds)) {
         ssize_t readbytes = 0;
-        if ((nread + 1024) > len) {
-          line = g_realloc(line, (len + 2048));
-          len = len + 2048;
+        if ((nread + DMENU_READ_SIZE + 1) > len) {
+          len = nread + DMENU_READ_SIZE + 1;
+          line = g_realloc(line, len);
         }
-        readbytes = read(fd, &line[nread], 1023);
+        readbytes = read(fd, &line[nread], DMENU_READ_SIZE);
         if (readbytes > 0) {
+          // The data left from the previous read holds no separator, only
+          // scan what is new.
+          ssize_t i = nread;
+          ssize_t start = 0;
+          char *sep = NULL;
           nread += readbytes;
-          line[nread] = '\0';
-          ssize_t i = 0;
-          while (i < nread) {
-            if (line[i] == pd->separator) {
-              line[i] = '\0';
-              read_add_block(pd, &block, line, i);
-              memmove(&line[0], &line[i + 1], nread - (i + 1));
-              nread -= (i + 1);
-              i = 0;
-              if (block) {
-                double elapsed = g_timer_elapsed(tim, NULL);
-                if (elapsed >= 0.1 || block->length == BLOCK_LINES_SIZE) {
-                  g_timer_start(tim);
-                  g_async_queue_push(pd->async_queue, block);
-                  block = NULL;
-                  write(pd->pipefd2[1], "r", 1);
-                }
+          while ((sep = memchr(&line[i], pd->separator, nread - i)) != NULL) {
+            i = sep - line;
+            line[i] = '\0';
+            read_add_block(pd, &block, &line[start], i - start);
+            start = ++i;
+            if (block) {
+              double elapsed = g_timer_elapsed(tim, NULL);
+              if (elapsed >= 0.1 || block->length == BLOCK_LINES_SIZE) {
+                g_timer_start(tim);
+                g_async_queue_push(pd->async_queue, block);
+                block = NULL;
+                write(pd->pipefd2[1], "r", 1);
               }
-            } else {
-              i++;
             }
           }
+          // Move the incomplete last line to the front, once per read.
+          if (start > 0) {
+            memmove(&line[0], &line[start], nread - start);
+            nread -= start;
+          }
         } else {
           // remainder in buffer, then quit.
           if (nread > 0) {
@@ -350,6 +367,300 @@ static gpointer read_input_thread(gpointer userdata) {
   return NULL;
 }
 
+/** Minimal number of bytes of a mapped input file indexed by one worker. */
+#define DMENU_MAP_CHUNK_SIZE (1024 * 1024)
+
+/**
+ * A line of a mapped input file.
+ */
+typedef struct {
+  /** Offset of the line in the mapping. */
+  gsize offset;
+  /** Length of the line, without the separator. */
+  gsize length;
+} DmenuMapRow;
+
+/**
+ * Part of a mapped input file, handled by one worker thread.
+ * The workers first index the lines that start in their part, then fill in
+ * their slice of the entry list.
+ */
+typedef struct {
+  DmenuModePrivateData *pd;
+  /** Lines starting in [start, stop) belong to this part. */
+  const char *start;
+  const char *stop;
+  /** The #DmenuMapRow of the lines in this part. */
+  GArray *rows;
+  /** First entry to fill in. */
+  DmenuScriptEntry *entries;
+  /** Strings that could not be used in place. */
+  rofi_string_arena *arena;
+} DmenuMapChunk;
+
+/**
+ * @param pd The dmenu mode private data.
+ * @param entry The (zeroed) entry to fill in.
+ * @param row The line in the mapping.
+ * @param arena The arena to copy strings into.
+ *
+ * The mapping is read-only. A line followed by a NUL in the mapping, as
+ * with extras or a NUL separator, is used in place if it is valid UTF-8.
+ * Other lines are copied into the arena, terminated.
+ */
+static void dmenu_map_entry(const DmenuModePrivateData *pd,
+                            DmenuScriptEntry *entry, const DmenuMapRow *row,
+                            rofi_string_arena *arena) {
+  const char *data = pd->map + row->offset;
+  gsize len = row->length;
+  gsize data_len = len;
+  gboolean terminated = FALSE;
+  const char *end = memchr(data, '\0', len);
+  if (end != NULL) {
+    data_len = end - data;
+    terminated = TRUE;
+    // The extras are split in place, so parse them from a copy.
+    gsize extras_len = len - data_len - 1;
+    char *extras = g_strndup(end + 1, extras_len);
+    dmenuscript_parse_entry_extras(NULL, entry, extras, extras_len, arena);
+    g_free(extras);
+  } else {
+    terminated = (row->offset + len) < pd->map_size && data[len] == '\0';
+  }
+  if (terminated && g_utf8_validate(data, data_len, NULL)) {
+    entry->entry = (char *)data;
+  } else {
+    entry->entry = rofi_string_arena_add_utf8(arena, data, data_len);
+  }
+}
+
+static void dmenu_map_index(gpointer data, G_GNUC_UNUSED gpointer user_data) {
+  DmenuMapChunk *c = (DmenuMapChunk *)data;
+  const char sep = c->pd->separator;
+  const char *iter = c->start;
+  const char *s = NULL;
+  c->rows = g_array_new(FALSE, FALSE, sizeof(DmenuMapRow));
+  while ((s = memchr(iter, sep, c->stop - iter)) != NULL) {
+    DmenuMapRow row = {.offset = iter - c->pd->map, .length = s - iter};
+    g_array_append_val(c->rows, row);
+    iter = s + 1;
+  }
+  // Unterminated last line.
+  if (iter < c->stop) {
+    DmenuMapRow row = {.offset = iter - c->pd->map,
+                       .length = c->stop - iter};
+    g_array_append_val(c->rows, row);
+  }
+}
+
+static void dmenu_map_fill(gpointer data, G_GNUC_UNUSED gpointer user_data) {
+  DmenuMapChunk *c = (DmenuMapChunk *)data;
+  c->arena = rofi_string_arena_new();
+  for (guint i = 0; i < c->rows->len; i++) {
+    dmenu_map_entry(c->pd, &(c->entries[i]),
+                    &g_array_index(c->rows, DmenuMapRow, i), c->arena);
+  }
+}
+
+/**
+ * @param func The work to do on each part.
+ * @param chunks The parts.
+ * @param nchunks The number of parts.
+ *
+ * Run func on all parts in parallel and wait for them. It uses its own pool,
+ * as the shared worker pool drops its queued jobs when the page changes.
+ */
+static void dmenu_map_run(GFunc func, DmenuMapChunk *chunks,
+                          unsigned int nchunks) {
+  GThreadPool *pool = NULL;
+  if (nchunks > 1) {
+    pool = g_thread_pool_new(func, NULL, nchunks - 1, FALSE, NULL);
+  }
+  for (unsigned int i = 1; i < nchunks; i++) {
+    if (pool != NULL) {
+      g_thread_pool_push(pool, &(chunks[i]), NULL);
+    } else {
+      func(&(chunks[i]), NULL);
+    }
+  }
+  // Do the first part in this thread.
+  func(&(chunks[0]), NULL);
+  if (pool != NULL) {
+    g_thread_pool_free(pool, FALSE, TRUE);
+  }
+}
+
+/**
+ * @param pd The dmenu mode private data.
+ * @param fd The input file descriptor.
+ *
+ * If the input is a regular file, map it read-only into memory and consume
+ * it.
+ *
+ * @returns the offset of the first unread byte, -1 if not mapped.
+ */
+static off_t dmenu_map_input(DmenuModePrivateData *pd, int fd) {
+  struct stat st;
+  if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode)) {
+    return -1;
+  }
+  off_t offset = lseek(fd, 0, SEEK_CUR);
+  if (offset < 0 || st.st_size <= offset) {
+    return -1;
+  }
+  gsize size = st.st_size;
+  char *map = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+  if (map == MAP_FAILED) {
+    g_debug("Failed to map input: %s", g_strerror(errno));
+    return -1;
+  }
+  madvise(map, size, MADV_WILLNEED);
+  // Like reading it, consume the input.
+  lseek(fd, 0, SEEK_END);
+  pd->map = map;
+  pd->map_size = size;
+  return offset;
+}
+
+/**
+ * @param pd The dmenu mode private data.
+ * @param offset The offset of the first line in the mapping.
+ * @param nchunks Set to the number of parts.
+ *
+ * Split the mapping in parts and index the lines of each in parallel.
+ *
+ * @returns the parts, free with dmenu_map_chunks_free.
+ */
+static DmenuMapChunk *dmenu_map_index_chunks(DmenuModePrivateData *pd,
+                                             off_t offset,
+                                             unsigned int *nchunks) {
+  const char *start = pd->map + offset;
+  const char *end = pd->map + pd->map_size;
+  unsigned int n = MAX(
+      1, MIN(config.threads, (gsize)(end - start) / DMENU_MAP_CHUNK_SIZE));
+  DmenuMapChunk *chunks = g_malloc0_n(n, sizeof(DmenuMapChunk));
+  gsize step = (end - start) / n;
+  for (unsigned int i = 0; i < n; i++) {
+    chunks[i].pd = pd;
+    chunks[i].start = (i == 0) ? start : chunks[i - 1].stop;
+    chunks[i].stop = end;
+    if (i + 1 < n) {
+      // Split right after a separator, so no line is cut in two.
+      const char *from = MAX(start + (i + 1) * step - 1, chunks[i].start);
+      const char *s = memchr(from, pd->separator, end - from);
+      if (s != NULL) {
+        chunks[i].stop = s + 1;
+      }
+    }
+  }
+  dmenu_map_run(dmenu_map_index, chunks, n);
+  *nchunks = n;
+  return chunks;
+}
+
+static void dmenu_map_chunks_free(DmenuMapChunk *chunks,
+                                  unsigned int nchunks) {
+  for (unsigned int i = 0; i < nchunks; i++) {
+    g_array_free(chunks[i].rows, TRUE);
+  }
+  g_free(chunks);
+}
+
+/**
+ * @param pd The dmenu mode private data.
+ * @param fd The input file descriptor.
+ *
+ * If the input is a regular file, map it into memory and index and fill in
+ * the lines in parallel.
+ *
+ * @returns TRUE if the input was read.
+ */
+static gboolean dmenu_read_input_mapped(DmenuModePrivateData *pd, int fd) {
+  off_t offset = dmenu_map_input(pd, fd);
+  if (offset < 0) {
+    return FALSE;
+  }
+  unsigned int nchunks = 0;
+  DmenuMapChunk *chunks = dmenu_map_index_chunks(pd, offset, &nchunks);
+  unsigned int total = 0;
+  for (unsigned int i = 0; i < nchunks; i++) {
+    total += chunks[i].rows->len;
+  }
+  pd->cmd_list = g_malloc0_n(total + 1, sizeof(DmenuScriptEntry));
+  pd->cmd_list_real_length = total + 1;
+  pd->cmd_list_length = total;
+  for (unsigned int i = 0, index = 0; i < nchunks; i++) {
+    chunks[i].entries = &(pd->cmd_list[index]);
+    index += chunks[i].rows->len;
+  }
+  dmenu_map_run(dmenu_map_fill, chunks, nchunks);
+  for (unsigned int i = 0; i < nchunks; i++) {
+    rofi_string_arena_merge(pd->arena, chunks[i].arena);
+  }
+  dmenu_map_chunks_free(chunks, nchunks);
+  return TRUE;
+}
+
+/**
+ * @param pd The dmenu mode private data.
+ * @param block The block to hand to the main thread, set to NULL.
+ */
+static void dmenu_push_block(DmenuModePrivateData *pd, Block **block) {
+  if ((*block) == NULL) {
+    return;
+  }
+  g_async_queue_push(pd->async_queue, *block);
+  *block = NULL;
+  write(pd->pipefd2[1], "r", 1);
+}
+
+/**
+ * @param userdata The dmenu mode private data, the input is mapped.
+ *
+ * Index the mapped input and hand the lines to the main thread in blocks,
+ * so the view is shown while large files are indexed.
+ *
+ * @returns NULL
+ */
+static gpointer dmenu_map_thread(gpointer userdata) {
+  DmenuModePrivateData *pd = (DmenuModePrivateData *)userdata;
+  unsigned int nchunks = 0;
+  DmenuMapChunk *chunks =
+      dmenu_map_index_chunks(pd, (off_t)pd->map_offset, &nchunks);
+  Block *block = NULL;
+  GTimer *tim = g_timer_new();
+  gboolean stop = FALSE;
+  for (unsigned int i = 0; !stop && i < nchunks; i++) {
+    GArray *rows = chunks[i].rows;
+    for (guint j = 0; !stop && j < rows->len; j++) {
+      if (block == NULL) {
+        block = g_malloc0(sizeof(Block));
+        block->pd = pd;
+      }
+      dmenu_map_entry(pd, &(block->values[block->length]),
+                      &g_array_index(rows, DmenuMapRow, j), pd->arena);
+      block->length++;
+      if (block->length == BLOCK_LINES_SIZE ||
+          g_timer_elapsed(tim, NULL) >= 0.1) {
+        g_timer_start(tim);
+        dmenu_push_block(pd, &block);
+        // The main thread asks to stop when it is done.
+        struct pollfd pfd = {.fd = pd->pipefd[0], .events = POLLIN};
+        stop = poll(&pfd, 1, 0) > 0;
+      }
+    }
+  }
+  if (stop) {
+    g_free(block);
+  } else {
+    dmenu_push_block(pd, &block);
+  }
+  g_timer_destroy(tim);
+  dmenu_map_chunks_free(chunks, nchunks);
+  write(pd->pipefd2[1], "q", 1);
+  return NULL;
+}
+
 static unsigned int dmenu_mode_get_num_entries(const Mode *sw) {
   const DmenuModePrivateData *rmpd =
       (const DmenuModePrivateData *)mode_get_private_data(sw);
@@ -480,16 +791,12 @@ static void dmenu_mode_free(Mode *sw) {
   DmenuModePrivateData *pd = (DmenuModePrivateData *)mode_get_private_data(sw);
   if (pd != NULL) {
 
-    for (size_t i = 0; i < pd->cmd_list_length; i++) {
-      if (pd->cmd_list[i].entry) {
-        g_free(pd->cmd_list[i].entry);
-        g_free(pd->cmd_list[i].icon_name);
-        g_free(pd->cmd_list[i].display);
-        g_free(pd->cmd_list[i].meta);
-        g_free(pd->cmd_list[i].info);
-      }
-    }
+    // All strings live in the arena or the mapped input file.
     g_free(pd->cmd_list);
+    rofi_string_arena_free(pd->arena);
+    if (pd->map != NULL) {
+      munmap(pd->map, pd->map_size);
+    }
     g_free(pd->urgent_list);
     g_free(pd->active_list);
     g_free(pd->selected_list);
@@ -527,6 +834,7 @@ static int dmenu_mode_init(Mode *sw) {
 
   pd->async = TRUE;
   pd->multi_select = FALSE;
+  pd->arena = rofi_string_arena_new();
 
   // For now these only work in sync mode.
   if (find_arg("-sync") >= 0 || find_arg("-dump") >= 0 ||
@@ -619,6 +927,11 @@ static int dmenu_mode_init(Mode *sw) {
       g_free(estr);
     }
 
+    off_t offset = dmenu_map_input(pd, pd->fd);
+    if (offset >= 0 && pd->fd != STDIN_FILENO) {
+      // The mapping stays valid.
+      close(pd->fd);
+    }
     if (pipe(pd->pipefd) == -1) {
       g_error("Failed to create pipe");
     }
@@ -629,8 +942,14 @@ static int dmenu_mode_init(Mode *sw) {
         g_unix_fd_add(pd->pipefd2[0], G_IO_IN, dmenu_async_read_proc, pd);
     // Create the message passing queue to the UI thread.
     pd->async_queue = g_async_queue_new();
-    pd->reading_thread =
-        g_thread_new("dmenu-read", (GThreadFunc)read_input_thread, pd);
+    if (offset >= 0) {
+      // Regular files are indexed in the background, in parallel.
+      pd->map_offset = offset;
+      pd->reading_thread = g_thread_new("dmenu-map", dmenu_map_thread, pd);
+    } else {
+      pd->reading_thread =
+          g_thread_new("dmenu-read", (GThreadFunc)read_input_thread, pd);
+    }
     pd->loading = TRUE;
   } else {
     pd->fd_file = stdin;
@@ -650,7 +969,9 @@ static int dmenu_mode_init(Mode *sw) {
       g_free(estr);
     }
 
-    read_input_sync(pd, -1);
+    if (!dmenu_read_input_mapped(pd, fileno(pd->fd_file))) {
+      read_input_sync(pd, -1);
+    }
   }
   gchar *columns = NULL;
   if (find_arg_str("-display-columns", &columns)) {
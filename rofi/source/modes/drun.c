@@ -37,10 +37,12 @@
 
 #include <dirent.h>
 #include <errno.h>
+#include <fcntl.h>
 #include <limits.h>
 #include <signal.h>
 #include <string.h>
 #include <strings.h>
+#include <sys/mman.h>
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <unistd.h>
@@ -55,11 +57,16 @@
 #include "rofi.h"
 #include "settings.h"
 #include "timings.h"
+#include "view.h"
 #include "widgets/textbox.h"
 #include "xcb.h"
 
 #include "rofi-icon-fetcher.h"
 
+#if defined(__APPLE__)
+#define st_mtim st_mtimespec
+#endif
+
 /** The filename of the history cache file. */
 #define DRUN_CACHE_FILE "rofi3.druncache"
 
@@ -129,6 +136,8 @@ typedef struct {
   char *comment;
   /* Url */
   char *url;
+  /* The fields enabled for matching, one per line. */
+  char *match_string;
   /* Underlying key-file. */
   GKeyFile *key_file;
   /* Used for sorting. */
@@ -138,6 +147,8 @@ typedef struct {
   uint32_t icon_fetch_size;
   /* Type of desktop file */
   DRunDesktopEntryType type;
+  /* Strings are owned by the mapped cache file. */
+  gboolean from_cache;
 } DRunModeEntry;
 
 typedef struct {
@@ -205,6 +216,24 @@ static DRunEntryField matching_entry_fields[DRUN_MATCH_NUM_FIELDS] = {
         .enabled_display = FALSE,
     }};
 
+/**
+ * A directory scanned for desktop files.
+ */
+typedef struct {
+  char *path;
+  gboolean exists;
+  gint64 mtime_sec;
+  gint64 mtime_nsec;
+} DRunScannedDir;
+
+/**
+ * A directory tree desktop files are loaded from.
+ */
+typedef struct {
+  char *dir;
+  gboolean recursive;
+} DRunScanRoot;
+
 struct _DRunModePrivateData {
   DRunModeEntry *entry_list;
   unsigned int cmd_list_length;
@@ -229,6 +258,21 @@ struct _DRunModePrivateData {
   char *old_input;
 
   gboolean disable_dbusactivate;
+
+  // Directories scanned, to validate the cache against.
+  GArray *scanned_dirs;
+  // The mapped cache file, entries loaded from it point into this.
+  char *cache_map;
+  gsize cache_map_size;
+  // String lists of the entries loaded from the cache.
+  char **cache_strv;
+
+  // Directory monitors by path, NULL when not watching for changes.
+  GHashTable *monitors;
+  // Loaded desktop files by path, while watching for changes.
+  GHashTable *key_files;
+  // Pending reload after a desktop file changed.
+  guint reload_timeout;
 };
 
 struct RegexEvalArg {
@@ -533,10 +577,13 @@ static gboolean rofi_strv_contains(const char *const *categories,
 }
 /**
  * This function absorbs/freeś path, so this is no longer available afterwards.
+ *
+ * key_file is the already loaded desktop file, or NULL to load it from path.
+ * Entries keep a reference to it.
  */
 static void read_desktop_file(DRunModePrivateData *pd, const char *root,
                               const char *path, const gchar *basename,
-                              const char *action) {
+                              const char *action, GKeyFile *key_file) {
   DRunDesktopEntryType desktop_entry_type =
       DRUN_DESKTOP_ENTRY_TYPE_UNDETERMINED;
   int parse_action = (config.drun_show_actions && action != DRUN_GROUP_NAME);
@@ -556,22 +603,27 @@ static void read_desktop_file(DRunModePrivateData *pd, const char *root,
     g_debug("[%s] [%s] Skipping, was previously seen.", id, path);
     return;
   }
-  GKeyFile *kf = g_key_file_new();
-  GError *error = NULL;
-  gboolean res = g_key_file_load_from_file(kf, path, 0, &error);
-  // If error, skip to next entry
-  if (!res) {
-    g_debug("[%s] [%s] Failed to parse desktop file because: %s.", id, path,
-            error->message);
-    g_error_free(error);
-    g_key_file_free(kf);
-    return;
+  GKeyFile *kf = NULL;
+  if (key_file != NULL) {
+    kf = g_key_file_ref(key_file);
+  } else {
+    kf = g_key_file_new();
+    GError *error = NULL;
+    gboolean res = g_key_file_load_from_file(kf, path, 0, &error);
+    // If error, skip to next entry
+    if (!res) {
+      g_debug("[%s] [%s] Failed to parse desktop file because: %s.", id, path,
+              error->message);
+      g_error_free(error);
+      g_key_file_unref(kf);
+      return;
+    }
   }
 
   if (g_key_file_has_group(kf, action) == FALSE) {
     // No type? ignore.
     g_debug("[%s] [%s] Invalid desktop file: No %s group", id, path, action);
-    g_key_file_free(kf);
+    g_key_file_unref(kf);
     return;
   }
   // Skip non Application entries.
@@ -579,7 +631,7 @@ static void read_desktop_file(DRunModePrivateData *pd, const char *root,
   if (key == NULL) {
     // No type? ignore.
     g_debug("[%s] [%s] Invalid desktop file: No type indicated", id, path);
-    g_key_file_free(kf);
+    g_key_file_unref(kf);
     return;
   }
   if (!g_strcmp0(key, "Application")) {
@@ -594,7 +646,7 @@ static void read_desktop_file(DRunModePrivateData *pd, const char *root,
         "[%s] [%s] Skipping desktop file: Not of type Application or Link (%s)",
         id, path, key);
     g_free(key);
-    g_key_file_free(kf);
+    g_key_file_unref(kf);
     return;
   }
   g_free(key);
@@ -602,7 +654,7 @@ static void read_desktop_file(DRunModePrivateData *pd, const char *root,
   // Name key is required.
   if (!g_key_file_has_key(kf, DRUN_GROUP_NAME, "Name", NULL)) {
     g_debug("[%s] [%s] Invalid desktop file: no 'Name' key present.", id, path);
-    g_key_file_free(kf);
+    g_key_file_unref(kf);
     return;
   }
 
@@ -611,7 +663,7 @@ static void read_desktop_file(DRunModePrivateData *pd, const char *root,
     g_debug(
         "[%s] [%s] Adding desktop file to disabled list: 'Hidden' key is true",
         id, path);
-    g_key_file_free(kf);
+    g_key_file_unref(kf);
     g_hash_table_add(pd->disabled_entries, g_strdup(id));
     return;
   }
@@ -650,7 +702,7 @@ static void read_desktop_file(DRunModePrivateData *pd, const char *root,
       g_debug("[%s] [%s] Adding desktop file to disabled list: "
               "'OnlyShowIn'/'NotShowIn' keys don't match current desktop",
               id, path);
-      g_key_file_free(kf);
+      g_key_file_unref(kf);
       g_hash_table_add(pd->disabled_entries, g_strdup(id));
       return;
     }
@@ -660,7 +712,7 @@ static void read_desktop_file(DRunModePrivateData *pd, const char *root,
     g_debug("[%s] [%s] Adding desktop file to disabled list: 'NoDisplay' key "
             "is true",
             id, path);
-    g_key_file_free(kf);
+    g_key_file_unref(kf);
     g_hash_table_add(pd->disabled_entries, g_strdup(id));
     return;
   }
@@ -671,7 +723,7 @@ static void read_desktop_file(DRunModePrivateData *pd, const char *root,
     g_debug("[%s] [%s] Unsupported desktop file: no 'Exec' key present for "
             "type Application.",
             id, path);
-    g_key_file_free(kf);
+    g_key_file_unref(kf);
     return;
   }
   if (desktop_entry_type == DRUN_DESKTOP_ENTRY_TYPE_SERVICE &&
@@ -679,7 +731,7 @@ static void read_desktop_file(DRunModePrivateData *pd, const char *root,
     g_debug("[%s] [%s] Unsupported desktop file: no 'Exec' key present for "
             "type Service.",
             id, path);
-    g_key_file_free(kf);
+    g_key_file_unref(kf);
     return;
   }
   if (desktop_entry_type == DRUN_DESKTOP_ENTRY_TYPE_LINK &&
@@ -687,7 +739,7 @@ static void read_desktop_file(DRunModePrivateData *pd, const char *root,
     g_debug("[%s] [%s] Unsupported desktop file: no 'URL' key present for type "
             "Link.",
             id, path);
-    g_key_file_free(kf);
+    g_key_file_unref(kf);
     return;
   }
 
@@ -697,14 +749,14 @@ static void read_desktop_file(DRunModePrivateData *pd, const char *root,
       char *fp = g_find_program_in_path(te);
       if (fp == NULL) {
         g_free(te);
-        g_key_file_free(kf);
+        g_key_file_unref(kf);
         return;
       }
       g_free(fp);
     } else {
       if (g_file_test(te, G_FILE_TEST_IS_EXECUTABLE) == FALSE) {
         g_free(te);
-        g_key_file_free(kf);
+        g_key_file_unref(kf);
         return;
       }
     }
@@ -718,7 +770,7 @@ static void read_desktop_file(DRunModePrivateData *pd, const char *root,
     if (!rofi_strv_contains((const char *const *)categories,
                             (const char *const *)pd->show_categories)) {
       g_strfreev(categories);
-      g_key_file_free(kf);
+      g_key_file_unref(kf);
       return;
     }
   }
@@ -731,7 +783,7 @@ static void read_desktop_file(DRunModePrivateData *pd, const char *root,
     if (rofi_strv_contains((const char *const *)categories,
                             (const char *const *)pd->exclude_categories)) {
       g_strfreev(categories);
-      g_key_file_free(kf);
+      g_key_file_unref(kf);
       return;
     }
   }
@@ -753,6 +805,7 @@ static void read_desktop_file(DRunModePrivateData *pd, const char *root,
   pd->entry_list[pd->cmd_list_length].icon_size = 0;
   pd->entry_list[pd->cmd_list_length].icon_fetch_uid = 0;
   pd->entry_list[pd->cmd_list_length].icon_fetch_size = 0;
+  pd->entry_list[pd->cmd_list_length].match_string = NULL;
   pd->entry_list[pd->cmd_list_length].root = g_strdup(root);
   pd->entry_list[pd->cmd_list_length].path = g_strdup(path);
   pd->entry_list[pd->cmd_list_length].desktop_id = g_strdup(id);
@@ -836,7 +889,7 @@ static void read_desktop_file(DRunModePrivateData *pd, const char *root,
                                                 &actions_length, NULL);
     for (gsize iter = 0; iter < actions_length; iter++) {
       char *new_action = g_strdup_printf("Desktop Action %s", actions[iter]);
-      read_desktop_file(pd, root, path, basename, new_action);
+      read_desktop_file(pd, root, path, basename, new_action, kf);
       g_free(new_action);
     }
     g_strfreev(actions);
@@ -844,15 +897,93 @@ static void read_desktop_file(DRunModePrivateData *pd, const char *root,
   return;
 }
 
+/**
+ * A desktop file found while walking the directories.
+ */
+typedef struct {
+  /** The directory tree it was found in. */
+  const char *root;
+  char *path;
+  /** File name, points into path. */
+  const char *basename;
+  /** Desktop file id, derived from the path relative to root. */
+  char *id;
+  /** The loaded file, NULL if it should be loaded when it is read. */
+  GKeyFile *key_file;
+} DRunDesktopFile;
+
+/**
+ * Part of a desktop file scan, handled by one worker thread.
+ * A scan first walks each directory tree in its own job, then loads the
+ * desktop files with the jobs picking files off a shared counter.
+ */
+typedef struct {
+  /** Thread state, has to be first. */
+  thread_state st;
+  /** Protects acount. */
+  GMutex *mutex;
+  /** Signalled when acount drops to zero. */
+  GCond *cond;
+  /** Number of jobs still running. */
+  unsigned int *acount;
+
+  /** The directory tree to walk. */
+  const DRunScanRoot *root;
+  /** #DRunDesktopFile found, in walk order. */
+  GArray *files;
+  /** #DRunScannedDir visited, NULL if not needed. */
+  GArray *dirs;
+
+  /** Files to load. */
+  DRunDesktopFile **load;
+  /** Number of files in load. */
+  unsigned int load_length;
+  /** Index of the next file to load, shared between the jobs. */
+  gint *load_next;
+} DRunScanJob;
+
+/**
+ * @param dirs The list of scanned directories, or NULL.
+ * @param dirname The directory being scanned.
+ * @param dir The opened directory, or NULL if it could not be opened.
+ *
+ * Remember the modification time of a scanned directory, adding or removing
+ * desktop files changes it and invalidates the cache.
+ */
+static void drun_cache_add_dir(GArray *dirs, const char *dirname, DIR *dir) {
+  if (dirs == NULL) {
+    return;
+  }
+  DRunScannedDir sd = {.path = g_strdup(dirname), .exists = FALSE};
+  struct stat st;
+  if (dir != NULL && fstat(dirfd(dir), &st) == 0) {
+    sd.exists = TRUE;
+    sd.mtime_sec = st.st_mtim.tv_sec;
+    sd.mtime_nsec = st.st_mtim.tv_nsec;
+  }
+  g_array_append_val(dirs, sd);
+}
+
+static void drun_scanned_dir_clear(DRunScannedDir *sd) { g_free(sd->path); }
+
+static void drun_desktop_file_clear(DRunDesktopFile *df) {
+  g_free(df->path);
+  g_free(df->id);
+  if (df->key_file != NULL) {
+    g_key_file_unref(df->key_file);
+  }
+}
+
 /**
  * Internal spider used to get list of executables.
  */
-static void walk_dir(DRunModePrivateData *pd, const char *root,
-                     const char *dirname, const gboolean recursive) {
+static void walk_dir(DRunScanJob *job, const char *root, const char *dirname,
+                     const gboolean recursive) {
   DIR *dir;
 
   g_debug("Checking directory %s for desktop files.", dirname);
   dir = opendir(dirname);
+  drun_cache_add_dir(job->dirs, dirname, dir);
   if (dir == NULL) {
     return;
   }
@@ -892,12 +1023,21 @@ static void walk_dir(DRunModePrivateData *pd, const char *root,
     case DT_REG:
       // Skip files not ending on .desktop.
       if (g_str_has_suffix(file->d_name, ".desktop")) {
-        read_desktop_file(pd, root, filename, file->d_name, DRUN_GROUP_NAME);
+        DRunDesktopFile df = {
+            .root = root,
+            .path = filename,
+            .basename = filename + strlen(filename) - strlen(file->d_name),
+            .key_file = NULL};
+        // Same id as read_desktop_file builds.
+        df.id = g_strdup(&(filename[strlen(root) + 1]));
+        g_strdelimit(df.id, "/", '-');
+        g_array_append_val(job->files, df);
+        filename = NULL;
       }
       break;
     case DT_DIR:
       if (recursive) {
-        walk_dir(pd, root, filename, recursive);
+        walk_dir(job, root, filename, recursive);
       }
       break;
     default:
@@ -907,6 +1047,163 @@ static void walk_dir(DRunModePrivateData *pd, const char *root,
   }
   closedir(dir);
 }
+
+static void drun_scan_job_done(DRunScanJob *job) {
+  g_mutex_lock(job->mutex);
+  (*(job->acount))--;
+  g_cond_signal(job->cond);
+  g_mutex_unlock(job->mutex);
+}
+
+static void drun_scan_walk(thread_state *t, G_GNUC_UNUSED gpointer data) {
+  DRunScanJob *job = (DRunScanJob *)t;
+  walk_dir(job, job->root->dir, job->root->dir, job->root->recursive);
+  drun_scan_job_done(job);
+}
+
+static void drun_scan_load(thread_state *t, G_GNUC_UNUSED gpointer data) {
+  DRunScanJob *job = (DRunScanJob *)t;
+  gint index;
+  while ((index = g_atomic_int_add(job->load_next, 1)) <
+         (gint)job->load_length) {
+    DRunDesktopFile *df = job->load[index];
+    GKeyFile *kf = g_key_file_new();
+    // On failure read_desktop_file loads it again and reports why.
+    if (g_key_file_load_from_file(kf, df->path, 0, NULL)) {
+      df->key_file = kf;
+    } else {
+      g_key_file_unref(kf);
+    }
+  }
+  drun_scan_job_done(job);
+}
+
+/**
+ * @param jobs The jobs to run.
+ * @param njobs The number of jobs.
+ * @param callback The function running a job.
+ *
+ * Run the jobs on the worker pool, and wait for them to finish.
+ */
+static void drun_scan_run(DRunScanJob *jobs, unsigned int njobs,
+                          void (*callback)(thread_state *, gpointer)) {
+  GMutex mutex;
+  GCond cond;
+  unsigned int count = njobs;
+  g_mutex_init(&mutex);
+  g_cond_init(&cond);
+  for (unsigned int i = 0; i < njobs; i++) {
+    jobs[i].st.callback = callback;
+    jobs[i].st.free = NULL;
+    jobs[i].st.priority = G_PRIORITY_HIGH;
+    jobs[i].mutex = &mutex;
+    jobs[i].cond = &cond;
+    jobs[i].acount = &count;
+    if (i > 0 && tpool != NULL) {
+      g_thread_pool_push(tpool, &(jobs[i]), NULL);
+    }
+  }
+  // Do the first job in this thread, all of them if there are no workers.
+  for (unsigned int i = 0; i < (tpool != NULL ? 1 : njobs); i++) {
+    callback((thread_state *)&(jobs[i]), NULL);
+  }
+  g_mutex_lock(&mutex);
+  while (count > 0) {
+    g_cond_wait(&cond, &mutex);
+  }
+  g_mutex_unlock(&mutex);
+  g_cond_clear(&cond);
+  g_mutex_clear(&mutex);
+}
+
+/**
+ * @param pd The drun mode private data.
+ * @param roots The directory trees to scan, in order.
+ *
+ * Walk the directory trees and load the desktop files on the worker pool,
+ * then add the entries in the same order a serial walk would.
+ * Only the first file with a given id is loaded ahead, later ones are
+ * normally skipped as duplicate.
+ * When watching for changes, files loaded in a previous scan that did not
+ * change since are not loaded again.
+ */
+static void drun_scan(DRunModePrivateData *pd, GArray *roots) {
+  DRunScanJob *jobs = g_malloc0_n(MAX(1, roots->len), sizeof(DRunScanJob));
+  for (guint i = 0; i < roots->len; i++) {
+    jobs[i].root = &g_array_index(roots, DRunScanRoot, i);
+    jobs[i].files = g_array_new(FALSE, FALSE, sizeof(DRunDesktopFile));
+    g_array_set_clear_func(jobs[i].files,
+                           (GDestroyNotify)drun_desktop_file_clear);
+    if (pd->scanned_dirs != NULL) {
+      jobs[i].dirs = g_array_new(FALSE, FALSE, sizeof(DRunScannedDir));
+    }
+  }
+  if (roots->len > 0) {
+    drun_scan_run(jobs, roots->len, drun_scan_walk);
+  }
+  TICK_N("Get Desktop apps (walked dirs)");
+
+  GHashTable *seen = g_hash_table_new(g_str_hash, g_str_equal);
+  GHashTable *key_files = NULL;
+  if (pd->key_files != NULL) {
+    key_files = g_hash_table_new_full(g_str_hash, g_str_equal, g_free,
+                                      (GDestroyNotify)g_key_file_unref);
+  }
+  GPtrArray *load = g_ptr_array_new();
+  for (guint i = 0; i < roots->len; i++) {
+    for (guint j = 0; j < jobs[i].files->len; j++) {
+      DRunDesktopFile *df = &g_array_index(jobs[i].files, DRunDesktopFile, j);
+      if (!g_hash_table_add(seen, df->id)) {
+        continue;
+      }
+      GKeyFile *kf = NULL;
+      if (pd->key_files != NULL &&
+          (kf = g_hash_table_lookup(pd->key_files, df->path)) != NULL) {
+        df->key_file = g_key_file_ref(kf);
+      } else {
+        g_ptr_array_add(load, df);
+      }
+    }
+  }
+  g_hash_table_destroy(seen);
+  if (load->len > 0) {
+    gint next = 0;
+    unsigned int njobs = MIN(MAX(1, config.threads), (load->len + 15) / 16);
+    DRunScanJob *ljobs = g_malloc0_n(njobs, sizeof(DRunScanJob));
+    for (unsigned int i = 0; i < njobs; i++) {
+      ljobs[i].load = (DRunDesktopFile **)load->pdata;
+      ljobs[i].load_length = load->len;
+      ljobs[i].load_next = &next;
+    }
+    drun_scan_run(ljobs, njobs, drun_scan_load);
+    g_free(ljobs);
+  }
+  g_ptr_array_free(load, TRUE);
+  TICK_N("Get Desktop apps (loaded files)");
+
+  for (guint i = 0; i < roots->len; i++) {
+    for (guint j = 0; j < jobs[i].files->len; j++) {
+      DRunDesktopFile *df = &g_array_index(jobs[i].files, DRunDesktopFile, j);
+      read_desktop_file(pd, df->root, df->path, df->basename, DRUN_GROUP_NAME,
+                        df->key_file);
+      if (key_files != NULL && df->key_file != NULL) {
+        g_hash_table_replace(key_files, g_strdup(df->path),
+                             g_key_file_ref(df->key_file));
+      }
+    }
+    if (jobs[i].dirs != NULL) {
+      g_array_append_vals(pd->scanned_dirs, jobs[i].dirs->data,
+                          jobs[i].dirs->len);
+      g_array_free(jobs[i].dirs, TRUE);
+    }
+    g_array_free(jobs[i].files, TRUE);
+  }
+  g_free(jobs);
+  if (key_files != NULL) {
+    g_hash_table_destroy(pd->key_files);
+    pd->key_files = key_files;
+  }
+}
 /**
  * @param entry The command entry to remove from history
  *
@@ -966,116 +1263,287 @@ static gint drun_int_sort_list(gconstpointer a, gconstpointer b,
  *******************************************/
 
 /** Version of the DRUN cache file format. */
-#define CACHE_VERSION 3
-static void drun_write_str(FILE *fd, const char *str) {
-  size_t l = (str == NULL ? 0 : strlen(str));
-  fwrite(&l, sizeof(l), 1, fd);
-  // Only write string if it is not NULL or empty.
-  if (l > 0) {
-    // Also writeout terminating '\0'
-    fwrite(str, 1, l + 1, fd);
-  }
-}
-static void drun_write_integer(FILE *fd, int32_t val) {
-  fwrite(&val, sizeof(val), 1, fd);
-}
-static gboolean drun_read_integer(FILE *fd, int32_t *type) {
-  if (fread(type, sizeof(int32_t), 1, fd) != 1) {
-    g_warning("Failed to read entry, cache corrupt?");
-    return TRUE;
-  }
-  return FALSE;
+#define CACHE_VERSION 4
+/** Magic number at the start of the DRUN cache file. */
+#define CACHE_MAGIC 0x43524452u
+/** String offset or list index of a missing value. */
+#define CACHE_NULL UINT32_MAX
+
+/**
+ * The cache file is mapped and used in place. It holds, in host byte order,
+ * the header, the scanned directories, one fixed size record per entry, the
+ * string list table and the string table.
+ * Strings are stored as offset in the string table, string lists as index of
+ * their first element in the string list table (terminated by CACHE_NULL).
+ */
+typedef struct {
+  uint32_t magic;
+  uint32_t version;
+  /** Number of scanned directories. */
+  uint32_t num_dirs;
+  /** Number of entries. */
+  uint32_t num_entries;
+  /** Number of elements in the string list table. */
+  uint32_t num_strv;
+  /** Settings that influence the entries, see drun_cache_settings. */
+  uint32_t settings;
+  /** Unused, avoids padding. */
+  uint32_t reserved;
+  /** Size of the string table. */
+  uint64_t strings_size;
+} DRunCacheHeader;
+
+/** Directory that was scanned when the cache was written. */
+typedef struct {
+  uint32_t path;
+  /** If the directory existed. */
+  uint32_t exists;
+  int64_t mtime_sec;
+  int64_t mtime_nsec;
+} DRunCacheDir;
+
+/** A #DRunModeEntry in the cache. */
+typedef struct {
+  uint32_t action;
+  uint32_t root;
+  uint32_t path;
+  uint32_t app_id;
+  uint32_t desktop_id;
+  uint32_t icon_name;
+  uint32_t exec;
+  uint32_t name;
+  uint32_t generic_name;
+  uint32_t comment;
+  uint32_t url;
+  uint32_t categories;
+  uint32_t keywords;
+  int32_t type;
+} DRunCacheRecord;
+
+/**
+ * @param roots The directories that are scanned.
+ *
+ * Everything besides the directory content the entries depend on.
+ *
+ * @returns the settings key, free with g_free.
+ */
+static char *drun_cache_settings(GArray *roots) {
+  GString *str = g_string_new(NULL);
+  const char *current_desktop = g_getenv("XDG_CURRENT_DESKTOP");
+  g_string_append_printf(
+      str, "%s\x1f%s\x1f%s\x1f%s\x1f%d\x1f%s",
+      current_desktop ? current_desktop : "", g_get_language_names()[0],
+      config.drun_categories ? config.drun_categories : "",
+      config.drun_exclude_categories ? config.drun_exclude_categories : "",
+      config.drun_show_actions, config.drun_match_fields);
+  for (guint i = 0; i < roots->len; i++) {
+    DRunScanRoot *root = &g_array_index(roots, DRunScanRoot, i);
+    g_string_append_printf(str, "\x1f%s:%d", root->dir, root->recursive);
+  }
+  return g_string_free(str, FALSE);
 }
-static gboolean drun_read_string(FILE *fd, char **str) {
-  size_t l = 0;
 
-  if (fread(&l, sizeof(l), 1, fd) != 1) {
-    g_warning("Failed to read entry, cache corrupt?");
-    return TRUE;
-  }
-  (*str) = NULL;
-  if (l > 0) {
-    // Include \0
-    l++;
-    (*str) = g_malloc(l);
-    if (fread((*str), 1, l, fd) != l) {
-      g_warning("Failed to read entry, cache corrupt?");
-      return TRUE;
-    }
+static uint32_t drun_cache_add_string(GString *strings, GHashTable *offsets,
+                                      const char *str) {
+  if (str == NULL) {
+    return CACHE_NULL;
   }
-  return FALSE;
-}
-static void drun_write_strv(FILE *fd, char **str) {
-  guint vl = (str == NULL ? 0 : g_strv_length(str));
-  fwrite(&vl, sizeof(vl), 1, fd);
-  for (guint index = 0; index < vl; index++) {
-    drun_write_str(fd, str[index]);
+  gpointer offset = NULL;
+  if (g_hash_table_lookup_extended(offsets, str, NULL, &offset)) {
+    return GPOINTER_TO_UINT(offset);
   }
+  uint32_t retv = strings->len;
+  g_string_append_len(strings, str, strlen(str) + 1);
+  g_hash_table_insert(offsets, (gpointer)str, GUINT_TO_POINTER(retv));
+  return retv;
 }
-static gboolean drun_read_stringv(FILE *fd, char ***str) {
-  guint vl = 0;
-  (*str) = NULL;
-  if (fread(&vl, sizeof(vl), 1, fd) != 1) {
-    g_warning("Failed to read entry, cache corrupt?");
-    return TRUE;
+
+static uint32_t drun_cache_add_strv(GArray *strv, GString *strings,
+                                    GHashTable *offsets, char **list) {
+  if (list == NULL) {
+    return CACHE_NULL;
   }
-  if (vl > 0) {
-    // Include terminating NULL entry.
-    (*str) = g_malloc0((vl + 1) * sizeof(**str));
-    for (guint index = 0; index < vl; index++) {
-      if (drun_read_string(fd, &((*str)[index]))) {
-        return TRUE;
-      }
-    }
+  uint32_t retv = strv->len;
+  for (; *list != NULL; list++) {
+    uint32_t offset = drun_cache_add_string(strings, offsets, *list);
+    g_array_append_val(strv, offset);
   }
-  return FALSE;
+  uint32_t end = CACHE_NULL;
+  g_array_append_val(strv, end);
+  return retv;
 }
 
-static void write_cache(DRunModePrivateData *pd, const char *cache_file) {
+static void write_cache(DRunModePrivateData *pd, const char *cache_file,
+                        const char *settings) {
   if (cache_file == NULL || config.drun_use_desktop_cache == FALSE) {
     return;
   }
   TICK_N("DRUN Write CACHE: start");
 
-  FILE *fd = fopen(cache_file, "w");
-  if (fd == NULL) {
-    g_warning("Failed to write to cache file");
-    return;
+  GString *strings = g_string_new(NULL);
+  // Strings are deduplicated, the entries own the keys.
+  GHashTable *offsets = g_hash_table_new(g_str_hash, g_str_equal);
+  GArray *strv = g_array_new(FALSE, FALSE, sizeof(uint32_t));
+  DRunCacheHeader header = {.magic = CACHE_MAGIC,
+                            .version = CACHE_VERSION,
+                            .num_dirs = pd->scanned_dirs->len,
+                            .num_entries = pd->cmd_list_length};
+  DRunCacheDir *dirs = g_malloc0_n(header.num_dirs, sizeof(DRunCacheDir));
+  for (uint32_t i = 0; i < header.num_dirs; i++) {
+    DRunScannedDir *sd = &g_array_index(pd->scanned_dirs, DRunScannedDir, i);
+    dirs[i].path = drun_cache_add_string(strings, offsets, sd->path);
+    dirs[i].exists = sd->exists;
+    dirs[i].mtime_sec = sd->mtime_sec;
+    dirs[i].mtime_nsec = sd->mtime_nsec;
+  }
+  DRunCacheRecord *records =
+      g_malloc0_n(header.num_entries, sizeof(DRunCacheRecord));
+  for (uint32_t i = 0; i < header.num_entries; i++) {
+    DRunModeEntry *entry = &(pd->entry_list[i]);
+    DRunCacheRecord *r = &(records[i]);
+    r->action = drun_cache_add_string(strings, offsets, entry->action);
+    r->root = drun_cache_add_string(strings, offsets, entry->root);
+    r->path = drun_cache_add_string(strings, offsets, entry->path);
+    r->app_id = drun_cache_add_string(strings, offsets, entry->app_id);
+    r->desktop_id = drun_cache_add_string(strings, offsets, entry->desktop_id);
+    r->icon_name = drun_cache_add_string(strings, offsets, entry->icon_name);
+    r->exec = drun_cache_add_string(strings, offsets, entry->exec);
+    r->name = drun_cache_add_string(strings, offsets, entry->name);
+    r->generic_name =
+        drun_cache_add_string(strings, offsets, entry->generic_name);
+    r->comment = drun_cache_add_string(strings, offsets, entry->comment);
+    r->url = drun_cache_add_string(strings, offsets, entry->url);
+    r->categories =
+        drun_cache_add_strv(strv, strings, offsets, entry->categories);
+    r->keywords = drun_cache_add_strv(strv, strings, offsets, entry->keywords);
+    r->type = entry->type;
+  }
+  header.settings = drun_cache_add_string(strings, offsets, settings);
+  header.num_strv = strv->len;
+  header.strings_size = strings->len;
+
+  GString *data = g_string_new(NULL);
+  g_string_append_len(data, (const char *)&header, sizeof(header));
+  g_string_append_len(data, (const char *)dirs,
+                      header.num_dirs * sizeof(DRunCacheDir));
+  g_string_append_len(data, (const char *)records,
+                      header.num_entries * sizeof(DRunCacheRecord));
+  g_string_append_len(data, (const char *)strv->data,
+                      strv->len * sizeof(uint32_t));
+  g_string_append_len(data, strings->str, strings->len);
+
+  // Written to a temporary file and renamed, a running rofi might have the
+  // old one mapped.
+  GError *error = NULL;
+  if (!g_file_set_contents(cache_file, data->str, data->len, &error)) {
+    g_warning("Failed to write to cache file: %s", error->message);
+    g_error_free(error);
   }
-  uint8_t version = CACHE_VERSION;
-  fwrite(&version, sizeof(version), 1, fd);
-
-  fwrite(&(pd->cmd_list_length), sizeof(pd->cmd_list_length), 1, fd);
-  for (unsigned int index = 0; index < pd->cmd_list_length; index++) {
-    DRunModeEntry *entry = &(pd->entry_list[index]);
-
-    drun_write_str(fd, entry->action);
-    drun_write_str(fd, entry->root);
-    drun_write_str(fd, entry->path);
-    drun_write_str(fd, entry->app_id);
-    drun_write_str(fd, entry->desktop_id);
-    drun_write_str(fd, entry->icon_name);
-    drun_write_str(fd, entry->exec);
-    drun_write_str(fd, entry->name);
-    drun_write_str(fd, entry->generic_name);
-
-    drun_write_strv(fd, entry->categories);
-    drun_write_strv(fd, entry->keywords);
+  g_string_free(data, TRUE);
+  g_free(records);
+  g_free(dirs);
+  g_array_free(strv, TRUE);
+  g_hash_table_destroy(offsets);
+  g_string_free(strings, TRUE);
+  TICK_N("DRUN Write CACHE: end");
+}
 
-    drun_write_str(fd, entry->comment);
-    drun_write_str(fd, entry->url);
-    drun_write_integer(fd, (int32_t)entry->type);
+/**
+ * @param map The mapped cache file.
+ * @param size The size of the mapping.
+ * @param settings The current settings key.
+ *
+ * Check that all offsets are within the file, and that the cache is still up
+ * to date.
+ *
+ * @returns TRUE if the cache can be used.
+ */
+static gboolean drun_cache_validate(const char *map, gsize size,
+                                    const char *settings) {
+  const DRunCacheHeader *header = (const DRunCacheHeader *)map;
+  if (header->magic != CACHE_MAGIC) {
+    g_warning("Cache corrupt, ignoring.");
+    return FALSE;
   }
-
-  fclose(fd);
-  TICK_N("DRUN Write CACHE: end");
+  if (header->version != CACHE_VERSION) {
+    g_warning("Cache file wrong version, ignoring.");
+    return FALSE;
+  }
+  guint64 expected = sizeof(DRunCacheHeader) +
+                     (guint64)header->num_dirs * sizeof(DRunCacheDir) +
+                     (guint64)header->num_entries * sizeof(DRunCacheRecord) +
+                     (guint64)header->num_strv * sizeof(uint32_t) +
+                     header->strings_size;
+  if (expected != size || header->strings_size == 0 ||
+      header->strings_size > CACHE_NULL) {
+    g_warning("Cache corrupt, ignoring.");
+    return FALSE;
+  }
+  const DRunCacheDir *dirs = (const DRunCacheDir *)(header + 1);
+  const DRunCacheRecord *records =
+      (const DRunCacheRecord *)(dirs + header->num_dirs);
+  const uint32_t *strv = (const uint32_t *)(records + header->num_entries);
+  const char *strings = (const char *)(strv + header->num_strv);
+  // The last string is terminated, so every offset below is a valid string.
+  if (strings[header->strings_size - 1] != '\0') {
+    g_warning("Cache corrupt, ignoring.");
+    return FALSE;
+  }
+#define CACHE_VALID_STRING(o) ((o) == CACHE_NULL || (o) < header->strings_size)
+#define CACHE_VALID_STRV(o) ((o) == CACHE_NULL || (o) < header->num_strv)
+  if (header->num_strv > 0 && strv[header->num_strv - 1] != CACHE_NULL) {
+    g_warning("Cache corrupt, ignoring.");
+    return FALSE;
+  }
+  for (uint32_t i = 0; i < header->num_strv; i++) {
+    if (!CACHE_VALID_STRING(strv[i])) {
+      g_warning("Cache corrupt, ignoring.");
+      return FALSE;
+    }
+  }
+  for (uint32_t i = 0; i < header->num_entries; i++) {
+    const DRunCacheRecord *r = &(records[i]);
+    if (!CACHE_VALID_STRING(r->action) || !CACHE_VALID_STRING(r->root) ||
+        !CACHE_VALID_STRING(r->path) || !CACHE_VALID_STRING(r->app_id) ||
+        !CACHE_VALID_STRING(r->desktop_id) ||
+        !CACHE_VALID_STRING(r->icon_name) || !CACHE_VALID_STRING(r->exec) ||
+        !CACHE_VALID_STRING(r->name) || !CACHE_VALID_STRING(r->generic_name) ||
+        !CACHE_VALID_STRING(r->comment) || !CACHE_VALID_STRING(r->url) ||
+        !CACHE_VALID_STRV(r->categories) || !CACHE_VALID_STRV(r->keywords)) {
+      g_warning("Cache corrupt, ignoring.");
+      return FALSE;
+    }
+  }
+  if (header->settings >= header->strings_size ||
+      g_strcmp0(strings + header->settings, settings) != 0) {
+    g_debug("Settings changed, rebuilding drun cache.");
+    return FALSE;
+  }
+  for (uint32_t i = 0; i < header->num_dirs; i++) {
+    if (dirs[i].path >= header->strings_size) {
+      g_warning("Cache corrupt, ignoring.");
+      return FALSE;
+    }
+    const char *path = strings + dirs[i].path;
+    struct stat st;
+    gboolean exists = (stat(path, &st) == 0);
+    if (exists != (gboolean)dirs[i].exists ||
+        (exists && (st.st_mtim.tv_sec != dirs[i].mtime_sec ||
+                    st.st_mtim.tv_nsec != dirs[i].mtime_nsec))) {
+      g_debug("Directory %s changed, rebuilding drun cache.", path);
+      return FALSE;
+    }
+  }
+#undef CACHE_VALID_STRING
+#undef CACHE_VALID_STRV
+  return TRUE;
 }
 
 /**
  * Read cache file. returns FALSE when success.
  */
-static gboolean drun_read_cache(DRunModePrivateData *pd,
-                                const char *cache_file) {
+static gboolean drun_read_cache(DRunModePrivateData *pd, const char *cache_file,
+                                const char *settings) {
   if (cache_file == NULL || config.drun_use_desktop_cache == FALSE) {
     return TRUE;
   }
@@ -1084,175 +1552,290 @@ static gboolean drun_read_cache(DRunModePrivateData *pd,
     return TRUE;
   }
   TICK_N("DRUN Read CACHE: start");
-  FILE *fd = fopen(cache_file, "r");
-  if (fd == NULL) {
+  int fd = open(cache_file, O_RDONLY | O_CLOEXEC);
+  if (fd < 0) {
     TICK_N("DRUN Read CACHE: stop");
     return TRUE;
   }
-
-  // Read version.
-  uint8_t version = 0;
-
-  if (fread(&version, sizeof(version), 1, fd) != 1) {
-    fclose(fd);
+  struct stat st;
+  char *map = MAP_FAILED;
+  if (fstat(fd, &st) == 0 && st.st_size >= (off_t)sizeof(DRunCacheHeader)) {
+    map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  }
+  close(fd);
+  if (map == MAP_FAILED) {
     g_warning("Cache corrupt, ignoring.");
     TICK_N("DRUN Read CACHE: stop");
     return TRUE;
   }
-
-  if (version != CACHE_VERSION) {
-    fclose(fd);
-    g_warning("Cache file wrong version, ignoring.");
+  if (!drun_cache_validate(map, st.st_size, settings)) {
+    munmap(map, st.st_size);
     TICK_N("DRUN Read CACHE: stop");
     return TRUE;
   }
+  const DRunCacheHeader *header = (const DRunCacheHeader *)map;
+  const DRunCacheDir *dirs = (const DRunCacheDir *)(header + 1);
+  const DRunCacheRecord *records =
+      (const DRunCacheRecord *)(dirs + header->num_dirs);
+  const uint32_t *strv = (const uint32_t *)(records + header->num_entries);
+  char *strings = (char *)(strv + header->num_strv);
+
+  pd->cache_map = map;
+  pd->cache_map_size = st.st_size;
+  if (pd->monitors != NULL && pd->scanned_dirs != NULL) {
+    // Watch the directories the entries were found in.
+    for (uint32_t i = 0; i < header->num_dirs; i++) {
+      DRunScannedDir sd = {.path = g_strdup(strings + dirs[i].path),
+                           .exists = dirs[i].exists,
+                           .mtime_sec = dirs[i].mtime_sec,
+                           .mtime_nsec = dirs[i].mtime_nsec};
+      g_array_append_val(pd->scanned_dirs, sd);
+    }
+  }
+  // The entries point straight into the mapping.
+#define CACHE_STRING(o) ((o) == CACHE_NULL ? NULL : strings + (o))
+  pd->cache_strv = g_malloc_n(header->num_strv, sizeof(char *));
+  for (uint32_t i = 0; i < header->num_strv; i++) {
+    pd->cache_strv[i] = CACHE_STRING(strv[i]);
+  }
+  pd->cmd_list_length = header->num_entries;
+  pd->cmd_list_length_actual = header->num_entries;
+  pd->entry_list = g_malloc0_n(header->num_entries, sizeof(DRunModeEntry));
+  for (uint32_t i = 0; i < header->num_entries; i++) {
+    const DRunCacheRecord *r = &(records[i]);
+    DRunModeEntry *entry = &(pd->entry_list[i]);
+    entry->from_cache = TRUE;
+    entry->action = CACHE_STRING(r->action);
+    entry->root = CACHE_STRING(r->root);
+    entry->path = CACHE_STRING(r->path);
+    entry->app_id = CACHE_STRING(r->app_id);
+    entry->desktop_id = CACHE_STRING(r->desktop_id);
+    entry->icon_name = CACHE_STRING(r->icon_name);
+    entry->exec = CACHE_STRING(r->exec);
+    entry->name = CACHE_STRING(r->name);
+    entry->generic_name = CACHE_STRING(r->generic_name);
+    entry->comment = CACHE_STRING(r->comment);
+    entry->url = CACHE_STRING(r->url);
+    entry->categories = (r->categories == CACHE_NULL)
+                            ? NULL
+                            : &(pd->cache_strv[r->categories]);
+    entry->keywords =
+        (r->keywords == CACHE_NULL) ? NULL : &(pd->cache_strv[r->keywords]);
+    entry->type = r->type;
+  }
+#undef CACHE_STRING
+  TICK_N("DRUN Read CACHE: stop");
+  return FALSE;
+}
 
-  if (fread(&(pd->cmd_list_length), sizeof(pd->cmd_list_length), 1, fd) != 1) {
-    fclose(fd);
-    g_warning("Cache corrupt, ignoring.");
-    TICK_N("DRUN Read CACHE: stop");
-    return TRUE;
+/**
+ * @param wid The drun theme widget.
+ *
+ * @returns the directories to load desktop files from, in order.
+ */
+static GArray *drun_get_scan_roots(ThemeWidget *wid) {
+  GArray *roots = g_array_new(FALSE, FALSE, sizeof(DRunScanRoot));
+  /** Load desktop entries */
+  Property *p = rofi_theme_find_property(wid, P_BOOLEAN, "scan-desktop", FALSE);
+  if (p != NULL && (p->type == P_BOOLEAN && p->value.b)) {
+    const gchar *dir = g_get_user_special_dir(G_USER_DIRECTORY_DESKTOP);
+    if (dir != NULL) {
+      DRunScanRoot root = {.dir = g_strdup(dir), .recursive = FALSE};
+      g_array_append_val(roots, root);
+    }
   }
-  // set actual length to length;
-  pd->cmd_list_length_actual = pd->cmd_list_length;
+  /** Load user entires */
+  p = rofi_theme_find_property(wid, P_BOOLEAN, "parse-user", TRUE);
+  if (p == NULL || (p->type == P_BOOLEAN && p->value.b)) {
+    DRunScanRoot root = {
+        .dir = g_build_filename(g_get_user_data_dir(), "applications", NULL),
+        .recursive = TRUE};
+    g_array_append_val(roots, root);
+  }
+
+  /** Load application entires */
+  p = rofi_theme_find_property(wid, P_BOOLEAN, "parse-system", TRUE);
+  if (p == NULL || (p->type == P_BOOLEAN && p->value.b)) {
+    // Then read thee system data dirs.
+    const gchar *const *sys = g_get_system_data_dirs();
+    for (const gchar *const *iter = sys; *iter != NULL; ++iter) {
+      gboolean unique = TRUE;
+      // Stupid duplicate detection, better then walking dir.
+      for (const gchar *const *iterd = sys; iterd != iter; ++iterd) {
+        if (g_strcmp0(*iter, *iterd) == 0) {
+          unique = FALSE;
+        }
+      }
+      // Check, we seem to be getting empty string...
+      if (unique && (**iter) != '\0') {
+        DRunScanRoot root = {
+            .dir = g_build_filename(*iter, "applications", NULL),
+            .recursive = TRUE};
+        g_array_append_val(roots, root);
+      }
+    }
+  }
+  return roots;
+}
 
-  pd->entry_list =
-      g_malloc0(pd->cmd_list_length_actual * sizeof(*(pd->entry_list)));
+/** Delay before reloading after a desktop file changed, in milliseconds. */
+#define DRUN_RELOAD_DELAY 250
 
-  int error = 0;
-  for (unsigned int index = 0; !error && index < pd->cmd_list_length; index++) {
-    DRunModeEntry *entry = &(pd->entry_list[index]);
+static gboolean drun_reload(gpointer data);
 
-    if (drun_read_string(fd, &(entry->action))) {
-      error = 1;
-      continue;
-    }
-    if (drun_read_string(fd, &(entry->root))) {
-      error = 1;
-      continue;
-    }
-    if (drun_read_string(fd, &(entry->path))) {
-      error = 1;
-      continue;
-    }
-    if (drun_read_string(fd, &(entry->app_id))) {
-      error = 1;
-      continue;
-    }
-    if (drun_read_string(fd, &(entry->desktop_id))) {
-      error = 1;
-      continue;
-    }
-    if (drun_read_string(fd, &(entry->icon_name))) {
-      error = 1;
-      continue;
-    }
-    if (drun_read_string(fd, &(entry->exec))) {
-      error = 1;
-      continue;
-    }
-    if (drun_read_string(fd, &(entry->name))) {
-      error = 1;
-      continue;
-    }
-    if (drun_read_string(fd, &(entry->generic_name))) {
-      error = 1;
-      continue;
-    }
+static void drun_monitor_free(GFileMonitor *monitor) {
+  g_file_monitor_cancel(monitor);
+  g_object_unref(monitor);
+}
 
-    if (drun_read_stringv(fd, &(entry->categories))) {
-      error = 1;
-      continue;
-    }
-    if (drun_read_stringv(fd, &(entry->keywords))) {
-      error = 1;
-      continue;
+static void drun_monitor_changed(G_GNUC_UNUSED GFileMonitor *monitor,
+                                 GFile *file, GFile *other_file,
+                                 G_GNUC_UNUSED GFileMonitorEvent event,
+                                 gpointer data) {
+  DRunModePrivateData *pd = (DRunModePrivateData *)data;
+  // Only the files that changed are loaded again.
+  char *path = g_file_get_path(file);
+  if (path != NULL) {
+    g_hash_table_remove(pd->key_files, path);
+    g_free(path);
+  }
+  if (other_file != NULL) {
+    path = g_file_get_path(other_file);
+    if (path != NULL) {
+      g_hash_table_remove(pd->key_files, path);
+      g_free(path);
     }
+  }
+  // Changes tend to come in bursts, reload once they settled.
+  if (pd->reload_timeout > 0) {
+    g_source_remove(pd->reload_timeout);
+  }
+  pd->reload_timeout = g_timeout_add(DRUN_RELOAD_DELAY, drun_reload, pd);
+}
 
-    if (drun_read_string(fd, &(entry->comment))) {
-      error = 1;
+/**
+ * @param pd The drun mode private data.
+ *
+ * Watch the scanned directories that exist, and stop watching the ones that
+ * are not scanned anymore.
+ */
+static void drun_watch_dirs(DRunModePrivateData *pd) {
+  GHashTable *old = pd->monitors;
+  pd->monitors = g_hash_table_new_full(g_str_hash, g_str_equal, g_free,
+                                       (GDestroyNotify)drun_monitor_free);
+  for (guint i = 0; i < pd->scanned_dirs->len; i++) {
+    DRunScannedDir *sd = &g_array_index(pd->scanned_dirs, DRunScannedDir, i);
+    if (!sd->exists || g_hash_table_contains(pd->monitors, sd->path)) {
       continue;
     }
-    if (drun_read_string(fd, &(entry->url))) {
-      error = 1;
+    gpointer key = NULL, monitor = NULL;
+    if (g_hash_table_steal_extended(old, sd->path, &key, &monitor)) {
+      g_hash_table_insert(pd->monitors, key, monitor);
       continue;
     }
-    int32_t type = 0;
-    if (drun_read_integer(fd, &(type))) {
-      error = 1;
+    GFile *file = g_file_new_for_path(sd->path);
+    GError *error = NULL;
+    monitor = g_file_monitor_directory(file, G_FILE_MONITOR_WATCH_MOVES, NULL,
+                                       &error);
+    g_object_unref(file);
+    if (monitor == NULL) {
+      g_warning("Failed to watch directory %s: %s", sd->path, error->message);
+      g_error_free(error);
       continue;
     }
-    entry->type = type;
+    g_signal_connect(monitor, "changed", G_CALLBACK(drun_monitor_changed), pd);
+    g_hash_table_insert(pd->monitors, g_strdup(sd->path), monitor);
   }
+  g_hash_table_destroy(old);
+}
 
-  fclose(fd);
-  if (error) {
-    for (size_t i = 0; i < pd->cmd_list_length; i++) {
-      drun_entry_clear(&(pd->entry_list[i]));
-    }
-    g_free(pd->entry_list);
-    pd->cmd_list_length = 0;
-    pd->cmd_list_length_actual = 0;
-    return TRUE;
+/**
+ * @param str The string to append to, created on the first field.
+ * @param field The field to append, can be NULL.
+ *
+ * Append a field to the match string, on a line of its own.
+ */
+static void drun_match_string_append(GString **str, const char *field) {
+  if (field == NULL) {
+    return;
+  }
+  if (*str == NULL) {
+    *str = g_string_new(field);
+  } else {
+    g_string_append_c(*str, '\n');
+    g_string_append(*str, field);
   }
-  TICK_N("DRUN Read CACHE: stop");
-  return FALSE;
 }
 
-static void get_apps(DRunModePrivateData *pd) {
-  char *cache_file = g_build_filename(cache_dir, DRUN_DESKTOP_CACHE_FILE, NULL);
-  TICK_N("Get Desktop apps (start)");
-  if (drun_read_cache(pd, cache_file)) {
-    ThemeWidget *wid = rofi_config_find_widget(drun_mode.name, NULL, TRUE);
-
-    /** Load desktop entries */
-    Property *p =
-        rofi_theme_find_property(wid, P_BOOLEAN, "scan-desktop", FALSE);
-    if (p != NULL && (p->type == P_BOOLEAN && p->value.b)) {
-      const gchar *dir;
-      // First read the user directory.
-      dir = g_get_user_special_dir(G_USER_DIRECTORY_DESKTOP);
-      walk_dir(pd, dir, dir, FALSE);
-      TICK_N("Get Desktop dir apps");
+/**
+ * @param e The entry.
+ *
+ * Join the fields enabled for matching, one per line. Matching a token
+ * against this string is the same as matching it against each field, as no
+ * matching method except regex matches across lines.
+ *
+ * @returns the joined fields, NULL if none is set.
+ */
+static char *drun_entry_match_string(const DRunModeEntry *e) {
+  GString *str = NULL;
+  if (matching_entry_fields[DRUN_MATCH_FIELD_NAME].enabled_match) {
+    drun_match_string_append(&str, e->name);
+  }
+  if (matching_entry_fields[DRUN_MATCH_FIELD_GENERIC].enabled_match) {
+    drun_match_string_append(&str, e->generic_name);
+  }
+  if (matching_entry_fields[DRUN_MATCH_FIELD_EXEC].enabled_match) {
+    drun_match_string_append(&str, e->exec);
+  }
+  if (matching_entry_fields[DRUN_MATCH_FIELD_CATEGORIES].enabled_match) {
+    for (int i = 0; e->categories && e->categories[i]; i++) {
+      drun_match_string_append(&str, e->categories[i]);
     }
-    /** Load user entires */
-    p = rofi_theme_find_property(wid, P_BOOLEAN, "parse-user", TRUE);
-    if (p == NULL || (p->type == P_BOOLEAN && p->value.b)) {
-      gchar *dir;
-      // First read the user directory.
-      dir = g_build_filename(g_get_user_data_dir(), "applications", NULL);
-      walk_dir(pd, dir, dir, TRUE);
-      g_free(dir);
-      TICK_N("Get Desktop apps (user dir)");
+  }
+  if (matching_entry_fields[DRUN_MATCH_FIELD_KEYWORDS].enabled_match) {
+    for (int i = 0; e->keywords && e->keywords[i]; i++) {
+      drun_match_string_append(&str, e->keywords[i]);
     }
+  }
+  if (matching_entry_fields[DRUN_MATCH_FIELD_URL].enabled_match) {
+    drun_match_string_append(&str, e->url);
+  }
+  if (matching_entry_fields[DRUN_MATCH_FIELD_COMMENT].enabled_match) {
+    drun_match_string_append(&str, e->comment);
+  }
+  return str ? g_string_free(str, FALSE) : NULL;
+}
 
-    /** Load application entires */
-    p = rofi_theme_find_property(wid, P_BOOLEAN, "parse-system", TRUE);
-    if (p == NULL || (p->type == P_BOOLEAN && p->value.b)) {
-      // Then read thee system data dirs.
-      const gchar *const *sys = g_get_system_data_dirs();
-      for (const gchar *const *iter = sys; *iter != NULL; ++iter) {
-        gboolean unique = TRUE;
-        // Stupid duplicate detection, better then walking dir.
-        for (const gchar *const *iterd = sys; iterd != iter; ++iterd) {
-          if (g_strcmp0(*iter, *iterd) == 0) {
-            unique = FALSE;
-          }
-        }
-        // Check, we seem to be getting empty string...
-        if (unique && (**iter) != '\0') {
-          char *dir = g_build_filename(*iter, "applications", NULL);
-          walk_dir(pd, dir, dir, TRUE);
-          g_free(dir);
-        }
-      }
-      TICK_N("Get Desktop apps (system dirs)");
-    }
-    pd->disable_dbusactivate = FALSE;
-    p = rofi_theme_find_property(wid, P_BOOLEAN, "DBusActivatable", TRUE);
-    if (p != NULL && (p->type == P_BOOLEAN && p->value.b == FALSE)) {
-      pd->disable_dbusactivate = TRUE;
-    }
+/**
+ * @param pd The drun mode private data.
+ * @param use_cache If the entries can be read from the cache.
+ */
+static void get_apps(DRunModePrivateData *pd, gboolean use_cache) {
+  char *cache_file = g_build_filename(cache_dir, DRUN_DESKTOP_CACHE_FILE, NULL);
+  TICK_N("Get Desktop apps (start)");
+  ThemeWidget *wid = rofi_config_find_widget(drun_mode.name, NULL, TRUE);
+  GArray *roots = drun_get_scan_roots(wid);
+  char *settings = drun_cache_settings(roots);
+
+  pd->disable_dbusactivate = FALSE;
+  Property *p =
+      rofi_theme_find_property(wid, P_BOOLEAN, "DBusActivatable", TRUE);
+  if (p != NULL && (p->type == P_BOOLEAN && p->value.b == FALSE)) {
+    pd->disable_dbusactivate = TRUE;
+  }
+  p = rofi_theme_find_property(wid, P_BOOLEAN, "watch-desktop-files", TRUE);
+  if (pd->monitors == NULL && p != NULL &&
+      (p->type == P_BOOLEAN && p->value.b)) {
+    pd->monitors = g_hash_table_new(g_str_hash, g_str_equal);
+    pd->key_files = g_hash_table_new_full(g_str_hash, g_str_equal, g_free,
+                                          (GDestroyNotify)g_key_file_unref);
+  }
+  pd->scanned_dirs = g_array_new(FALSE, FALSE, sizeof(DRunScannedDir));
+  g_array_set_clear_func(pd->scanned_dirs,
+                         (GDestroyNotify)drun_scanned_dir_clear);
+  if (!use_cache || drun_read_cache(pd, cache_file, settings)) {
+    drun_scan(pd, roots);
+    TICK_N("Get Desktop apps (scanned dirs)");
     get_apps_history(pd);
 
     g_qsort_with_data(pd->entry_list, pd->cmd_list_length,
@@ -1260,13 +1843,74 @@ static void get_apps(DRunModePrivateData *pd) {
 
     TICK_N("Sorting done.");
 
-    write_cache(pd, cache_file);
+    write_cache(pd, cache_file, settings);
   } else {
     g_debug("Read drun entries from cache.");
   }
+  for (unsigned int i = 0; i < pd->cmd_list_length; i++) {
+    pd->entry_list[i].match_string =
+        drun_entry_match_string(&(pd->entry_list[i]));
+  }
+  TICK_N("Match strings");
+  if (pd->monitors != NULL) {
+    drun_watch_dirs(pd);
+  }
+  g_array_free(pd->scanned_dirs, TRUE);
+  pd->scanned_dirs = NULL;
+  for (guint i = 0; i < roots->len; i++) {
+    g_free(g_array_index(roots, DRunScanRoot, i).dir);
+  }
+  g_array_free(roots, TRUE);
+  g_free(settings);
   g_free(cache_file);
 }
 
+/**
+ * @param pd The drun mode private data.
+ *
+ * Free all entries, and the cache they might point into.
+ */
+static void drun_entries_free(DRunModePrivateData *pd) {
+  for (size_t i = 0; i < pd->cmd_list_length; i++) {
+    drun_entry_clear(&(pd->entry_list[i]));
+  }
+  g_free(pd->entry_list);
+  pd->entry_list = NULL;
+  pd->cmd_list_length = 0;
+  pd->cmd_list_length_actual = 0;
+  g_free(pd->cache_strv);
+  pd->cache_strv = NULL;
+  if (pd->cache_map != NULL) {
+    munmap(pd->cache_map, pd->cache_map_size);
+    pd->cache_map = NULL;
+    pd->cache_map_size = 0;
+  }
+}
+
+/**
+ * @param data The drun mode private data.
+ *
+ * Scan the desktop files again after a change, files that did not change are
+ * not loaded again.
+ *
+ * @returns G_SOURCE_REMOVE, or G_SOURCE_CONTINUE to try again later.
+ */
+static gboolean drun_reload(gpointer data) {
+  DRunModePrivateData *pd = (DRunModePrivateData *)data;
+  if (pd->file_complete) {
+    // The completer refers to the selected entry.
+    return G_SOURCE_CONTINUE;
+  }
+  pd->reload_timeout = 0;
+  // The filter reads the entries, stop it before they are replaced.
+  rofi_view_cancel_filter();
+  drun_entries_free(pd);
+  g_hash_table_remove_all(pd->disabled_entries);
+  get_apps(pd, FALSE);
+  rofi_view_reload();
+  return G_SOURCE_REMOVE;
+}
+
 static void drun_mode_parse_entry_fields(void) {
   char *savept = NULL;
   // Make a copy, as strtok will modify it.
@@ -1340,7 +1984,7 @@ static int drun_mode_init(Mode *sw) {
 
   drun_mode_parse_entry_fields();
   drun_mode_parse_display_format();
-  get_apps(pd);
+  get_apps(pd, TRUE);
 
   pd->completer = NULL;
   return TRUE;
@@ -1349,13 +1993,20 @@ static void drun_entry_clear(DRunModeEntry *e) {
   if (e == NULL) {
     return;
   }
+  if (e->icon != NULL) {
+    cairo_surface_destroy(e->icon);
+  }
+  if (e->key_file) {
+    g_key_file_unref(e->key_file);
+  }
+  g_free(e->match_string);
+  if (e->from_cache) {
+    return;
+  }
   g_free(e->root);
   g_free(e->path);
   g_free(e->app_id);
   g_free(e->desktop_id);
-  if (e->icon != NULL) {
-    cairo_surface_destroy(e->icon);
-  }
   g_free(e->icon_name);
   g_free(e->exec);
   g_free(e->name);
@@ -1366,9 +2017,6 @@ static void drun_entry_clear(DRunModeEntry *e) {
   }
   g_strfreev(e->categories);
   g_strfreev(e->keywords);
-  if (e->key_file) {
-    g_key_file_free(e->key_file);
-  }
 }
 
 static ModeMode drun_mode_result(Mode *sw, int mretv, char **input,
@@ -1476,11 +2124,15 @@ static ModeMode drun_mode_result(Mode *sw, int mretv, char **input,
 static void drun_mode_destroy(Mode *sw) {
   DRunModePrivateData *rmpd = (DRunModePrivateData *)mode_get_private_data(sw);
   if (rmpd != NULL) {
-    for (size_t i = 0; i < rmpd->cmd_list_length; i++) {
-      drun_entry_clear(&(rmpd->entry_list[i]));
+    if (rmpd->reload_timeout > 0) {
+      g_source_remove(rmpd->reload_timeout);
+    }
+    if (rmpd->monitors != NULL) {
+      g_hash_table_destroy(rmpd->monitors);
+      g_hash_table_destroy(rmpd->key_files);
     }
+    drun_entries_free(rmpd);
     g_hash_table_destroy(rmpd->disabled_entries);
-    g_free(rmpd->entry_list);
 
     g_free(rmpd->old_completer_input);
     g_free(rmpd->old_input);
@@ -1510,7 +2162,7 @@ static char *_get_display_value(const Mode *sw, unsigned int selected_line,
   if (!get_entry) {
     return NULL;
   }
-  if (pd->entry_list == NULL) {
+  if (pd->entry_list == NULL || selected_line >= pd->cmd_list_length) {
     // Should never get here.
     return g_strdup("Failed");
   }
@@ -1575,6 +2227,10 @@ static cairo_surface_t *_get_icon(const Mode *sw, unsigned int selected_line,
     return pd->completer->_get_icon(pd->completer, selected_line, height);
   }
   g_return_val_if_fail(pd->entry_list != NULL, NULL);
+  if (selected_line >= pd->cmd_list_length) {
+    // Entries were reloaded, the view catches up on the next update.
+    return NULL;
+  }
   DRunModeEntry *dr = &(pd->entry_list[selected_line]);
   if (dr->icon_name != NULL) {
     if (dr->icon_fetch_uid > 0 && dr->icon_fetch_size == height) {
@@ -1591,6 +2247,9 @@ static cairo_surface_t *_get_icon(const Mode *sw, unsigned int selected_line,
 
 static char *drun_get_completion(const Mode *sw, unsigned int index) {
   DRunModePrivateData *pd = (DRunModePrivateData *)mode_get_private_data(sw);
+  if (index >= pd->cmd_list_length) {
+    return g_strdup("");
+  }
   /* Free temp storage. */
   DRunModeEntry *dr = &(pd->entry_list[index]);
   if (dr->generic_name == NULL) {
@@ -1606,8 +2265,27 @@ static int drun_token_match(const Mode *data, rofi_int_matcher **tokens,
   if (rmpd->file_complete) {
     return rmpd->completer->_token_match(rmpd->completer, tokens, index);
   }
+  if (index >= rmpd->cmd_list_length) {
+    return 0;
+  }
   int match = 1;
-  if (tokens) {
+  const DRunModeEntry *e = &(rmpd->entry_list[index]);
+  if (tokens && config.matching_method != MM_REGEX) {
+    // An inverted token is only tested against the name.
+    gboolean has_name =
+        matching_entry_fields[DRUN_MATCH_FIELD_NAME].enabled_match &&
+        e->name != NULL;
+    for (int j = 0; match && tokens[j] != NULL; j++) {
+      rofi_int_matcher *ftokens[2] = {tokens[j], NULL};
+      if (tokens[j]->invert) {
+        match = has_name && helper_token_match(ftokens, e->name);
+      } else if (e->match_string == NULL ||
+                 !helper_token_match(ftokens, e->match_string)) {
+        match = 0;
+      }
+    }
+  } else if (tokens) {
+    // A regex can match across lines, match each field on its own.
     for (int j = 0; match && tokens[j] != NULL; j++) {
       int test = 0;
       rofi_int_matcher *ftokens[2] = {tokens[j], NULL};
@@ -33,9 +33,13 @@
 #include <unistd.h>
 
 #include <dirent.h>
+#include <fcntl.h>
 #include <glib/gstdio.h>
 #include <sys/stat.h>
 #include <sys/types.h>
+#if defined(__linux__)
+#include <sys/syscall.h>
+#endif
 
 #include "helper.h"
 #include "history.h"
@@ -43,6 +47,7 @@
 #include "mode.h"
 #include "modes/filebrowser.h"
 #include "rofi.h"
+#include "settings.h"
 #include "theme.h"
 
 #include <stdint.h>
@@ -53,6 +58,20 @@
 /** The default program used to open the file. */
 #define DEFAULT_OPEN "xdg-open"
 
+/** Number of bytes of directory entries read from the kernel in one go. */
+#define FB_READ_SIZE (256 * 1024)
+/** Maximum number of rows resolved and sorted as one block. */
+#define FB_BLOCK_SIZE 4096
+
+#if defined(__linux__) && defined(SYS_getdents64)
+/** Read directory entries with getdents64 instead of readdir. */
+#define FB_USE_GETDENTS 1
+#endif
+#if defined(__linux__) && defined(STATX_TYPE)
+/** Look up only the needed fields with statx. */
+#define FB_USE_STATX 1
+#endif
+
 #if defined(__APPLE__)
 #define st_atim st_atimespec
 #define st_ctim st_ctimespec
@@ -68,6 +87,8 @@ enum FBFileType {
   RFILE,
   NUM_FILE_TYPES,
 };
+/** Type of a row that still has to be looked up with a stat. */
+#define FB_UNKNOWN NUM_FILE_TYPES
 
 /**
  * Possible sorting methods
@@ -98,14 +119,65 @@ typedef struct {
   time_t time;
 } FBFile;
 
+typedef struct _FBListing FBListing;
+
 typedef struct {
   char *command;
   GFile *current_dir;
   FBFile *array;
   unsigned int array_length;
   unsigned int array_length_real;
+  /** The listing of current_dir that fills array, NULL if there is none. */
+  FBListing *listing;
 } FileBrowserModePrivateData;
 
+/**
+ * Listing of one directory. A reading thread reads the entries and hands
+ * them in blocks to the worker pool, where the types and times are looked up
+ * and the block is sorted. The sorted blocks are merged into the rows on the
+ * main thread as they arrive.
+ * Reference counted with g_atomic_rc_box, the mode holds one reference while
+ * the listing is current.
+ */
+struct _FBListing {
+  /** The mode data the rows are merged into, only used on the main thread. */
+  FileBrowserModePrivateData *pd;
+  /** The directory, in filename encoding. */
+  char *dir;
+  /** The opened directory, entries are looked up relative to it. */
+  int fd;
+  /** Length of the directory part of the row paths, including the '/'. */
+  gsize prefix_len;
+  /** If hidden files are listed. */
+  gboolean show_hidden;
+  /** Names and paths of the rows, only the reading thread adds to it. */
+  rofi_string_arena *arena;
+  /**
+   * Pool resolving and sorting the blocks, owned by the reading thread. It is
+   * separate from the shared worker pool, that drops its queued jobs when the
+   * page changes.
+   */
+  GThreadPool *pool;
+  /** Set when the rows are no longer wanted. */
+  gint cancelled;
+  /** Sorted #FBBlock waiting to be merged. */
+  GAsyncQueue *queue;
+  /** If an idle callback merging the queue is pending. */
+  gint merge_queued;
+};
+
+/**
+ * Block of rows read from the directory, resolved and sorted on a worker.
+ */
+typedef struct {
+  /** Reference to the listing, dropped when the block is queued. */
+  FBListing *listing;
+  /** Number of rows. */
+  unsigned int length;
+  /** The rows. */
+  FBFile rows[FB_BLOCK_SIZE];
+} FBBlock;
+
 /**
  * The sorting settings used in file-browser.
  */
@@ -125,11 +197,34 @@ struct {
     .show_hidden = FALSE,
 };
 
+static void fb_listing_clear(gpointer data) {
+  FBListing *l = (FBListing *)data;
+  if (l->fd >= 0) {
+    close(l->fd);
+  }
+  g_async_queue_unref(l->queue);
+  rofi_string_arena_free(l->arena);
+  g_free(l->dir);
+}
+
+static void fb_listing_release(gpointer data) {
+  g_atomic_rc_box_release_full(data, fb_listing_clear);
+}
+
+static void fb_block_free(gpointer data) {
+  FBBlock *b = (FBBlock *)data;
+  if (b->listing != NULL) {
+    fb_listing_release(b->listing);
+  }
+  g_free(b);
+}
+
 static void free_list(FileBrowserModePrivateData *pd) {
-  for (unsigned int i = 0; i < pd->array_length; i++) {
-    FBFile *fb = &(pd->array[i]);
-    g_free(fb->name);
-    g_free(fb->path);
+  if (pd->listing != NULL) {
+    // The strings of the rows are owned by the listing.
+    g_atomic_int_set(&(pd->listing->cancelled), TRUE);
+    fb_listing_release(pd->listing);
+    pd->listing = NULL;
   }
   g_free(pd->array);
   pd->array = NULL;
@@ -189,6 +284,7 @@ static gint compare(gconstpointer a, gconstpointer b, gpointer data) {
   return comparator(a, b, data);
 }
 
+#ifndef FB_USE_STATX
 static time_t get_time(const GStatBuf *statbuf) {
   switch (file_browser_config.sorting_time) {
   case FB_MTIME:
@@ -201,149 +297,405 @@ static time_t get_time(const GStatBuf *statbuf) {
     return 0;
   }
 }
+#endif
 
-static void set_time(FBFile *file) {
-  // GError *error = NULL;
-  //  gchar *path = g_filename_from_utf8(file->path, -1, NULL, NULL, &error);
-  //  if (error) {
-  //    g_warning("Failed to convert filename: %s: %s", file->path,
-  //    error->message); g_error_free(error); return;
-  //  }
-
+/**
+ * @param l The listing.
+ * @param f The row to look up, f->path points to the entry.
+ * @param follow If symbolic links are followed.
+ * @param mode Set to the file type and mode.
+ *
+ * Stat the entry relative to the directory of the listing. The time used for
+ * sorting is only asked for when sorting on time.
+ *
+ * @returns TRUE when successful.
+ */
+static gboolean fb_listing_stat(FBListing *l, FBFile *f, gboolean follow,
+                                mode_t *mode) {
+  const char *name = f->path + l->prefix_len;
+  gboolean sort_time = file_browser_config.sorting_method == FB_SORT_TIME;
+#ifdef FB_USE_STATX
+  struct statx stx;
+  unsigned int mask = STATX_TYPE;
+  if (sort_time) {
+    switch (file_browser_config.sorting_time) {
+    case FB_MTIME:
+      mask |= STATX_MTIME;
+      break;
+    case FB_ATIME:
+      mask |= STATX_ATIME;
+      break;
+    case FB_CTIME:
+      mask |= STATX_CTIME;
+      break;
+    default:
+      break;
+    }
+  }
+  if (statx(l->fd, name, follow ? 0 : AT_SYMLINK_NOFOLLOW, mask, &stx) != 0) {
+    return FALSE;
+  }
+  *mode = stx.stx_mode;
+  if (sort_time) {
+    switch (file_browser_config.sorting_time) {
+    case FB_MTIME:
+      f->time = stx.stx_mtime.tv_sec;
+      break;
+    case FB_ATIME:
+      f->time = stx.stx_atime.tv_sec;
+      break;
+    case FB_CTIME:
+      f->time = stx.stx_ctime.tv_sec;
+      break;
+    default:
+      f->time = 0;
+      break;
+    }
+  }
+#else
   GStatBuf statbuf;
+  if (fstatat(l->fd, name, &statbuf, follow ? 0 : AT_SYMLINK_NOFOLLOW) != 0) {
+    return FALSE;
+  }
+  *mode = statbuf.st_mode;
+  if (sort_time) {
+    f->time = get_time(&statbuf);
+  }
+#endif
+  return TRUE;
+}
 
-  if (g_lstat(file->path, &statbuf) == 0) {
-    file->time = get_time(&statbuf);
+/**
+ * @param l The listing.
+ * @param f The row to resolve.
+ *
+ * Find out what a link or an entry of unknown type points to, and the time
+ * used for sorting.
+ *
+ * @returns FALSE if the row should not be listed.
+ */
+static gboolean fb_listing_resolve(FBListing *l, FBFile *f) {
+  mode_t mode = 0;
+  if (f->type == FB_UNKNOWN) {
+    // The file system did not tell the type.
+    if (!fb_listing_stat(l, f, FALSE, &mode)) {
+      return FALSE;
+    }
+    if (S_ISLNK(mode)) {
+      f->link = TRUE;
+      f->type = RFILE;
+    } else if (S_ISDIR(mode)) {
+      f->type = DIRECTORY;
+      return TRUE;
+    } else if (S_ISREG(mode)) {
+      f->type = RFILE;
+      return TRUE;
+    } else {
+      return FALSE;
+    }
+  }
+  if (f->link) {
+    // If we have link, use a stat to find out what it is, if we fail, we
+    // mark it as file.
+    // TODO have a 'broken link' mode?
+    if (fb_listing_stat(l, f, TRUE, &mode)) {
+      if (S_ISDIR(mode)) {
+        f->type = DIRECTORY;
+      } else if (S_ISREG(mode)) {
+        f->type = RFILE;
+      }
+    } else {
+      g_warning("Failed to stat file: %s, %s", f->path, strerror(errno));
+    }
+  } else if (!fb_listing_stat(l, f, FALSE, &mode)) {
+    g_warning("Failed to stat file: %s, %s", f->path, strerror(errno));
+  }
+  return TRUE;
+}
+
+static gboolean fb_listing_merge_idle(gpointer data);
+
+static void fb_block_resolve(gpointer data, G_GNUC_UNUSED gpointer user_data) {
+  FBBlock *b = (FBBlock *)data;
+  FBListing *l = b->listing;
+  if (g_atomic_int_get(&(l->cancelled))) {
+    fb_block_free(b);
+    return;
+  }
+  gboolean sort_time = file_browser_config.sorting_method == FB_SORT_TIME;
+  unsigned int length = 0;
+  for (unsigned int i = 0; i < b->length; i++) {
+    FBFile *f = &(b->rows[i]);
+    if (f->type != UP && (sort_time || f->link || f->type == FB_UNKNOWN)) {
+      if (!fb_listing_resolve(l, f)) {
+        continue;
+      }
+    }
+    b->rows[length++] = *f;
+  }
+  b->length = length;
+  g_qsort_with_data(b->rows, b->length, sizeof(FBFile), compare, NULL);
+
+  // The queue is freed with the listing, so the block does not keep it alive.
+  b->listing = NULL;
+  g_async_queue_push(l->queue, b);
+  if (g_atomic_int_compare_and_exchange(&(l->merge_queued), FALSE, TRUE)) {
+    g_idle_add_full(G_PRIORITY_DEFAULT_IDLE, fb_listing_merge_idle,
+                    g_atomic_rc_box_acquire(l), fb_listing_release);
+  }
+  fb_listing_release(l);
+}
+
+/**
+ * @param l The listing.
+ * @param block The block to hand over, set to NULL.
+ *
+ * Resolve and sort the block on the pool of the listing.
+ */
+static void fb_listing_push(FBListing *l, FBBlock **block) {
+  if ((*block) == NULL) {
+    return;
+  }
+  FBBlock *b = *block;
+  *block = NULL;
+  b->listing = g_atomic_rc_box_acquire(l);
+  if (l->pool != NULL) {
+    g_thread_pool_push(l->pool, b, NULL);
   } else {
-    g_warning("Failed to stat file: %s, %s", file->path, strerror(errno));
+    fb_block_resolve(b, NULL);
   }
+}
 
-  //  g_free(path);
+/**
+ * @param l The listing.
+ * @param block The block being filled.
+ * @param path Buffer holding the directory followed by a '/'.
+ * @param d_name The name of the entry.
+ * @param d_type The type of the entry, as reported by the file system.
+ *
+ * Add a directory entry to the block, the strings go into the arena.
+ */
+static void fb_listing_add(FBListing *l, FBBlock **block, GString *path,
+                           const char *d_name, unsigned char d_type) {
+  enum FBFileType type = RFILE;
+  gboolean link = FALSE;
+  if (d_name[0] == '.') {
+    if (d_name[1] == '\0') {
+      return;
+    }
+    if (g_strcmp0(d_name, "..") == 0) {
+      type = UP;
+    } else if (l->show_hidden == FALSE) {
+      return;
+    }
+  }
+  if (type != UP) {
+    switch (d_type) {
+    case DT_REG:
+      type = RFILE;
+      break;
+    case DT_DIR:
+      type = DIRECTORY;
+      break;
+    case DT_LNK:
+      // Default to file.
+      type = RFILE;
+      link = TRUE;
+      break;
+    case DT_UNKNOWN:
+      type = FB_UNKNOWN;
+      break;
+    case DT_BLK:
+    case DT_CHR:
+    case DT_FIFO:
+    case DT_SOCK:
+    default:
+      return;
+    }
+  }
+
+  if ((*block) == NULL) {
+    (*block) = g_malloc(sizeof(FBBlock));
+    (*block)->length = 0;
+  }
+  FBFile *f = &((*block)->rows[(*block)->length]);
+  f->type = type;
+  f->link = link;
+  f->icon_fetch_uid = 0;
+  f->icon_fetch_size = 0;
+  if (type == UP) {
+    f->name = rofi_string_arena_add(l->arena, "..", -1);
+    f->path = NULL;
+    f->time = -1;
+  } else {
+    g_string_truncate(path, l->prefix_len);
+    g_string_append(path, d_name);
+    f->path = rofi_string_arena_add(l->arena, path->str, path->len);
+    f->time = 0;
+    // Rofi expects utf-8, so lets convert the filename. In the common case
+    // the name is valid utf-8 and shares the string with the path.
+    gsize len = path->len - l->prefix_len;
+    if (g_get_filename_charsets(NULL) &&
+        g_utf8_validate(d_name, len, NULL)) {
+      f->name = f->path + l->prefix_len;
+    } else {
+      char *name = g_filename_to_utf8(d_name, len, NULL, NULL, NULL);
+      if (name != NULL) {
+        f->name = rofi_string_arena_add(l->arena, name, -1);
+        g_free(name);
+      } else {
+        f->name = rofi_string_arena_add_utf8(l->arena, d_name, len);
+      }
+    }
+  }
+  (*block)->length++;
+  if ((*block)->length == FB_BLOCK_SIZE) {
+    fb_listing_push(l, block);
+  }
 }
 
-inline static void fb_resize_array(FileBrowserModePrivateData *pd) {
-  if ((pd->array_length + 1) > pd->array_length_real) {
-    pd->array_length_real += 256;
+#ifdef FB_USE_GETDENTS
+/** Directory entry as returned by getdents64. */
+struct fb_dirent64 {
+  uint64_t d_ino;
+  int64_t d_off;
+  unsigned short d_reclen;
+  unsigned char d_type;
+  char d_name[];
+};
+#endif
+
+static gpointer fb_listing_thread(gpointer data) {
+  FBListing *l = (FBListing *)data;
+  FBBlock *block = NULL;
+  GString *path = g_string_new(l->dir);
+  if (path->len == 0 || path->str[path->len - 1] != G_DIR_SEPARATOR) {
+    g_string_append_c(path, G_DIR_SEPARATOR);
+  }
+  l->prefix_len = path->len;
+  l->pool = g_thread_pool_new(fb_block_resolve, NULL, MAX(1, config.threads),
+                              FALSE, NULL);
+
+  GTimer *t = g_timer_new();
+#ifdef FB_USE_GETDENTS
+  // Read the entries in large batches, without the per entry overhead of
+  // readdir.
+  char *buf = g_malloc(FB_READ_SIZE);
+  long nread = 0;
+  while (!g_atomic_int_get(&(l->cancelled)) &&
+         (nread = syscall(SYS_getdents64, l->fd, buf, FB_READ_SIZE)) > 0) {
+    for (long off = 0; off < nread;) {
+      struct fb_dirent64 *d = (struct fb_dirent64 *)(buf + off);
+      fb_listing_add(l, &block, path, d->d_name, d->d_type);
+      off += d->d_reclen;
+    }
+    // Show what is read so far.
+    fb_listing_push(l, &block);
+  }
+  if (nread < 0) {
+    g_warning("Failed to read directory: %s, %s", l->dir, strerror(errno));
+  }
+  g_free(buf);
+#else
+  int fd = dup(l->fd);
+  DIR *dir = fd >= 0 ? fdopendir(fd) : NULL;
+  if (dir) {
+    struct dirent *rd = NULL;
+    while (!g_atomic_int_get(&(l->cancelled)) && (rd = readdir(dir)) != NULL) {
+      fb_listing_add(l, &block, path, rd->d_name, rd->d_type);
+    }
+    closedir(dir);
+  } else if (fd >= 0) {
+    close(fd);
+  }
+#endif
+  fb_listing_push(l, &block);
+  if (l->pool != NULL) {
+    // Wait for the queued blocks, they are dropped when cancelled.
+    g_thread_pool_free(l->pool, FALSE, TRUE);
+    l->pool = NULL;
+  }
+  g_debug("Read directory %s: %f", l->dir, g_timer_elapsed(t, NULL));
+  g_timer_destroy(t);
+  g_string_free(path, TRUE);
+  fb_listing_release(l);
+  return NULL;
+}
+
+/**
+ * @param pd The mode data.
+ * @param b The sorted block.
+ *
+ * Merge the rows of the block into the sorted rows.
+ */
+static void fb_merge_block(FileBrowserModePrivateData *pd, FBBlock *b) {
+  if ((pd->array_length + b->length + 1) > pd->array_length_real) {
+    pd->array_length_real =
+        MAX(pd->array_length_real * 2, pd->array_length + b->length + 256);
     pd->array =
         g_realloc(pd->array, (pd->array_length_real + 1) * sizeof(FBFile));
   }
+  // Merge from the back, so no rows have to be moved twice.
+  unsigned int i = pd->array_length;
+  unsigned int j = b->length;
+  unsigned int k = i + j;
+  while (j > 0) {
+    if (i > 0 && compare(&(pd->array[i - 1]), &(b->rows[j - 1]), NULL) > 0) {
+      pd->array[--k] = pd->array[--i];
+    } else {
+      pd->array[--k] = b->rows[--j];
+    }
+  }
+  pd->array_length += b->length;
+}
+
+static gboolean fb_listing_merge_idle(gpointer data) {
+  FBListing *l = (FBListing *)data;
+  g_atomic_int_set(&(l->merge_queued), FALSE);
+  if (g_atomic_int_get(&(l->cancelled))) {
+    return G_SOURCE_REMOVE;
+  }
+  FileBrowserModePrivateData *pd = l->pd;
+  FBBlock *b = NULL;
+  gboolean changed = FALSE;
+  while ((b = g_async_queue_try_pop(l->queue)) != NULL) {
+    if (!changed) {
+      // The filter reads array, stop it before it moves.
+      rofi_view_cancel_filter();
+    }
+    fb_merge_block(pd, b);
+    fb_block_free(b);
+    changed = TRUE;
+  }
+  if (changed) {
+    rofi_view_reload();
+  }
+  return G_SOURCE_REMOVE;
 }
 
 static void get_file_browser(Mode *sw) {
   FileBrowserModePrivateData *pd =
       (FileBrowserModePrivateData *)mode_get_private_data(sw);
   /**
-   * Get the entries to display.
-   * this gets called on plugin initialization.
+   * Start reading the entries to display, they are added to the view as they
+   * come in.
    */
   char *cdir = g_file_get_path(pd->current_dir);
-  DIR *dir = opendir(cdir);
-  if (dir) {
-    struct dirent *rd = NULL;
-    while ((rd = readdir(dir)) != NULL) {
-      if (g_strcmp0(rd->d_name, "..") == 0) {
-        fb_resize_array(pd);
-        // Rofi expects utf-8, so lets convert the filename.
-        pd->array[pd->array_length].name = g_strdup("..");
-        pd->array[pd->array_length].path = NULL;
-        pd->array[pd->array_length].type = UP;
-        pd->array[pd->array_length].icon_fetch_uid = 0;
-        pd->array[pd->array_length].icon_fetch_size = 0;
-        pd->array[pd->array_length].link = FALSE;
-        pd->array[pd->array_length].time = -1;
-        pd->array_length++;
-        continue;
-      }
-      if (g_strcmp0(rd->d_name, ".") == 0) {
-        continue;
-      }
-      if (rd->d_name[0] == '.' && file_browser_config.show_hidden == FALSE) {
-        continue;
-      }
-
-      switch (rd->d_type) {
-      case DT_BLK:
-      case DT_CHR:
-      case DT_FIFO:
-      case DT_UNKNOWN:
-      case DT_SOCK:
-      default:
-        break;
-      case DT_REG:
-      case DT_DIR:
-        fb_resize_array(pd);
-        // Rofi expects utf-8, so lets convert the filename.
-        pd->array[pd->array_length].name =
-            g_filename_to_utf8(rd->d_name, -1, NULL, NULL, NULL);
-        if (pd->array[pd->array_length].name == NULL) {
-          pd->array[pd->array_length].name = rofi_force_utf8(rd->d_name, -1);
-        }
-        pd->array[pd->array_length].path =
-            g_build_filename(cdir, rd->d_name, NULL);
-        pd->array[pd->array_length].type =
-            (rd->d_type == DT_DIR) ? DIRECTORY : RFILE;
-        pd->array[pd->array_length].icon_fetch_uid = 0;
-        pd->array[pd->array_length].icon_fetch_size = 0;
-        pd->array[pd->array_length].link = FALSE;
-
-        if (file_browser_config.sorting_method == FB_SORT_TIME) {
-          set_time(&pd->array[pd->array_length]);
-        }
-
-        pd->array_length++;
-        break;
-      case DT_LNK:
-        fb_resize_array(pd);
-        // Rofi expects utf-8, so lets convert the filename.
-        pd->array[pd->array_length].name =
-            g_filename_to_utf8(rd->d_name, -1, NULL, NULL, NULL);
-        if (pd->array[pd->array_length].name == NULL) {
-          pd->array[pd->array_length].name = rofi_force_utf8(rd->d_name, -1);
-        }
-        pd->array[pd->array_length].path =
-            g_build_filename(cdir, rd->d_name, NULL);
-        pd->array[pd->array_length].icon_fetch_uid = 0;
-        pd->array[pd->array_length].icon_fetch_size = 0;
-        pd->array[pd->array_length].link = TRUE;
-        // Default to file.
-        pd->array[pd->array_length].type = RFILE;
-        {
-          // If we have link, use a stat to fine out what it is, if we fail, we
-          // mark it as file.
-          // TODO have a 'broken link' mode?
-          // Convert full path to right encoding.
-          // DD: Path should be in file encoding, not utf-8
-          //          char *file =
-          //          g_filename_from_utf8(pd->array[pd->array_length].path,
-          //                                            -1, NULL, NULL, NULL);
-          if (pd->array[pd->array_length].path) {
-            GStatBuf statbuf;
-            if (g_stat(pd->array[pd->array_length].path, &statbuf) == 0) {
-              if (S_ISDIR(statbuf.st_mode)) {
-                pd->array[pd->array_length].type = DIRECTORY;
-              } else if (S_ISREG(statbuf.st_mode)) {
-                pd->array[pd->array_length].type = RFILE;
-              }
-
-              if (file_browser_config.sorting_method == FB_SORT_TIME) {
-                pd->array[pd->array_length].time = get_time(&statbuf);
-              }
-            } else {
-              g_warning("Failed to stat file: %s, %s",
-                        pd->array[pd->array_length].path, strerror(errno));
-            }
-
-            //            g_free(file);
-          }
-        }
-        pd->array_length++;
-        break;
-      }
-    }
-    closedir(dir);
+  int fd = cdir ? open(cdir, O_RDONLY | O_DIRECTORY | O_CLOEXEC) : -1;
+  if (fd < 0) {
+    g_free(cdir);
+    return;
   }
-  g_free(cdir);
-  g_qsort_with_data(pd->array, pd->array_length, sizeof(FBFile), compare, NULL);
+  FBListing *l = g_atomic_rc_box_new0(FBListing);
+  l->pd = pd;
+  l->dir = cdir;
+  l->fd = fd;
+  l->show_hidden = file_browser_config.show_hidden;
+  l->arena = rofi_string_arena_new();
+  l->queue = g_async_queue_new_full(fb_block_free);
+  pd->listing = l;
+  g_thread_unref(g_thread_new("filebrowser-read", fb_listing_thread,
+                              g_atomic_rc_box_acquire(l)));
 }
 
 static void file_browser_mode_init_config(Mode *sw) {
@@ -35,8 +35,10 @@
 #include <unistd.h>
 
 #include <dirent.h>
+#include <fcntl.h>
 #include <glib-unix.h>
 #include <glib/gstdio.h>
+#include <sys/mman.h>
 #include <sys/stat.h>
 #include <sys/types.h>
 
@@ -46,7 +48,9 @@
 #include "mode.h"
 #include "modes/recursivebrowser.h"
 #include "rofi.h"
+#include "settings.h"
 #include "theme.h"
+#include "timings.h"
 
 #include <stdint.h>
 
@@ -54,6 +58,8 @@
 
 /** The default program used to open the file. */
 #define DEFAULT_OPEN "xdg-open"
+/** Name of the file holding the index of the scanned tree. */
+#define RB_INDEX_FILE "rofi-recursivebrowser.index"
 
 /**
  * The internal data structure holding the private data of the TEST Mode.
@@ -77,6 +83,8 @@ typedef struct {
   time_t time;
 } FBFile;
 
+typedef struct _RBIndex RBIndex;
+
 typedef struct {
   char *command;
   GFile *current_dir;
@@ -84,21 +92,47 @@ typedef struct {
   unsigned int array_length;
   unsigned int array_length_real;
 
+  /** Strings of the entries, filled by the scanning threads. */
+  rofi_string_arena *arena;
+
   GThread *reading_thread;
   GAsyncQueue *async_queue;
   guint wake_source;
   guint end_thread;
+  /** If the main thread is woken up to take the queued blocks. */
+  gint wake_queued;
   gboolean loading;
   int pipefd2[2];
   GRegex *filter_regex;
+  /** Patterns of entries that are not listed or descended into. */
+  char **exclude_patterns;
+  /** The compiled exclude_patterns. */
+  GPatternSpec **exclude;
+  /** If the exclude pattern matches the path instead of the name. */
+  gboolean *exclude_path;
+  unsigned int num_exclude;
+  /** Number of files found by the last scan. */
+  unsigned int num_scanned;
+
+  /** Path of the index file, NULL if the index is not used. */
+  char *index_file;
+  /** The settings the index has to match. */
+  char *index_settings;
+  /** The index of the last scan, NULL if there is none. */
+  RBIndex *index;
 } FileBrowserModePrivateData;
 
+/** Maximum number of files a scanning thread hands over at once. */
+#define BLOCK_SIZE 1024
+typedef struct {
+  unsigned int length;
+  /** Paths of the files to remove, NULL if none. Directories end in a '/'. */
+  GPtrArray *removed;
+  FBFile values[BLOCK_SIZE];
+} Block;
+
 static void free_list(FileBrowserModePrivateData *pd) {
-  for (unsigned int i = 0; i < pd->array_length; i++) {
-    FBFile *fb = &(pd->array[i]);
-    g_free(fb->name);
-    g_free(fb->path);
-  }
+  // The strings are owned by the arena.
   g_free(pd->array);
   pd->array = NULL;
   pd->array_length = 0;
@@ -107,14 +141,6 @@ static void free_list(FileBrowserModePrivateData *pd) {
 #include <dirent.h>
 #include <sys/types.h>
 
-inline static void fb_resize_array(FileBrowserModePrivateData *pd) {
-  if ((pd->array_length + 1) > pd->array_length_real) {
-    pd->array_length_real += 10240;
-    pd->array =
-        g_realloc(pd->array, (pd->array_length_real + 1) * sizeof(FBFile));
-  }
-}
-
 static void recursive_browser_mode_init_config(Mode *sw) {
   FileBrowserModePrivateData *pd =
       (FileBrowserModePrivateData *)mode_get_private_data(sw);
@@ -144,12 +170,34 @@ static void recursive_browser_mode_init_config(Mode *sw) {
     g_debug("compile default regex\n");
     pd->filter_regex = g_regex_new("^(\\..*)", G_REGEX_OPTIMIZE, 0, NULL);
   }
+  p = rofi_theme_find_property(wid, P_LIST, "exclude", TRUE);
+  if (p != NULL && p->type == P_LIST) {
+    pd->exclude_patterns =
+        g_malloc0_n(g_list_length(p->value.list) + 1, sizeof(char *));
+    pd->exclude = g_malloc0_n(g_list_length(p->value.list) + 1,
+                              sizeof(GPatternSpec *));
+    pd->exclude_path = g_malloc0_n(g_list_length(p->value.list) + 1,
+                                   sizeof(gboolean));
+    for (GList *iter = p->value.list; iter != NULL; iter = g_list_next(iter)) {
+      Property *p2 = (Property *)iter->data;
+      if (p2->type == P_STRING && p2->value.s[0] != '\0') {
+        pd->exclude_patterns[pd->num_exclude] = g_strdup(p2->value.s);
+        pd->exclude_path[pd->num_exclude] =
+            strchr(p2->value.s, G_DIR_SEPARATOR) != NULL;
+        pd->exclude[pd->num_exclude++] = g_pattern_spec_new(p2->value.s);
+      }
+    }
+  }
   p = rofi_theme_find_property(wid, P_STRING, "command", TRUE);
   if (p != NULL && p->type == P_STRING) {
     pd->command = g_strdup(p->value.s);
   } else {
     pd->command = g_strdup(DEFAULT_OPEN);
   }
+  p = rofi_theme_find_property(wid, P_BOOLEAN, "index", TRUE);
+  if (p == NULL || p->type != P_BOOLEAN || p->value.b) {
+    pd->index_file = g_build_filename(cache_dir, RB_INDEX_FILE, NULL);
+  }
 
   if (found_error) {
     rofi_view_error_dialog(msg, FALSE);
@@ -177,149 +225,964 @@ static void recursive_browser_mode_init_current_dir(Mode *sw) {
   }
 }
 
-static void scan_dir(FileBrowserModePrivateData *pd, GFile *path) {
-  GQueue *dirs_to_scan = g_queue_new();
-  g_queue_push_tail(dirs_to_scan, g_object_ref(path));
-  GFile *dir_to_scan = NULL;
-  while ((dir_to_scan = g_queue_pop_head(dirs_to_scan)) != NULL) {
-    char *cdir = g_file_get_path(dir_to_scan);
-    DIR *dir = opendir(cdir);
-    g_object_unref(dir_to_scan);
-    if (dir) {
-      struct dirent *rd = NULL;
-      while (pd->end_thread == FALSE && (rd = readdir(dir)) != NULL) {
-        if (g_strcmp0(rd->d_name, "..") == 0) {
-          continue;
-        }
-        if (g_strcmp0(rd->d_name, ".") == 0) {
-          continue;
-        }
-        if (pd->filter_regex &&
-            g_regex_match(pd->filter_regex, rd->d_name, 0, NULL)) {
-          continue;
-        }
-        switch (rd->d_type) {
-        case DT_BLK:
-        case DT_CHR:
-        case DT_FIFO:
-        case DT_SOCK:
-        default:
-          break;
-        case DT_REG: {
-          FBFile *f = g_malloc0(sizeof(FBFile));
-          // Rofi expects utf-8, so lets convert the filename.
-          f->path = g_build_filename(cdir, rd->d_name, NULL);
-          f->name = g_filename_to_utf8(f->path, -1, NULL, NULL, NULL);
-          if (f->name == NULL) {
-            f->name = rofi_force_utf8(rd->d_name, -1);
-          }
-          if (f->name == NULL) {
-            f->name = g_strdup("n/a");
-          }
-          f->type = (rd->d_type == DT_DIR) ? DIRECTORY : RFILE;
-          f->icon_fetch_uid = 0;
-          f->icon_fetch_size = 0;
-          f->link = FALSE;
-
-          g_async_queue_push(pd->async_queue, f);
-          if (g_async_queue_length(pd->async_queue) > 10000) {
-            write(pd->pipefd2[1], "r", 1);
+/*******************************************
+ * Index                                   *
+ *******************************************/
+
+/** Bump when the layout of the index changes. */
+#define RB_INDEX_VERSION 1
+/** Magic number at the start of the index. */
+#define RB_INDEX_MAGIC 0x58494252u
+/** Index of a missing directory. */
+#define RB_INDEX_NULL UINT32_MAX
+/** The file is a symbolic link. */
+#define RB_INDEX_FILE_LINK 1u
+
+/**
+ * The index is a tree of the scanned directories. It holds, in host byte
+ * order, the header, the directories, the files and the string table.
+ * A directory refers to its parent, that comes before it, and stores its
+ * name and the range of its files. The first directory is the root, its name
+ * is the full path. Names are offsets in the string table.
+ */
+typedef struct {
+  uint32_t magic;
+  uint32_t version;
+  /** Number of directories. */
+  uint32_t num_dirs;
+  /** Number of files. */
+  uint32_t num_files;
+  /** Settings the tree was scanned with, see rb_index_settings. */
+  uint32_t settings;
+  /** Unused, avoids padding. */
+  uint32_t reserved;
+  /** Size of the string table. */
+  uint64_t strings_size;
+} RBIndexHeader;
+
+/** A directory in the index. */
+typedef struct {
+  uint32_t parent;
+  uint32_t name;
+  uint32_t first_file;
+  uint32_t num_files;
+  int64_t mtime_sec;
+  int64_t mtime_nsec;
+} RBIndexDir;
+
+/** A file in the index. */
+typedef struct {
+  uint32_t name;
+  /** RB_INDEX_FILE_ flags. */
+  uint32_t flags;
+} RBIndexFile;
+
+/**
+ * The mapped index, the scan compares the directories against it.
+ */
+struct _RBIndex {
+  char *map;
+  gsize map_size;
+  const RBIndexHeader *header;
+  const RBIndexDir *dirs;
+  const RBIndexFile *files;
+  const char *strings;
+  /** First child of each directory, RB_INDEX_NULL if none. */
+  uint32_t *first_child;
+  /** Next child of the parent of each directory. */
+  uint32_t *next_sibling;
+  /** Paths of the directories, owned by the mode arena. */
+  const char **dir_paths;
+};
+
+/**
+ * @param pd The mode data.
+ *
+ * Everything besides the directory content the rows depend on.
+ *
+ * @returns the settings key, free with g_free.
+ */
+static char *rb_index_settings(FileBrowserModePrivateData *pd) {
+  GString *str = g_string_new(NULL);
+  char *root = g_file_get_path(pd->current_dir);
+  g_string_append(str, root ? root : "");
+  g_free(root);
+  g_string_append_c(str, '\x1f');
+  if (pd->filter_regex) {
+    g_string_append(str, g_regex_get_pattern(pd->filter_regex));
+  }
+  for (unsigned int i = 0; i < pd->num_exclude; i++) {
+    g_string_append_c(str, '\x1f');
+    g_string_append(str, pd->exclude_patterns[i]);
+  }
+  return g_string_free(str, FALSE);
+}
+
+/**
+ * @param path Buffer to add to.
+ * @param dir The directory.
+ * @param name The name of the entry in it.
+ *
+ * Set path to the path of the entry, the same way the scan builds them.
+ */
+static void rb_build_path(GString *path, const char *dir, const char *name) {
+  g_string_assign(path, dir);
+  if (path->len == 0 || path->str[path->len - 1] != G_DIR_SEPARATOR) {
+    g_string_append_c(path, G_DIR_SEPARATOR);
+  }
+  g_string_append(path, name);
+}
+
+/**
+ * @param f The row to fill.
+ * @param arena The arena the strings are allocated from.
+ * @param path The path of the file.
+ * @param len The length of path.
+ * @param link If the file is a link.
+ */
+static void rb_file_init(FBFile *f, rofi_string_arena *arena,
+                         const char *path, gsize len, gboolean link) {
+  f->path = rofi_string_arena_add(arena, path, len);
+  // Rofi expects utf-8, so lets convert the filename. In the common case it
+  // is valid and the name shares the string with the path.
+  if (g_get_filename_charsets(NULL) && g_utf8_validate(path, len, NULL)) {
+    f->name = f->path;
+  } else {
+    char *name = g_filename_to_utf8(path, len, NULL, NULL, NULL);
+    if (name != NULL) {
+      f->name = rofi_string_arena_add(arena, name, -1);
+      g_free(name);
+    } else {
+      f->name = rofi_string_arena_add_utf8(arena, path, len);
+    }
+  }
+  f->type = RFILE;
+  f->icon_fetch_uid = 0;
+  f->icon_fetch_size = 0;
+  f->link = link;
+  f->time = 0;
+}
+
+static void rb_index_free(RBIndex *index) {
+  if (index == NULL) {
+    return;
+  }
+  munmap(index->map, index->map_size);
+  g_free(index->first_child);
+  g_free(index->next_sibling);
+  g_free(index->dir_paths);
+  g_free(index);
+}
+
+/**
+ * @param map The mapped index.
+ * @param size The size of the mapping.
+ * @param settings The current settings key.
+ *
+ * Check that all offsets are within the file, and that the settings match.
+ *
+ * @returns TRUE if the index can be used.
+ */
+static gboolean rb_index_validate(const char *map, gsize size,
+                                  const char *settings) {
+  const RBIndexHeader *header = (const RBIndexHeader *)map;
+  if (header->magic != RB_INDEX_MAGIC) {
+    g_warning("Index corrupt, ignoring.");
+    return FALSE;
+  }
+  if (header->version != RB_INDEX_VERSION) {
+    g_debug("Index file wrong version, ignoring.");
+    return FALSE;
+  }
+  guint64 expected = sizeof(RBIndexHeader) +
+                     (guint64)header->num_dirs * sizeof(RBIndexDir) +
+                     (guint64)header->num_files * sizeof(RBIndexFile) +
+                     header->strings_size;
+  if (expected != size || header->num_dirs == 0 ||
+      header->strings_size == 0 || header->strings_size > RB_INDEX_NULL) {
+    g_warning("Index corrupt, ignoring.");
+    return FALSE;
+  }
+  const RBIndexDir *dirs = (const RBIndexDir *)(header + 1);
+  const RBIndexFile *files = (const RBIndexFile *)(dirs + header->num_dirs);
+  const char *strings = (const char *)(files + header->num_files);
+  // The last string is terminated, so every offset below is a valid string.
+  if (strings[header->strings_size - 1] != '\0') {
+    g_warning("Index corrupt, ignoring.");
+    return FALSE;
+  }
+  for (uint32_t i = 0; i < header->num_dirs; i++) {
+    const RBIndexDir *d = &(dirs[i]);
+    gboolean parent_ok = (i == 0) ? (d->parent == RB_INDEX_NULL)
+                                  : (d->parent < i);
+    if (!parent_ok || d->name >= header->strings_size ||
+        (guint64)d->first_file + d->num_files > header->num_files) {
+      g_warning("Index corrupt, ignoring.");
+      return FALSE;
+    }
+  }
+  for (uint32_t i = 0; i < header->num_files; i++) {
+    if (files[i].name >= header->strings_size) {
+      g_warning("Index corrupt, ignoring.");
+      return FALSE;
+    }
+  }
+  if (header->settings >= header->strings_size ||
+      g_strcmp0(strings + header->settings, settings) != 0) {
+    g_debug("Settings changed, rescanning the tree.");
+    return FALSE;
+  }
+  return TRUE;
+}
+
+/**
+ * @param pd The mode data.
+ *
+ * Load the index of the last scan, and show its files. The scan then only
+ * reads the directories that changed since.
+ */
+static void rb_index_read(FileBrowserModePrivateData *pd) {
+  if (pd->index_file == NULL) {
+    return;
+  }
+  TICK_N("RecursiveBrowser Read Index: start");
+  int fd = open(pd->index_file, O_RDONLY | O_CLOEXEC);
+  if (fd < 0) {
+    TICK_N("RecursiveBrowser Read Index: stop");
+    return;
+  }
+  struct stat st;
+  char *map = MAP_FAILED;
+  if (fstat(fd, &st) == 0 && st.st_size >= (off_t)sizeof(RBIndexHeader)) {
+    map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  }
+  close(fd);
+  if (map == MAP_FAILED) {
+    g_warning("Index corrupt, ignoring.");
+    TICK_N("RecursiveBrowser Read Index: stop");
+    return;
+  }
+  if (!rb_index_validate(map, st.st_size, pd->index_settings)) {
+    munmap(map, st.st_size);
+    TICK_N("RecursiveBrowser Read Index: stop");
+    return;
+  }
+  RBIndex *index = g_malloc0(sizeof(RBIndex));
+  index->map = map;
+  index->map_size = st.st_size;
+  index->header = (const RBIndexHeader *)map;
+  index->dirs = (const RBIndexDir *)(index->header + 1);
+  index->files = (const RBIndexFile *)(index->dirs + index->header->num_dirs);
+  index->strings =
+      (const char *)(index->files + index->header->num_files);
+
+  uint32_t num_dirs = index->header->num_dirs;
+  index->first_child = g_malloc_n(num_dirs, sizeof(uint32_t));
+  index->next_sibling = g_malloc_n(num_dirs, sizeof(uint32_t));
+  index->dir_paths = g_malloc_n(num_dirs, sizeof(char *));
+  for (uint32_t i = 0; i < num_dirs; i++) {
+    index->first_child[i] = RB_INDEX_NULL;
+    index->next_sibling[i] = RB_INDEX_NULL;
+  }
+
+  pd->array_length_real = index->header->num_files;
+  pd->array = g_malloc_n(pd->array_length_real + 1, sizeof(FBFile));
+  GString *path = g_string_new(NULL);
+  // Parents come first, so their path is known.
+  for (uint32_t i = 0; i < num_dirs; i++) {
+    const RBIndexDir *d = &(index->dirs[i]);
+    const char *name = index->strings + d->name;
+    if (i == 0) {
+      index->dir_paths[i] = rofi_string_arena_add(pd->arena, name, -1);
+    } else {
+      rb_build_path(path, index->dir_paths[d->parent], name);
+      index->dir_paths[i] =
+          rofi_string_arena_add(pd->arena, path->str, path->len);
+    }
+    for (uint32_t j = d->first_file; j < d->first_file + d->num_files; j++) {
+      const RBIndexFile *f = &(index->files[j]);
+      rb_build_path(path, index->dir_paths[i], index->strings + f->name);
+      rb_file_init(&(pd->array[pd->array_length++]), pd->arena, path->str,
+                   path->len, (f->flags & RB_INDEX_FILE_LINK) != 0);
+    }
+  }
+  // Build the child lists backwards, so the children keep their order.
+  for (uint32_t i = num_dirs - 1; i > 0; i--) {
+    uint32_t parent = index->dirs[i].parent;
+    index->next_sibling[i] = index->first_child[parent];
+    index->first_child[parent] = i;
+  }
+  g_string_free(path, TRUE);
+  pd->index = index;
+  g_debug("Loaded %u files in %u directories from the index.",
+          index->header->num_files, num_dirs);
+  TICK_N("RecursiveBrowser Read Index: stop");
+}
+
+/*******************************************
+ * Scan                                    *
+ *******************************************/
+
+/**
+ * Directory identity, to not scan a directory twice when links loop.
+ */
+typedef struct {
+  dev_t dev;
+  ino_t ino;
+} RBDirId;
+
+static guint rb_dir_id_hash(gconstpointer key) {
+  const RBDirId *id = (const RBDirId *)key;
+  return (guint)((guint64)id->ino ^ ((guint64)id->ino >> 32)) ^ (guint)id->dev;
+}
+
+static gboolean rb_dir_id_equal(gconstpointer a, gconstpointer b) {
+  const RBDirId *ia = (const RBDirId *)a;
+  const RBDirId *ib = (const RBDirId *)b;
+  return ia->dev == ib->dev && ia->ino == ib->ino;
+}
+
+/** A directory waiting to be scanned. */
+typedef struct {
+  /** Path, in filename encoding. */
+  char *path;
+  /** Index of the parent in the scanned tree, RB_INDEX_NULL for the root. */
+  uint32_t parent;
+  /** Index of the directory in the loaded index, RB_INDEX_NULL if new. */
+  uint32_t cached;
+} RBQueuedDir;
+
+/** A file in a scanned directory. */
+typedef struct {
+  /** Name, owned by an arena or the index. */
+  const char *name;
+  /** RB_INDEX_FILE_ flags. */
+  uint32_t flags;
+} RBScanFile;
+
+/** A scanned directory, kept to write the index. */
+typedef struct {
+  /** Name, the full path for the root. */
+  char *name;
+  /** Index of the parent in the scanned tree. */
+  uint32_t parent;
+  int64_t mtime_sec;
+  int64_t mtime_nsec;
+  /** Index in the loaded index if unchanged, its files are used. */
+  uint32_t cached;
+  /** #RBScanFile in the directory, NULL if unchanged. */
+  GArray *files;
+} RBScanDir;
+
+static void rb_queued_dir_free(RBQueuedDir *q) {
+  g_free(q->path);
+  g_free(q);
+}
+
+static void rb_scan_dir_free(RBScanDir *d) {
+  g_free(d->name);
+  if (d->files) {
+    g_array_free(d->files, TRUE);
+  }
+  g_free(d);
+}
+
+/**
+ * State shared by the threads scanning the tree.
+ * The threads take directories from a shared queue, and queue the
+ * directories they find in it.
+ */
+typedef struct {
+  FileBrowserModePrivateData *pd;
+  /** The index of the last scan, NULL if there is none. */
+  const RBIndex *index;
+  /** Protects dirs, busy, seen and tree. */
+  GMutex mutex;
+  /** Signalled when directories are queued or the scan is done. */
+  GCond cond;
+  /** #RBQueuedDir to scan. */
+  GQueue dirs;
+  /** Number of threads scanning a directory. */
+  unsigned int busy;
+  /** #RBDirId of the directories scanned. */
+  GHashTable *seen;
+  /** #RBScanDir scanned, parents come before their children. */
+  GPtrArray *tree;
+  /** Length of the path of the root directory, including the '/'. */
+  gsize root_len;
+  /** Number of files found. */
+  gint num_files;
+  /** Number of directories read. */
+  gint num_dirs;
+  /** If a directory differs from the index. */
+  gint changed;
+} RBScan;
+
+/**
+ * State of one scanning thread.
+ */
+typedef struct {
+  RBScan *scan;
+  /** Strings of the files this thread found. */
+  rofi_string_arena *arena;
+  /** Files not yet handed to the main thread. */
+  Block *block;
+  /** Time since the last block was handed over. */
+  GTimer *timer;
+  /** #RBQueuedDir found in the directory being scanned. */
+  GPtrArray *found;
+} RBScanWorker;
+
+/**
+ * @param pd The mode data.
+ * @param name The name of the entry.
+ * @param path The path of the entry.
+ * @param root_len Length of the path of the root directory.
+ *
+ * Check the entry against the filter regex and the exclude patterns. This
+ * is done before a directory is descended into.
+ *
+ * @returns TRUE if the entry is excluded.
+ */
+static gboolean rb_is_excluded(FileBrowserModePrivateData *pd,
+                               const char *name, const char *path,
+                               gsize root_len) {
+  if (pd->filter_regex && g_regex_match(pd->filter_regex, name, 0, NULL)) {
+    return TRUE;
+  }
+  for (unsigned int i = 0; i < pd->num_exclude; i++) {
+    // Patterns with a '/' match the path relative to the root.
+    const char *str = pd->exclude_path[i] ? path + root_len : name;
+    if (g_pattern_spec_match_string(pd->exclude[i], str)) {
+      return TRUE;
+    }
+  }
+  return FALSE;
+}
+
+static Block *rb_scan_block(RBScanWorker *w) {
+  if (w->block == NULL) {
+    w->block = g_malloc(sizeof(Block));
+    w->block->length = 0;
+    w->block->removed = NULL;
+  }
+  return w->block;
+}
+
+/**
+ * @param w The scanning thread.
+ *
+ * Hand the collected files to the main thread.
+ */
+static void rb_scan_flush(RBScanWorker *w) {
+  FileBrowserModePrivateData *pd = w->scan->pd;
+  if (w->block == NULL) {
+    return;
+  }
+  g_atomic_int_add(&(w->scan->num_files), w->block->length);
+  g_async_queue_push(pd->async_queue, w->block);
+  w->block = NULL;
+  g_timer_start(w->timer);
+  // One wake up is enough for all blocks queued before it is handled.
+  if (g_atomic_int_compare_and_exchange(&(pd->wake_queued), FALSE, TRUE)) {
+    write(pd->pipefd2[1], "r", 1);
+  }
+}
+
+/**
+ * @param w The scanning thread.
+ * @param path The path of the file.
+ * @param len The length of path.
+ * @param dir_len The length of the directory part of path.
+ * @param link If the file is a link.
+ *
+ * Add a file to the view.
+ *
+ * @returns the name of the file, owned by the arena.
+ */
+static const char *rb_scan_add_file(RBScanWorker *w, const char *path,
+                                    gsize len, gsize dir_len, gboolean link) {
+  Block *block = rb_scan_block(w);
+  FBFile *f = &(block->values[block->length]);
+  rb_file_init(f, w->arena, path, len, link);
+  const char *name = f->path + dir_len;
+  block->length++;
+  if (block->length == BLOCK_SIZE || g_timer_elapsed(w->timer, NULL) >= 0.1) {
+    rb_scan_flush(w);
+  }
+  return name;
+}
+
+/**
+ * @param w The scanning thread.
+ * @param path The path of the removed file, directories end in a '/'.
+ *
+ * Remove the file, or everything below the directory, from the view.
+ */
+static void rb_scan_remove(RBScanWorker *w, char *path) {
+  Block *block = rb_scan_block(w);
+  if (block->removed == NULL) {
+    block->removed = g_ptr_array_new_with_free_func(g_free);
+  }
+  g_ptr_array_add(block->removed, path);
+}
+
+/**
+ * @param w The scanning thread.
+ * @param path The path of the directory.
+ * @param parent The index of the directory in the scanned tree.
+ * @param cached The index of the directory in the loaded index.
+ *
+ * Queue the directory to be scanned.
+ */
+static void rb_scan_found_dir(RBScanWorker *w, const char *path,
+                              uint32_t parent, uint32_t cached) {
+  RBQueuedDir *q = g_malloc(sizeof(RBQueuedDir));
+  q->path = g_strdup(path);
+  q->parent = parent;
+  q->cached = cached;
+  g_ptr_array_add(w->found, q);
+}
+
+/**
+ * @param w The scanning thread.
+ * @param q The directory to scan.
+ *
+ * Add the files in the directory, and collect the directories in it in
+ * w->found. A directory that did not change since it was indexed is not
+ * read, only its subdirectories are queued. Of a directory that changed, the
+ * files that are not in the index are added and the ones that are gone are
+ * removed.
+ */
+static void rb_scan_dir(RBScanWorker *w, RBQueuedDir *q) {
+  RBScan *scan = w->scan;
+  FileBrowserModePrivateData *pd = scan->pd;
+  const RBIndex *index = scan->index;
+  struct stat st;
+  if (stat(q->path, &st) != 0 || !S_ISDIR(st.st_mode)) {
+    if (q->cached != RB_INDEX_NULL) {
+      // Gone without its parent changing, the root for example.
+      g_atomic_int_set(&(scan->changed), TRUE);
+      rb_scan_remove(w, g_strconcat(q->path, G_DIR_SEPARATOR_S, NULL));
+    }
+    return;
+  }
+  // Links can lead to a directory that is already scanned.
+  RBDirId *id = g_malloc(sizeof(RBDirId));
+  id->dev = st.st_dev;
+  id->ino = st.st_ino;
+  RBScanDir *sd = g_malloc0(sizeof(RBScanDir));
+  sd->name = (q->parent == RB_INDEX_NULL)
+                 ? g_strdup(q->path)
+                 : g_strdup(strrchr(q->path, G_DIR_SEPARATOR) + 1);
+  sd->parent = q->parent;
+  sd->mtime_sec = st.st_mtim.tv_sec;
+  sd->mtime_nsec = st.st_mtim.tv_nsec;
+  sd->cached = RB_INDEX_NULL;
+  g_mutex_lock(&(scan->mutex));
+  gboolean seen = !g_hash_table_add(scan->seen, id);
+  uint32_t self = scan->tree->len;
+  if (!seen) {
+    g_ptr_array_add(scan->tree, sd);
+  }
+  g_mutex_unlock(&(scan->mutex));
+  if (seen) {
+    rb_scan_dir_free(sd);
+    if (q->cached != RB_INDEX_NULL) {
+      // Indexed under this path, but now reached through another one first:
+      // its rows would show up twice.
+      g_atomic_int_set(&(scan->changed), TRUE);
+      rb_scan_remove(w, g_strconcat(q->path, G_DIR_SEPARATOR_S, NULL));
+    }
+    return;
+  }
+
+  const RBIndexDir *cd = NULL;
+  if (q->cached != RB_INDEX_NULL) {
+    cd = &(index->dirs[q->cached]);
+    if (cd->mtime_sec == sd->mtime_sec && cd->mtime_nsec == sd->mtime_nsec) {
+      // Nothing was added or removed, the files are still shown.
+      sd->cached = q->cached;
+      for (uint32_t c = index->first_child[q->cached]; c != RB_INDEX_NULL;
+           c = index->next_sibling[c]) {
+        rb_scan_found_dir(w, index->dir_paths[c], self, c);
+      }
+      return;
+    }
+  }
+  g_atomic_int_set(&(scan->changed), TRUE);
+
+  // What the index has, entries still there are taken out.
+  GHashTable *cached_files = NULL;
+  GHashTable *cached_dirs = NULL;
+  if (cd != NULL) {
+    cached_files = g_hash_table_new(g_str_hash, g_str_equal);
+    for (uint32_t i = cd->first_file; i < cd->first_file + cd->num_files;
+         i++) {
+      g_hash_table_add(cached_files,
+                       (gpointer)(index->strings + index->files[i].name));
+    }
+    cached_dirs = g_hash_table_new(g_str_hash, g_str_equal);
+    for (uint32_t c = index->first_child[q->cached]; c != RB_INDEX_NULL;
+         c = index->next_sibling[c]) {
+      g_hash_table_insert(cached_dirs,
+                          (gpointer)(index->strings + index->dirs[c].name),
+                          GUINT_TO_POINTER(c));
+    }
+  }
+  sd->files = g_array_new(FALSE, FALSE, sizeof(RBScanFile));
+
+  DIR *dir = opendir(q->path);
+  if (dir != NULL) {
+    g_atomic_int_inc(&(scan->num_dirs));
+    GString *path = g_string_new(q->path);
+    if (path->len == 0 || path->str[path->len - 1] != G_DIR_SEPARATOR) {
+      g_string_append_c(path, G_DIR_SEPARATOR);
+    }
+    gsize dir_len = path->len;
+    struct dirent *rd = NULL;
+    while (pd->end_thread == FALSE && (rd = readdir(dir)) != NULL) {
+      if (g_strcmp0(rd->d_name, "..") == 0) {
+        continue;
+      }
+      if (g_strcmp0(rd->d_name, ".") == 0) {
+        continue;
+      }
+      unsigned char d_type = rd->d_type;
+      if (d_type != DT_REG && d_type != DT_DIR && d_type != DT_LNK &&
+          d_type != DT_UNKNOWN) {
+        continue;
+      }
+      g_string_truncate(path, dir_len);
+      g_string_append(path, rd->d_name);
+      if (rb_is_excluded(pd, rd->d_name, path->str, scan->root_len)) {
+        continue;
+      }
+      if (d_type == DT_LNK || d_type == DT_UNKNOWN) {
+        // If we have link, use a stat to find out what it is, if we fail,
+        // we mark it as file.
+        // TODO have a 'broken link' mode?
+        if (g_stat(path->str, &st) == 0) {
+          if (S_ISDIR(st.st_mode)) {
+            d_type = DT_DIR;
           }
-          break;
-        }
-        case DT_DIR: {
-          char *d = g_build_filename(cdir, rd->d_name, NULL);
-          GFile *dirp = g_file_new_for_path(d);
-          g_queue_push_tail(dirs_to_scan, dirp);
-          g_free(d);
-          break;
+        } else {
+          g_warning("Failed to stat file: %s, %s", path->str,
+                    strerror(errno));
         }
-        case DT_UNKNOWN:
-        case DT_LNK: {
-          FBFile *f = g_malloc0(sizeof(FBFile));
-          // Rofi expects utf-8, so lets convert the filename.
-          f->path = g_build_filename(cdir, rd->d_name, NULL);
-          f->name = g_filename_to_utf8(f->path, -1, NULL, NULL, NULL);
-          if (f->name == NULL) {
-            f->name = rofi_force_utf8(rd->d_name, -1);
-          }
-          if (f->name == NULL) {
-            f->name = g_strdup("n/a");
-          }
-          f->icon_fetch_uid = 0;
-          f->icon_fetch_size = 0;
-          // Default to file.
-          f->type = RFILE;
-          if (rd->d_type == DT_LNK) {
-            f->link = TRUE;
+      }
+      if (d_type == DT_DIR) {
+        gpointer c = GUINT_TO_POINTER(RB_INDEX_NULL);
+        if (cached_dirs != NULL) {
+          gpointer key = NULL;
+          if (g_hash_table_lookup_extended(cached_dirs, rd->d_name, &key,
+                                           &c)) {
+            g_hash_table_remove(cached_dirs, key);
           } else {
-            f->link = FALSE;
-          }
-          {
-            // If we have link, use a stat to fine out what it is, if we fail,
-            // we mark it as file.
-            // TODO have a 'broken link' mode?
-            // Convert full path to right encoding.
-            // DD: Path should be in file encoding, not utf-8
-            //          char *file =
-            //          g_filename_from_utf8(pd->array[pd->array_length].path,
-            //                                            -1, NULL, NULL, NULL);
-            // TODO: How to handle loops in links.
-            if (f->path) {
-              GStatBuf statbuf;
-              if (g_stat(f->path, &statbuf) == 0) {
-                if (S_ISDIR(statbuf.st_mode)) {
-                  char *new_full_path =
-                      g_build_filename(cdir, rd->d_name, NULL);
-                  g_free(f->path);
-                  g_free(f->name);
-                  g_free(f);
-                  f = NULL;
-                  GFile *dirp = g_file_new_for_path(new_full_path);
-                  g_queue_push_tail(dirs_to_scan, dirp);
-                  g_free(new_full_path);
-                  break;
-                } else if (S_ISREG(statbuf.st_mode)) {
-                  f->type = RFILE;
-                }
-
-              } else {
-                g_warning("Failed to stat file: %s, %s", f->path,
-                          strerror(errno));
-              }
-
-              //            g_free(file);
-            }
+            c = GUINT_TO_POINTER(RB_INDEX_NULL);
           }
-          if (f != NULL) {
-            g_async_queue_push(pd->async_queue, f);
-            if (g_async_queue_length(pd->async_queue) > 10000) {
-              write(pd->pipefd2[1], "r", 1);
-            }
-          }
-          break;
-        }
         }
+        rb_scan_found_dir(w, path->str, self, GPOINTER_TO_UINT(c));
+        continue;
       }
-      closedir(dir);
+      RBScanFile sf = {.name = NULL,
+                       .flags = (rd->d_type == DT_LNK) ? RB_INDEX_FILE_LINK
+                                                       : 0};
+      gpointer key = NULL;
+      if (cached_files != NULL &&
+          g_hash_table_lookup_extended(cached_files, rd->d_name, &key,
+                                       NULL)) {
+        // Already shown.
+        g_hash_table_remove(cached_files, key);
+        sf.name = key;
+      } else {
+        sf.name = rb_scan_add_file(w, path->str, path->len, dir_len,
+                                   rd->d_type == DT_LNK);
+      }
+      g_array_append_val(sd->files, sf);
     }
-    g_free(cdir);
+    g_string_free(path, TRUE);
+    closedir(dir);
   }
 
-  g_queue_free(dirs_to_scan);
+  if (cd != NULL) {
+    GHashTableIter iter;
+    gpointer key = NULL;
+    GString *path = g_string_new(NULL);
+    g_hash_table_iter_init(&iter, cached_files);
+    while (g_hash_table_iter_next(&iter, &key, NULL)) {
+      rb_build_path(path, q->path, (const char *)key);
+      rb_scan_remove(w, g_strndup(path->str, path->len));
+    }
+    g_hash_table_iter_init(&iter, cached_dirs);
+    while (g_hash_table_iter_next(&iter, &key, NULL)) {
+      rb_build_path(path, q->path, (const char *)key);
+      g_string_append_c(path, G_DIR_SEPARATOR);
+      rb_scan_remove(w, g_strndup(path->str, path->len));
+    }
+    g_string_free(path, TRUE);
+    g_hash_table_destroy(cached_files);
+    g_hash_table_destroy(cached_dirs);
+  }
+}
+
+static gpointer rb_scan_thread(gpointer data) {
+  RBScanWorker *w = (RBScanWorker *)data;
+  RBScan *scan = w->scan;
+  g_mutex_lock(&(scan->mutex));
+  while (TRUE) {
+    RBQueuedDir *q = g_queue_pop_head(&(scan->dirs));
+    if (q == NULL) {
+      // Done when nobody can queue more directories.
+      if (scan->busy == 0 || scan->pd->end_thread) {
+        break;
+      }
+      // Show what was found while waiting for more directories.
+      rb_scan_flush(w);
+      g_cond_wait(&(scan->cond), &(scan->mutex));
+      continue;
+    }
+    scan->busy++;
+    g_mutex_unlock(&(scan->mutex));
+
+    if (scan->pd->end_thread == FALSE) {
+      rb_scan_dir(w, q);
+    }
+    rb_queued_dir_free(q);
+
+    g_mutex_lock(&(scan->mutex));
+    scan->busy--;
+    for (guint i = 0; i < w->found->len; i++) {
+      g_queue_push_tail(&(scan->dirs), g_ptr_array_index(w->found, i));
+    }
+    g_ptr_array_set_size(w->found, 0);
+    g_cond_broadcast(&(scan->cond));
+  }
+  g_cond_broadcast(&(scan->cond));
+  g_mutex_unlock(&(scan->mutex));
+  rb_scan_flush(w);
+  return NULL;
+}
+
+static uint32_t rb_index_add_string(GString *strings, GHashTable *offsets,
+                                    const char *str) {
+  gpointer offset = NULL;
+  if (g_hash_table_lookup_extended(offsets, str, NULL, &offset)) {
+    return GPOINTER_TO_UINT(offset);
+  }
+  uint32_t retv = strings->len;
+  g_string_append_len(strings, str, strlen(str) + 1);
+  g_hash_table_insert(offsets, (gpointer)str, GUINT_TO_POINTER(retv));
+  return retv;
+}
+
+/**
+ * @param scan The finished scan.
+ *
+ * Write the scanned tree to the index file.
+ */
+static void rb_index_write(RBScan *scan) {
+  FileBrowserModePrivateData *pd = scan->pd;
+  const RBIndex *index = scan->index;
+  if (pd->index_file == NULL || scan->tree->len == 0) {
+    return;
+  }
+  GString *strings = g_string_new(NULL);
+  // Names are deduplicated, the tree and the arenas own the keys.
+  GHashTable *offsets = g_hash_table_new(g_str_hash, g_str_equal);
+  GArray *files = g_array_new(FALSE, FALSE, sizeof(RBIndexFile));
+  RBIndexHeader header = {.magic = RB_INDEX_MAGIC,
+                          .version = RB_INDEX_VERSION,
+                          .num_dirs = scan->tree->len};
+  RBIndexDir *dirs = g_malloc0_n(header.num_dirs, sizeof(RBIndexDir));
+  for (uint32_t i = 0; i < header.num_dirs; i++) {
+    RBScanDir *sd = g_ptr_array_index(scan->tree, i);
+    RBIndexDir *d = &(dirs[i]);
+    d->parent = sd->parent;
+    d->name = rb_index_add_string(strings, offsets, sd->name);
+    d->mtime_sec = sd->mtime_sec;
+    d->mtime_nsec = sd->mtime_nsec;
+    d->first_file = files->len;
+    if (sd->files == NULL) {
+      const RBIndexDir *cd = &(index->dirs[sd->cached]);
+      for (uint32_t j = cd->first_file; j < cd->first_file + cd->num_files;
+           j++) {
+        RBIndexFile f = {
+            .name = rb_index_add_string(
+                strings, offsets, index->strings + index->files[j].name),
+            .flags = index->files[j].flags};
+        g_array_append_val(files, f);
+      }
+    } else {
+      for (guint j = 0; j < sd->files->len; j++) {
+        RBScanFile *sf = &g_array_index(sd->files, RBScanFile, j);
+        RBIndexFile f = {
+            .name = rb_index_add_string(strings, offsets, sf->name),
+            .flags = sf->flags};
+        g_array_append_val(files, f);
+      }
+    }
+    d->num_files = files->len - d->first_file;
+  }
+  header.num_files = files->len;
+  header.settings =
+      rb_index_add_string(strings, offsets, pd->index_settings);
+  header.strings_size = strings->len;
+
+  GString *data = g_string_new(NULL);
+  g_string_append_len(data, (const char *)&header, sizeof(header));
+  g_string_append_len(data, (const char *)dirs,
+                      header.num_dirs * sizeof(RBIndexDir));
+  g_string_append_len(data, (const char *)files->data,
+                      files->len * sizeof(RBIndexFile));
+  g_string_append_len(data, strings->str, strings->len);
+
+  // Written to a temporary file and renamed, a running rofi might have the
+  // old one mapped.
+  GError *error = NULL;
+  if (!g_file_set_contents(pd->index_file, data->str, data->len, &error)) {
+    g_warning("Failed to write to index file: %s", error->message);
+    g_error_free(error);
+  }
+  g_string_free(data, TRUE);
+  g_free(dirs);
+  g_array_free(files, TRUE);
+  g_hash_table_destroy(offsets);
+  g_string_free(strings, TRUE);
+}
+
+/**
+ * @param pd The mode data.
+ * @param path The root of the tree to scan.
+ *
+ * Scan the tree with config.threads threads, sharing a queue of directories
+ * to scan. Each thread hands the files it finds to the main thread in
+ * blocks. With an index, only the directories that changed are read, and
+ * the differences are handed over. The index is updated afterwards.
+ */
+static void scan_dir(FileBrowserModePrivateData *pd, GFile *path) {
+  RBScan scan = {.pd = pd, .index = pd->index, .busy = 0};
+  g_mutex_init(&(scan.mutex));
+  g_cond_init(&(scan.cond));
+  g_queue_init(&(scan.dirs));
+  scan.seen = g_hash_table_new_full(rb_dir_id_hash, rb_dir_id_equal, g_free,
+                                    NULL);
+  scan.tree = g_ptr_array_new_with_free_func((GDestroyNotify)rb_scan_dir_free);
+  RBQueuedDir *root = g_malloc(sizeof(RBQueuedDir));
+  root->path = g_file_get_path(path);
+  if (root->path == NULL) {
+    root->path = g_strdup(G_DIR_SEPARATOR_S);
+  }
+  root->parent = RB_INDEX_NULL;
+  root->cached = (pd->index != NULL) ? 0 : RB_INDEX_NULL;
+  scan.root_len = strlen(root->path);
+  if (scan.root_len == 0 ||
+      root->path[scan.root_len - 1] != G_DIR_SEPARATOR) {
+    scan.root_len++;
+  }
+  g_queue_push_tail(&(scan.dirs), root);
+
+  unsigned int nthreads = MAX(1, config.threads);
+  RBScanWorker *workers = g_malloc0_n(nthreads, sizeof(RBScanWorker));
+  GThread **threads = g_malloc0_n(nthreads, sizeof(GThread *));
+  for (unsigned int i = 0; i < nthreads; i++) {
+    workers[i].scan = &scan;
+    workers[i].arena = rofi_string_arena_new();
+    workers[i].timer = g_timer_new();
+    workers[i].found = g_ptr_array_new();
+  }
+  // Scan in this thread too.
+  for (unsigned int i = 1; i < nthreads; i++) {
+    threads[i] =
+        g_thread_new("recursivebrowser-scan", rb_scan_thread, &(workers[i]));
+  }
+  rb_scan_thread(&(workers[0]));
+  for (unsigned int i = 1; i < nthreads; i++) {
+    g_thread_join(threads[i]);
+  }
+
+  g_debug("Scanned %d files in %d directories with %u threads.",
+          scan.num_files, scan.num_dirs, nthreads);
+  pd->num_scanned = scan.num_files;
+  // A stopped scan did not see the whole tree.
+  if (pd->end_thread == FALSE && g_atomic_int_get(&(scan.changed))) {
+    rb_index_write(&scan);
+  }
+
+  for (unsigned int i = 0; i < nthreads; i++) {
+    // The strings are freed with the mode.
+    rofi_string_arena_merge(pd->arena, workers[i].arena);
+    g_timer_destroy(workers[i].timer);
+    g_ptr_array_free(workers[i].found, TRUE);
+  }
+  g_free(threads);
+  g_free(workers);
+  // Left over when the scan was stopped.
+  g_queue_clear_full(&(scan.dirs), (GDestroyNotify)rb_queued_dir_free);
+  g_ptr_array_free(scan.tree, TRUE);
+  g_hash_table_destroy(scan.seen);
+  g_cond_clear(&(scan.cond));
+  g_mutex_clear(&(scan.mutex));
 }
 static gpointer recursive_browser_input_thread(gpointer userdata) {
   FileBrowserModePrivateData *pd = (FileBrowserModePrivateData *)userdata;
   GTimer *t = g_timer_new();
   g_debug("Start scan.\n");
   scan_dir(pd, pd->current_dir);
-  write(pd->pipefd2[1], "r", 1);
   write(pd->pipefd2[1], "q", 1);
   double f = g_timer_elapsed(t, NULL);
-  g_debug("End scan: %f\n", f);
+  g_debug("End scan: %f, %.0f files/s", f, (f > 0) ? pd->num_scanned / f : 0);
   g_timer_destroy(t);
   return NULL;
 }
+
+/**
+ * @param pd The mode data.
+ * @param removed Paths of the removed files, directories end in a '/'.
+ *
+ * Remove the rows of the files, and of everything below the directories.
+ * Takes a single pass over the rows, looking up each parent directory of a
+ * row in the set of removed directories.
+ */
+static void rb_remove_rows(FileBrowserModePrivateData *pd,
+                           GPtrArray *removed) {
+  GHashTable *files = g_hash_table_new(g_str_hash, g_str_equal);
+  GHashTable *dirs = g_hash_table_new(g_str_hash, g_str_equal);
+  for (guint i = 0; i < removed->len; i++) {
+    char *path = g_ptr_array_index(removed, i);
+    if (g_str_has_suffix(path, G_DIR_SEPARATOR_S)) {
+      g_hash_table_add(dirs, path);
+    } else {
+      g_hash_table_add(files, path);
+    }
+  }
+  gboolean check_dirs = g_hash_table_size(dirs) > 0;
+  GString *prefix = g_string_new(NULL);
+  unsigned int length = 0;
+  for (unsigned int i = 0; i < pd->array_length; i++) {
+    const char *path = pd->array[i].path;
+    gboolean remove = g_hash_table_contains(files, path);
+    if (!remove && check_dirs) {
+      g_string_assign(prefix, path);
+      for (gsize k = 0; !remove && k < prefix->len; k++) {
+        if (prefix->str[k] == G_DIR_SEPARATOR) {
+          char c = prefix->str[k + 1];
+          prefix->str[k + 1] = '\0';
+          remove = g_hash_table_contains(dirs, prefix->str);
+          prefix->str[k + 1] = c;
+        }
+      }
+    }
+    if (!remove) {
+      pd->array[length++] = pd->array[i];
+    }
+  }
+  pd->array_length = length;
+  g_string_free(prefix, TRUE);
+  g_hash_table_destroy(dirs);
+  g_hash_table_destroy(files);
+}
+
 static gboolean recursive_browser_async_read_proc(gint fd,
                                                   GIOCondition condition,
                                                   gpointer user_data) {
@@ -332,15 +1195,30 @@ static gboolean recursive_browser_async_read_proc(gint fd,
   // Read the entry from the pipe that was used to signal this action.
   if (read(fd, &command, 1) == 1) {
     if (command == 'r') {
-      FBFile *block = NULL;
+      Block *block = NULL;
       gboolean changed = FALSE;
+      // Blocks queued from now on need a new wake up.
+      g_atomic_int_set(&(pd->wake_queued), FALSE);
       // Empty out the AsyncQueue (that is thread safe) from all blocks pushed
       // into it.
       while ((block = g_async_queue_try_pop(pd->async_queue)) != NULL) {
-
-        fb_resize_array(pd);
-        pd->array[pd->array_length] = *block;
-        pd->array_length++;
+        if (!changed) {
+          // The filter reads array, stop it before it moves.
+          rofi_view_cancel_filter();
+        }
+        if (block->removed != NULL) {
+          rb_remove_rows(pd, block->removed);
+          g_ptr_array_free(block->removed, TRUE);
+        }
+        if (pd->array_length_real < (pd->array_length + block->length)) {
+          pd->array_length_real = MAX(pd->array_length_real * 2,
+                                      pd->array_length + block->length);
+          pd->array = g_realloc(pd->array, (pd->array_length_real + 1) *
+                                               sizeof(FBFile));
+        }
+        memcpy(&(pd->array[pd->array_length]), &(block->values[0]),
+               sizeof(FBFile) * block->length);
+        pd->array_length += block->length;
         g_free(block);
         changed = TRUE;
       }
@@ -365,9 +1243,14 @@ static int recursive_browser_mode_init(Mode *sw) {
     FileBrowserModePrivateData *pd = g_malloc0(sizeof(*pd));
     mode_set_private_data(sw, (void *)pd);
 
+    pd->arena = rofi_string_arena_new();
     recursive_browser_mode_init_config(sw);
     recursive_browser_mode_init_current_dir(sw);
 
+    // Show the files of the last scan, the scan then updates them.
+    pd->index_settings = rb_index_settings(pd);
+    rb_index_read(pd);
+
     // Load content.
     if (pipe(pd->pipefd2) == -1) {
       g_error("Failed to create pipe");
@@ -442,9 +1325,19 @@ static void recursive_browser_mode_destroy(Mode *sw) {
     if (pd->filter_regex) {
       g_regex_unref(pd->filter_regex);
     }
+    for (unsigned int i = 0; i < pd->num_exclude; i++) {
+      g_pattern_spec_free(pd->exclude[i]);
+    }
+    g_strfreev(pd->exclude_patterns);
+    g_free(pd->exclude);
+    g_free(pd->exclude_path);
     g_object_unref(pd->current_dir);
     g_free(pd->command);
     free_list(pd);
+    rb_index_free(pd->index);
+    g_free(pd->index_file);
+    g_free(pd->index_settings);
+    rofi_string_arena_free(pd->arena);
     g_free(pd);
     mode_set_private_data(sw, NULL);
   }
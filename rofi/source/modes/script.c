@@ -55,6 +55,8 @@ typedef struct {
   DmenuScriptEntry *cmd_list;
   /** length list of visible items. */
   unsigned int cmd_list_length;
+  /** Strings of the visible items. */
+  rofi_string_arena *arena;
 
   /** Urgent list */
   struct rofi_range_pair *urgent_list;
@@ -83,45 +85,39 @@ typedef struct {
  */
 void dmenuscript_parse_entry_extras(G_GNUC_UNUSED Mode *sw,
                                     DmenuScriptEntry *entry, char *buffer,
-                                    G_GNUC_UNUSED size_t length) {
-  gchar **extras = g_strsplit(buffer, "\x1f", -1);
-  gchar **extra = extras;
-  for (; *extra != NULL && *(extra + 1) != NULL; extra += 2) {
-    gchar *key = *extra;
-    gchar *value = *(extra + 1);
-    // Mark NULL
-    *(extra) = NULL;
-    *(extra + 1) = NULL;
+                                    G_GNUC_UNUSED size_t length,
+                                    rofi_string_arena *arena) {
+  // Split the key/value pairs in place, only the values we keep are copied.
+  char *key = buffer;
+  while (key != NULL) {
+    char *value = strchr(key, '\x1f');
+    if (value == NULL) {
+      break;
+    }
+    *(value++) = '\0';
+    char *next = strchr(value, '\x1f');
+    if (next != NULL) {
+      *(next++) = '\0';
+    }
     if (strcasecmp(key, "icon") == 0) {
-      entry->icon_name = value;
+      entry->icon_name = rofi_string_arena_add(arena, value, -1);
     } else if (strcasecmp(key, "display") == 0) {
-      entry->display = value;
+      entry->display = rofi_string_arena_add(arena, value, -1);
     } else if (strcasecmp(key, "meta") == 0) {
-      entry->meta = value;
+      entry->meta = rofi_string_arena_add(arena, value, -1);
     } else if (strcasecmp(key, "info") == 0) {
-      entry->info = value;
+      entry->info = rofi_string_arena_add(arena, value, -1);
     } else if (strcasecmp(key, "nonselectable") == 0) {
       entry->nonselectable = g_ascii_strcasecmp(value, "true") == 0;
-      g_free(value);
     } else if (strcasecmp(key, "permanent") == 0) {
       entry->permanent = g_ascii_strcasecmp(value, "true") == 0;
-      g_free(value);
     } else if (strcasecmp(key, "urgent") == 0) {
       entry->urgent = g_ascii_strcasecmp(value, "true") == 0;
-      g_free(value);
     } else if (strcasecmp(key, "active") == 0) {
       entry->active = g_ascii_strcasecmp(value, "true") == 0;
-      g_free(value);
-    } else {
-      g_free(value);
     }
-    g_free(key);
-  }
-  // Got an extra entry.. lets free it.
-  if (*extras != NULL) {
-    g_free(*extras);
+    key = next;
   }
-  g_free(extras);
 }
 
 /**
@@ -177,7 +173,8 @@ static void parse_header_entry(Mode *sw, char *line, ssize_t length) {
 
 static DmenuScriptEntry *execute_executor(Mode *sw, char *arg,
                                           unsigned int *length, int value,
-                                          DmenuScriptEntry *entry) {
+                                          DmenuScriptEntry *entry,
+                                          rofi_string_arena **arena) {
   ScriptModePrivateData *pd = (ScriptModePrivateData *)sw->private_data;
   int fd = -1;
   GError *error = NULL;
@@ -185,6 +182,7 @@ static DmenuScriptEntry *execute_executor(Mode *sw, char *arg,
   char **argv = NULL;
   int argc = 0;
   *length = 0;
+  *arena = rofi_string_arena_new();
   // Reset these between runs.
   pd->new_selection = -1;
   pd->keep_selection = 0;
@@ -241,16 +239,13 @@ static DmenuScriptEntry *execute_executor(Mode *sw, char *arg,
           parse_header_entry(sw, &buffer[1], read_length - 1);
         } else {
           if (actual_size < ((*length) + 2)) {
-            actual_size += 256;
+            actual_size = MAX(actual_size * 2, 256);
             retv = g_realloc(retv, (actual_size) * sizeof(DmenuScriptEntry));
           }
           if (retv) {
             size_t buf_length = strlen(buffer) + 1;
-#if GLIB_CHECK_VERSION(2, 68, 0)
-            retv[(*length)].entry = g_memdup2(buffer, buf_length);
-#else
-            retv[(*length)].entry = g_memdup(buffer, buf_length);
-#endif
+            retv[(*length)].entry =
+                rofi_string_arena_add(*arena, buffer, buf_length - 1);
             retv[(*length)].icon_name = NULL;
             retv[(*length)].display = NULL;
             retv[(*length)].meta = NULL;
@@ -264,7 +259,7 @@ static DmenuScriptEntry *execute_executor(Mode *sw, char *arg,
             if (buf_length > 0 && (read_length > (ssize_t)buf_length)) {
               dmenuscript_parse_entry_extras(sw, &(retv[(*length)]),
                                              buffer + buf_length,
-                                             read_length - buf_length);
+                                             read_length - buf_length, *arena);
             }
             memset(&(retv[(*length) + 1]), 0, sizeof(DmenuScriptEntry));
             (*length)++;
@@ -298,7 +293,8 @@ static int script_mode_init(Mode *sw) {
     ScriptModePrivateData *pd = g_malloc0(sizeof(*pd));
     pd->delim = '\n';
     sw->private_data = (void *)pd;
-    pd->cmd_list = execute_executor(sw, NULL, &(pd->cmd_list_length), 0, NULL);
+    pd->cmd_list = execute_executor(sw, NULL, &(pd->cmd_list_length), 0, NULL,
+                                    &(pd->arena));
   }
   return TRUE;
 }
@@ -325,6 +321,7 @@ static ModeMode script_mode_result(Mode *sw, int mretv, char **input,
   ModeMode retv = MODE_EXIT;
   DmenuScriptEntry *new_list = NULL;
   unsigned int new_length = 0;
+  rofi_string_arena *new_arena = NULL;
   // store them as they might be different on next executor and reset.
   gboolean keep_filter = rmpd->keep_filter;
   gboolean keep_selection = rmpd->keep_selection;
@@ -333,13 +330,15 @@ static ModeMode script_mode_result(Mode *sw, int mretv, char **input,
     if (rmpd->use_hot_keys) {
       script_mode_reset_highlight(sw);
       if (selected_line != UINT32_MAX) {
-        new_list = execute_executor(sw, rmpd->cmd_list[selected_line].entry,
-                                    &new_length, 10 + (mretv & MENU_LOWER_MASK),
-                                    &(rmpd->cmd_list[selected_line]));
+        new_list = execute_executor(
+            sw, rmpd->cmd_list[selected_line].entry, &new_length,
+            10 + (mretv & MENU_LOWER_MASK), &(rmpd->cmd_list[selected_line]),
+            &new_arena);
       } else {
         if (rmpd->no_custom == FALSE) {
           new_list = execute_executor(sw, *input, &new_length,
-                                      10 + (mretv & MENU_LOWER_MASK), NULL);
+                                      10 + (mretv & MENU_LOWER_MASK), NULL,
+                                      &new_arena);
         } else {
           return RELOAD_DIALOG;
         }
@@ -350,8 +349,9 @@ static ModeMode script_mode_result(Mode *sw, int mretv, char **input,
     }
   } else if ((mretv & MENU_ENTRY_DELETE) && selected_line != UINT32_MAX) {
     script_mode_reset_highlight(sw);
-    new_list = execute_executor(sw, rmpd->cmd_list[selected_line].entry, &new_length,
-                                3, &(rmpd->cmd_list[selected_line]));
+    new_list = execute_executor(sw, rmpd->cmd_list[selected_line].entry,
+                                &new_length, 3,
+                                &(rmpd->cmd_list[selected_line]), &new_arena);
   } else if ((mretv & MENU_OK) && rmpd->cmd_list[selected_line].entry != NULL) {
     if (rmpd->cmd_list[selected_line].nonselectable) {
       return RELOAD_DIALOG;
@@ -359,11 +359,11 @@ static ModeMode script_mode_result(Mode *sw, int mretv, char **input,
     script_mode_reset_highlight(sw);
     new_list =
         execute_executor(sw, rmpd->cmd_list[selected_line].entry, &new_length,
-                         1, &(rmpd->cmd_list[selected_line]));
+                         1, &(rmpd->cmd_list[selected_line]), &new_arena);
   } else if ((mretv & MENU_CUSTOM_INPUT) && *input != NULL) {
     if (rmpd->no_custom == FALSE) {
       script_mode_reset_highlight(sw);
-      new_list = execute_executor(sw, *input, &new_length, 2, NULL);
+      new_list = execute_executor(sw, *input, &new_length, 2, NULL, &new_arena);
     } else {
       return RELOAD_DIALOG;
     }
@@ -371,17 +371,12 @@ static ModeMode script_mode_result(Mode *sw, int mretv, char **input,
 
   // If a new list was generated, use that an loop around.
   if (new_list != NULL) {
-    for (unsigned int i = 0; i < rmpd->cmd_list_length; i++) {
-      g_free(rmpd->cmd_list[i].entry);
-      g_free(rmpd->cmd_list[i].icon_name);
-      g_free(rmpd->cmd_list[i].display);
-      g_free(rmpd->cmd_list[i].meta);
-      g_free(rmpd->cmd_list[i].info);
-    }
     g_free(rmpd->cmd_list);
+    rofi_string_arena_free(rmpd->arena);
 
     rmpd->cmd_list = new_list;
     rmpd->cmd_list_length = new_length;
+    rmpd->arena = new_arena;
     if (keep_selection) {
       if (rmpd->new_selection >= 0 &&
           rmpd->new_selection < rmpd->cmd_list_length) {
@@ -398,6 +393,8 @@ static ModeMode script_mode_result(Mode *sw, int mretv, char **input,
       *input = NULL;
     }
     retv = RELOAD_DIALOG;
+  } else {
+    rofi_string_arena_free(new_arena);
   }
   return retv;
 }
@@ -405,13 +402,8 @@ static ModeMode script_mode_result(Mode *sw, int mretv, char **input,
 static void script_mode_destroy(Mode *sw) {
   ScriptModePrivateData *rmpd = (ScriptModePrivateData *)sw->private_data;
   if (rmpd != NULL) {
-    for (unsigned int i = 0; i < rmpd->cmd_list_length; i++) {
-      g_free(rmpd->cmd_list[i].entry);
-      g_free(rmpd->cmd_list[i].icon_name);
-      g_free(rmpd->cmd_list[i].display);
-      g_free(rmpd->cmd_list[i].meta);
-    }
     g_free(rmpd->cmd_list);
+    rofi_string_arena_free(rmpd->arena);
     g_free(rmpd->message);
     g_free(rmpd->prompt);
     g_free(rmpd->data);
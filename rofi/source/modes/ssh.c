@@ -48,6 +48,7 @@
 #include <signal.h>
 #include <string.h>
 #include <strings.h>
+#include <sys/stat.h>
 #include <sys/types.h>
 #include <unistd.h>
 
@@ -87,6 +88,107 @@ typedef struct {
  */
 #define SSH_TOKEN_DELIM "= \t\r\n"
 
+/**
+ * Name of the file caching the hosts found in the ssh configuration, the
+ * known hosts files and `/etc/hosts`.
+ */
+#define SSH_HOSTS_CACHE_FILE "rofi-ssh.hostscache"
+/** Bump when the layout of the cache changes. */
+#define SSH_HOSTS_CACHE_VERSION 1
+/** Magic number at the start of the cache. */
+#define SSH_HOSTS_CACHE_MAGIC 0x48485353u
+/** The cache holds the hosts from the known hosts files. */
+#define SSH_HOSTS_CACHE_KNOWN_HOSTS 1u
+/** The cache holds the hosts from `/etc/hosts`. */
+#define SSH_HOSTS_CACHE_HOSTS 2u
+
+/**
+ * Layout of the cache: the header, the files the hosts were read from, the
+ * hosts and the string table. The hosts from the ssh configuration come
+ * first. Paths and host names are offsets into the string table.
+ */
+typedef struct {
+  uint32_t magic;
+  uint32_t version;
+  /** The SSH_HOSTS_CACHE_ flags of the parsed files. */
+  uint32_t flags;
+  /** The ssh configuration the hosts were read from. */
+  uint32_t path;
+  /** Number of files. */
+  uint32_t num_files;
+  /** Number of hosts from the ssh configuration. */
+  uint32_t num_config;
+  /** Number of hosts. */
+  uint32_t num_hosts;
+  /** Unused, avoids padding. */
+  uint32_t reserved;
+  /** Size of the string table. */
+  uint64_t strings_size;
+} SshCacheHeader;
+
+/** A file in the cache. */
+typedef struct {
+  uint32_t path;
+  /** If the file exists. */
+  uint32_t exists;
+  uint64_t dev;
+  uint64_t ino;
+  uint64_t size;
+  int64_t mtime_sec;
+  int64_t mtime_nsec;
+} SshCacheFile;
+
+/** A host in the cache. */
+typedef struct {
+  uint32_t hostname;
+  int32_t port;
+} SshCacheHost;
+
+/** A file (or directory) the hosts were read from. */
+typedef struct {
+  char *path;
+  /** If the file exists. */
+  gboolean exists;
+  struct stat st;
+} SshFile;
+
+/**
+ * The hosts found in the ssh configuration, the known hosts files and
+ * `/etc/hosts`, before the ones in the history are dropped.
+ */
+typedef struct {
+  /** The #SshFile the hosts were read from. */
+  GArray *files;
+  /** The #SshEntry from the ssh configuration. */
+  GArray *config;
+  /** The #SshEntry from the other files, without duplicates. */
+  GArray *hosts;
+} SshHosts;
+
+/** Parse a known hosts file, or `/etc/hosts`, on the worker pool. */
+typedef struct {
+  thread_state st;
+  /** The file to parse. */
+  char *path;
+  /** If the file is in the `/etc/hosts` format. */
+  gboolean etc_hosts;
+  /** The #SshEntry found. */
+  GArray *entries;
+  GMutex *mutex;
+  GCond *cond;
+  unsigned int *acount;
+} SshParseJob;
+
+/** The files being parsed on the worker pool. */
+typedef struct {
+  GMutex mutex;
+  GCond cond;
+  /** Number of jobs that did not finish yet. */
+  unsigned int acount;
+  /** The #SshParseJob, in the order they were started. */
+  GPtrArray *jobs;
+} SshParse;
+
 /**
  * @param entry The host to connect too
  *
@@ -162,15 +264,11 @@ static void delete_ssh(const char *host) {
 
 /**
  * @param path Path of the known host file.
- * @param retv list of hosts
- * @param length pointer to length of list [in][out]
+ * @param entries The #SshEntry found [out]
  *
  * Read 'known_hosts' file when entries are not hashed.
- *
- * @returns updated list of hosts.
  */
-static SshEntry *read_known_hosts_file(const char *path, SshEntry *retv,
-                                       unsigned int *length) {
+static void read_known_hosts_file(const char *path, GArray *entries) {
   FILE *fd = fopen(path, "r");
   if (fd != NULL) {
     char *buffer = NULL;
@@ -202,7 +300,7 @@ static SshEntry *read_known_hosts_file(const char *path, SshEntry *retv,
         if (start[0] == '[') {
           start++;
           char *strend = strchr(start, ']');
-          if (strend[1] == ':') {
+          if (strend != NULL && strend[1] == ':') {
             *strend = '\0';
             errno = 0;
             gchar *endptr = NULL;
@@ -220,25 +318,9 @@ static SshEntry *read_known_hosts_file(const char *path, SshEntry *retv,
             }
           }
         }
-        // Is this host name already in the list?
-        // We often get duplicates in hosts file, so lets check this.
-        int found = 0;
-        for (unsigned int j = 0; j < (*length); j++) {
-          if (!g_ascii_strcasecmp(start, retv[j].hostname)) {
-            found = 1;
-            break;
-          }
-        }
-
-        if (!found) {
-          // Add this host name to the list.
-          retv = g_realloc(retv, ((*length) + 2) * sizeof(SshEntry));
-          retv[(*length)].hostname = g_strdup(start);
-          retv[(*length)].port = port;
-          retv[(*length) + 1].hostname = NULL;
-          retv[(*length) + 1].port = 0;
-          (*length)++;
-        }
+        // Duplicates are dropped when merging.
+        SshEntry entry = {.hostname = g_strdup(start), .port = port};
+        g_array_append_val(entries, entry);
         start = strsep(&sep, ", ");
       }
     }
@@ -251,21 +333,17 @@ static SshEntry *read_known_hosts_file(const char *path, SshEntry *retv,
   } else {
     g_debug("Failed to open KnownHostFile: '%s'", path);
   }
-
-  return retv;
 }
 
 /**
- * @param retv The list of hosts to update.
- * @param length The length of the list retv [in][out]
+ * @param path Path of the hosts file.
+ * @param entries The #SshEntry found [out]
  *
- * Read `/etc/hosts` and appends them to the list retv
- *
- * @returns an updated list with the added hosts.
+ * Read `/etc/hosts`.
  */
-static SshEntry *read_hosts_file(SshEntry *retv, unsigned int *length) {
+static void read_hosts_file(const char *path, GArray *entries) {
   // Read the hosts file.
-  FILE *fd = fopen("/etc/hosts", "r");
+  FILE *fd = fopen(path, "r");
   if (fd != NULL) {
     char *buffer = NULL;
     size_t buffer_length = 0;
@@ -286,24 +364,9 @@ static SshEntry *read_hosts_file(SshEntry *retv, unsigned int *length) {
             ti++;
             // and first token.
             if (ti > 1) {
-              // Is this host name already in the list?
-              // We often get duplicates in hosts file, so lets check this.
-              int found = 0;
-              for (unsigned int j = 0; j < (*length); j++) {
-                if (!g_ascii_strcasecmp(token, retv[j].hostname)) {
-                  found = 1;
-                  break;
-                }
-              }
-
-              if (!found) {
-                // Add this host name to the list.
-                retv = g_realloc(retv, ((*length) + 2) * sizeof(SshEntry));
-                retv[(*length)].hostname = g_strdup(token);
-                retv[(*length)].port = 0;
-                retv[(*length) + 1].hostname = NULL;
-                (*length)++;
-              }
+              // Duplicates are dropped when merging.
+              SshEntry entry = {.hostname = g_strdup(token), .port = 0};
+              g_array_append_val(entries, entry);
             }
           }
           // Set start to next element.
@@ -324,8 +387,6 @@ static SshEntry *read_hosts_file(SshEntry *retv, unsigned int *length) {
       g_warning("Failed to close hosts file: '%s'", g_strerror(errno));
     }
   }
-
-  return retv;
 }
 
 static void add_known_hosts_file(SSHModePrivateData *pd, const char *token) {
@@ -339,9 +400,61 @@ static void add_known_hosts_file(SSHModePrivateData *pd, const char *token) {
   }
 }
 
+/**
+ * Host names are compared case-insensitive.
+ */
+static guint ssh_host_hash(gconstpointer key) {
+  guint hash = 5381;
+  for (const char *iter = key; *iter != '\0'; iter++) {
+    hash = (hash << 5) + hash + (guchar)g_ascii_tolower(*iter);
+  }
+  return hash;
+}
+
+static gboolean ssh_host_equal(gconstpointer a, gconstpointer b) {
+  return g_ascii_strcasecmp(a, b) == 0;
+}
+
+static void ssh_entry_clear(gpointer data) {
+  SshEntry *entry = (SshEntry *)data;
+  g_free(entry->hostname);
+}
+
+static void ssh_file_clear(gpointer data) {
+  SshFile *file = (SshFile *)data;
+  g_free(file->path);
+}
+
+static void ssh_hosts_init(SshHosts *hosts) {
+  hosts->files = g_array_new(FALSE, FALSE, sizeof(SshFile));
+  g_array_set_clear_func(hosts->files, ssh_file_clear);
+  hosts->config = g_array_new(FALSE, FALSE, sizeof(SshEntry));
+  g_array_set_clear_func(hosts->config, ssh_entry_clear);
+  hosts->hosts = g_array_new(FALSE, FALSE, sizeof(SshEntry));
+  g_array_set_clear_func(hosts->hosts, ssh_entry_clear);
+}
+
+static void ssh_hosts_clear(SshHosts *hosts) {
+  g_array_free(hosts->files, TRUE);
+  g_array_free(hosts->config, TRUE);
+  g_array_free(hosts->hosts, TRUE);
+}
+
+/**
+ * @param hosts The hosts.
+ * @param path The file (or directory).
+ *
+ * Remember the state of a file the hosts depend on.
+ */
+static void ssh_hosts_add_file(SshHosts *hosts, const char *path) {
+  SshFile file = {.path = g_strdup(path)};
+  file.exists = (stat(path, &(file.st)) == 0);
+  g_array_append_val(hosts->files, file);
+}
+
 static void parse_ssh_config_file(SSHModePrivateData *pd, const char *filename,
-                                  SshEntry **retv, unsigned int *length,
-                                  unsigned int num_favorites) {
+                                  SshHosts *hosts) {
+  ssh_hosts_add_file(hosts, filename);
   FILE *fd = fopen(filename, "r");
 
   g_debug("Parsing ssh config file: %s", filename);
@@ -374,12 +487,16 @@ static void parse_ssh_config_file(SSHModePrivateData *pd, const char *filename,
         } else {
           full_path = g_strdup(path);
         }
+        // Files added to (or removed from) the directory change what the
+        // pattern matches.
+        char *dirname = g_path_get_dirname(full_path);
+        ssh_hosts_add_file(hosts, dirname);
+        g_free(dirname);
         glob_t globbuf = {.gl_pathc = 0, .gl_pathv = NULL, .gl_offs = 0};
 
         if (glob(full_path, 0, NULL, &globbuf) == 0) {
           for (size_t iter = 0; iter < globbuf.gl_pathc; iter++) {
-            parse_ssh_config_file(pd, globbuf.gl_pathv[iter], retv, length,
-                                  num_favorites);
+            parse_ssh_config_file(pd, globbuf.gl_pathv[iter], hosts);
           }
         }
         globfree(&globbuf);
@@ -409,27 +526,10 @@ static void parse_ssh_config_file(SSHModePrivateData *pd, const char *filename,
             break;
           }
 
-          // Is this host name already in the history file?
-          // This is a nice little penalty, but doable? time will tell.
-          // given num_favorites is max 25.
-          int found = 0;
-          for (unsigned int j = 0; j < num_favorites; j++) {
-            if (!g_ascii_strcasecmp(token, (*retv)[j].hostname)) {
-              found = 1;
-              break;
-            }
-          }
-
-          if (found) {
-            continue;
-          }
-
-          // Add this host name to the list.
-          (*retv) = g_realloc((*retv), ((*length) + 2) * sizeof(SshEntry));
-          (*retv)[(*length)].hostname = g_strdup(token);
-          (*retv)[(*length)].port = 0;
-          (*retv)[(*length) + 1].hostname = NULL;
-          (*length)++;
+          // Add this host name to the list, the ones also in the history
+          // are dropped in get_ssh().
+          SshEntry entry = {.hostname = g_strdup(token), .port = 0};
+          g_array_append_val(hosts->config, entry);
         }
       }
       g_free(low_token);
@@ -445,6 +545,336 @@ static void parse_ssh_config_file(SSHModePrivateData *pd, const char *filename,
   }
 }
 
+static void ssh_parse_job(thread_state *t, G_GNUC_UNUSED gpointer data) {
+  SshParseJob *job = (SshParseJob *)t;
+  if (job->etc_hosts) {
+    read_hosts_file(job->path, job->entries);
+  } else {
+    read_known_hosts_file(job->path, job->entries);
+  }
+  g_mutex_lock(job->mutex);
+  (*(job->acount))--;
+  g_cond_signal(job->cond);
+  g_mutex_unlock(job->mutex);
+}
+
+static void ssh_parse_job_free(gpointer data) {
+  SshParseJob *job = (SshParseJob *)data;
+  g_free(job->path);
+  g_array_free(job->entries, TRUE);
+  g_free(job);
+}
+
+/**
+ * @param parse The parse run.
+ * @param hosts The hosts.
+ * @param path The file to parse.
+ * @param etc_hosts If the file is in the `/etc/hosts` format.
+ *
+ * Parse the file on the worker pool, or right away if there is none.
+ */
+static void ssh_parse_push(SshParse *parse, SshHosts *hosts, const char *path,
+                           gboolean etc_hosts) {
+  ssh_hosts_add_file(hosts, path);
+  SshParseJob *job = g_malloc0(sizeof(SshParseJob));
+  job->st.callback = ssh_parse_job;
+  job->st.priority = G_PRIORITY_HIGH;
+  job->path = g_strdup(path);
+  job->etc_hosts = etc_hosts;
+  job->entries = g_array_new(FALSE, FALSE, sizeof(SshEntry));
+  g_array_set_clear_func(job->entries, ssh_entry_clear);
+  job->mutex = &(parse->mutex);
+  job->cond = &(parse->cond);
+  job->acount = &(parse->acount);
+  g_ptr_array_add(parse->jobs, job);
+
+  g_mutex_lock(&(parse->mutex));
+  parse->acount++;
+  g_mutex_unlock(&(parse->mutex));
+  if (tpool != NULL) {
+    g_thread_pool_push(tpool, job, NULL);
+  } else {
+    ssh_parse_job((thread_state *)job, NULL);
+  }
+}
+
+/**
+ * @param set The host names seen so far.
+ * @param hosts The hosts.
+ * @param job The parsed file.
+ *
+ * Move the entries of the file into the hosts, dropping duplicates.
+ */
+static void ssh_parse_merge(GHashTable *set, SshHosts *hosts,
+                            SshParseJob *job) {
+  for (unsigned int i = 0; i < job->entries->len; i++) {
+    SshEntry *entry = &g_array_index(job->entries, SshEntry, i);
+    if (g_hash_table_contains(set, entry->hostname)) {
+      continue;
+    }
+    g_array_append_val(hosts->hosts, *entry);
+    g_hash_table_add(set, entry->hostname);
+    // Ownership moved.
+    entry->hostname = NULL;
+  }
+}
+
+/**
+ * @param pd The plugin data handle
+ * @param config_path The path of the ssh configuration.
+ * @param hosts The hosts [out]
+ *
+ * Parse the ssh configuration, while the known hosts files and `/etc/hosts`
+ * are parsed on the worker pool.
+ */
+static void ssh_hosts_parse(SSHModePrivateData *pd, const char *config_path,
+                            SshHosts *hosts) {
+  SshParse parse = {.acount = 0};
+  g_mutex_init(&(parse.mutex));
+  g_cond_init(&(parse.cond));
+  parse.jobs = g_ptr_array_new_with_free_func(ssh_parse_job_free);
+
+  if (config.parse_known_hosts == TRUE) {
+    char *known_hosts_path =
+        g_build_filename(g_get_home_dir(), ".ssh", "known_hosts", NULL);
+    ssh_parse_push(&parse, hosts, known_hosts_path, FALSE);
+    g_free(known_hosts_path);
+  }
+  if (config.parse_hosts == TRUE) {
+    ssh_parse_push(&parse, hosts, "/etc/hosts", TRUE);
+  }
+
+  parse_ssh_config_file(pd, config_path, hosts);
+
+  if (config.parse_known_hosts == TRUE) {
+    for (GList *iter = g_list_first(pd->user_known_hosts); iter;
+         iter = g_list_next(iter)) {
+      char *user_known_hosts_path = rofi_expand_path((const char *)iter->data);
+      ssh_parse_push(&parse, hosts, user_known_hosts_path, FALSE);
+      g_free(user_known_hosts_path);
+    }
+  }
+
+  g_mutex_lock(&(parse.mutex));
+  while (parse.acount > 0) {
+    g_cond_wait(&(parse.cond), &(parse.mutex));
+  }
+  g_mutex_unlock(&(parse.mutex));
+
+  // Merge in the order they were read before: known hosts files first, then
+  // `/etc/hosts`. Hosts already in the ssh configuration are dropped.
+  GHashTable *set = g_hash_table_new(ssh_host_hash, ssh_host_equal);
+  for (unsigned int i = 0; i < hosts->config->len; i++) {
+    g_hash_table_add(set, g_array_index(hosts->config, SshEntry, i).hostname);
+  }
+  for (unsigned int i = 0; i < parse.jobs->len; i++) {
+    SshParseJob *job = g_ptr_array_index(parse.jobs, i);
+    if (!job->etc_hosts) {
+      ssh_parse_merge(set, hosts, job);
+    }
+  }
+  for (unsigned int i = 0; i < parse.jobs->len; i++) {
+    SshParseJob *job = g_ptr_array_index(parse.jobs, i);
+    if (job->etc_hosts) {
+      ssh_parse_merge(set, hosts, job);
+    }
+  }
+  g_hash_table_destroy(set);
+
+  g_ptr_array_free(parse.jobs, TRUE);
+  g_cond_clear(&(parse.cond));
+  g_mutex_clear(&(parse.mutex));
+}
+
+static uint32_t ssh_hosts_cache_flags(void) {
+  return (config.parse_known_hosts == TRUE ? SSH_HOSTS_CACHE_KNOWN_HOSTS : 0) |
+         (config.parse_hosts == TRUE ? SSH_HOSTS_CACHE_HOSTS : 0);
+}
+
+/**
+ * @param data The content of the cache file.
+ * @param size The size of the cache file.
+ *
+ * Check that all offsets are within the file.
+ *
+ * @returns TRUE if the cache can be used.
+ */
+static gboolean ssh_hosts_cache_validate(const char *data, gsize size) {
+  if (size < sizeof(SshCacheHeader)) {
+    return FALSE;
+  }
+  const SshCacheHeader *header = (const SshCacheHeader *)data;
+  if (header->magic != SSH_HOSTS_CACHE_MAGIC ||
+      header->version != SSH_HOSTS_CACHE_VERSION ||
+      header->num_config > header->num_hosts) {
+    return FALSE;
+  }
+  uint64_t expected = sizeof(SshCacheHeader) +
+                      (uint64_t)header->num_files * sizeof(SshCacheFile) +
+                      (uint64_t)header->num_hosts * sizeof(SshCacheHost) +
+                      header->strings_size;
+  if (expected != size || header->strings_size == 0 ||
+      data[size - 1] != '\0' || header->path >= header->strings_size) {
+    return FALSE;
+  }
+  const SshCacheFile *files = (const SshCacheFile *)(header + 1);
+  const SshCacheHost *entries =
+      (const SshCacheHost *)(files + header->num_files);
+  for (uint32_t i = 0; i < header->num_files; i++) {
+    if (files[i].path >= header->strings_size) {
+      return FALSE;
+    }
+  }
+  for (uint32_t i = 0; i < header->num_hosts; i++) {
+    if (entries[i].hostname >= header->strings_size) {
+      return FALSE;
+    }
+  }
+  return TRUE;
+}
+
+/**
+ * @param cache_file The path of the cache.
+ * @param config_path The path of the ssh configuration.
+ * @param hosts The hosts [out]
+ *
+ * Read the hosts from the cache, if none of the files they were read from
+ * changed since.
+ *
+ * @returns TRUE if the hosts were read from the cache.
+ */
+static gboolean ssh_hosts_cache_read(const char *cache_file,
+                                     const char *config_path,
+                                     SshHosts *hosts) {
+  gchar *data = NULL;
+  gsize size = 0;
+  if (!g_file_get_contents(cache_file, &data, &size, NULL)) {
+    return FALSE;
+  }
+  if (!ssh_hosts_cache_validate(data, size)) {
+    g_free(data);
+    return FALSE;
+  }
+  const SshCacheHeader *header = (const SshCacheHeader *)data;
+  const SshCacheFile *files = (const SshCacheFile *)(header + 1);
+  const SshCacheHost *entries =
+      (const SshCacheHost *)(files + header->num_files);
+  const char *strings = (const char *)(entries + header->num_hosts);
+  gboolean valid = header->flags == ssh_hosts_cache_flags() &&
+                   g_strcmp0(strings + header->path, config_path) == 0;
+  for (uint32_t i = 0; valid && i < header->num_files; i++) {
+    struct stat st;
+    gboolean exists = (stat(strings + files[i].path, &st) == 0);
+    if (exists != (gboolean)files[i].exists) {
+      valid = FALSE;
+    } else if (exists) {
+      valid = files[i].dev == (uint64_t)st.st_dev &&
+              files[i].ino == (uint64_t)st.st_ino &&
+              files[i].size == (uint64_t)st.st_size &&
+              files[i].mtime_sec == (int64_t)st.st_mtim.tv_sec &&
+              files[i].mtime_nsec == (int64_t)st.st_mtim.tv_nsec;
+    }
+  }
+  if (valid) {
+    for (uint32_t i = 0; i < header->num_hosts; i++) {
+      SshEntry entry = {.hostname = g_strdup(strings + entries[i].hostname),
+                        .port = entries[i].port};
+      g_array_append_val(i < header->num_config ? hosts->config
+                                                : hosts->hosts,
+                         entry);
+    }
+  }
+  g_free(data);
+  return valid;
+}
+
+/**
+ * @param cache_file The path of the cache.
+ * @param config_path The path of the ssh configuration.
+ * @param hosts The hosts.
+ *
+ * Write the hosts, and the state of the files they were read from, to the
+ * cache.
+ */
+static void ssh_hosts_cache_write(const char *cache_file,
+                                  const char *config_path,
+                                  const SshHosts *hosts) {
+  GString *strings = g_string_new(NULL);
+  SshCacheHeader header = {.magic = SSH_HOSTS_CACHE_MAGIC,
+                           .version = SSH_HOSTS_CACHE_VERSION,
+                           .flags = ssh_hosts_cache_flags(),
+                           .num_files = hosts->files->len,
+                           .num_config = hosts->config->len,
+                           .num_hosts =
+                               hosts->config->len + hosts->hosts->len};
+  header.path = strings->len;
+  g_string_append_len(strings, config_path, strlen(config_path) + 1);
+
+  SshCacheFile *files = g_malloc0_n(header.num_files, sizeof(SshCacheFile));
+  for (uint32_t i = 0; i < header.num_files; i++) {
+    const SshFile *file = &g_array_index(hosts->files, SshFile, i);
+    files[i].path = strings->len;
+    g_string_append_len(strings, file->path, strlen(file->path) + 1);
+    files[i].exists = file->exists;
+    if (file->exists) {
+      files[i].dev = file->st.st_dev;
+      files[i].ino = file->st.st_ino;
+      files[i].size = file->st.st_size;
+      files[i].mtime_sec = file->st.st_mtim.tv_sec;
+      files[i].mtime_nsec = file->st.st_mtim.tv_nsec;
+    }
+  }
+  SshCacheHost *entries = g_malloc0_n(header.num_hosts, sizeof(SshCacheHost));
+  for (uint32_t i = 0; i < header.num_hosts; i++) {
+    const SshEntry *entry =
+        i < header.num_config
+            ? &g_array_index(hosts->config, SshEntry, i)
+            : &g_array_index(hosts->hosts, SshEntry, i - header.num_config);
+    entries[i].hostname = strings->len;
+    entries[i].port = entry->port;
+    g_string_append_len(strings, entry->hostname, strlen(entry->hostname) + 1);
+  }
+  header.strings_size = strings->len;
+
+  GString *data = g_string_new(NULL);
+  g_string_append_len(data, (const char *)&header, sizeof(header));
+  g_string_append_len(data, (const char *)files,
+                      header.num_files * sizeof(SshCacheFile));
+  g_string_append_len(data, (const char *)entries,
+                      header.num_hosts * sizeof(SshCacheHost));
+  g_string_append_len(data, strings->str, strings->len);
+  GError *error = NULL;
+  if (!g_file_set_contents(cache_file, data->str, data->len, &error)) {
+    g_warning("Failed to write ssh hosts cache: %s", error->message);
+    g_error_free(error);
+  }
+  g_string_free(data, TRUE);
+  g_free(entries);
+  g_free(files);
+  g_string_free(strings, TRUE);
+}
+
+/**
+ * @param retv The list of hosts to update.
+ * @param length The length of the list retv [in][out]
+ * @param favorites The host names in the history.
+ * @param entries The #SshEntry to add.
+ *
+ * Move the entries that are not in the history into the list.
+ */
+static void ssh_add_entries(SshEntry *retv, unsigned int *length,
+                            GHashTable *favorites, GArray *entries) {
+  for (unsigned int i = 0; i < entries->len; i++) {
+    SshEntry *entry = &g_array_index(entries, SshEntry, i);
+    if (g_hash_table_contains(favorites, entry->hostname)) {
+      continue;
+    }
+    retv[(*length)++] = *entry;
+    // Ownership moved.
+    entry->hostname = NULL;
+  }
+}
+
 /**
  * @param pd The plugin data handle
  * @param length The number of found ssh hosts [out]
@@ -496,24 +926,28 @@ static SshEntry *get_ssh(SSHModePrivateData *pd, unsigned int *length) {
 
   const char *hd = g_get_home_dir();
   path = g_build_filename(hd, ".ssh", "config", NULL);
-  parse_ssh_config_file(pd, path, &retv, length, num_favorites);
-
-  if (config.parse_known_hosts == TRUE) {
-    char *known_hosts_path =
-        g_build_filename(g_get_home_dir(), ".ssh", "known_hosts", NULL);
-    retv = read_known_hosts_file(known_hosts_path, retv, length);
-    g_free(known_hosts_path);
-    for (GList *iter = g_list_first(pd->user_known_hosts); iter;
-         iter = g_list_next(iter)) {
-      char *user_known_hosts_path = rofi_expand_path((const char *)iter->data);
-      retv = read_known_hosts_file((const char *)user_known_hosts_path, retv,
-                                   length);
-      g_free(user_known_hosts_path);
-    }
+  char *cache_file = g_build_filename(cache_dir, SSH_HOSTS_CACHE_FILE, NULL);
+  SshHosts hosts;
+  ssh_hosts_init(&hosts);
+  if (!ssh_hosts_cache_read(cache_file, path, &hosts)) {
+    ssh_hosts_parse(pd, path, &hosts);
+    ssh_hosts_cache_write(cache_file, path, &hosts);
   }
-  if (config.parse_hosts == TRUE) {
-    retv = read_hosts_file(retv, length);
+  g_free(cache_file);
+
+  // Drop the hosts that are in the history already.
+  GHashTable *favorites = g_hash_table_new(ssh_host_hash, ssh_host_equal);
+  for (unsigned int i = 0; i < num_favorites; i++) {
+    g_hash_table_add(favorites, retv[i].hostname);
   }
+  retv = g_realloc(retv, ((*length) + hosts.config->len + hosts.hosts->len +
+                          1) * sizeof(SshEntry));
+  ssh_add_entries(retv, length, favorites, hosts.config);
+  ssh_add_entries(retv, length, favorites, hosts.hosts);
+  retv[(*length)].hostname = NULL;
+  retv[(*length)].port = 0;
+  g_hash_table_destroy(favorites);
+  ssh_hosts_clear(&hosts);
 
   g_free(path);
 
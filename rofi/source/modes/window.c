@@ -104,6 +104,23 @@ static WinModeField matching_window_fields[WIN_MATCH_NUM_FIELDS] = {
 
 static gboolean window_matching_fields_parsed = FALSE;
 
+/**
+ * Thumbnail of a window, captured on the worker pool. It is reference
+ * counted, so a client can go away while the capture is running.
+ */
+typedef struct {
+  /** Worker pool job, must be first. */
+  thread_state state;
+  /** The window to capture. */
+  xcb_window_t window;
+  /** Size of the thumbnail. */
+  unsigned int size;
+  /** The thumbnail, NULL if it could not be captured. */
+  cairo_surface_t *surface;
+  /** Set once the capture finished. */
+  gint done;
+} WindowThumbnail;
+
 // a manageable window
 typedef struct {
   xcb_window_t window;
@@ -127,6 +144,7 @@ typedef struct {
   uint32_t icon_fetch_uid;
   uint32_t icon_fetch_size;
   gboolean thumbnail_checked;
+  WindowThumbnail *thumbnail;
   gboolean icon_theme_checked;
 } client;
 
@@ -135,6 +153,8 @@ typedef struct {
   xcb_window_t *array;
   client **data;
   int len;
+  // Window to index + 1 in array.
+  GHashTable *index;
 } winlist;
 
 typedef struct {
@@ -166,6 +186,7 @@ static winlist *winlist_new(void) {
   l->len = 0;
   l->array = g_malloc_n(WINLIST + 1, sizeof(xcb_window_t));
   l->data = g_malloc_n(WINLIST + 1, sizeof(client *));
+  l->index = g_hash_table_new(g_direct_hash, g_direct_equal);
   return l;
 }
 
@@ -192,13 +213,78 @@ static int winlist_append(winlist *l, xcb_window_t w, client *d) {
 
   l->data[l->len] = d;
   l->array[l->len++] = w;
+  // On duplicates the last one is found, like the old backwards search.
+  g_hash_table_insert(l->index, GUINT_TO_POINTER(w), GINT_TO_POINTER(l->len));
   return l->len - 1;
 }
 
+static void window_thumbnail_clear(gpointer data) {
+  WindowThumbnail *wt = (WindowThumbnail *)data;
+  if (wt->surface) {
+    cairo_surface_destroy(wt->surface);
+  }
+}
+
+static void window_thumbnail_release(gpointer data) {
+  g_atomic_rc_box_release_full(data, window_thumbnail_clear);
+}
+
+static void window_thumbnail_capture(thread_state *t,
+                                     G_GNUC_UNUSED gpointer data) {
+  WindowThumbnail *wt = (WindowThumbnail *)t;
+  wt->surface = x11_helper_get_screenshot_surface_window(wt->window, wt->size);
+  g_atomic_int_set(&(wt->done), TRUE);
+  rofi_view_queue_icon_redraw();
+  window_thumbnail_release(wt);
+}
+
+/**
+ * @param data The thumbnail of a capture job that never ran.
+ *
+ * Mark it done without a surface, so the row falls back to the icon.
+ */
+static void window_thumbnail_dropped(gpointer data) {
+  WindowThumbnail *wt = (WindowThumbnail *)data;
+  g_atomic_int_set(&(wt->done), TRUE);
+  rofi_view_queue_icon_redraw();
+  window_thumbnail_release(wt);
+}
+
+/**
+ * @param window The window to capture.
+ * @param size The size of the thumbnail.
+ *
+ * Queue the capture of a window thumbnail on the worker pool, so drawing
+ * the row does not wait on the X server. Without a pool it is captured right
+ * away.
+ *
+ * @returns a reference to the thumbnail, done is set once it is captured.
+ */
+static WindowThumbnail *window_thumbnail_request(xcb_window_t window,
+                                                 unsigned int size) {
+  WindowThumbnail *wt = g_atomic_rc_box_new0(WindowThumbnail);
+  wt->state.callback = window_thumbnail_capture;
+  wt->state.free = window_thumbnail_dropped;
+  wt->state.priority = G_PRIORITY_LOW;
+  wt->window = window;
+  wt->size = size;
+  // One reference for the worker.
+  if (tpool != NULL) {
+    g_thread_pool_push(tpool, g_atomic_rc_box_acquire(wt), NULL);
+  } else {
+    window_thumbnail_capture((thread_state *)g_atomic_rc_box_acquire(wt),
+                             NULL);
+  }
+  return wt;
+}
+
 static void client_free(client *c) {
   if (c == NULL) {
     return;
   }
+  if (c->thumbnail) {
+    window_thumbnail_release(c->thumbnail);
+  }
   if (c->icon) {
     cairo_surface_destroy(c->icon);
   }
@@ -216,6 +302,7 @@ static void winlist_empty(winlist *l) {
       g_free(c);
     }
   }
+  g_hash_table_remove_all(l->index);
 }
 
 /**
@@ -226,6 +313,7 @@ static void winlist_empty(winlist *l) {
 static void winlist_free(winlist *l) {
   if (l != NULL) {
     winlist_empty(l);
+    g_hash_table_destroy(l->index);
     g_free(l->array);
     g_free(l->data);
     g_free(l);
@@ -244,17 +332,8 @@ static int winlist_find(winlist *l, xcb_window_t w) {
   if (l == NULL) {
     return -1;
   }
-  // iterate backwards. Theory is: windows most often accessed will be
-  // nearer the end. Testing with kcachegrind seems to support this...
-  int i;
-
-  for (i = (l->len - 1); i >= 0; i--) {
-    if (l->array[i] == w) {
-      return i;
-    }
-  }
-
-  return -1;
+  return GPOINTER_TO_INT(g_hash_table_lookup(l->index, GUINT_TO_POINTER(w))) -
+         1;
 }
 /**
  * Create empty X11 cache for windows and windows attributes.
@@ -273,26 +352,6 @@ static void x11_cache_free(void) {
   cache_client = NULL;
 }
 
-/**
- * @param d Display connection to X server
- * @param w window
- *
- * Get window attributes.
- * This functions uses caching.
- *
- * @returns a XWindowAttributes
- */
-static xcb_get_window_attributes_reply_t *
-window_get_attributes(xcb_window_t w) {
-  xcb_get_window_attributes_cookie_t c =
-      xcb_get_window_attributes(xcb->connection, w);
-  xcb_get_window_attributes_reply_t *r =
-      xcb_get_window_attributes_reply(xcb->connection, c, NULL);
-  if (r) {
-    return r;
-  }
-  return NULL;
-}
 // _NET_WM_STATE_*
 static int client_has_state(client *c, xcb_atom_t state) {
   for (int i = 0; i < c->states; i++) {
@@ -313,48 +372,153 @@ static int client_has_window_type(client *c, xcb_atom_t type) {
   return 0;
 }
 
-static client *window_client(WindowModePrivateData *pd, xcb_window_t win) {
+/**
+ * The requests sent for a window. For a window that is in the cache already
+ * only the desktop is requested, it changes when the window is moved.
+ */
+typedef struct {
+  xcb_window_t window;
+  /** If only the desktop was requested. */
+  gboolean cached;
+  xcb_get_window_attributes_cookie_t attributes;
+  xcb_get_property_cookie_t state;
+  xcb_get_property_cookie_t window_type;
+  xcb_get_property_cookie_t net_wm_name;
+  xcb_get_property_cookie_t wm_name;
+  xcb_get_property_cookie_t role;
+  xcb_get_property_cookie_t wm_class;
+  xcb_get_property_cookie_t hints;
+  xcb_get_property_cookie_t desktop;
+} client_request;
+
+/**
+ * @param r The requests to fill in.
+ * @param win The window.
+ *
+ * Send all requests needed to create the client, without waiting on the
+ * replies. Requests for many windows are sent before collecting any reply,
+ * so loading them takes a single round trip.
+ */
+static void window_client_request(client_request *r, xcb_window_t win) {
+  r->window = win;
   if (win == XCB_WINDOW_NONE) {
+    r->cached = TRUE;
+    return;
+  }
+  r->desktop =
+      xcb_get_property(xcb->connection, 0, win, xcb->ewmh._NET_WM_DESKTOP,
+                       XCB_ATOM_CARDINAL, 0, 1);
+  r->cached = winlist_find(cache_client, win) >= 0;
+  if (r->cached) {
+    return;
+  }
+  r->attributes = xcb_get_window_attributes(xcb->connection, win);
+  r->state = xcb_ewmh_get_wm_state(&xcb->ewmh, win);
+  r->window_type = xcb_ewmh_get_wm_window_type(&xcb->ewmh, win);
+  r->net_wm_name = window_get_text_prop_request(win, xcb->ewmh._NET_WM_NAME);
+  r->wm_name = window_get_text_prop_request(win, XCB_ATOM_WM_NAME);
+  r->role = window_get_text_prop_request(win, netatoms[WM_WINDOW_ROLE]);
+  r->wm_class = xcb_icccm_get_wm_class(xcb->connection, win);
+  r->hints = xcb_icccm_get_wm_hints(xcb->connection, win);
+}
+
+/**
+ * @param r The requests.
+ *
+ * Drop the replies of the property requests, they are not needed.
+ */
+static void window_client_discard(client_request *r) {
+  xcb_discard_reply(xcb->connection, r->state.sequence);
+  xcb_discard_reply(xcb->connection, r->window_type.sequence);
+  xcb_discard_reply(xcb->connection, r->net_wm_name.sequence);
+  xcb_discard_reply(xcb->connection, r->wm_name.sequence);
+  xcb_discard_reply(xcb->connection, r->role.sequence);
+  xcb_discard_reply(xcb->connection, r->wm_class.sequence);
+  xcb_discard_reply(xcb->connection, r->hints.sequence);
+  xcb_discard_reply(xcb->connection, r->desktop.sequence);
+}
+
+/**
+ * @param cookie The _NET_WM_DESKTOP request.
+ *
+ * @returns the desktop of the window, 0xFFFFFFFF if not set.
+ */
+static uint32_t window_client_desktop_reply(xcb_get_property_cookie_t cookie) {
+  uint32_t wmdesktop = 0xFFFFFFFF;
+  xcb_get_property_reply_t *dr =
+      xcb_get_property_reply(xcb->connection, cookie, NULL);
+  if (dr) {
+    if (dr->type == XCB_ATOM_CARDINAL) {
+      wmdesktop = *((uint32_t *)xcb_get_property_value(dr));
+    }
+    free(dr);
+  }
+  return wmdesktop;
+}
+
+/**
+ * @param pd The window mode private data.
+ * @param r The requests sent by window_client_request.
+ *
+ * Collect the replies and add the client to the cache.
+ *
+ * @returns the client, NULL if the window does not exist.
+ */
+static client *window_client_reply(WindowModePrivateData *pd,
+                                   client_request *r) {
+  if (r->window == XCB_WINDOW_NONE) {
     return NULL;
   }
 
-  int idx = winlist_find(cache_client, win);
+  int idx = winlist_find(cache_client, r->window);
 
   if (idx >= 0) {
-    return cache_client->data[idx];
+    client *c = cache_client->data[idx];
+    if (r->cached) {
+      c->wmdesktop = window_client_desktop_reply(r->desktop);
+    } else {
+      // Listed twice, the first reply added it.
+      xcb_discard_reply(xcb->connection, r->attributes.sequence);
+      window_client_discard(r);
+    }
+    return c;
   }
 
   // if this fails, we're up that creek
-  xcb_get_window_attributes_reply_t *attr = window_get_attributes(win);
+  xcb_get_window_attributes_reply_t *attr =
+      xcb_get_window_attributes_reply(xcb->connection, r->attributes, NULL);
 
   if (!attr) {
+    window_client_discard(r);
     return NULL;
   }
   client *c = g_malloc0(sizeof(client));
-  c->window = win;
+  c->window = r->window;
 
   // copy xattr so we don't have to care when stuff is freed
   memmove(&c->xattr, attr, sizeof(xcb_get_window_attributes_reply_t));
 
-  xcb_get_property_cookie_t cky = xcb_ewmh_get_wm_state(&xcb->ewmh, win);
   xcb_ewmh_get_atoms_reply_t states;
-  if (xcb_ewmh_get_wm_state_reply(&xcb->ewmh, cky, &states, NULL)) {
+  if (xcb_ewmh_get_wm_state_reply(&xcb->ewmh, r->state, &states, NULL)) {
     c->states = MIN(CLIENTSTATE, states.atoms_len);
     memcpy(c->state, states.atoms,
            MIN(CLIENTSTATE, states.atoms_len) * sizeof(xcb_atom_t));
     xcb_ewmh_get_atoms_reply_wipe(&states);
   }
-  cky = xcb_ewmh_get_wm_window_type(&xcb->ewmh, win);
-  if (xcb_ewmh_get_wm_window_type_reply(&xcb->ewmh, cky, &states, NULL)) {
+  if (xcb_ewmh_get_wm_window_type_reply(&xcb->ewmh, r->window_type, &states,
+                                        NULL)) {
     c->window_types = MIN(CLIENTWINDOWTYPE, states.atoms_len);
     memcpy(c->window_type, states.atoms,
            MIN(CLIENTWINDOWTYPE, states.atoms_len) * sizeof(xcb_atom_t));
     xcb_ewmh_get_atoms_reply_wipe(&states);
   }
 
-  char *tmp_title = window_get_text_prop(c->window, xcb->ewmh._NET_WM_NAME);
+  char *tmp_title = window_get_text_prop_reply(r->net_wm_name);
+  char *tmp_wm_name = window_get_text_prop_reply(r->wm_name);
   if (tmp_title == NULL) {
-    tmp_title = window_get_text_prop(c->window, XCB_ATOM_WM_NAME);
+    tmp_title = tmp_wm_name;
+  } else {
+    g_free(tmp_wm_name);
   }
   if (tmp_title != NULL) {
     c->title = g_markup_escape_text(tmp_title, -1);
@@ -365,27 +529,28 @@ static client *window_client(WindowModePrivateData *pd, xcb_window_t win) {
       MAX(c->title ? g_utf8_strlen(c->title, -1) : 0, pd->title_len);
   g_free(tmp_title);
 
-  char *tmp_role = window_get_text_prop(c->window, netatoms[WM_WINDOW_ROLE]);
+  char *tmp_role = window_get_text_prop_reply(r->role);
   c->role = g_markup_escape_text(tmp_role ? tmp_role : "", -1);
   pd->role_len = MAX(c->role ? g_utf8_strlen(c->role, -1) : 0, pd->role_len);
   g_free(tmp_role);
 
-  cky = xcb_icccm_get_wm_class(xcb->connection, c->window);
   xcb_icccm_get_wm_class_reply_t wcr;
-  if (xcb_icccm_get_wm_class_reply(xcb->connection, cky, &wcr, NULL)) {
+  if (xcb_icccm_get_wm_class_reply(xcb->connection, r->wm_class, &wcr,
+                                   NULL)) {
     c->class = g_markup_escape_text(wcr.class_name, -1);
     c->name = g_markup_escape_text(wcr.instance_name, -1);
     pd->name_len = MAX(c->name ? g_utf8_strlen(c->name, -1) : 0, pd->name_len);
     xcb_icccm_get_wm_class_reply_wipe(&wcr);
   }
 
-  xcb_get_property_cookie_t cc =
-      xcb_icccm_get_wm_hints(xcb->connection, c->window);
-  xcb_icccm_wm_hints_t r;
-  if (xcb_icccm_get_wm_hints_reply(xcb->connection, cc, &r, NULL)) {
-    c->hint_flags = r.flags;
+  xcb_icccm_wm_hints_t hints;
+  if (xcb_icccm_get_wm_hints_reply(xcb->connection, r->hints, &hints, NULL)) {
+    c->hint_flags = hints.flags;
   }
 
+  // find client's desktop.
+  c->wmdesktop = window_client_desktop_reply(r->desktop);
+
   idx = winlist_append(cache_client, c->window, c);
   // Should never happen.
   if (idx < 0) {
@@ -397,9 +562,22 @@ static client *window_client(WindowModePrivateData *pd, xcb_window_t win) {
   return c;
 }
 
+static client *window_client(WindowModePrivateData *pd, xcb_window_t win) {
+  // Called per row, do not wait on the server for a client we have.
+  int idx = winlist_find(cache_client, win);
+  if (idx >= 0) {
+    return cache_client->data[idx];
+  }
+  client_request r;
+  window_client_request(&r, win);
+  return window_client_reply(pd, &r);
+}
+
 guint window_reload_timeout = 0;
 static gboolean window_client_reload(G_GNUC_UNUSED void *data) {
   window_reload_timeout = 0;
+  // The filter reads the window list, stop it before it is rebuilt.
+  rofi_view_cancel_filter();
   if (window_mode.private_data) {
     window_mode._destroy(&window_mode);
     window_mode._init(&window_mode);
@@ -598,9 +776,15 @@ static void _window_mode_load_data(Mode *sw, unsigned int cd) {
       has_names = TRUE;
       xcb_ewmh_get_utf8_strings_reply_wipe(&names);
     }
+    // Send the requests for all windows before waiting on the first reply.
+    client_request *requests =
+        g_malloc_n(clients.windows_len, sizeof(client_request));
+    for (i = clients.windows_len - 1; i > -1; i--) {
+      window_client_request(&(requests[i]), clients.windows[i]);
+    }
     // calc widths of fields
     for (i = clients.windows_len - 1; i > -1; i--) {
-      client *winclient = window_client(pd, clients.windows[i]);
+      client *winclient = window_client_reply(pd, &(requests[i]));
       if ((winclient != NULL) && !winclient->xattr.override_redirect &&
           !client_has_window_type(winclient,
                                   xcb->ewmh._NET_WM_WINDOW_TYPE_DOCK) &&
@@ -624,21 +808,7 @@ static void _window_mode_load_data(Mode *sw, unsigned int cd) {
         if (winclient->window == curr_win_id) {
           winclient->active = TRUE;
         }
-        // find client's desktop.
-        xcb_get_property_cookie_t cookie;
-        xcb_get_property_reply_t *r;
-
-        winclient->wmdesktop = 0xFFFFFFFF;
-        cookie = xcb_get_property(xcb->connection, 0, winclient->window,
-                                  xcb->ewmh._NET_WM_DESKTOP, XCB_ATOM_CARDINAL,
-                                  0, 1);
-        r = xcb_get_property_reply(xcb->connection, cookie, NULL);
-        if (r) {
-          if (r->type == XCB_ATOM_CARDINAL) {
-            winclient->wmdesktop = *((uint32_t *)xcb_get_property_value(r));
-          }
-          free(r);
-        }
+        g_free(winclient->wmdesktopstr);
         if (winclient->wmdesktop != 0xFFFFFFFF) {
           if (has_names) {
             if ((current_window_manager & WM_PANGO_WORKSPACE_NAMES) ==
@@ -690,6 +860,7 @@ static void _window_mode_load_data(Mode *sw, unsigned int cd) {
       }
     }
 
+    g_free(requests);
     if (has_names) {
       g_free(ws_names);
     }
@@ -1081,12 +1252,28 @@ static cairo_surface_t *_get_icon(const Mode *sw, unsigned int selected_line,
       cairo_surface_destroy(c->icon);
       c->icon = NULL;
     }
+    if (c->thumbnail) {
+      window_thumbnail_release(c->thumbnail);
+      c->thumbnail = NULL;
+    }
     c->thumbnail_checked = FALSE;
     c->icon_checked = FALSE;
     c->icon_theme_checked = FALSE;
   }
   if (config.window_thumbnail && c->thumbnail_checked == FALSE) {
-    c->icon = x11_helper_get_screenshot_surface_window(c->window, size);
+    if (c->thumbnail == NULL) {
+      c->thumbnail = window_thumbnail_request(c->window, size);
+    }
+    if (!g_atomic_int_get(&(c->thumbnail->done))) {
+      // Only fall back to the icon if there is no thumbnail.
+      c->icon_fetch_size = size;
+      return NULL;
+    }
+    if (c->thumbnail->surface) {
+      c->icon = cairo_surface_reference(c->thumbnail->surface);
+    }
+    window_thumbnail_release(c->thumbnail);
+    c->thumbnail = NULL;
     c->thumbnail_checked = TRUE;
   }
   if (rmpd->prefer_icon_theme == FALSE) {
@@ -29,12 +29,19 @@
 #define G_LOG_DOMAIN "Helpers.IconFetcher"
 
 #include "config.h"
+#include <errno.h>
+#include <fcntl.h>
 #include <stdlib.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
 #include <xcb/xproto.h>
 
 #include "helper.h"
 #include "rofi-icon-fetcher.h"
 #include "rofi-types.h"
+#include "rofi.h"
 #include "settings.h"
 #include <cairo.h>
 #include <pango/pangocairo.h>
@@ -50,12 +57,48 @@
 
 #include "helper.h"
 #include <gdk-pixbuf/gdk-pixbuf.h>
+#include <glib/gstdio.h>
 
 /** Desktop entry specifying the thumbnailer. */
 #define THUMBNAILER_ENTRY_GROUP "Thumbnailer Entry"
 /** Extension used for the thumbnailer. */
 #define THUMBNAILER_EXTENSION ".thumbnailer"
 
+/** Directory, in the cache directory, holding the decoded icons. */
+#define ICON_CACHE_DIR "rofi-icons"
+/** Magic number of an icon cache file. */
+#define ICON_CACHE_MAGIC 0x4e434952u
+/** Bump when the icon cache file layout changes. */
+#define ICON_CACHE_VERSION 1u
+/** Icon cache files not used for this many seconds are removed (30 days). */
+#define ICON_CACHE_MAX_AGE (30 * 24 * 60 * 60)
+/** Size, in bytes, above which the least recently used files are removed. */
+#define ICON_CACHE_MAX_SIZE (64 * 1024 * 1024)
+/** The access time of a file used is only updated once this is passed. */
+#define ICON_CACHE_TOUCH_INTERVAL (24 * 60 * 60)
+
+/**
+ * An icon cache file holds, in host byte order, this header followed by the
+ * pixels of the icon as premultiplied ARGB32, ready to be used by cairo.
+ * The file is named after a checksum of the request and the source file, a
+ * changed icon or theme ends up in another file.
+ */
+typedef struct {
+  uint32_t magic;
+  uint32_t version;
+  int32_t width;
+  int32_t height;
+  int32_t stride;
+  /** Unused, keeps the pixels 16 byte aligned. */
+  uint32_t reserved[3];
+} IconCacheHeader;
+
+/** A mapped icon cache file, owned by the surface using it. */
+typedef struct {
+  void *map;
+  size_t size;
+} IconCacheMap;
+
 typedef struct {
   // Context for icon-themes.
   NkXdgThemeContext *xdg_context;
@@ -71,6 +114,32 @@ typedef struct {
 
   // thumbnailers per mime-types hashmap
   GHashTable *thumbnailers;
+
+  // Directory with decoded icons, NULL if disabled.
+  char *cache_dir;
+
+  // Frame counter, bumped for every redraw of the view.
+  gint frame;
+  // If a frame is being drawn.
+  gboolean in_frame;
+  // Icons requested while drawing the current frame, in order.
+  GPtrArray *requests;
+  // Pinned icons, unpinned at the end of a frame once loaded.
+  GPtrArray *pinned;
+
+  // Loaded icons that can be dropped, least recently used first.
+  GQueue lru;
+  // Memory used by the surfaces in lru.
+  size_t lru_size;
+  // Highest value of lru_size.
+  size_t lru_peak;
+  // Memory budget for lru, 0 for no limit.
+  size_t lru_limit;
+
+  // Statistics, printed on exit.
+  unsigned int stat_hits;
+  unsigned int stat_fetches;
+  unsigned int stat_evictions;
 } IconFetcher;
 
 typedef struct {
@@ -92,6 +161,15 @@ typedef struct {
   gboolean query_done;
   gboolean query_started;
 
+  // Last frame the icon was requested in.
+  gint frame;
+  // Requested outside of a frame, not dropped while loading.
+  gboolean pinned;
+  // In the requests of the current frame.
+  gboolean frame_requested;
+  // Link in the lru, data is NULL when not in there.
+  GList lru;
+
   IconFetcherNameEntry *entry;
 } IconFetcherEntry;
 
@@ -249,7 +327,173 @@ static gboolean rofi_icon_fetcher_create_thumbnail(const gchar *mime_type,
 static void rofi_icon_fetch_thread_pool_entry_remove(gpointer data) {
   IconFetcherEntry *entry = (IconFetcherEntry *)data;
   // Mark it in a way it should be re-fetched on next query?
-  entry->query_started = FALSE;
+  g_atomic_int_set(&(entry->query_started), FALSE);
+}
+
+/**
+ * @param sentry The icon to fetch.
+ *
+ * Push the icon into the fetching queue, unless it is already in there.
+ */
+static void rofi_icon_fetcher_push(IconFetcherEntry *sentry) {
+  if (g_atomic_int_compare_and_exchange(&(sentry->query_started), FALSE,
+                                        TRUE)) {
+    rofi_icon_fetcher_data->stat_fetches++;
+    g_thread_pool_push(tpool, sentry, NULL);
+  }
+}
+
+static size_t rofi_icon_fetcher_surface_size(cairo_surface_t *surface) {
+  if (cairo_surface_get_type(surface) != CAIRO_SURFACE_TYPE_IMAGE) {
+    return 0;
+  }
+  return (size_t)cairo_image_surface_get_stride(surface) *
+         cairo_image_surface_get_height(surface);
+}
+
+/**
+ * @param sentry The loaded icon that is shown.
+ *
+ * Mark the icon as most recently used.
+ */
+static void rofi_icon_fetcher_lru_touch(IconFetcherEntry *sentry) {
+  IconFetcher *data = rofi_icon_fetcher_data;
+  if (sentry->lru.data != NULL) {
+    g_queue_unlink(&(data->lru), &(sentry->lru));
+  } else {
+    sentry->lru.data = sentry;
+    data->lru_size += rofi_icon_fetcher_surface_size(sentry->surface);
+    data->lru_peak = MAX(data->lru_peak, data->lru_size);
+  }
+  g_queue_push_tail_link(&(data->lru), &(sentry->lru));
+}
+
+static void rofi_icon_fetcher_lru_remove(IconFetcherEntry *sentry) {
+  IconFetcher *data = rofi_icon_fetcher_data;
+  g_queue_unlink(&(data->lru), &(sentry->lru));
+  sentry->lru.data = NULL;
+  data->lru_size -= rofi_icon_fetcher_surface_size(sentry->surface);
+}
+
+/**
+ * @param sentry The icon that is requested.
+ *
+ * Mark the icon as shown in the current frame and make sure it gets fetched.
+ * Icons requested while drawing a frame are queued when the frame is done,
+ * ahead of icons requested in earlier frames.
+ */
+static void rofi_icon_fetcher_request(IconFetcherEntry *sentry) {
+  g_atomic_int_set(&(sentry->frame),
+                   g_atomic_int_get(&(rofi_icon_fetcher_data->frame)));
+  if (sentry->query_done) {
+    if (sentry->surface != NULL && !g_atomic_int_get(&(sentry->pinned))) {
+      rofi_icon_fetcher_lru_touch(sentry);
+    }
+    return;
+  }
+  if (!rofi_icon_fetcher_data->in_frame) {
+    // Not drawn as part of the rows, so no later frame keeps it alive while
+    // it loads.
+    if (!g_atomic_int_get(&(sentry->pinned))) {
+      g_atomic_int_set(&(sentry->pinned), TRUE);
+      g_ptr_array_add(rofi_icon_fetcher_data->pinned, sentry);
+    }
+    rofi_icon_fetcher_push(sentry);
+  } else if (!sentry->frame_requested) {
+    sentry->frame_requested = TRUE;
+    g_ptr_array_add(rofi_icon_fetcher_data->requests, sentry);
+  }
+}
+
+/**
+ * @param sentry The icon that is about to be fetched.
+ *
+ * @returns TRUE if the icon was not requested in the last two frames.
+ */
+static gboolean rofi_icon_fetcher_is_stale(IconFetcherEntry *sentry) {
+  guint frame = g_atomic_int_get(&(rofi_icon_fetcher_data->frame));
+  guint last = g_atomic_int_get(&(sentry->frame));
+  return !g_atomic_int_get(&(sentry->pinned)) && (frame - last) > 1;
+}
+
+/**
+ * Unpin the icons requested outside of a frame that finished loading. From
+ * now on they count as shown in the current frame, and are dropped like any
+ * other icon once they are no longer requested.
+ */
+static void rofi_icon_fetcher_unpin(void) {
+  GPtrArray *pinned = rofi_icon_fetcher_data->pinned;
+  gint frame = g_atomic_int_get(&(rofi_icon_fetcher_data->frame));
+  for (guint i = pinned->len; i > 0; i--) {
+    IconFetcherEntry *sentry = g_ptr_array_index(pinned, i - 1);
+    if (!sentry->query_done) {
+      continue;
+    }
+    g_ptr_array_remove_index_fast(pinned, i - 1);
+    g_atomic_int_set(&(sentry->frame), frame);
+    g_atomic_int_set(&(sentry->pinned), FALSE);
+    if (sentry->surface != NULL) {
+      rofi_icon_fetcher_lru_touch(sentry);
+    }
+  }
+}
+
+/**
+ * Drop the least recently used icons that are not shown, until the memory
+ * budget is met. They are fetched again when requested.
+ */
+static void rofi_icon_fetcher_lru_evict(void) {
+  IconFetcher *data = rofi_icon_fetcher_data;
+  while (data->lru_limit > 0 && data->lru_size > data->lru_limit) {
+    GList *link = g_queue_peek_head_link(&(data->lru));
+    if (link == NULL) {
+      break;
+    }
+    IconFetcherEntry *sentry = (IconFetcherEntry *)link->data;
+    if (g_atomic_int_get(&(sentry->pinned))) {
+      // Not dropped while pinned, so it does not count.
+      rofi_icon_fetcher_lru_remove(sentry);
+      continue;
+    }
+    if (!rofi_icon_fetcher_is_stale(sentry)) {
+      // Everything left is shown.
+      break;
+    }
+    rofi_icon_fetcher_lru_remove(sentry);
+    g_debug("evicting icon %s(%dx%d).", sentry->entry->name, sentry->wsize,
+            sentry->hsize);
+    cairo_surface_destroy(sentry->surface);
+    sentry->surface = NULL;
+    sentry->query_done = FALSE;
+    g_atomic_int_set(&(sentry->query_started), FALSE);
+    data->stat_evictions++;
+  }
+}
+
+void rofi_icon_fetcher_frame_start(void) {
+  if (rofi_icon_fetcher_data == NULL) {
+    return;
+  }
+  g_atomic_int_inc(&(rofi_icon_fetcher_data->frame));
+  rofi_icon_fetcher_data->in_frame = TRUE;
+}
+
+void rofi_icon_fetcher_frame_end(void) {
+  if (rofi_icon_fetcher_data == NULL) {
+    return;
+  }
+  GPtrArray *requests = rofi_icon_fetcher_data->requests;
+  rofi_icon_fetcher_data->in_frame = FALSE;
+  // Move the last one to the front first, so the first row loads first.
+  for (guint i = requests->len; i > 0; i--) {
+    IconFetcherEntry *sentry = g_ptr_array_index(requests, i - 1);
+    sentry->frame_requested = FALSE;
+    rofi_icon_fetcher_push(sentry);
+    g_thread_pool_move_to_front(tpool, sentry);
+  }
+  g_ptr_array_set_size(requests, 0);
+  rofi_icon_fetcher_unpin();
+  rofi_icon_fetcher_lru_evict();
 }
 
 static void rofi_icon_fetch_entry_free(gpointer data) {
@@ -270,6 +514,79 @@ static void rofi_icon_fetch_entry_free(gpointer data) {
   g_free(entry);
 }
 
+/** A file in the icon cache directory, considered for pruning. */
+typedef struct {
+  char *path;
+  time_t atime;
+  goffset size;
+} IconCacheFile;
+
+static gint rofi_icon_fetcher_cache_file_cmp(gconstpointer a,
+                                             gconstpointer b) {
+  const IconCacheFile *fa = (const IconCacheFile *)a;
+  const IconCacheFile *fb = (const IconCacheFile *)b;
+  return (fa->atime > fb->atime) - (fa->atime < fb->atime);
+}
+
+/**
+ * @param data The icon cache directory, freed when done.
+ *
+ * Remove the cache files that were not used for ICON_CACHE_MAX_AGE, then the
+ * least recently used ones until the cache fits in ICON_CACHE_MAX_SIZE.
+ * Files are named after their contents, so a changed icon, theme or size
+ * leaves the old file behind until it is pruned here.
+ *
+ * @returns NULL
+ */
+static gpointer rofi_icon_fetcher_cache_prune(gpointer data) {
+  char *dir_path = (char *)data;
+  GDir *dir = g_dir_open(dir_path, 0, NULL);
+  if (dir == NULL) {
+    g_free(dir_path);
+    return NULL;
+  }
+  time_t now = time(NULL);
+  GArray *files = g_array_new(FALSE, FALSE, sizeof(IconCacheFile));
+  goffset total = 0;
+  unsigned int removed = 0;
+  const char *name = NULL;
+  while ((name = g_dir_read_name(dir)) != NULL) {
+    char *path = g_build_filename(dir_path, name, NULL);
+    GStatBuf st;
+    if (g_stat(path, &st) != 0 || !S_ISREG(st.st_mode)) {
+      g_free(path);
+      continue;
+    }
+    if ((now - st.st_atim.tv_sec) > ICON_CACHE_MAX_AGE) {
+      if (g_unlink(path) == 0) {
+        removed++;
+      }
+      g_free(path);
+      continue;
+    }
+    IconCacheFile f = {.path = path, .atime = st.st_atim.tv_sec,
+                       .size = st.st_size};
+    g_array_append_val(files, f);
+    total += st.st_size;
+  }
+  g_dir_close(dir);
+
+  g_array_sort(files, rofi_icon_fetcher_cache_file_cmp);
+  for (guint i = 0; i < files->len; i++) {
+    IconCacheFile *f = &g_array_index(files, IconCacheFile, i);
+    if (total > ICON_CACHE_MAX_SIZE && g_unlink(f->path) == 0) {
+      total -= f->size;
+      removed++;
+    }
+    g_free(f->path);
+  }
+  g_array_free(files, TRUE);
+  g_debug("Icon cache: removed %u files, %" G_GINT64_FORMAT " bytes left.",
+          removed, (gint64)total);
+  g_free(dir_path);
+  return NULL;
+}
+
 void rofi_icon_fetcher_init(void) {
   g_assert(rofi_icon_fetcher_data == NULL);
 
@@ -282,6 +599,10 @@ void rofi_icon_fetcher_init(void) {
       nk_xdg_theme_context_new(icon_fallback_themes, NULL);
   nk_xdg_theme_preload_themes_icon(rofi_icon_fetcher_data->xdg_context, themes);
 
+  rofi_icon_fetcher_data->requests = g_ptr_array_new();
+  rofi_icon_fetcher_data->pinned = g_ptr_array_new();
+  rofi_icon_fetcher_data->lru_limit =
+      (size_t)config.icon_memory_limit * 1024 * 1024;
   rofi_icon_fetcher_data->icon_cache_uid =
       g_hash_table_new(g_direct_hash, g_direct_equal);
   rofi_icon_fetcher_data->icon_cache = g_hash_table_new_full(
@@ -316,6 +637,21 @@ void rofi_icon_fetcher_init(void) {
   for (i = 0; system_data_dirs[i] != NULL; i++) {
     rofi_icon_fetcher_load_thumbnailers(system_data_dirs[i]);
   }
+
+  if (config.icon_cache && cache_dir != NULL) {
+    char *path = g_build_filename(cache_dir, ICON_CACHE_DIR, NULL);
+    if (g_mkdir_with_parents(path, 0700) == 0) {
+      rofi_icon_fetcher_data->cache_dir = path;
+      // Bound the disk use, without holding up the start.
+      g_thread_unref(g_thread_new("icon-cache-prune",
+                                  rofi_icon_fetcher_cache_prune,
+                                  g_strdup(path)));
+    } else {
+      g_warning("Failed to create icon cache directory %s: %s", path,
+                g_strerror(errno));
+      g_free(path);
+    }
+  }
 }
 
 static void free_wrapper(gpointer data, G_GNUC_UNUSED gpointer user_data) {
@@ -327,16 +663,26 @@ void rofi_icon_fetcher_destroy(void) {
     return;
   }
 
+  g_debug("icon fetcher: %u hits, %u fetches, %u evictions, %zu of %zu "
+          "bytes used (peak %zu).",
+          rofi_icon_fetcher_data->stat_hits,
+          rofi_icon_fetcher_data->stat_fetches,
+          rofi_icon_fetcher_data->stat_evictions,
+          rofi_icon_fetcher_data->lru_size, rofi_icon_fetcher_data->lru_limit,
+          rofi_icon_fetcher_data->lru_peak);
   g_hash_table_unref(rofi_icon_fetcher_data->thumbnailers);
 
   nk_xdg_theme_context_free(rofi_icon_fetcher_data->xdg_context);
 
   g_hash_table_unref(rofi_icon_fetcher_data->icon_cache_uid);
   g_hash_table_unref(rofi_icon_fetcher_data->icon_cache);
+  g_ptr_array_free(rofi_icon_fetcher_data->requests, TRUE);
+  g_ptr_array_free(rofi_icon_fetcher_data->pinned, TRUE);
 
   g_list_foreach(rofi_icon_fetcher_data->supported_extensions, free_wrapper,
                  NULL);
   g_list_free(rofi_icon_fetcher_data->supported_extensions);
+  g_free(rofi_icon_fetcher_data->cache_dir);
   g_free(rofi_icon_fetcher_data);
 }
 
@@ -440,6 +786,173 @@ rofi_icon_fetcher_get_surface_from_pixbuf(GdkPixbuf *pixbuf) {
   return surface;
 }
 
+/**
+ * Key to attach the mapped cache file to the surface using it.
+ */
+static const cairo_user_data_key_t icon_cache_map_key;
+
+static void rofi_icon_fetcher_cache_unmap(void *data) {
+  IconCacheMap *m = (IconCacheMap *)data;
+  munmap(m->map, m->size);
+  g_free(m);
+}
+
+/**
+ * @param sentry The icon request.
+ * @param icon_path The file the icon is loaded from.
+ *
+ * The cache file is keyed on the request, the icon theme and the size and
+ * modification time of the source file.
+ *
+ * @returns the path of the cache file for this icon, NULL if not cached.
+ */
+static char *rofi_icon_fetcher_cache_path(const IconFetcherEntry *sentry,
+                                          const char *icon_path) {
+  GStatBuf st;
+  if (rofi_icon_fetcher_data->cache_dir == NULL ||
+      g_stat(icon_path, &st) != 0) {
+    return NULL;
+  }
+  char *key = g_strdup_printf(
+      "%s\n%s\n%s\n%dx%d\n%" G_GINT64_FORMAT ".%ld\n%" G_GINT64_FORMAT,
+      sentry->entry->name, config.icon_theme ? config.icon_theme : "",
+      icon_path, sentry->wsize, sentry->hsize, (gint64)st.st_mtim.tv_sec,
+      (long)st.st_mtim.tv_nsec, (gint64)st.st_size);
+  char *checksum = g_compute_checksum_for_string(G_CHECKSUM_SHA256, key, -1);
+  char *path =
+      g_build_filename(rofi_icon_fetcher_data->cache_dir, checksum, NULL);
+  g_free(checksum);
+  g_free(key);
+  return path;
+}
+
+/**
+ * @param path The cache file.
+ *
+ * Map the cache file and use the pixels in place, nothing is decoded.
+ *
+ * @returns the icon surface, NULL if not cached.
+ */
+static cairo_surface_t *rofi_icon_fetcher_cache_load(const char *path) {
+  int fd = open(path, O_RDONLY | O_CLOEXEC);
+  if (fd < 0) {
+    return NULL;
+  }
+  struct stat st;
+  void *map = MAP_FAILED;
+  if (fstat(fd, &st) == 0 && st.st_size >= (off_t)sizeof(IconCacheHeader)) {
+    // Private and writable, so drawing on the surface does not fault.
+    map = mmap(NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+  }
+  if (map != MAP_FAILED &&
+      (time(NULL) - st.st_atim.tv_sec) > ICON_CACHE_TOUCH_INTERVAL) {
+    // Mark it used for pruning, also on file systems mounted noatime.
+    const struct timespec times[2] = {{.tv_nsec = UTIME_NOW},
+                                      {.tv_nsec = UTIME_OMIT}};
+    futimens(fd, times);
+  }
+  close(fd);
+  if (map == MAP_FAILED) {
+    return NULL;
+  }
+  const IconCacheHeader *header = (const IconCacheHeader *)map;
+  if (header->magic != ICON_CACHE_MAGIC ||
+      header->version != ICON_CACHE_VERSION || header->width <= 0 ||
+      header->height <= 0 ||
+      header->stride != cairo_format_stride_for_width(CAIRO_FORMAT_ARGB32,
+                                                      header->width) ||
+      (guint64)header->stride * header->height !=
+          (guint64)st.st_size - sizeof(IconCacheHeader)) {
+    g_debug("Icon cache file %s corrupt, ignoring.", path);
+    munmap(map, st.st_size);
+    return NULL;
+  }
+  cairo_surface_t *surface = cairo_image_surface_create_for_data(
+      (unsigned char *)map + sizeof(IconCacheHeader), CAIRO_FORMAT_ARGB32,
+      header->width, header->height, header->stride);
+  IconCacheMap *m = g_new0(IconCacheMap, 1);
+  m->map = map;
+  m->size = st.st_size;
+  if (cairo_surface_set_user_data(surface, &icon_cache_map_key, m,
+                                  rofi_icon_fetcher_cache_unmap) !=
+      CAIRO_STATUS_SUCCESS) {
+    cairo_surface_destroy(surface);
+    rofi_icon_fetcher_cache_unmap(m);
+    return NULL;
+  }
+  return surface;
+}
+
+/**
+ * @param path The cache file.
+ * @param surface The decoded icon.
+ *
+ * Store the pixels of the icon in the cache.
+ */
+static void rofi_icon_fetcher_cache_store(const char *path,
+                                          cairo_surface_t *surface) {
+  if (cairo_image_surface_get_format(surface) != CAIRO_FORMAT_ARGB32) {
+    return;
+  }
+  cairo_surface_flush(surface);
+  IconCacheHeader header = {
+      .magic = ICON_CACHE_MAGIC,
+      .version = ICON_CACHE_VERSION,
+      .width = cairo_image_surface_get_width(surface),
+      .height = cairo_image_surface_get_height(surface),
+      .stride = cairo_image_surface_get_stride(surface),
+  };
+  size_t size = (size_t)header.stride * header.height;
+  char *data = g_malloc(sizeof(header) + size);
+  memcpy(data, &header, sizeof(header));
+  memcpy(data + sizeof(header), cairo_image_surface_get_data(surface), size);
+  GError *error = NULL;
+  // Written to a temporary file and renamed, readers never see a partial one.
+  if (!g_file_set_contents(path, data, sizeof(header) + size, &error)) {
+    g_debug("Failed to write icon cache file %s: %s", path, error->message);
+    g_error_free(error);
+  }
+  g_free(data);
+}
+
+/**
+ * @param icon_path The image to load.
+ * @param wsize The width to scale it to.
+ * @param hsize The height to scale it to.
+ *
+ * @returns the decoded image, NULL on failure.
+ */
+static cairo_surface_t *rofi_icon_fetcher_load_image(const char *icon_path,
+                                                     int wsize, int hsize) {
+  cairo_surface_t *icon_surf = NULL;
+  GError *error = NULL;
+  GdkPixbuf *pb =
+      gdk_pixbuf_new_from_file_at_scale(icon_path, wsize, hsize, TRUE, &error);
+
+  /*
+   * The GIF codec throws GDK_PIXBUF_ERROR_INCOMPLETE_ANIMATION if it's closed
+   * without decoding all the frames. Since gdk_pixbuf_new_from_file_at_scale
+   * only decodes the first frame, this specific error needs to be ignored.
+   */
+  if (error != NULL && g_error_matches(error, GDK_PIXBUF_ERROR,
+                                       GDK_PIXBUF_ERROR_INCOMPLETE_ANIMATION)) {
+    g_clear_error(&error);
+  }
+
+  if (error != NULL) {
+    g_warning("Failed to load image: |%s| %d %d %s (%p)", icon_path, wsize,
+              hsize, error->message, (void *)pb);
+    g_error_free(error);
+    if (pb) {
+      g_object_unref(pb);
+    }
+  } else {
+    icon_surf = rofi_icon_fetcher_get_surface_from_pixbuf(pb);
+    g_object_unref(pb);
+  }
+  return icon_surf;
+}
+
 gboolean rofi_icon_fetcher_file_is_image(const char *const path) {
   if (path == NULL) {
     return FALSE;
@@ -468,30 +981,30 @@ static gchar *rofi_icon_fetcher_get_thumbnail(gchar *name, int requested_size,
   const gchar *md5_hex = g_checksum_get_string(checksum);
 
   // determine thumbnail folder based on the request size
-  const gchar *cache_dir = g_get_user_cache_dir();
+  const gchar *user_cache = g_get_user_cache_dir();
   gchar *thumb_dir;
   gchar *thumb_path;
 
   if (requested_size <= 128) {
     *thumb_size = 128;
-    thumb_dir = g_strconcat(cache_dir, "/thumbnails/normal/", NULL);
+    thumb_dir = g_strconcat(user_cache, "/thumbnails/normal/", NULL);
     thumb_path =
-        g_strconcat(cache_dir, "/thumbnails/normal/", md5_hex, ".png", NULL);
+        g_strconcat(user_cache, "/thumbnails/normal/", md5_hex, ".png", NULL);
   } else if (requested_size <= 256) {
     *thumb_size = 256;
-    thumb_dir = g_strconcat(cache_dir, "/thumbnails/large/", NULL);
+    thumb_dir = g_strconcat(user_cache, "/thumbnails/large/", NULL);
     thumb_path =
-        g_strconcat(cache_dir, "/thumbnails/large/", md5_hex, ".png", NULL);
+        g_strconcat(user_cache, "/thumbnails/large/", md5_hex, ".png", NULL);
   } else if (requested_size <= 512) {
     *thumb_size = 512;
-    thumb_dir = g_strconcat(cache_dir, "/thumbnails/x-large/", NULL);
+    thumb_dir = g_strconcat(user_cache, "/thumbnails/x-large/", NULL);
     thumb_path =
-        g_strconcat(cache_dir, "/thumbnails/x-large/", md5_hex, ".png", NULL);
+        g_strconcat(user_cache, "/thumbnails/x-large/", md5_hex, ".png", NULL);
   } else {
     *thumb_size = 1024;
-    thumb_dir = g_strconcat(cache_dir, "/thumbnails/xx-large/", NULL);
+    thumb_dir = g_strconcat(user_cache, "/thumbnails/xx-large/", NULL);
     thumb_path =
-        g_strconcat(cache_dir, "/thumbnails/xx-large/", md5_hex, ".png", NULL);
+        g_strconcat(user_cache, "/thumbnails/xx-large/", md5_hex, ".png", NULL);
   }
 
   // create thumbnail directory if it does not exist
@@ -533,6 +1046,19 @@ static void rofi_icon_fetcher_worker(thread_state *sdata,
   IconFetcherEntry *sentry = (IconFetcherEntry *)sdata;
   const gchar *themes[] = {config.icon_theme, NULL};
 
+  // Drop icons that scrolled out of view, they are queued again when shown.
+  if (rofi_icon_fetcher_is_stale(sentry)) {
+    g_atomic_int_set(&(sentry->query_started), FALSE);
+    // Unless it was requested again in the meantime.
+    if (rofi_icon_fetcher_is_stale(sentry) ||
+        !g_atomic_int_compare_and_exchange(&(sentry->query_started), FALSE,
+                                           TRUE)) {
+      g_debug("dropping icon request %s(%dx%d).", sentry->entry->name,
+              sentry->wsize, sentry->hsize);
+      return;
+    }
+  }
+
   const gchar *icon_path;
   gchar *icon_path_ = NULL;
 
@@ -542,7 +1068,7 @@ static void rofi_icon_fetcher_worker(thread_state *sdata,
 
     if (strcmp(entry_name, "") == 0) {
       sentry->query_done = TRUE;
-      rofi_view_reload();
+      rofi_view_queue_icon_redraw();
       return;
     }
 
@@ -643,7 +1169,7 @@ static void rofi_icon_fetcher_worker(thread_state *sdata,
     // no suitable icon or thumbnail was found
     if (icon_path_ == NULL || !g_file_test(icon_path, G_FILE_TEST_EXISTS)) {
       sentry->query_done = TRUE;
-      rofi_view_reload();
+      rofi_view_queue_icon_redraw();
       return;
     }
   } else if (g_path_is_absolute(sentry->entry->name)) {
@@ -672,7 +1198,7 @@ static void rofi_icon_fetcher_worker(thread_state *sdata,
     cairo_destroy(cr);
     sentry->surface = surface;
     sentry->query_done = TRUE;
-    rofi_view_reload();
+    rofi_view_queue_icon_redraw();
     return;
 
   } else {
@@ -691,7 +1217,7 @@ static void rofi_icon_fetcher_worker(thread_state *sdata,
       }
       if (icon_path_ == NULL) {
         sentry->query_done = TRUE;
-        rofi_view_reload();
+        rofi_view_queue_icon_redraw();
         return;
       }
     } else {
@@ -706,41 +1232,32 @@ static void rofi_icon_fetcher_worker(thread_state *sdata,
   if (suf == NULL) {
     sentry->query_done = TRUE;
     g_free(icon_path_);
-    rofi_view_reload();
+    rofi_view_queue_icon_redraw();
     return;
   }
 #endif
 
-  GError *error = NULL;
-  GdkPixbuf *pb = gdk_pixbuf_new_from_file_at_scale(
-      icon_path, sentry->wsize, sentry->hsize, TRUE, &error);
-
-  /*
-   * The GIF codec throws GDK_PIXBUF_ERROR_INCOMPLETE_ANIMATION if it's closed
-   * without decoding all the frames. Since gdk_pixbuf_new_from_file_at_scale
-   * only decodes the first frame, this specific error needs to be ignored.
-   */
-  if (error != NULL && g_error_matches(error, GDK_PIXBUF_ERROR,
-                                       GDK_PIXBUF_ERROR_INCOMPLETE_ANIMATION)) {
-    g_clear_error(&error);
+  // Thumbnails are already cached by the thumbnailers.
+  char *cache_path = NULL;
+  if (!g_str_has_prefix(sentry->entry->name, "thumbnail://")) {
+    cache_path = rofi_icon_fetcher_cache_path(sentry, icon_path);
   }
-
-  if (error != NULL) {
-    g_warning("Failed to load image: |%s| %d %d %s (%p)", icon_path,
-              sentry->wsize, sentry->hsize, error->message, (void *)pb);
-    g_error_free(error);
-    if (pb) {
-      g_object_unref(pb);
+  if (cache_path != NULL) {
+    icon_surf = rofi_icon_fetcher_cache_load(cache_path);
+  }
+  if (icon_surf == NULL) {
+    icon_surf =
+        rofi_icon_fetcher_load_image(icon_path, sentry->wsize, sentry->hsize);
+    if (icon_surf != NULL && cache_path != NULL) {
+      rofi_icon_fetcher_cache_store(cache_path, icon_surf);
     }
-  } else {
-    icon_surf = rofi_icon_fetcher_get_surface_from_pixbuf(pb);
-    g_object_unref(pb);
   }
+  g_free(cache_path);
 
   sentry->surface = icon_surf;
   g_free(icon_path_);
   sentry->query_done = TRUE;
-  rofi_view_reload();
+  rofi_view_queue_icon_redraw();
 }
 
 uint32_t rofi_icon_fetcher_query_advanced(const char *name, const int wsize,
@@ -758,9 +1275,7 @@ uint32_t rofi_icon_fetcher_query_advanced(const char *name, const int wsize,
        iter = g_list_next(iter)) {
     sentry = iter->data;
     if (sentry->wsize == wsize && sentry->hsize == hsize) {
-      if (!sentry->query_started) {
-        g_thread_pool_push(tpool, sentry, NULL);
-      }
+      rofi_icon_fetcher_request(sentry);
       return sentry->uid;
     }
   }
@@ -772,7 +1287,7 @@ uint32_t rofi_icon_fetcher_query_advanced(const char *name, const int wsize,
   sentry->hsize = hsize;
   sentry->entry = entry;
   sentry->query_done = FALSE;
-  sentry->query_started = TRUE;
+  sentry->query_started = FALSE;
   sentry->surface = NULL;
 
   entry->sizes = g_list_prepend(entry->sizes, sentry);
@@ -783,7 +1298,7 @@ uint32_t rofi_icon_fetcher_query_advanced(const char *name, const int wsize,
   sentry->state.callback = rofi_icon_fetcher_worker;
   sentry->state.free = rofi_icon_fetch_thread_pool_entry_remove;
   sentry->state.priority = G_PRIORITY_LOW;
-  g_thread_pool_push(tpool, sentry, NULL);
+  rofi_icon_fetcher_request(sentry);
 
   return sentry->uid;
 }
@@ -801,9 +1316,7 @@ uint32_t rofi_icon_fetcher_query(const char *name, const int size) {
        iter = g_list_next(iter)) {
     sentry = iter->data;
     if (sentry->wsize == size && sentry->hsize == size) {
-      if (!sentry->query_started) {
-        g_thread_pool_push(tpool, sentry, NULL);
-      }
+      rofi_icon_fetcher_request(sentry);
       return sentry->uid;
     }
   }
@@ -815,7 +1328,7 @@ uint32_t rofi_icon_fetcher_query(const char *name, const int size) {
   sentry->hsize = size;
   sentry->entry = entry;
   sentry->query_done = FALSE;
-  sentry->query_started = TRUE;
+  sentry->query_started = FALSE;
   sentry->surface = NULL;
 
   entry->sizes = g_list_prepend(entry->sizes, sentry);
@@ -826,7 +1339,7 @@ uint32_t rofi_icon_fetcher_query(const char *name, const int size) {
   sentry->state.callback = rofi_icon_fetcher_worker;
   sentry->state.free = rofi_icon_fetch_thread_pool_entry_remove;
   sentry->state.priority = G_PRIORITY_LOW;
-  g_thread_pool_push(tpool, sentry, NULL);
+  rofi_icon_fetcher_request(sentry);
 
   return sentry->uid;
 }
@@ -835,6 +1348,10 @@ cairo_surface_t *rofi_icon_fetcher_get(const uint32_t uid) {
   IconFetcherEntry *sentry = g_hash_table_lookup(
       rofi_icon_fetcher_data->icon_cache_uid, GINT_TO_POINTER(uid));
   if (sentry) {
+    rofi_icon_fetcher_request(sentry);
+    if (sentry->surface != NULL) {
+      rofi_icon_fetcher_data->stat_hits++;
+    }
     return sentry->surface;
   }
   g_warning("Querying an non-existing uid");
@@ -847,6 +1364,10 @@ gboolean rofi_icon_fetcher_get_ex(const uint32_t uid,
       rofi_icon_fetcher_data->icon_cache_uid, GINT_TO_POINTER(uid));
   *surface = NULL;
   if (sentry) {
+    rofi_icon_fetcher_request(sentry);
+    if (sentry->surface != NULL) {
+      rofi_icon_fetcher_data->stat_hits++;
+    }
     *surface = sentry->surface;
     return sentry->query_done;
   }
@@ -33,3 +33,6 @@ const char *const PropertyTypeName[P_NUM_TYPES] = {
     /** Inherit */
     "Inherit",
 };
+
+/** Thread pool used for filtering */
+GThreadPool *tpool = NULL;
@@ -72,6 +72,58 @@ void rofi_theme_print_parsed_files(gboolean is_term) {
 }
 
 void yyerror(YYLTYPE *yylloc, const char *, const char *);
+
+/**
+ * Resolved lookups of one property on a (widget, state) pair, one slot per
+ * #PropertyType.
+ */
+typedef struct {
+  /** Bit mask of the #PropertyType slots that have been resolved. */
+  guint32 resolved;
+  /** Property found for each type, NULL if unset. */
+  Property *found[P_NUM_TYPES];
+} RofiThemeStyleProperty;
+
+G_STATIC_ASSERT(P_NUM_TYPES <= 32);
+
+/**
+ * The theme compiled for a widget name in a given state.
+ */
+typedef struct {
+  /** Widget name, owned by #rofi_theme_styles. */
+  const char *name;
+  /** Widget state, owned by #rofi_theme_styles. */
+  const char *state;
+  /** The theme widget matching the name and state. */
+  ThemeWidget *wid;
+  /** Property name to #RofiThemeStyleProperty. */
+  GHashTable *properties;
+} RofiThemeStyle;
+
+/**
+ * Widget name to a table of state to #RofiThemeStyle.
+ * Dropped whenever the theme tree is modified.
+ */
+static GHashTable *rofi_theme_styles = NULL;
+/** Last style looked up, widgets tend to query several properties in a row. */
+static RofiThemeStyle *rofi_theme_style_last = NULL;
+
+static void rofi_theme_style_free(RofiThemeStyle *style) {
+  g_hash_table_destroy(style->properties);
+  g_free(style);
+}
+
+/**
+ * Drop all resolved styles, the theme tree they point into changed.
+ */
+static void rofi_theme_styles_invalidate(void) {
+  if (rofi_theme_styles != NULL) {
+    g_hash_table_destroy(rofi_theme_styles);
+    rofi_theme_styles = NULL;
+  }
+  rofi_theme_style_last = NULL;
+}
+
 static gboolean distance_compare(RofiDistance d, RofiDistance e) {
   // TODO UPDATE
   return d.base.type == e.base.type && d.base.distance == e.base.distance &&
@@ -86,6 +138,7 @@ ThemeWidget *rofi_theme_find_or_create_name(ThemeWidget *base,
     }
   }
 
+  rofi_theme_styles_invalidate();
   base->widgets =
       g_realloc(base->widgets, sizeof(ThemeWidget *) * (base->num_widgets + 1));
   base->widgets[base->num_widgets] = g_slice_new0(ThemeWidget);
@@ -241,6 +294,7 @@ void rofi_theme_free(ThemeWidget *wid) {
   if (wid == NULL) {
     return;
   }
+  rofi_theme_styles_invalidate();
   if (wid->properties) {
     g_hash_table_destroy(wid->properties);
     wid->properties = NULL;
@@ -655,6 +709,7 @@ void rofi_theme_widget_add_properties(ThemeWidget *wid, GHashTable *table) {
   if (table == NULL) {
     return;
   }
+  rofi_theme_styles_invalidate();
   if (wid->properties == NULL) {
     wid->properties =
         g_hash_table_new_full(g_str_hash, g_str_equal, NULL,
@@ -794,15 +849,74 @@ ThemeWidget *rofi_theme_find_widget(const char *name, const char *state,
   return wid;
 }
 
+/**
+ * @param name The name of the widget.
+ * @param state The state of the widget.
+ * @param type The type of the property.
+ * @param property The name of the property.
+ *
+ * Same as rofi_theme_find_property() on rofi_theme_find_widget(), but the
+ * result is remembered until the theme changes. Widgets look up the same
+ * properties on every redraw, this avoids walking the theme tree each time.
+ *
+ * @returns the property if found, otherwise NULL.
+ */
+static Property *rofi_theme_style_find(const char *name, const char *state,
+                                       PropertyType type,
+                                       const char *property) {
+  // A NULL and an empty name or state resolve to the same theme widget.
+  const char *name_key = name ? name : "";
+  const char *state_key = state ? state : "";
+  RofiThemeStyle *style = rofi_theme_style_last;
+  if (style == NULL || strcmp(style->name, name_key) != 0 ||
+      strcmp(style->state, state_key) != 0) {
+    if (rofi_theme_styles == NULL) {
+      rofi_theme_styles =
+          g_hash_table_new_full(g_str_hash, g_str_equal, g_free,
+                                (GDestroyNotify)g_hash_table_destroy);
+    }
+    char *stored_name = NULL;
+    GHashTable *states = NULL;
+    if (!g_hash_table_lookup_extended(rofi_theme_styles, name_key,
+                                      (gpointer *)&stored_name,
+                                      (gpointer *)&states)) {
+      stored_name = g_strdup(name_key);
+      states = g_hash_table_new_full(g_str_hash, g_str_equal, g_free,
+                                     (GDestroyNotify)rofi_theme_style_free);
+      g_hash_table_insert(rofi_theme_styles, stored_name, states);
+    }
+    style = g_hash_table_lookup(states, state_key);
+    if (style == NULL) {
+      style = g_new0(RofiThemeStyle, 1);
+      style->name = stored_name;
+      style->state = g_strdup(state_key);
+      style->wid = rofi_theme_find_widget(name, state, FALSE);
+      style->properties =
+          g_hash_table_new_full(g_str_hash, g_str_equal, g_free, g_free);
+      g_hash_table_insert(states, (char *)style->state, style);
+    }
+    rofi_theme_style_last = style;
+  }
+  RofiThemeStyleProperty *sp = g_hash_table_lookup(style->properties, property);
+  if (sp == NULL) {
+    sp = g_new0(RofiThemeStyleProperty, 1);
+    g_hash_table_insert(style->properties, g_strdup(property), sp);
+  }
+  if ((sp->resolved & (1u << type)) == 0) {
+    sp->found[type] =
+        rofi_theme_find_property(style->wid, type, property, FALSE);
+    sp->resolved |= (1u << type);
+  }
+  return sp->found[type];
+}
+
 static int rofi_theme_get_position_inside(Property *p, const widget *wid,
                                           const char *property, int def) {
   if (p) {
     if (p->type == P_INHERIT) {
       if (wid->parent) {
-        ThemeWidget *parent =
-            rofi_theme_find_widget(wid->parent->name, wid->state, FALSE);
-        Property *pv =
-            rofi_theme_find_property(parent, P_POSITION, property, FALSE);
+        Property *pv = rofi_theme_style_find(wid->parent->name, wid->state,
+                                             P_POSITION, property);
         return rofi_theme_get_position_inside(pv, wid->parent, property, def);
       }
       return def;
@@ -814,8 +928,8 @@ static int rofi_theme_get_position_inside(Property *p, const widget *wid,
   return def;
 }
 int rofi_theme_get_position(const widget *wid, const char *property, int def) {
-  ThemeWidget *wid_find = rofi_theme_find_widget(wid->name, wid->state, FALSE);
-  Property *p = rofi_theme_find_property(wid_find, P_POSITION, property, FALSE);
+  Property *p =
+      rofi_theme_style_find(wid->name, wid->state, P_POSITION, property);
   return rofi_theme_get_position_inside(p, wid, property, def);
 }
 static int rofi_theme_get_integer_inside(Property *p, const widget *wid,
@@ -823,10 +937,8 @@ static int rofi_theme_get_integer_inside(Property *p, const widget *wid,
   if (p) {
     if (p->type == P_INHERIT) {
       if (wid->parent) {
-        ThemeWidget *parent =
-            rofi_theme_find_widget(wid->parent->name, wid->state, FALSE);
-        Property *pv =
-            rofi_theme_find_property(parent, P_INTEGER, property, FALSE);
+        Property *pv = rofi_theme_style_find(wid->parent->name, wid->state,
+                                             P_INTEGER, property);
         return rofi_theme_get_integer_inside(pv, wid->parent, property, def);
       }
       return def;
@@ -838,8 +950,8 @@ static int rofi_theme_get_integer_inside(Property *p, const widget *wid,
   return def;
 }
 int rofi_theme_get_integer(const widget *wid, const char *property, int def) {
-  ThemeWidget *wid_find = rofi_theme_find_widget(wid->name, wid->state, FALSE);
-  Property *p = rofi_theme_find_property(wid_find, P_INTEGER, property, FALSE);
+  Property *p =
+      rofi_theme_style_find(wid->name, wid->state, P_INTEGER, property);
   return (int)rofi_theme_get_integer_inside(p, wid, property, (double)def);
 }
 static RofiDistance rofi_theme_get_distance_inside(Property *p,
@@ -849,10 +961,8 @@ static RofiDistance rofi_theme_get_distance_inside(Property *p,
   if (p) {
     if (p->type == P_INHERIT) {
       if (wid->parent) {
-        ThemeWidget *parent =
-            rofi_theme_find_widget(wid->parent->name, wid->state, FALSE);
-        Property *pv =
-            rofi_theme_find_property(parent, P_PADDING, property, FALSE);
+        Property *pv = rofi_theme_style_find(wid->parent->name, wid->state,
+                                             P_PADDING, property);
         return rofi_theme_get_distance_inside(pv, wid->parent, property, def);
       }
       return (RofiDistance){
@@ -874,8 +984,8 @@ static RofiDistance rofi_theme_get_distance_inside(Property *p,
 }
 RofiDistance rofi_theme_get_distance(const widget *wid, const char *property,
                                      int def) {
-  ThemeWidget *wid_find = rofi_theme_find_widget(wid->name, wid->state, FALSE);
-  Property *p = rofi_theme_find_property(wid_find, P_PADDING, property, FALSE);
+  Property *p =
+      rofi_theme_style_find(wid->name, wid->state, P_PADDING, property);
   return rofi_theme_get_distance_inside(p, wid, property, def);
 }
 
@@ -884,10 +994,8 @@ static int rofi_theme_get_boolean_inside(Property *p, const widget *wid,
   if (p) {
     if (p->type == P_INHERIT) {
       if (wid->parent) {
-        ThemeWidget *parent =
-            rofi_theme_find_widget(wid->parent->name, wid->state, FALSE);
-        Property *pv =
-            rofi_theme_find_property(parent, P_BOOLEAN, property, FALSE);
+        Property *pv = rofi_theme_style_find(wid->parent->name, wid->state,
+                                             P_BOOLEAN, property);
         return rofi_theme_get_boolean_inside(pv, wid->parent, property, def);
       }
       return def;
@@ -899,8 +1007,8 @@ static int rofi_theme_get_boolean_inside(Property *p, const widget *wid,
   return def;
 }
 int rofi_theme_get_boolean(const widget *wid, const char *property, int def) {
-  ThemeWidget *wid_find = rofi_theme_find_widget(wid->name, wid->state, FALSE);
-  Property *p = rofi_theme_find_property(wid_find, P_BOOLEAN, property, FALSE);
+  Property *p =
+      rofi_theme_style_find(wid->name, wid->state, P_BOOLEAN, property);
   return rofi_theme_get_boolean_inside(p, wid, property, def);
 }
 
@@ -911,10 +1019,8 @@ static RofiOrientation rofi_theme_get_orientation_inside(Property *p,
   if (p) {
     if (p->type == P_INHERIT) {
       if (wid->parent) {
-        ThemeWidget *parent =
-            rofi_theme_find_widget(wid->parent->name, wid->state, FALSE);
-        Property *pv =
-            rofi_theme_find_property(parent, P_ORIENTATION, property, FALSE);
+        Property *pv = rofi_theme_style_find(wid->parent->name, wid->state,
+                                             P_ORIENTATION, property);
         return rofi_theme_get_orientation_inside(pv, wid->parent, property,
                                                  def);
       }
@@ -929,9 +1035,8 @@ static RofiOrientation rofi_theme_get_orientation_inside(Property *p,
 RofiOrientation rofi_theme_get_orientation(const widget *wid,
                                            const char *property,
                                            RofiOrientation def) {
-  ThemeWidget *wid_find = rofi_theme_find_widget(wid->name, wid->state, FALSE);
   Property *p =
-      rofi_theme_find_property(wid_find, P_ORIENTATION, property, FALSE);
+      rofi_theme_style_find(wid->name, wid->state, P_ORIENTATION, property);
   return rofi_theme_get_orientation_inside(p, wid, property, def);
 }
 
@@ -942,10 +1047,8 @@ static RofiCursorType rofi_theme_get_cursor_type_inside(Property *p,
   if (p) {
     if (p->type == P_INHERIT) {
       if (wid->parent) {
-        ThemeWidget *parent =
-            rofi_theme_find_widget(wid->parent->name, wid->state, FALSE);
-        Property *pv =
-            rofi_theme_find_property(parent, P_CURSOR, property, FALSE);
+        Property *pv = rofi_theme_style_find(wid->parent->name, wid->state,
+                                             P_CURSOR, property);
         return rofi_theme_get_cursor_type_inside(pv, wid->parent, property,
                                                  def);
       }
@@ -960,8 +1063,8 @@ static RofiCursorType rofi_theme_get_cursor_type_inside(Property *p,
 RofiCursorType rofi_theme_get_cursor_type(const widget *wid,
                                           const char *property,
                                           RofiCursorType def) {
-  ThemeWidget *wid_find = rofi_theme_find_widget(wid->name, wid->state, FALSE);
-  Property *p = rofi_theme_find_property(wid_find, P_CURSOR, property, FALSE);
+  Property *p =
+      rofi_theme_style_find(wid->name, wid->state, P_CURSOR, property);
   return rofi_theme_get_cursor_type_inside(p, wid, property, def);
 }
 static const char *rofi_theme_get_string_inside(Property *p, const widget *wid,
@@ -970,10 +1073,8 @@ static const char *rofi_theme_get_string_inside(Property *p, const widget *wid,
   if (p) {
     if (p->type == P_INHERIT) {
       if (wid->parent) {
-        ThemeWidget *parent =
-            rofi_theme_find_widget(wid->parent->name, wid->state, FALSE);
-        Property *pv =
-            rofi_theme_find_property(parent, P_STRING, property, FALSE);
+        Property *pv = rofi_theme_style_find(wid->parent->name, wid->state,
+                                             P_STRING, property);
         return rofi_theme_get_string_inside(pv, wid->parent, property, def);
       }
       return def;
@@ -986,8 +1087,8 @@ static const char *rofi_theme_get_string_inside(Property *p, const widget *wid,
 }
 const char *rofi_theme_get_string(const widget *wid, const char *property,
                                   const char *def) {
-  ThemeWidget *wid_find = rofi_theme_find_widget(wid->name, wid->state, FALSE);
-  Property *p = rofi_theme_find_property(wid_find, P_STRING, property, FALSE);
+  Property *p =
+      rofi_theme_style_find(wid->name, wid->state, P_STRING, property);
   return rofi_theme_get_string_inside(p, wid, property, def);
 }
 
@@ -998,10 +1099,8 @@ static double rofi_theme_get_double_integer_fb_inside(Property *p,
   if (p) {
     if (p->type == P_INHERIT) {
       if (wid->parent) {
-        ThemeWidget *parent =
-            rofi_theme_find_widget(wid->parent->name, wid->state, FALSE);
-        Property *pv =
-            rofi_theme_find_property(parent, P_INTEGER, property, FALSE);
+        Property *pv = rofi_theme_style_find(wid->parent->name, wid->state,
+                                             P_INTEGER, property);
         return rofi_theme_get_double_integer_fb_inside(pv, wid->parent,
                                                        property, def);
       }
@@ -1019,10 +1118,8 @@ static double rofi_theme_get_double_inside(const widget *orig, Property *p,
   if (p) {
     if (p->type == P_INHERIT) {
       if (wid->parent) {
-        ThemeWidget *parent =
-            rofi_theme_find_widget(wid->parent->name, wid->state, FALSE);
-        Property *pv =
-            rofi_theme_find_property(parent, P_DOUBLE, property, FALSE);
+        Property *pv = rofi_theme_style_find(wid->parent->name, wid->state,
+                                             P_DOUBLE, property);
         return rofi_theme_get_double_inside(orig, pv, wid->parent, property,
                                             def);
       }
@@ -1030,15 +1127,14 @@ static double rofi_theme_get_double_inside(const widget *orig, Property *p,
     }
     return p->value.f;
   }
-  ThemeWidget *wid_find = rofi_theme_find_widget(orig->name, wid->state, FALSE);
   // Fallback to integer if double is not found.
-  p = rofi_theme_find_property(wid_find, P_INTEGER, property, FALSE);
+  p = rofi_theme_style_find(orig->name, wid->state, P_INTEGER, property);
   return rofi_theme_get_double_integer_fb_inside(p, wid, property, def);
 }
 double rofi_theme_get_double(const widget *wid, const char *property,
                              double def) {
-  ThemeWidget *wid_find = rofi_theme_find_widget(wid->name, wid->state, FALSE);
-  Property *p = rofi_theme_find_property(wid_find, P_DOUBLE, property, FALSE);
+  Property *p =
+      rofi_theme_style_find(wid->name, wid->state, P_DOUBLE, property);
   return rofi_theme_get_double_inside(wid, p, wid, property, def);
 }
 static void rofi_theme_get_color_inside(const widget *wid, Property *p,
@@ -1046,10 +1142,8 @@ static void rofi_theme_get_color_inside(const widget *wid, Property *p,
   if (p) {
     if (p->type == P_INHERIT) {
       if (wid->parent) {
-        ThemeWidget *parent =
-            rofi_theme_find_widget(wid->parent->name, wid->state, FALSE);
-        Property *pv =
-            rofi_theme_find_property(parent, P_COLOR, property, FALSE);
+        Property *pv = rofi_theme_style_find(wid->parent->name, wid->state,
+                                             P_COLOR, property);
         rofi_theme_get_color_inside(wid->parent, pv, property, d);
       }
       return;
@@ -1063,8 +1157,7 @@ static void rofi_theme_get_color_inside(const widget *wid, Property *p,
 }
 
 void rofi_theme_get_color(const widget *wid, const char *property, cairo_t *d) {
-  ThemeWidget *wid_find = rofi_theme_find_widget(wid->name, wid->state, FALSE);
-  Property *p = rofi_theme_find_property(wid_find, P_COLOR, property, FALSE);
+  Property *p = rofi_theme_style_find(wid->name, wid->state, P_COLOR, property);
   rofi_theme_get_color_inside(wid, p, property, d);
 }
 
@@ -1073,10 +1166,8 @@ static gboolean rofi_theme_get_image_inside(Property *p, const widget *wid,
   if (p) {
     if (p->type == P_INHERIT) {
       if (wid->parent) {
-        ThemeWidget *parent =
-            rofi_theme_find_widget(wid->parent->name, wid->state, FALSE);
-        Property *pv =
-            rofi_theme_find_property(parent, P_IMAGE, property, FALSE);
+        Property *pv = rofi_theme_style_find(wid->parent->name, wid->state,
+                                             P_IMAGE, property);
         return rofi_theme_get_image_inside(pv, wid->parent, property, d);
       }
       return FALSE;
@@ -1172,8 +1263,7 @@ static gboolean rofi_theme_get_image_inside(Property *p, const widget *wid,
 }
 gboolean rofi_theme_get_image(const widget *wid, const char *property,
                               cairo_t *d) {
-  ThemeWidget *wid_find = rofi_theme_find_widget(wid->name, wid->state, FALSE);
-  Property *p = rofi_theme_find_property(wid_find, P_IMAGE, property, FALSE);
+  Property *p = rofi_theme_style_find(wid->name, wid->state, P_IMAGE, property);
   return rofi_theme_get_image_inside(p, wid, property, d);
 }
 static RofiPadding rofi_theme_get_padding_inside(Property *p, const widget *wid,
@@ -1182,10 +1272,8 @@ static RofiPadding rofi_theme_get_padding_inside(Property *p, const widget *wid,
   if (p) {
     if (p->type == P_INHERIT) {
       if (wid->parent) {
-        ThemeWidget *parent =
-            rofi_theme_find_widget(wid->parent->name, wid->state, FALSE);
-        Property *pv =
-            rofi_theme_find_property(parent, P_PADDING, property, FALSE);
+        Property *pv = rofi_theme_style_find(wid->parent->name, wid->state,
+                                             P_PADDING, property);
         return rofi_theme_get_padding_inside(pv, wid->parent, property, pad);
       }
       return pad;
@@ -1206,8 +1294,8 @@ static RofiPadding rofi_theme_get_padding_inside(Property *p, const widget *wid,
 }
 RofiPadding rofi_theme_get_padding(const widget *wid, const char *property,
                                    RofiPadding pad) {
-  ThemeWidget *wid_find = rofi_theme_find_widget(wid->name, wid->state, FALSE);
-  Property *p = rofi_theme_find_property(wid_find, P_PADDING, property, FALSE);
+  Property *p =
+      rofi_theme_style_find(wid->name, wid->state, P_PADDING, property);
   return rofi_theme_get_padding_inside(p, wid, property, pad);
 }
 
@@ -1217,10 +1305,8 @@ static GList *rofi_theme_get_list_inside(Property *p, const widget *wid,
   if (p) {
     if (p->type == P_INHERIT) {
       if (wid->parent) {
-        ThemeWidget *parent =
-            rofi_theme_find_widget(wid->parent->name, wid->state, FALSE);
-        Property *pv =
-            rofi_theme_find_property(parent, P_LIST, property, FALSE);
+        Property *pv = rofi_theme_style_find(wid->parent->name, wid->state,
+                                             P_LIST, property);
         return rofi_theme_get_list_inside(pv, wid->parent, property,
                                           child_type);
       }
@@ -1231,8 +1317,7 @@ static GList *rofi_theme_get_list_inside(Property *p, const widget *wid,
   return NULL;
 }
 GList *rofi_theme_get_list_distance(const widget *wid, const char *property) {
-  ThemeWidget *wid2 = rofi_theme_find_widget(wid->name, wid->state, FALSE);
-  Property *p = rofi_theme_find_property(wid2, P_LIST, property, FALSE);
+  Property *p = rofi_theme_style_find(wid->name, wid->state, P_LIST, property);
   GList *list = rofi_theme_get_list_inside(p, wid, property, P_PADDING);
   GList *retv = NULL;
   for (GList *iter = g_list_first(list); iter != NULL;
@@ -1257,8 +1342,7 @@ GList *rofi_theme_get_list_distance(const widget *wid, const char *property) {
   return retv;
 }
 GList *rofi_theme_get_list_strings(const widget *wid, const char *property) {
-  ThemeWidget *wid2 = rofi_theme_find_widget(wid->name, wid->state, FALSE);
-  Property *p = rofi_theme_find_property(wid2, P_LIST, property, FALSE);
+  Property *p = rofi_theme_style_find(wid->name, wid->state, P_LIST, property);
   GList *list = rofi_theme_get_list_inside(p, wid, property, P_STRING);
   GList *retv = NULL;
   for (GList *iter = g_list_first(list); iter != NULL;
@@ -1279,10 +1363,8 @@ rofi_theme_get_highlight_inside(Property *p, widget *wid, const char *property,
   if (p) {
     if (p->type == P_INHERIT) {
       if (wid->parent) {
-        ThemeWidget *parent =
-            rofi_theme_find_widget(wid->parent->name, wid->state, FALSE);
-        Property *pv =
-            rofi_theme_find_property(parent, P_HIGHLIGHT, property, FALSE);
+        Property *pv = rofi_theme_style_find(wid->parent->name, wid->state,
+                                             P_HIGHLIGHT, property);
         return rofi_theme_get_highlight_inside(pv, wid->parent, property, th);
       }
       return th;
@@ -1294,9 +1376,8 @@ rofi_theme_get_highlight_inside(Property *p, widget *wid, const char *property,
 
     return p->value.highlight;
   } else {
-    ThemeWidget *find_wid =
-        rofi_theme_find_widget(wid->name, wid->state, FALSE);
-    Property *p2 = rofi_theme_find_property(find_wid, P_COLOR, property, FALSE);
+    Property *p2 =
+        rofi_theme_style_find(wid->name, wid->state, P_COLOR, property);
     if (p2 != NULL) {
       return rofi_theme_get_highlight_inside(p2, wid, property, th);
     }
@@ -1309,11 +1390,10 @@ rofi_theme_get_highlight_inside(Property *p, widget *wid, const char *property,
 RofiHighlightColorStyle rofi_theme_get_highlight(widget *wid,
                                                  const char *property,
                                                  RofiHighlightColorStyle th) {
-  ThemeWidget *found_wid = rofi_theme_find_widget(wid->name, wid->state, FALSE);
   Property *p =
-      rofi_theme_find_property(found_wid, P_HIGHLIGHT, property, FALSE);
+      rofi_theme_style_find(wid->name, wid->state, P_HIGHLIGHT, property);
   if (p == NULL) {
-    p = rofi_theme_find_property(found_wid, P_COLOR, property, FALSE);
+    p = rofi_theme_style_find(wid->name, wid->state, P_COLOR, property);
   }
   return rofi_theme_get_highlight_inside(p, wid, property, th);
 }
@@ -1602,6 +1682,7 @@ void rofi_theme_parse_process_links(void) {
 void rofi_theme_parse_process_conditionals(void) {
   workarea mon;
   monitor_active(&mon);
+  rofi_theme_styles_invalidate();
   rofi_theme_parse_process_conditionals_int(mon, rofi_theme);
 }
 
@@ -1639,10 +1720,9 @@ static gboolean rofi_theme_has_property_inside(Property *p,
   if (p) {
     if (p->type == P_INHERIT) {
       if (wid_in->parent) {
-        ThemeWidget *parent =
-            rofi_theme_find_widget(wid_in->parent->name, wid_in->state, FALSE);
         Property *pp =
-            rofi_theme_find_property(parent, P_STRING, property, FALSE);
+            rofi_theme_style_find(wid_in->parent->name, wid_in->state, P_STRING,
+                                  property);
         return rofi_theme_has_property_inside(pp, wid_in->parent, property);
       }
       return FALSE;
@@ -1652,7 +1732,7 @@ static gboolean rofi_theme_has_property_inside(Property *p,
   return FALSE;
 }
 gboolean rofi_theme_has_property(const widget *wid_in, const char *property) {
-  ThemeWidget *wid = rofi_theme_find_widget(wid_in->name, wid_in->state, FALSE);
-  Property *p = rofi_theme_find_property(wid, P_STRING, property, FALSE);
+  Property *p =
+      rofi_theme_style_find(wid_in->name, wid_in->state, P_STRING, property);
   return rofi_theme_has_property_inside(p, wid_in, property);
 }
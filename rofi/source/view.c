@@ -62,6 +62,7 @@
 #include "helper.h"
 #include "mode.h"
 #include "modes/modes.h"
+#include "rofi-icon-fetcher.h"
 #include "xcb-internal.h"
 
 #include "view-internal.h"
@@ -95,9 +96,6 @@ xcb_xim_im_callback xim_callback = {.forward_event =
                                     .disconnected = xim_disconnected};
 #endif
 
-/** Thread pool used for filtering */
-GThreadPool *tpool = NULL;
-
 /** Global pointer to the currently active RofiViewState */
 RofiViewState *current_active_menu = NULL;
 
@@ -131,16 +129,8 @@ struct {
   workarea mon;
   /** timeout for reloading */
   guint idle_timeout;
-  /** timeout for reloading */
-  guint refilter_timeout;
-  /** amount of time refiltering delay got reset */
-  guint refilter_timeout_count;
-
-  /** if filtering takes longer then this time,
-   * reduce the amount of refilters. */
-  double max_refilter_time;
-  /** enable the reduced refilter mode. */
-  gboolean delayed_mode;
+  /** Filter pass running in the background. */
+  struct _filter_context *filter;
   /** timeout handling */
   guint user_timeout;
   /** timeout overlay */
@@ -149,6 +139,8 @@ struct {
   unsigned long long count;
   /** redraw idle time. */
   guint repaint_source;
+  /** Set while a redraw for loaded icons is pending. */
+  gint icon_redraw;
   /** Window fullscreen */
   gboolean fullscreen;
   /** Cursor type */
@@ -169,14 +161,12 @@ struct {
                 .flags = MENU_NORMAL,
                 .views = G_QUEUE_INIT,
                 .idle_timeout = 0,
-                .refilter_timeout = 0,
-                .refilter_timeout_count = 0,
-                .max_refilter_time = 0.0,
-                .delayed_mode = FALSE,
+                .filter = NULL,
                 .user_timeout = 0,
                 .overlay_timeout = 0,
                 .count = 0L,
                 .repaint_source = 0,
+                .icon_redraw = FALSE,
                 .fullscreen = FALSE,
                 .entry_history_enable = TRUE,
                 .entry_history = NULL,
@@ -212,9 +202,81 @@ static int lev_sort(const void *p1, const void *p2, void *arg) {
   const int *b = p2;
   int *distances = arg;
 
+  if (distances[*a] == distances[*b]) {
+    // Keep the original order for equal distance, independent of the order
+    // the matches were handed to us.
+    return (*a > *b) - (*a < *b);
+  }
   return distances[*a] - distances[*b];
 }
 
+/**
+ * @param heap Heap of rows, the worst ranked row on top.
+ * @param size Number of rows in heap.
+ * @param limit Maximum number of rows in heap.
+ * @param row The row to add.
+ * @param distances Distance of each row.
+ *
+ * Add row to the heap, if it is among the limit best ranked rows seen.
+ */
+static void rank_heap_push(unsigned int *heap, unsigned int *size,
+                           unsigned int limit, unsigned int row,
+                           int *distances) {
+  unsigned int pos = 0;
+  if (*size < limit) {
+    pos = (*size)++;
+    while (pos > 0) {
+      unsigned int parent = (pos - 1) / 2;
+      if (lev_sort(&row, &(heap[parent]), distances) < 0) {
+        break;
+      }
+      heap[pos] = heap[parent];
+      pos = parent;
+    }
+    heap[pos] = row;
+    return;
+  }
+  if (limit == 0 || lev_sort(&row, &(heap[0]), distances) > 0) {
+    return;
+  }
+  // Replace the worst row.
+  while (TRUE) {
+    unsigned int child = 2 * pos + 1;
+    if (child >= *size) {
+      break;
+    }
+    if (child + 1 < *size &&
+        lev_sort(&(heap[child + 1]), &(heap[child]), distances) > 0) {
+      child++;
+    }
+    if (lev_sort(&(heap[child]), &row, distances) < 0) {
+      break;
+    }
+    heap[pos] = heap[child];
+    pos = child;
+  }
+  heap[pos] = row;
+}
+
+/**
+ * @param state The handle to the view
+ * @param index Position in the filtered list.
+ *
+ * Rows past the ranked rows are ranked on first access.
+ *
+ * @returns the row shown at position index.
+ */
+static unsigned int rofi_view_line(RofiViewState *state, unsigned int index) {
+  if (index >= state->ranked_lines && index < state->filtered_lines) {
+    g_qsort_with_data(&(state->line_map[state->ranked_lines]),
+                      state->filtered_lines - state->ranked_lines, sizeof(int),
+                      lev_sort, state->distance);
+    state->ranked_lines = state->filtered_lines;
+    TICK_N("Rank remaining rows");
+  }
+  return state->line_map[index];
+}
+
 static void screenshot_taken_user_callback(const char *path) {
   if (config.on_screenshot_taken == NULL)
     return;
@@ -652,15 +714,17 @@ void rofi_view_set_active(RofiViewState *state) {
   rofi_view_queue_redraw();
 }
 
+static void rofi_view_refilter_force(RofiViewState *state);
 void rofi_view_set_selected_line(RofiViewState *state,
                                  unsigned int selected_line) {
+  rofi_view_refilter_force(state);
   state->selected_line = selected_line;
   // Find the line.
   unsigned int selected = 0;
   for (unsigned int i = 0; ((state->selected_line)) < UINT32_MAX && !selected &&
                            i < state->filtered_lines;
        i++) {
-    if (state->line_map[i] == (state->selected_line)) {
+    if (rofi_view_line(state, i) == (state->selected_line)) {
       selected = i;
       break;
     }
@@ -671,17 +735,23 @@ void rofi_view_set_selected_line(RofiViewState *state,
   xcb_flush(xcb->connection);
 }
 
+static void rofi_view_filter_cancel_view(RofiViewState *state);
 void rofi_view_free(RofiViewState *state) {
+  rofi_view_filter_cancel_view(state);
   if (state->tokens) {
     helper_tokenize_free(state->tokens);
     state->tokens = NULL;
   }
+  rofi_normalize_cache_free(state->normalize);
+  state->normalize = NULL;
   // Do this here?
   // Wait for final release?
   widget_free(WIDGET(state->main_window));
 
   g_free(state->line_map);
   g_free(state->distance);
+  g_free(state->last_filter.input);
+  g_free(state->last_filter.pattern);
   // Free the switcher boxes.
   // When state is free'ed we should no longer need these.
   g_free(state->modes);
@@ -701,7 +771,8 @@ unsigned int rofi_view_get_next_position(const RofiViewState *state) {
   unsigned int next_pos = state->selected_line;
   unsigned int selected = listview_get_selected(state->list_view);
   if ((selected + 1) < state->num_lines) {
-    (next_pos) = state->line_map[selected + 1];
+    // Ranking the remaining rows does not change the rows shown.
+    (next_pos) = rofi_view_line((RofiViewState *)state, selected + 1);
   }
   return next_pos;
 }
@@ -726,34 +797,120 @@ static RofiViewState *__rofi_view_state_create(void) {
   return g_malloc0(sizeof(RofiViewState));
 }
 
+/** Number of rows a filter worker claims at a time. */
+#define FILTER_BATCH_SIZE 256
+/** Minimum number of matches ranked when a filter pass completes. */
+#define FILTER_RANKED_ROWS 128
+
+/**
+ * Shared state of one filter pass.
+ * The pass runs on the worker pool while the UI keeps handling input. Workers
+ * claim batches of rows until none are left, so a worker that hits expensive
+ * rows does not hold up the others. Each batch writes its matches compacted
+ * to the start of its own range in map.
+ */
+typedef struct _filter_context {
+  /** Reference count, held by the view, queued jobs and queued idles. */
+  gint ref_count;
+  /** Lock protecting the administration below. */
+  GMutex mutex;
+  /** Signalled when workers stop. */
+  GCond cond;
+  /** Set when the pass is cancelled, workers stop at the next batch. */
+  gint cancelled;
+  /** Number of workers filtering. */
+  unsigned int running;
+  /** Number of batches finished. */
+  unsigned int done;
+  /** Set when all batches are done and all workers merged their matches. */
+  gboolean complete;
+  /** Number of leading batches that are all finished. */
+  unsigned int prefix_batches;
+  /** Number of matches in the leading finished batches. */
+  unsigned int prefix_matches;
+  /** If the main loop should be notified of progress. */
+  gboolean notify;
+  /** If the partial result has been queued for display. */
+  gboolean partial_queued;
+  /** Next batch to claim, atomic. */
+  gint next;
+  /** Number of batches. */
+  unsigned int num_batches;
+  /** Number of matches in each batch. */
+  unsigned int *batch_count;
+  /** If each batch is finished. */
+  gboolean *batch_done;
+
+  /** Current state, only used on the main thread. */
+  RofiViewState *state;
+  /** Tokens to match, owned by the pass. */
+  rofi_int_matcher **tokens;
+  /** If matching is case sensitive. */
+  gboolean case_sensitive;
+  /** Normalized strings of the rows, owned by the state. */
+  rofi_normalize_cache *normalize;
+  /** The mode to filter. */
+  Mode *sw;
+  /** Number of rows to filter. */
+  unsigned int num_rows;
+  /** Rows to filter, if NULL row index r is filtered directly. */
+  unsigned int *rows;
+  /** Matched rows, compacted per batch. */
+  unsigned int *map;
+  /** Show the leading matches once there are this many, 0 to disable. */
+  unsigned int partial_limit;
+  /** Distance of each row, when sorting. */
+  int *distance;
+  /** Number of best ranked matches to collect, 0 when not sorting. */
+  unsigned int rank_limit;
+  /** Heap with the best ranked matches, worst on top. */
+  unsigned int *top;
+  /** Number of matches in top. */
+  unsigned int top_count;
+  /** If only the previous matches are filtered. */
+  gboolean incremental;
+  /** User input. */
+  char *input;
+  /** Pattern input to filter. */
+  char *pattern;
+  /** Length of pattern. */
+  glong plen;
+} filter_context;
+
 /**
  * Thread state for workers started for the view.
  */
 typedef struct _thread_state_view {
   /** Generic thread state. */
   thread_state st;
+  /** The filter pass this worker helps with. */
+  filter_context *ctx;
+} thread_state_view;
 
-  /** Condition. */
-  GCond *cond;
-  /** Lock for condition. */
-  GMutex *mutex;
-  /** Count that is protected by lock. */
-  unsigned int *acount;
+static filter_context *filter_context_ref(filter_context *ctx) {
+  g_atomic_int_inc(&(ctx->ref_count));
+  return ctx;
+}
 
-  /** Current state. */
-  RofiViewState *state;
-  /** Start row for this worker. */
-  unsigned int start;
-  /** Stop row for this worker. */
-  unsigned int stop;
-  /** Rows processed. */
-  unsigned int count;
+static void filter_context_unref(filter_context *ctx) {
+  if (g_atomic_int_dec_and_test(&(ctx->ref_count))) {
+    g_mutex_clear(&(ctx->mutex));
+    g_cond_clear(&(ctx->cond));
+    g_free(ctx->batch_count);
+    g_free(ctx->batch_done);
+    g_free(ctx->rows);
+    g_free(ctx->map);
+    g_free(ctx->distance);
+    g_free(ctx->top);
+    g_free(ctx->input);
+    g_free(ctx->pattern);
+    if (ctx->tokens) {
+      helper_tokenize_free(ctx->tokens);
+    }
+    g_free(ctx);
+  }
+}
 
-  /** Pattern input to filter. */
-  const char *pattern;
-  /** Length of pattern. */
-  glong plen;
-} thread_state_view;
 /**
  * @param data A thread_state object.
  * @param user_data User data to pass to thread_state callback
@@ -765,39 +922,145 @@ static void rofi_view_call_thread(gpointer data, gpointer user_data) {
   t->callback(t, user_data);
 }
 
-static void filter_elements(thread_state *ts,
-                            G_GNUC_UNUSED gpointer user_data) {
-  thread_state_view *t = (thread_state_view *)ts;
-  for (unsigned int i = t->start; i < t->stop; i++) {
-    int match = mode_token_match(t->state->sw, t->state->tokens, i);
-    // If each token was matched, add it to list.
-    if (match) {
-      t->state->line_map[t->start + t->count] = i;
-      if (config.sort) {
-        // This is inefficient, need to fix it.
-        char *str = mode_get_completion(t->state->sw, i);
-        glong slen = g_utf8_strlen(str, -1);
-        switch (config.sorting_method_enum) {
-        case SORT_FZF:
-          t->state->distance[i] = rofi_scorer_fuzzy_evaluate(
-              t->pattern, t->plen, str, slen, t->state->case_sensitive);
-          break;
-        case SORT_NORMAL:
-        default:
-          t->state->distance[i] = levenshtein(t->pattern, t->plen, str, slen,
-                                              t->state->case_sensitive);
-          break;
+static gboolean rofi_view_filter_partial_idle(gpointer data);
+static gboolean rofi_view_filter_complete_idle(gpointer data);
+
+/**
+ * @param ctx The filter pass.
+ *
+ * Claim and filter batches of rows until none are left or the pass is
+ * cancelled or finished. Workers never touch the view state, jobs that start
+ * after the pass finished return right away.
+ * When sorting, the best ranked matches this worker finds are kept in a
+ * bounded heap, that is merged into the pass when it stops.
+ */
+static void filter_batches(filter_context *ctx) {
+  g_mutex_lock(&(ctx->mutex));
+  if (ctx->cancelled) {
+    g_mutex_unlock(&(ctx->mutex));
+    return;
+  }
+  ctx->running++;
+  g_mutex_unlock(&(ctx->mutex));
+
+  unsigned int *top = NULL;
+  unsigned int top_count = 0;
+  rofi_scorer *scorer = NULL;
+  while (!g_atomic_int_get(&(ctx->cancelled))) {
+    unsigned int b = (unsigned int)g_atomic_int_add(&(ctx->next), 1);
+    if (b >= ctx->num_batches) {
+      break;
+    }
+    if (ctx->rank_limit > 0 && scorer == NULL) {
+      top = g_malloc_n(ctx->rank_limit, sizeof(unsigned int));
+      scorer = rofi_scorer_create(ctx->pattern, ctx->plen, ctx->case_sensitive);
+    }
+    unsigned int start = b * FILTER_BATCH_SIZE;
+    unsigned int stop = MIN(ctx->num_rows, start + FILTER_BATCH_SIZE);
+    unsigned int count = 0;
+    for (unsigned int r = start; r < stop; r++) {
+      unsigned int i = (ctx->rows != NULL) ? ctx->rows[r] : r;
+      helper_token_match_set_row(ctx->normalize, i);
+      int match = mode_token_match(ctx->sw, ctx->tokens, i);
+      // If each token was matched, add it to list.
+      if (match) {
+        ctx->map[start + count] = i;
+        if (ctx->rank_limit > 0) {
+          char *str = mode_get_completion(ctx->sw, i);
+          switch (config.sorting_method_enum) {
+          case SORT_FZF:
+            ctx->distance[i] = rofi_scorer_fuzzy(scorer, str, -1);
+            break;
+          case SORT_NORMAL:
+          default:
+            ctx->distance[i] = rofi_scorer_levenshtein(scorer, str, -1);
+            break;
+          }
+          g_free(str);
+          rank_heap_push(top, &top_count, ctx->rank_limit, i, ctx->distance);
         }
-        g_free(str);
+        count++;
       }
-      t->count++;
     }
+
+    g_mutex_lock(&(ctx->mutex));
+    ctx->batch_count[b] = count;
+    ctx->batch_done[b] = TRUE;
+    ctx->done++;
+    while (ctx->prefix_batches < ctx->num_batches &&
+           ctx->batch_done[ctx->prefix_batches]) {
+      ctx->prefix_matches += ctx->batch_count[ctx->prefix_batches];
+      ctx->prefix_batches++;
+    }
+    if (ctx->notify && ctx->partial_limit > 0 && !ctx->partial_queued &&
+        ctx->done < ctx->num_batches &&
+        ctx->prefix_matches >= ctx->partial_limit) {
+      // The first screen is filled, show it while the rest is filtered.
+      ctx->partial_queued = TRUE;
+      g_idle_add_full(G_PRIORITY_HIGH_IDLE, rofi_view_filter_partial_idle,
+                      filter_context_ref(ctx),
+                      (GDestroyNotify)filter_context_unref);
+    }
+    g_mutex_unlock(&(ctx->mutex));
   }
-  if (t->acount != NULL) {
-    g_mutex_lock(t->mutex);
-    (*(t->acount))--;
-    g_cond_signal(t->cond);
-    g_mutex_unlock(t->mutex);
+  helper_token_match_set_row(NULL, 0);
+
+  g_mutex_lock(&(ctx->mutex));
+  if (!ctx->cancelled) {
+    for (unsigned int k = 0; k < top_count; k++) {
+      rank_heap_push(ctx->top, &(ctx->top_count), ctx->rank_limit, top[k],
+                     ctx->distance);
+    }
+  }
+  ctx->running--;
+  // The last worker to stop, after all batches are done, completes the pass.
+  if (!ctx->cancelled && !ctx->complete && ctx->running == 0 &&
+      ctx->done == ctx->num_batches) {
+    ctx->complete = TRUE;
+    if (ctx->notify) {
+      g_idle_add_full(G_PRIORITY_HIGH_IDLE, rofi_view_filter_complete_idle,
+                      filter_context_ref(ctx),
+                      (GDestroyNotify)filter_context_unref);
+    }
+  }
+  g_cond_broadcast(&(ctx->cond));
+  g_mutex_unlock(&(ctx->mutex));
+  rofi_scorer_free(scorer);
+  g_free(top);
+}
+
+static void filter_elements(thread_state *ts,
+                            G_GNUC_UNUSED gpointer user_data) {
+  thread_state_view *t = (thread_state_view *)ts;
+  filter_batches(t->ctx);
+  filter_context_unref(t->ctx);
+  g_free(t);
+}
+
+/**
+ * @param data The thread_state_view of a job that never ran.
+ */
+static void filter_elements_free(void *data) {
+  thread_state_view *t = (thread_state_view *)data;
+  filter_context_unref(t->ctx);
+  g_free(t);
+}
+
+/**
+ * @param ctx The filter pass.
+ *
+ * Queue jobs on the worker pool for the filter pass. Jobs that start when
+ * all batches are claimed return right away.
+ */
+static void filter_context_queue(filter_context *ctx) {
+  unsigned int nt = MIN(config.threads, ctx->num_batches);
+  for (unsigned int i = 0; i < nt; i++) {
+    thread_state_view *t = g_malloc0(sizeof(thread_state_view));
+    t->ctx = filter_context_ref(ctx);
+    t->st.callback = filter_elements;
+    t->st.free = filter_elements_free;
+    t->st.priority = G_PRIORITY_HIGH;
+    g_thread_pool_push(tpool, t, NULL);
   }
 }
 
@@ -1245,7 +1508,7 @@ static void rofi_view_nav_row_tab(RofiViewState *state) {
   if (state->filtered_lines == 1) {
     state->retv = MENU_OK;
     (state->selected_line) =
-        state->line_map[listview_get_selected(state->list_view)];
+        rofi_view_line(state, listview_get_selected(state->list_view));
     state->quit = 1;
     return;
   }
@@ -1272,7 +1535,7 @@ inline static void rofi_view_nav_row_select(RofiViewState *state) {
   unsigned int selected = listview_get_selected(state->list_view);
   // If a valid item is selected, return that..
   if (selected < state->filtered_lines) {
-    char *str = mode_get_completion(state->sw, state->line_map[selected]);
+    char *str = mode_get_completion(state->sw, rofi_view_line(state, selected));
     textbox_text(state->text, str);
     g_free(str);
     textbox_keybinding(state->text, MOVE_END);
@@ -1309,8 +1572,8 @@ static void selection_changed_user_callback(unsigned int index,
     return;
 
   int fstate = 0;
-  char *text = mode_get_display_value(state->sw, state->line_map[index],
-                                      &fstate, NULL, TRUE);
+  char *text = mode_get_display_value(
+      state->sw, rofi_view_line(state, index), &fstate, NULL, TRUE);
   char **args = NULL;
   int argv = 0;
   helper_parse_setup(config.on_selection_changed, &args, &argv, "{entry}", text,
@@ -1323,16 +1586,16 @@ static void selection_changed_callback(G_GNUC_UNUSED listview *lv,
                                        unsigned int index, void *udata) {
   RofiViewState *state = (RofiViewState *)udata;
   if (index < state->filtered_lines) {
-    if (state->previous_line != state->line_map[index]) {
+    if (state->previous_line != rofi_view_line(state, index)) {
       selection_changed_user_callback(index, state);
-      state->previous_line = state->line_map[index];
+      state->previous_line = rofi_view_line(state, index);
     }
   }
   if (state->tb_current_entry) {
     if (index < state->filtered_lines) {
       int fstate = 0;
-      char *text = mode_get_display_value(state->sw, state->line_map[index],
-                                          &fstate, NULL, TRUE);
+      char *text = mode_get_display_value(
+          state->sw, rofi_view_line(state, index), &fstate, NULL, TRUE);
       textbox_text(state->tb_current_entry, text);
       g_free(text);
     } else {
@@ -1345,27 +1608,50 @@ static void selection_changed_callback(G_GNUC_UNUSED listview *lv,
           widget_get_desired_height(WIDGET(state->icon_current_entry),
                                     WIDGET(state->icon_current_entry)->w);
       cairo_surface_t *surf_icon =
-          mode_get_icon(state->sw, state->line_map[index], icon_height);
+          mode_get_icon(state->sw, rofi_view_line(state, index), icon_height);
       icon_set_surface(state->icon_current_entry, surf_icon);
     } else {
       icon_set_surface(state->icon_current_entry, NULL);
     }
   }
 }
+
+static gboolean rofi_view_icon_redraw_timeout(G_GNUC_UNUSED gpointer data) {
+  g_atomic_int_set(&(CacheState.icon_redraw), FALSE);
+  RofiViewState *state = current_active_menu;
+  if (state) {
+    if (state->icon_current_entry) {
+      selection_changed_callback(
+          state->list_view, listview_get_selected(state->list_view), state);
+    }
+    // The rows get their icon again when drawn, no reload needed.
+    widget_queue_redraw(WIDGET(state->main_window));
+    rofi_view_queue_redraw();
+  }
+  return G_SOURCE_REMOVE;
+}
+
+void rofi_view_queue_icon_redraw(void) {
+  if (g_atomic_int_compare_and_exchange(&(CacheState.icon_redraw), FALSE,
+                                        TRUE)) {
+    g_timeout_add(1000 / 60, rofi_view_icon_redraw_timeout, NULL);
+  }
+}
+
 static void update_callback(textbox *t, icon *ico, unsigned int index,
                             void *udata, TextBoxFontType *type, gboolean full) {
   RofiViewState *state = (RofiViewState *)udata;
   if (full) {
     GList *add_list = NULL;
     int fstate = 0;
-    char *text = mode_get_display_value(state->sw, state->line_map[index],
-                                        &fstate, &add_list, TRUE);
+    char *text = mode_get_display_value(
+        state->sw, rofi_view_line(state, index), &fstate, &add_list, TRUE);
     (*type) |= fstate;
 
     if (ico) {
       int icon_height = widget_get_desired_height(WIDGET(ico), WIDGET(ico)->w);
       cairo_surface_t *surf_icon =
-          mode_get_icon(state->sw, state->line_map[index], icon_height);
+          mode_get_icon(state->sw, rofi_view_line(state, index), icon_height);
       icon_set_surface(ico, surf_icon);
     }
     if (t) {
@@ -1400,8 +1686,8 @@ static void update_callback(textbox *t, icon *ico, unsigned int index,
   } else {
     // Never called.
     int fstate = 0;
-    mode_get_display_value(state->sw, state->line_map[index], &fstate, NULL,
-                           FALSE);
+    mode_get_display_value(state->sw, rofi_view_line(state, index), &fstate,
+                           NULL, FALSE);
     (*type) |= fstate;
     // TODO needed for markup.
     textbox_font(t, *type);
@@ -1410,6 +1696,10 @@ static void update_callback(textbox *t, icon *ico, unsigned int index,
 static void page_changed_callback(void) {
   rofi_view_workers_finalize();
   rofi_view_workers_initialize();
+  // Jobs still queued for the filter pass got dropped with the old pool.
+  if (CacheState.filter != NULL) {
+    filter_context_queue(CacheState.filter);
+  }
 }
 
 void rofi_view_update(RofiViewState *state, gboolean qr) {
@@ -1437,7 +1727,9 @@ void rofi_view_update(RofiViewState *state, gboolean qr) {
   cairo_set_operator(d, CAIRO_OPERATOR_OVER);
 
   TICK_N("Background");
+  rofi_icon_fetcher_frame_start();
   widget_draw(WIDGET(state->main_window), d);
+  rofi_icon_fetcher_frame_end();
 
 #ifdef XCB_IMDKIT
   int x = widget_get_x_pos(&state->text->widget) +
@@ -1455,119 +1747,96 @@ void rofi_view_update(RofiViewState *state, gboolean qr) {
 }
 
 static void _rofi_view_reload_row(RofiViewState *state) {
-  g_free(state->line_map);
+  // Rows can have moved or changed, normalize them again.
+  rofi_normalize_cache_free(state->normalize);
+  state->normalize = NULL;
   g_free(state->distance);
   state->num_lines = mode_get_num_entries(state->sw);
-  state->line_map = g_malloc0_n(state->num_lines, sizeof(unsigned int));
+  // Keep showing the rows that still exist until the new filter completes.
+  unsigned int j = 0;
+  for (unsigned int i = 0; i < state->filtered_lines; i++) {
+    if (state->line_map[i] < state->num_lines) {
+      state->line_map[j++] = state->line_map[i];
+    }
+  }
+  state->line_map = g_realloc_n(state->line_map, MAX(1, state->num_lines),
+                                sizeof(unsigned int));
+  state->filtered_lines = j;
+  state->ranked_lines = j;
   state->distance = g_malloc0_n(state->num_lines, sizeof(int));
+  listview_set_num_elements(state->list_view, state->filtered_lines);
   listview_set_max_lines(state->list_view, state->num_lines);
   rofi_view_reload_message_bar(state);
 }
 
-static gboolean rofi_view_refilter_real(RofiViewState *state) {
-  CacheState.refilter_timeout = 0;
-  CacheState.refilter_timeout_count = 0;
-  if (state->sw == NULL) {
-    return G_SOURCE_REMOVE;
+/**
+ * @param state The handle to the view
+ * @param input The user input
+ * @param pattern The user input after preprocessing by the mode.
+ *
+ * Check if the new filter can only reject rows accepted by the previous
+ * filter. This holds when the input only got extended, the mode and matching
+ * options are unchanged and no tokens are negated. Regex matching is excluded,
+ * as extending a regex can widen the match.
+ *
+ * @returns TRUE if only the rows in line_map need to be filtered again.
+ */
+static gboolean rofi_view_filter_is_refinement(RofiViewState *state,
+                                               const char *input,
+                                               const char *pattern) {
+  if (!state->last_filter.valid || state->last_filter.sw != state->sw) {
+    return FALSE;
   }
-  GTimer *timer = g_timer_new();
-  TICK_N("Filter start");
-  if (state->reload) {
-    _rofi_view_reload_row(state);
-    state->reload = FALSE;
+  if (config.matching_method == MM_REGEX ||
+      state->last_filter.matching_method != config.matching_method ||
+      state->last_filter.case_sensitive != state->case_sensitive) {
+    return FALSE;
   }
-  TICK_N("Filter reload rows");
-  if (state->tokens) {
-    helper_tokenize_free(state->tokens);
-    state->tokens = NULL;
+  if (!g_str_has_prefix(input, state->last_filter.input)) {
+    return FALSE;
   }
-  TICK_N("Filter tokenize");
-  if (state->text && strlen(state->text->text) > 0) {
-
-    listview_set_filtered(state->list_view, TRUE);
-    unsigned int j = 0;
-    gchar *pattern = mode_preprocess_input(state->sw, state->text->text);
-    glong plen = pattern ? g_utf8_strlen(pattern, -1) : 0;
-    state->case_sensitive = parse_case_sensitivity(state->text->text);
-    state->tokens = helper_tokenize(pattern, state->case_sensitive);
-
-    if (config.case_smart && state->case_indicator) {
-      textbox_text(state->case_indicator, get_matching_state(state));
-    }
-    /**
-     * On long lists it can be beneficial to parallelize.
-     * If number of threads is 1, no thread is spawn.
-     * If number of threads > 1 and there are enough (> 1000) items, spawn jobs
-     * for the thread pool. For large lists with 8 threads I see a factor three
-     * speedup of the whole function.
-     */
-    unsigned int nt = MAX(1, state->num_lines / 500);
-    // Limit the number of jobs, it could cause stack overflow if we don´t
-    // limit.
-    nt = MIN(nt, config.threads * 4);
-    thread_state_view states[nt];
-    GCond cond;
-    GMutex mutex;
-    g_mutex_init(&mutex);
-    g_cond_init(&cond);
-    unsigned int count = nt;
-    unsigned int steps = (state->num_lines + nt) / nt;
-    for (unsigned int i = 0; i < nt; i++) {
-      states[i].state = state;
-      states[i].start = i * steps;
-      states[i].stop = MIN(state->num_lines, (i + 1) * steps);
-      states[i].count = 0;
-      states[i].cond = &cond;
-      states[i].mutex = &mutex;
-      states[i].acount = &count;
-      states[i].plen = plen;
-      states[i].pattern = pattern;
-      states[i].st.callback = filter_elements;
-      states[i].st.free = NULL;
-      states[i].st.priority = G_PRIORITY_HIGH;
-      if (i > 0) {
-        g_thread_pool_push(tpool, &states[i], NULL);
-      }
-    }
-    // Run one in this thread.
-    rofi_view_call_thread(&states[0], NULL);
-    // No need to do this with only one thread.
-    if (nt > 1) {
-      g_mutex_lock(&mutex);
-      while (count > 0) {
-        g_cond_wait(&cond, &mutex);
-      }
-      g_mutex_unlock(&mutex);
-    }
-    g_cond_clear(&cond);
-    g_mutex_clear(&mutex);
-    for (unsigned int i = 0; i < nt; i++) {
-      if (j != states[i].start) {
-        memmove(&(state->line_map[j]), &(state->line_map[states[i].start]),
-                sizeof(unsigned int) * (states[i].count));
-      }
-      j += states[i].count;
-    }
-    if (config.sort) {
-      g_qsort_with_data(state->line_map, j, sizeof(int), lev_sort,
-                        state->distance);
+  // Modes (like combi) can strip or interpret part of the input, so the
+  // preprocessed pattern should be extended too.
+  if (!g_str_has_prefix(pattern ? pattern : "",
+                        state->last_filter.pattern ? state->last_filter.pattern
+                                                   : "")) {
+    return FALSE;
+  }
+  for (size_t i = 0; state->tokens && state->tokens[i]; i++) {
+    if (state->tokens[i]->invert) {
+      return FALSE;
     }
+  }
+  return TRUE;
+}
 
-    // Cleanup + bookkeeping.
-    state->filtered_lines = j;
-    g_free(pattern);
-
-    double elapsed = g_timer_elapsed(timer, NULL);
+/**
+ * @param state The handle to the view
+ * @param input The user input
+ * @param pattern The user input after preprocessing by the mode.
+ *
+ * Remember the filter that produced the current line_map.
+ */
+static void rofi_view_filter_store_last(RofiViewState *state,
+                                        const char *input,
+                                        const char *pattern) {
+  g_free(state->last_filter.input);
+  g_free(state->last_filter.pattern);
+  state->last_filter.valid = TRUE;
+  state->last_filter.sw = state->sw;
+  state->last_filter.input = g_strdup(input);
+  state->last_filter.pattern = g_strdup(pattern);
+  state->last_filter.matching_method = config.matching_method;
+  state->last_filter.case_sensitive = state->case_sensitive;
+}
 
-    CacheState.max_refilter_time = elapsed;
-  } else {
-    listview_set_filtered(state->list_view, FALSE);
-    for (unsigned int i = 0; i < state->num_lines; i++) {
-      state->line_map[i] = i;
-    }
-    state->filtered_lines = state->num_lines;
-  }
-  TICK_N("Filter matching done");
+/**
+ * @param state The handle to the view
+ * @param complete If line_map holds the complete filter result.
+ *
+ * Show the rows in line_map and resize the window to fit them.
+ */
+static void rofi_view_filter_publish(RofiViewState *state, gboolean complete) {
   listview_set_num_elements(state->list_view, state->filtered_lines);
 
   if (state->tb_filtered_rows) {
@@ -1582,10 +1851,11 @@ static gboolean rofi_view_refilter_real(RofiViewState *state) {
   }
   TICK_N("Update filter lines");
 
-  if (config.auto_select == TRUE && state->filtered_lines == 1 &&
+  // A partial result can still grow, so do not auto-select on it.
+  if (complete && config.auto_select == TRUE && state->filtered_lines == 1 &&
       state->num_lines > 1) {
     (state->selected_line) =
-        state->line_map[listview_get_selected(state->list_view)];
+        rofi_view_line(state, listview_get_selected(state->list_view));
     state->retv = MENU_OK;
     state->quit = TRUE;
   }
@@ -1599,50 +1869,275 @@ static gboolean rofi_view_refilter_real(RofiViewState *state) {
     g_debug("Resize based on re-filter");
   }
   TICK_N("Filter resize window based on window ");
-  state->refilter = FALSE;
   TICK_N("Filter done");
   rofi_view_update(state, TRUE);
+}
+
+/**
+ * @param ctx The filter pass, with all batches done.
+ *
+ * Move the matches into line_map and show them.
+ */
+static void rofi_view_filter_finish(filter_context *ctx) {
+  RofiViewState *state = ctx->state;
+  unsigned int j = 0;
+  if (ctx->rank_limit > 0) {
+    // The best ranked matches go first in order, the rest after them
+    // unsorted, until the user scrolls past the ranked rows.
+    g_free(state->distance);
+    state->distance = ctx->distance;
+    ctx->distance = NULL;
+    g_qsort_with_data(ctx->top, ctx->top_count, sizeof(int), lev_sort,
+                      state->distance);
+    memcpy(state->line_map, ctx->top, sizeof(unsigned int) * ctx->top_count);
+    j = ctx->top_count;
+    for (unsigned int b = 0; j > 0 && b < ctx->num_batches; b++) {
+      const unsigned int *rows = &(ctx->map[b * FILTER_BATCH_SIZE]);
+      for (unsigned int r = 0; r < ctx->batch_count[b]; r++) {
+        if (lev_sort(&(rows[r]), &(ctx->top[ctx->top_count - 1]),
+                     state->distance) > 0) {
+          state->line_map[j++] = rows[r];
+        }
+      }
+    }
+    state->ranked_lines = ctx->top_count;
+  } else {
+    // Prefix sum over the batch counts gives each batch its final offset.
+    for (unsigned int b = 0; b < ctx->num_batches; b++) {
+      memcpy(&(state->line_map[j]), &(ctx->map[b * FILTER_BATCH_SIZE]),
+             sizeof(unsigned int) * (ctx->batch_count[b]));
+      j += ctx->batch_count[b];
+    }
+    state->ranked_lines = j;
+  }
+
+  // Cleanup + bookkeeping.
+  state->filtered_lines = j;
+  rofi_view_filter_store_last(state, ctx->input, ctx->pattern);
+  TICK_N(ctx->incremental ? "Filter matching done (incremental)"
+                          : "Filter matching done (full scan)");
+  // Jobs that did not start yet must not touch the view anymore.
+  g_atomic_int_set(&(ctx->cancelled), TRUE);
+  if (CacheState.filter == ctx) {
+    CacheState.filter = NULL;
+    filter_context_unref(ctx);
+  }
+  rofi_view_filter_publish(state, TRUE);
+}
+
+/**
+ * Stop the filter pass running in the background, if any.
+ * Returns once no worker touches the view anymore, the view keeps showing
+ * the rows it had.
+ */
+static void rofi_view_filter_cancel(void) {
+  filter_context *ctx = CacheState.filter;
+  if (ctx == NULL) {
+    return;
+  }
+  CacheState.filter = NULL;
+  g_mutex_lock(&(ctx->mutex));
+  g_atomic_int_set(&(ctx->cancelled), TRUE);
+  // Workers finish the batch they are on, and then stop.
+  while (ctx->running > 0) {
+    g_cond_wait(&(ctx->cond), &(ctx->mutex));
+  }
+  g_mutex_unlock(&(ctx->mutex));
+  filter_context_unref(ctx);
+  TICK_N("Filter cancelled");
+}
+
+/**
+ * @param state The handle to the view
+ *
+ * Stop the filter pass running in the background for state, if any.
+ */
+static void rofi_view_filter_cancel_view(RofiViewState *state) {
+  if (CacheState.filter != NULL && CacheState.filter->state == state) {
+    rofi_view_filter_cancel();
+  }
+}
+
+void rofi_view_cancel_filter(void) {
+  if (CacheState.filter != NULL) {
+    RofiViewState *state = CacheState.filter->state;
+    rofi_view_filter_cancel();
+    // Filter again on the next update.
+    state->refilter = TRUE;
+  }
+}
+
+/**
+ * @param ctx The filter pass running in the background.
+ *
+ * Help the workers finish the filter pass, and show the result.
+ */
+static void rofi_view_filter_wait(filter_context *ctx) {
+  filter_batches(ctx);
+  g_mutex_lock(&(ctx->mutex));
+  while (!ctx->complete) {
+    g_cond_wait(&(ctx->cond), &(ctx->mutex));
+  }
+  g_mutex_unlock(&(ctx->mutex));
+  rofi_view_filter_finish(ctx);
+}
 
-  g_timer_destroy(timer);
+/**
+ * @param data The filter pass.
+ *
+ * Show the matches found in the leading rows, while the rest is filtered.
+ *
+ * @returns G_SOURCE_REMOVE
+ */
+static gboolean rofi_view_filter_partial_idle(gpointer data) {
+  filter_context *ctx = (filter_context *)data;
+  if (CacheState.filter != ctx) {
+    return G_SOURCE_REMOVE;
+  }
+  RofiViewState *state = ctx->state;
+  g_mutex_lock(&(ctx->mutex));
+  unsigned int num_batches = ctx->prefix_batches;
+  g_mutex_unlock(&(ctx->mutex));
+  unsigned int j = 0;
+  for (unsigned int b = 0; b < num_batches; b++) {
+    memcpy(&(state->line_map[j]), &(ctx->map[b * FILTER_BATCH_SIZE]),
+           sizeof(unsigned int) * (ctx->batch_count[b]));
+    j += ctx->batch_count[b];
+  }
+  state->filtered_lines = j;
+  state->ranked_lines = j;
+  // line_map does not hold a complete result to narrow down anymore.
+  state->last_filter.valid = FALSE;
+  TICK_N("Filter matching partial");
+  rofi_view_filter_publish(state, FALSE);
+  return G_SOURCE_REMOVE;
+}
+
+/**
+ * @param data The filter pass.
+ *
+ * Show the result of a completed filter pass.
+ *
+ * @returns G_SOURCE_REMOVE
+ */
+static gboolean rofi_view_filter_complete_idle(gpointer data) {
+  filter_context *ctx = (filter_context *)data;
+  if (CacheState.filter == ctx) {
+    rofi_view_filter_finish(ctx);
+  }
   return G_SOURCE_REMOVE;
 }
+
 static void rofi_view_refilter(RofiViewState *state) {
-  CacheState.refilter_timeout_count++;
-  if (CacheState.refilter_timeout != 0) {
-
-    g_source_remove(CacheState.refilter_timeout);
-    CacheState.refilter_timeout = 0;
-  }
-  if (CacheState.max_refilter_time > (config.refilter_timeout_limit / 1000.0) &&
-      state->text && strlen(state->text->text) > 0 &&
-      CacheState.refilter_timeout_count < 25) {
-    if (CacheState.delayed_mode == FALSE) {
-      g_warning(
-          "Filtering took %f seconds ( %f ), switching to delayed filter\n",
-          CacheState.max_refilter_time, config.refilter_timeout_limit / 1000.0);
-      CacheState.delayed_mode = TRUE;
-    }
-    CacheState.refilter_timeout =
-        g_timeout_add(200, (GSourceFunc)rofi_view_refilter_real, state);
+  // The new pass replaces the one that might be running.
+  rofi_view_filter_cancel();
+  state->refilter = FALSE;
+  if (state->sw == NULL) {
+    return;
+  }
+  TICK_N("Filter start");
+  if (state->reload) {
+    _rofi_view_reload_row(state);
+    state->reload = FALSE;
+    state->last_filter.valid = FALSE;
+  }
+  TICK_N("Filter reload rows");
+  if (state->tokens) {
+    helper_tokenize_free(state->tokens);
+    state->tokens = NULL;
+  }
+  TICK_N("Filter tokenize");
+  if (state->text && strlen(state->text->text) > 0) {
+
+    listview_set_filtered(state->list_view, TRUE);
+    gchar *pattern = mode_preprocess_input(state->sw, state->text->text);
+    glong plen = pattern ? g_utf8_strlen(pattern, -1) : 0;
+    state->case_sensitive = parse_case_sensitivity(state->text->text);
+    state->tokens = helper_tokenize(pattern, state->case_sensitive);
+
+    if (config.case_smart && state->case_indicator) {
+      textbox_text(state->case_indicator, get_matching_state(state));
+    }
+    /**
+     * If the user only added to the input, the previous matches are a
+     * superset of the new ones. In that case only re-test those.
+     */
+    gboolean incremental =
+        rofi_view_filter_is_refinement(state, state->text->text, pattern);
+    unsigned int num_rows =
+        incremental ? state->filtered_lines : state->num_lines;
+    /**
+     * Filtering runs on the worker pool, so input keeps being handled while
+     * it runs. The rows are split in small batches, and up to config.threads
+     * workers take batches until all are done. The result replaces line_map
+     * when complete, a new pass cancels it. If the rows fit in one batch, they
+     * are filtered right away.
+     */
+    filter_context *ctx = g_malloc0(sizeof(filter_context));
+    g_mutex_init(&(ctx->mutex));
+    g_cond_init(&(ctx->cond));
+    ctx->ref_count = 1;
+    ctx->state = state;
+    ctx->tokens = helper_tokenize(pattern, state->case_sensitive);
+    ctx->case_sensitive = state->case_sensitive;
+    if (config.normalize_match && state->normalize == NULL) {
+      state->normalize = rofi_normalize_cache_new(state->num_lines);
+    }
+    ctx->normalize = state->normalize;
+    ctx->sw = state->sw;
+    ctx->num_rows = num_rows;
+    if (incremental) {
+      ctx->rows =
+          g_memdup2(state->line_map, sizeof(unsigned int) * (num_rows));
+    }
+    ctx->map = g_malloc_n(MAX(1, num_rows), sizeof(unsigned int));
+    ctx->incremental = incremental;
+    ctx->input = g_strdup(state->text->text);
+    ctx->pattern = pattern;
+    ctx->plen = plen;
+    ctx->num_batches = (num_rows + FILTER_BATCH_SIZE - 1) / FILTER_BATCH_SIZE;
+    ctx->batch_count =
+        g_malloc0_n(MAX(1, ctx->num_batches), sizeof(unsigned int));
+    ctx->batch_done = g_malloc0_n(MAX(1, ctx->num_batches), sizeof(gboolean));
+    if (config.sort) {
+      // Only the rows that fit on screen need ranking right away.
+      ctx->distance = g_malloc0_n(MAX(1, state->num_lines), sizeof(int));
+      ctx->rank_limit =
+          MAX(FILTER_RANKED_ROWS, listview_get_max_elements(state->list_view));
+      ctx->top = g_malloc_n(ctx->rank_limit, sizeof(unsigned int));
+    }
+    if (ctx->num_batches <= 1) {
+      filter_batches(ctx);
+      rofi_view_filter_finish(ctx);
+      filter_context_unref(ctx);
+      return;
+    }
+    // When sorting, the best matches are only known once all rows are done.
+    ctx->partial_limit =
+        config.sort ? 0
+                    : MAX(1, listview_get_max_elements(state->list_view));
+    ctx->notify = TRUE;
+    CacheState.filter = ctx;
+    filter_context_queue(ctx);
+    TICK_N("Filter queued");
   } else {
-    if (CacheState.delayed_mode == TRUE && state->text &&
-        strlen(state->text->text) > 0 &&
-        CacheState.refilter_timeout_count < 25) {
-      g_warning(
-          "Filtering took %f seconds , switching back to instant filter\n",
-          CacheState.max_refilter_time);
-      CacheState.delayed_mode = FALSE;
+    listview_set_filtered(state->list_view, FALSE);
+    for (unsigned int i = 0; i < state->num_lines; i++) {
+      state->line_map[i] = i;
     }
-    rofi_view_refilter_real(state);
+    state->filtered_lines = state->num_lines;
+    state->ranked_lines = state->num_lines;
+    state->last_filter.valid = FALSE;
+    TICK_N("Filter matching done");
+    rofi_view_filter_publish(state, TRUE);
   }
 }
 static void rofi_view_refilter_force(RofiViewState *state) {
-  if (CacheState.refilter_timeout != 0) {
-    g_source_remove(CacheState.refilter_timeout);
-    CacheState.refilter_timeout = 0;
-  }
   if (state->refilter) {
-    rofi_view_refilter_real(state);
+    rofi_view_refilter(state);
+  }
+  if (CacheState.filter != NULL && CacheState.filter->state == state) {
+    rofi_view_filter_wait(CacheState.filter);
   }
 }
 /**
@@ -1652,6 +2147,9 @@ static void rofi_view_refilter_force(RofiViewState *state) {
  */
 void process_result(RofiViewState *state);
 void rofi_view_finalize(RofiViewState *state) {
+  if (state) {
+    rofi_view_filter_cancel_view(state);
+  }
   if (state && state->finalize != NULL) {
     state->finalize(state);
   }
@@ -1697,7 +2195,7 @@ static void rofi_view_trigger_global_action(KeyBindingAction action) {
     char *data = NULL;
     unsigned int selected = listview_get_selected(state->list_view);
     if (selected < state->filtered_lines) {
-      data = mode_get_completion(state->sw, state->line_map[selected]);
+      data = mode_get_completion(state->sw, rofi_view_line(state, selected));
     } else if (state->text && state->text->text) {
       data = g_strdup(state->text->text);
     }
@@ -1738,7 +2236,7 @@ static void rofi_view_trigger_global_action(KeyBindingAction action) {
     unsigned int selected = listview_get_selected(state->list_view);
     state->selected_line = UINT32_MAX;
     if (selected < state->filtered_lines) {
-      state->selected_line = state->line_map[selected];
+      state->selected_line = rofi_view_line(state, selected);
     }
     state->retv = MENU_COMPLETE;
     state->quit = TRUE;
@@ -1755,9 +2253,10 @@ static void rofi_view_trigger_global_action(KeyBindingAction action) {
     break;
   // Special delete entry command.
   case DELETE_ENTRY: {
+    rofi_view_refilter_force(state);
     unsigned int selected = listview_get_selected(state->list_view);
     if (selected < state->filtered_lines) {
-      (state->selected_line) = state->line_map[selected];
+      (state->selected_line) = rofi_view_line(state, selected);
       state->retv = MENU_ENTRY_DELETE;
       state->quit = TRUE;
     }
@@ -1773,9 +2272,10 @@ static void rofi_view_trigger_global_action(KeyBindingAction action) {
   case SELECT_ELEMENT_8:
   case SELECT_ELEMENT_9:
   case SELECT_ELEMENT_10: {
+    rofi_view_refilter_force(state);
     unsigned int index = action - SELECT_ELEMENT_1;
     if (index < state->filtered_lines) {
-      state->selected_line = state->line_map[index];
+      state->selected_line = rofi_view_line(state, index);
       state->retv = MENU_OK;
       state->quit = TRUE;
     }
@@ -1800,10 +2300,11 @@ static void rofi_view_trigger_global_action(KeyBindingAction action) {
   case CUSTOM_17:
   case CUSTOM_18:
   case CUSTOM_19: {
+    rofi_view_refilter_force(state);
     state->selected_line = UINT32_MAX;
     unsigned int selected = listview_get_selected(state->list_view);
     if (selected < state->filtered_lines) {
-      (state->selected_line) = state->line_map[selected];
+      (state->selected_line) = rofi_view_line(state, selected);
     }
     state->retv = MENU_CUSTOM_COMMAND | ((action - CUSTOM_1) & MENU_LOWER_MASK);
     state->quit = TRUE;
@@ -1890,7 +2391,7 @@ static void rofi_view_trigger_global_action(KeyBindingAction action) {
     unsigned int selected = listview_get_selected(state->list_view);
     state->selected_line = UINT32_MAX;
     if (selected < state->filtered_lines) {
-      (state->selected_line) = state->line_map[selected];
+      (state->selected_line) = rofi_view_line(state, selected);
       state->retv = MENU_OK;
     } else {
       // Nothing entered and nothing selected.
@@ -1920,7 +2421,7 @@ static void rofi_view_trigger_global_action(KeyBindingAction action) {
     unsigned int selected = listview_get_selected(state->list_view);
     state->selected_line = UINT32_MAX;
     if (selected < state->filtered_lines) {
-      (state->selected_line) = state->line_map[selected];
+      (state->selected_line) = rofi_view_line(state, selected);
       state->retv = MENU_OK;
     } else {
       // Nothing entered and nothing selected.
@@ -2149,8 +2650,8 @@ static void rofi_quit_user_callback(RofiViewState *state) {
     if (selected >= state->filtered_lines)
       return;
     // Pass selected text to custom command
-    char *text = mode_get_display_value(state->sw, state->line_map[selected],
-                                        &fstate, NULL, TRUE);
+    char *text = mode_get_display_value(
+        state->sw, rofi_view_line(state, selected), &fstate, NULL, TRUE);
     char **args = NULL;
     int argv = 0;
     helper_parse_setup(config.on_entry_accepted, &args, &argv, "{entry}", text,
@@ -2278,7 +2779,7 @@ WidgetTriggerActionResult textbox_button_trigger_action(
     if (type) {
       if (state->list_view) {
         (state->selected_line) =
-            state->line_map[listview_get_selected(state->list_view)];
+            rofi_view_line(state, listview_get_selected(state->list_view));
       } else {
         (state->selected_line) = UINT32_MAX;
       }
@@ -2329,11 +2830,12 @@ static WidgetTriggerActionResult textbox_sidebar_modes_trigger_action(
 static void rofi_view_listview_mouse_activated_cb(listview *lv, gboolean custom,
                                                   void *udata) {
   RofiViewState *state = (RofiViewState *)udata;
+  rofi_view_refilter_force(state);
   state->retv = MENU_OK;
   if (custom) {
     state->retv |= MENU_CUSTOM_ACTION;
   }
-  (state->selected_line) = state->line_map[listview_get_selected(lv)];
+  (state->selected_line) = rofi_view_line(state, listview_get_selected(lv));
   // Quit
   state->quit = TRUE;
   state->skip_absorb = TRUE;
@@ -2731,10 +3233,7 @@ void rofi_view_cleanup(void) {
     g_source_remove(CacheState.idle_timeout);
     CacheState.idle_timeout = 0;
   }
-  if (CacheState.refilter_timeout > 0) {
-    g_source_remove(CacheState.refilter_timeout);
-    CacheState.refilter_timeout = 0;
-  }
+  rofi_view_filter_cancel();
   if (CacheState.overlay_timeout) {
     g_source_remove(CacheState.overlay_timeout);
     CacheState.overlay_timeout = 0;
@@ -2897,6 +3396,7 @@ void rofi_view_ellipsize_listview(RofiViewState *state,
 }
 
 void rofi_view_switch_mode(RofiViewState *state, Mode *mode) {
+  rofi_view_filter_cancel();
   state->sw = mode;
   // Update prompt;
   if (state->prompt) {
@@ -1157,6 +1157,13 @@ void listview_set_max_lines(listview *lv, unsigned int max_lines) {
   }
 }
 
+unsigned int listview_get_max_elements(listview *lv) {
+  if (lv) {
+    return lv->max_elements;
+  }
+  return 0;
+}
+
 gboolean listview_get_fixed_num_lines(listview *lv) {
   if (lv) {
     return lv->fixed_num_lines;
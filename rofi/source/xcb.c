@@ -37,7 +37,6 @@
 #include <cairo-xcb.h>
 #include <cairo.h>
 #include <glib.h>
-#include <math.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -142,191 +141,77 @@ static xcb_visualtype_t *lookup_visual(xcb_screen_t *s, xcb_visualid_t vis) {
   return 0;
 }
 
-/* This blur function was originally created my MacSlow and published on his
- * website: http://macslow.thepimp.net. I'm not entirely sure he's proud of it,
- * but it has proved immeasurably useful for me. */
-
-static uint32_t *create_kernel(int radius, double deviation, uint32_t *sum2) {
-  int size = 2 * (radius) + 1;
-  uint32_t *kernel = (uint32_t *)(g_malloc(sizeof(uint32_t) * (size + 1)));
-  double radiusf = abs(radius) + 1.0;
-  double value = -radius;
-  double sum = 0.0;
-  int i;
-
-  if (deviation == 0.0) {
-    deviation = sqrt(-(radiusf * radiusf) / (2.0 * log(1.0 / 255.0)));
-  }
-
-  kernel[0] = size;
-
-  for (i = 0; i < size; i++) {
-    kernel[1 + i] = INT16_MAX / (2.506628275 * deviation) *
-                    exp(-((value * value) / (2.0 * (deviation * deviation))));
-
-    sum += kernel[1 + i];
-    value += 1.0;
-  }
-
-  *sum2 = sum;
-
-  return kernel;
-}
-
-void cairo_image_surface_blur(cairo_surface_t *surface, int radius,
-                              double deviation) {
-  uint32_t *horzBlur;
-  uint32_t *kernel = 0;
-  cairo_format_t format;
-  unsigned int channels;
-
-  if (cairo_surface_status(surface)) {
-    return;
-  }
-
-  uint8_t *data = cairo_image_surface_get_data(surface);
-  format = cairo_image_surface_get_format(surface);
-  const int width = cairo_image_surface_get_width(surface);
-  const int height = cairo_image_surface_get_height(surface);
-  const int stride = cairo_image_surface_get_stride(surface);
-
-  if (format == CAIRO_FORMAT_ARGB32) {
-    channels = 4;
-  } else {
-    return;
-  }
-
-  horzBlur = (uint32_t *)(g_malloc(sizeof(uint32_t) * height * stride));
-  TICK();
-  uint32_t sum = 0;
-  kernel = create_kernel(radius, deviation, &sum);
-  TICK_N("BLUR: kernel");
-
-  /* Horizontal pass. */
-  uint32_t *horzBlur_ptr = horzBlur;
-  for (int iY = 0; iY < height; iY++) {
-    const int iYs = iY * stride;
-    for (int iX = 0; iX < width; iX++) {
-      uint32_t red = 0;
-      uint32_t green = 0;
-      uint32_t blue = 0;
-      uint32_t alpha = 0;
-      int offset = (int)(kernel[0]) / -2;
-
-      for (int i = 0; i < (int)(kernel[0]); i++) {
-        int x = iX + offset;
-
-        if (x < 0 || x >= width) {
-          offset++;
-          continue;
-        }
-
-        uint8_t *dataPtr = &data[iYs + x * channels];
-        const uint32_t kernip1 = kernel[i + 1];
-
-        blue += kernip1 * dataPtr[0];
-        green += kernip1 * dataPtr[1];
-        red += kernip1 * dataPtr[2];
-        alpha += kernip1 * dataPtr[3];
-        offset++;
-      }
-
-      *horzBlur_ptr++ = blue / sum;
-      *horzBlur_ptr++ = green / sum;
-      *horzBlur_ptr++ = red / sum;
-      *horzBlur_ptr++ = alpha / sum;
-    }
-  }
-  TICK_N("BLUR: hori");
-
-  /* Vertical pass. */
-  for (int iY = 0; iY < height; iY++) {
-    for (int iX = 0; iX < width; iX++) {
-      uint32_t red = 0;
-      uint32_t green = 0;
-      uint32_t blue = 0;
-      uint32_t alpha = 0;
-      int offset = (int)(kernel[0]) / -2;
-
-      const int iXs = iX * channels;
-      for (int i = 0; i < (int)(kernel[0]); i++) {
-        int y = iY + offset;
-
-        if (y < 0 || y >= height) {
-          offset++;
-          continue;
-        }
-
-        uint32_t *dataPtr = &horzBlur[y * stride + iXs];
-        const uint32_t kernip1 = kernel[i + 1];
-
-        blue += kernip1 * dataPtr[0];
-        green += kernip1 * dataPtr[1];
-        red += kernip1 * dataPtr[2];
-        alpha += kernip1 * dataPtr[3];
-
-        offset++;
-      }
-
-      *data++ = blue / sum;
-      *data++ = green / sum;
-      *data++ = red / sum;
-      *data++ = alpha / sum;
-    }
-  }
-  TICK_N("BLUR: vert");
-
-  free(kernel);
-  free(horzBlur);
-
-  return;
-}
-
 cairo_surface_t *x11_helper_get_screenshot_surface_window(xcb_window_t window,
                                                           int size) {
-  xcb_get_geometry_cookie_t cookie;
-  xcb_get_geometry_reply_t *reply;
-
-  cookie = xcb_get_geometry(xcb->connection, window);
-  reply = xcb_get_geometry_reply(xcb->connection, cookie, NULL);
-  if (reply == NULL) {
-    return NULL;
-  }
-
+  // Both requests go out before waiting on either.
+  xcb_get_geometry_cookie_t cookie = xcb_get_geometry(xcb->connection, window);
   xcb_get_window_attributes_cookie_t attributesCookie =
       xcb_get_window_attributes(xcb->connection, window);
+  xcb_get_geometry_reply_t *reply =
+      xcb_get_geometry_reply(xcb->connection, cookie, NULL);
   xcb_get_window_attributes_reply_t *attributes =
       xcb_get_window_attributes_reply(xcb->connection, attributesCookie, NULL);
-  if (attributes == NULL || (attributes->map_state != XCB_MAP_STATE_VIEWABLE)) {
+  if (reply == NULL || attributes == NULL ||
+      attributes->map_state != XCB_MAP_STATE_VIEWABLE || reply->width == 0 ||
+      reply->height == 0) {
     free(reply);
-    if (attributes) {
-      free(attributes);
-    }
+    free(attributes);
     return NULL;
   }
-  // Create a cairo surface for the window.
   xcb_visualtype_t *vt = lookup_visual(xcb->screen, attributes->visual);
   free(attributes);
-
-  cairo_surface_t *t = cairo_xcb_surface_create(xcb->connection, window, vt,
-                                                reply->width, reply->height);
-
-  if (cairo_surface_status(t) != CAIRO_STATUS_SUCCESS) {
-    cairo_surface_destroy(t);
+  // The image is read straight into a cairo surface, this only works if the
+  // pixel layout matches.
+  const xcb_setup_t *setup = xcb_get_setup(xcb->connection);
+  uint8_t byte_order = (G_BYTE_ORDER == G_LITTLE_ENDIAN)
+                           ? XCB_IMAGE_ORDER_LSB_FIRST
+                           : XCB_IMAGE_ORDER_MSB_FIRST;
+  if (vt == NULL || vt->red_mask != 0xff0000 || vt->green_mask != 0xff00 ||
+      vt->blue_mask != 0xff || setup->image_byte_order != byte_order) {
     free(reply);
     return NULL;
   }
 
+  uint16_t width = reply->width;
+  uint16_t height = reply->height;
+  free(reply);
+  xcb_get_image_cookie_t icookie =
+      xcb_get_image(xcb->connection, XCB_IMAGE_FORMAT_Z_PIXMAP, window, 0, 0,
+                    width, height, UINT32_MAX);
+  xcb_get_image_reply_t *image =
+      xcb_get_image_reply(xcb->connection, icookie, NULL);
+  if (image == NULL) {
+    return NULL;
+  }
+  int bpp = 0;
+  xcb_format_iterator_t f = xcb_setup_pixmap_formats_iterator(setup);
+  for (; f.rem; xcb_format_next(&f)) {
+    if (f.data->depth == image->depth) {
+      bpp = f.data->bits_per_pixel;
+    }
+  }
+  cairo_format_t format =
+      (image->depth == 32) ? CAIRO_FORMAT_ARGB32 : CAIRO_FORMAT_RGB24;
+  int stride = cairo_format_stride_for_width(format, width);
+  if (bpp != 32 || (image->depth != 24 && image->depth != 32) ||
+      xcb_get_image_data_length(image) < stride * height) {
+    free(image);
+    return NULL;
+  }
+  cairo_surface_t *t = cairo_image_surface_create_for_data(
+      xcb_get_image_data(image), format, width, height, stride);
+
   // Scale the image, as we don't want to keep large one around.
-  int max = MAX(reply->width, reply->height);
+  int max = MAX(width, height);
   double scale = (double)size / max;
 
-  cairo_surface_t *s2 = cairo_surface_create_similar_image(
-      t, CAIRO_FORMAT_ARGB32, reply->width * scale, reply->height * scale);
-  free(reply);
+  cairo_surface_t *s2 = cairo_image_surface_create(
+      CAIRO_FORMAT_ARGB32, MAX(1, width * scale), MAX(1, height * scale));
 
   if (cairo_surface_status(s2) != CAIRO_STATUS_SUCCESS) {
+    cairo_surface_destroy(s2);
     cairo_surface_destroy(t);
+    free(image);
     return NULL;
   }
   // Paint it in.
@@ -337,6 +222,7 @@ cairo_surface_t *x11_helper_get_screenshot_surface_window(xcb_window_t window,
   cairo_destroy(d);
 
   cairo_surface_destroy(t);
+  free(image);
   return s2;
 }
 /**
@@ -383,9 +269,17 @@ cairo_surface_t *x11_helper_get_bg_surface(void) {
 // retrieve a text property from a window
 // technically we could use window_get_prop(), but this is better for character
 // set support
+xcb_get_property_cookie_t window_get_text_prop_request(xcb_window_t w,
+                                                       xcb_atom_t atom) {
+  return xcb_get_property(xcb->connection, 0, w, atom,
+                          XCB_GET_PROPERTY_TYPE_ANY, 0, UINT_MAX);
+}
+
 char *window_get_text_prop(xcb_window_t w, xcb_atom_t atom) {
-  xcb_get_property_cookie_t c = xcb_get_property(
-      xcb->connection, 0, w, atom, XCB_GET_PROPERTY_TYPE_ANY, 0, UINT_MAX);
+  return window_get_text_prop_reply(window_get_text_prop_request(w, atom));
+}
+
+char *window_get_text_prop_reply(xcb_get_property_cookie_t c) {
   xcb_get_property_reply_t *r =
       xcb_get_property_reply(xcb->connection, c, NULL);
   if (r) {
@@ -463,6 +463,18 @@ static XrmOption xrmOptions[] = {
      NULL,
      "DRUN: If enabled, reload the cache with desktop file content.",
      CONFIG_DEFAULT},
+    {xrm_Boolean,
+     "icon-cache",
+     {.snum = &config.icon_cache},
+     NULL,
+     "Keep decoded icons in a cache on disk.",
+     CONFIG_DEFAULT},
+    {xrm_Number,
+     "icon-memory-limit",
+     {.num = &config.icon_memory_limit},
+     NULL,
+     "Memory, in MiB, used to keep decoded icons. (0 for no limit)",
+     CONFIG_DEFAULT},
     {xrm_Boolean,
      "normalize-match",
      {.snum = &config.normalize_match},
@@ -482,13 +494,6 @@ static XrmOption xrmOptions[] = {
      NULL,
      "Fallback icon to use when the application icon is not found in run/drun.",
      CONFIG_DEFAULT},
-    {xrm_Number,
-     "refilter-timeout-limit",
-     {.num = &(config.refilter_timeout_limit)},
-     NULL,
-     "When filtering takes  more then this time (in ms) switch to delayed "
-     "filter.",
-     CONFIG_DEFAULT},
     {xrm_Boolean,
      "xserver-i300-workaround",
      {.snum = &(config.xserver_i300_workaround)},
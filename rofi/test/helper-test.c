@@ -38,6 +38,7 @@
 #include <glib.h>
 #include <helper.h>
 #include <locale.h>
+#include <math.h>
 #include <stdio.h>
 #include <string.h>
 #include <xcb/xcb_ewmh.h>
@@ -113,6 +114,182 @@ void display_startup_notification(
     G_GNUC_UNUSED GSpawnChildSetupFunc *child_setup,
     G_GNUC_UNUSED gpointer *user_data) {}
 
+/** Rows a benchmark thread claims at a time. */
+#define FILTER_BENCH_BATCH_SIZE 256
+
+/**
+ * Shared state of the batch claiming benchmark.
+ */
+typedef struct {
+  /** The rows. */
+  char **lines;
+  /** Number of rows. */
+  unsigned int n;
+  /** The matching rows, per batch. */
+  gint *match;
+  /** Tokens to match. */
+  rofi_int_matcher **tokens;
+  /** Next batch to claim. */
+  gint next;
+  /** Number of matches. */
+  gint found;
+} filter_bench;
+
+/**
+ * Claim and match batches until none are left.
+ */
+static gpointer filter_bench_thread(gpointer data) {
+  filter_bench *fb = (filter_bench *)data;
+  unsigned int num_batches =
+      (fb->n + FILTER_BENCH_BATCH_SIZE - 1) / FILTER_BENCH_BATCH_SIZE;
+  while (TRUE) {
+    unsigned int b = (unsigned int)g_atomic_int_add(&(fb->next), 1);
+    if (b >= num_batches) {
+      break;
+    }
+    unsigned int start = b * FILTER_BENCH_BATCH_SIZE;
+    unsigned int stop = MIN(fb->n, start + FILTER_BENCH_BATCH_SIZE);
+    unsigned int count = 0;
+    for (unsigned int i = start; i < stop; i++) {
+      if (helper_token_match(fb->tokens, fb->lines[i])) {
+        fb->match[start + count] = i;
+        count++;
+      }
+    }
+    g_atomic_int_add(&(fb->found), count);
+  }
+  return NULL;
+}
+
+/**
+ * Levenshtein distance straight from the definition, to check the scorer.
+ */
+static unsigned int test_levenshtein_reference(const char *a, const char *b,
+                                               int case_sensitive) {
+  glong alen = 0, blen = 0;
+  gunichar *ac = g_utf8_to_ucs4_fast(a, -1, &alen);
+  gunichar *bc = g_utf8_to_ucs4_fast(b, -1, &blen);
+  unsigned int *d = g_malloc_n((alen + 1) * (blen + 1), sizeof(unsigned int));
+  for (glong i = 0; i <= alen; i++) {
+    for (glong j = 0; j <= blen; j++) {
+      unsigned int *cell = &(d[i * (blen + 1) + j]);
+      if (i == 0 || j == 0) {
+        *cell = i + j;
+        continue;
+      }
+      gunichar x = case_sensitive ? ac[i - 1] : g_unichar_tolower(ac[i - 1]);
+      gunichar y = case_sensitive ? bc[j - 1] : g_unichar_tolower(bc[j - 1]);
+      *cell = MIN(MIN(d[(i - 1) * (blen + 1) + j] + 1, *(cell - 1) + 1),
+                  d[(i - 1) * (blen + 1) + j - 1] + (x == y ? 0 : 1));
+    }
+  }
+  unsigned int retv = d[alen * (blen + 1) + blen];
+  g_free(d);
+  g_free(ac);
+  g_free(bc);
+  return retv;
+}
+
+/**
+ * The gaussian blur rofi used before the box blur, to check the
+ * approximation against.
+ */
+static void test_blur_reference(uint8_t *data, int width, int height,
+                                int stride, int radius) {
+  const int size = 2 * radius + 1;
+  double radiusf = radius + 1.0;
+  double deviation = sqrt(-(radiusf * radiusf) / (2.0 * log(1.0 / 255.0)));
+  uint32_t *kernel = g_malloc_n(size, sizeof(uint32_t));
+  double sumf = 0.0;
+  for (int i = 0; i < size; i++) {
+    double value = i - radius;
+    kernel[i] = INT16_MAX / (2.506628275 * deviation) *
+                exp(-((value * value) / (2.0 * (deviation * deviation))));
+    sumf += kernel[i];
+  }
+  uint32_t sum = sumf;
+  uint32_t *horz = g_malloc_n((size_t)height * stride, sizeof(uint32_t));
+  for (int y = 0; y < height; y++) {
+    for (int x = 0; x < width; x++) {
+      for (int c = 0; c < 4; c++) {
+        uint32_t v = 0;
+        for (int i = 0; i < size; i++) {
+          int xi = x + i - radius;
+          if (xi >= 0 && xi < width) {
+            v += kernel[i] * data[y * stride + xi * 4 + c];
+          }
+        }
+        horz[y * stride + x * 4 + c] = v / sum;
+      }
+    }
+  }
+  for (int y = 0; y < height; y++) {
+    for (int x = 0; x < width; x++) {
+      for (int c = 0; c < 4; c++) {
+        uint32_t v = 0;
+        for (int i = 0; i < size; i++) {
+          int yi = y + i - radius;
+          if (yi >= 0 && yi < height) {
+            v += kernel[i] * horz[yi * stride + x * 4 + c];
+          }
+        }
+        data[y * stride + x * 4 + c] = v / sum;
+      }
+    }
+  }
+  g_free(horz);
+  g_free(kernel);
+}
+
+/**
+ * Blur a test pattern with both kernels, and check the difference away from
+ * the edges. Returns the largest difference.
+ */
+static int test_blur_compare(int width, int height, int radius,
+                             double *mean) {
+  cairo_surface_t *a =
+      cairo_image_surface_create(CAIRO_FORMAT_ARGB32, width, height);
+  uint8_t *data = cairo_image_surface_get_data(a);
+  const int stride = cairo_image_surface_get_stride(a);
+  for (int y = 0; y < height; y++) {
+    for (int x = 0; x < width; x++) {
+      uint8_t *p = &(data[y * stride + x * 4]);
+      p[0] = ((x / 7 + y / 5) % 2) ? 220 : 30;
+      p[1] = (x * 255) / width;
+      p[2] = (y * 255) / height;
+      p[3] = 255;
+    }
+  }
+  cairo_surface_mark_dirty(a);
+  uint8_t *ref = g_memdup2(data, (gsize)height * stride);
+  test_blur_reference(ref, width, height, stride, radius);
+  cairo_image_surface_blur(a, radius, 0);
+  data = cairo_image_surface_get_data(a);
+
+  int max = 0;
+  double total = 0;
+  unsigned int n = 0;
+  for (int y = 2 * radius; y < height - 2 * radius; y++) {
+    for (int x = 2 * radius; x < width - 2 * radius; x++) {
+      for (int c = 0; c < 4; c++) {
+        int d = abs(data[y * stride + x * 4 + c] - ref[y * stride + x * 4 + c]);
+        max = MAX(max, d);
+        total += d;
+        n++;
+      }
+    }
+  }
+  *mean = total / n;
+  g_free(ref);
+  cairo_surface_destroy(a);
+  return max;
+}
+
+static void test_call_thread(gpointer data, gpointer user_data) {
+  thread_state *t = (thread_state *)data;
+  t->callback(t, user_data);
+}
+
 int main(int argc, char **argv) {
   cmd_set_arguments(argc, argv);
 
@@ -206,6 +383,197 @@ int main(int argc, char **argv) {
              1073741824);
   }
 
+  /**
+   * Scorer, against the reference and the one-shot functions.
+   */
+  {
+    const char *const words[] = {
+        "",
+        "aap",
+        "Aap Noot",
+        "noot aap mies",
+        "f\xc3\xa9" "e",
+        "F\xc3\x89" "E",
+        "\xe4\xbd\xa0\xe5\xa5\xbd aap",
+        "/usr/share/applications/org.mozilla.firefox.desktop",
+        "aaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaa",
+        "aaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaab",
+        "the quick brown fox jumps over the lazy dog, the quick brown fox "
+        "jumps over the lazy dog",
+        NULL};
+    unsigned int mismatches = 0;
+    for (int cs = 0; cs < 2; cs++) {
+      for (int p = 0; words[p] != NULL; p++) {
+        glong plen = g_utf8_strlen(words[p], -1);
+        rofi_scorer *scorer = rofi_scorer_create(words[p], -1, cs);
+        for (int w = 0; words[w] != NULL; w++) {
+          glong wlen = g_utf8_strlen(words[w], -1);
+          unsigned int d = rofi_scorer_levenshtein(scorer, words[w], -1);
+          if (d != test_levenshtein_reference(words[p], words[w], cs) ||
+              d != levenshtein(words[p], plen, words[w], wlen, cs)) {
+            mismatches++;
+          }
+          if (rofi_scorer_fuzzy(scorer, words[w], -1) !=
+              rofi_scorer_fuzzy_evaluate(words[p], plen, words[w], wlen, cs)) {
+            mismatches++;
+          }
+        }
+        rofi_scorer_free(scorer);
+      }
+    }
+    TASSERTE(mismatches, 0u);
+    rofi_scorer *scorer = rofi_scorer_create(NULL, -1, FALSE);
+    TASSERTE(rofi_scorer_levenshtein(scorer, "aap", -1), 3u);
+    rofi_scorer_free(scorer);
+  }
+  /**
+   * Scorer micro-benchmark, reports the time it takes.
+   */
+  {
+    const char *pattern = "firefx";
+    char *lines[256];
+    for (int i = 0; i < 256; i++) {
+      lines[i] =
+          g_strdup_printf("/usr/share/applications/app-%d-Firefox.desktop", i);
+    }
+    unsigned long long sum_once = 0, sum_scorer = 0;
+    GTimer *timer = g_timer_new();
+    for (int r = 0; r < 100; r++) {
+      for (int i = 0; i < 256; i++) {
+        sum_once += levenshtein(pattern, 6, lines[i],
+                                g_utf8_strlen(lines[i], -1), FALSE);
+      }
+    }
+    double once = g_timer_elapsed(timer, NULL);
+    g_timer_start(timer);
+    rofi_scorer *scorer = rofi_scorer_create(pattern, -1, FALSE);
+    for (int r = 0; r < 100; r++) {
+      for (int i = 0; i < 256; i++) {
+        sum_scorer += rofi_scorer_levenshtein(scorer, lines[i], -1);
+      }
+    }
+    rofi_scorer_free(scorer);
+    double scored = g_timer_elapsed(timer, NULL);
+    g_timer_destroy(timer);
+    printf("levenshtein: %.3fms one-shot, %.3fms with scorer\n", once * 1000.0,
+           scored * 1000.0);
+    TASSERT(sum_once == sum_scorer);
+    for (int i = 0; i < 256; i++) {
+      g_free(lines[i]);
+    }
+  }
+  /**
+   * String arena.
+   */
+  {
+    rofi_string_arena *arena = rofi_string_arena_new();
+    TASSERT(rofi_string_arena_get_size(arena) == 0);
+    char *a = rofi_string_arena_add(arena, "aap noot", 3);
+    TASSERT(g_strcmp0(a, "aap") == 0);
+    char *b = rofi_string_arena_add(arena, "mies", -1);
+    TASSERT(g_strcmp0(b, "mies") == 0);
+    TASSERT(rofi_string_arena_add(arena, NULL, -1) == NULL);
+    char *c = rofi_string_arena_add_utf8(arena, "a\xff" "b", 3);
+    TASSERT(g_strcmp0(c, "a\uFFFDb") == 0);
+    // Larger than a block.
+    char *large = g_strnfill(200000, 'x');
+    char *d = rofi_string_arena_add(arena, large, -1);
+    TASSERT(g_strcmp0(d, large) == 0);
+    g_free(large);
+    rofi_string_arena *other = rofi_string_arena_new();
+    char *e = rofi_string_arena_add(other, "wim", -1);
+    gsize size = rofi_string_arena_get_size(arena);
+    gsize other_size = rofi_string_arena_get_size(other);
+    rofi_string_arena_merge(arena, other);
+    TASSERT(rofi_string_arena_get_size(arena) == size + other_size);
+    TASSERT(g_strcmp0(a, "aap") == 0);
+    TASSERT(g_strcmp0(e, "wim") == 0);
+    rofi_string_arena_free(arena);
+    rofi_string_arena_free(NULL);
+  }
+  /**
+   * String arena benchmark, reports the time and memory for a million rows
+   * compared to allocating each string.
+   */
+  {
+    const unsigned int n = 1000000;
+    char **strs = g_malloc_n(n, sizeof(char *));
+    char buffer[64];
+    gsize bytes = 0, malloced = 0;
+    GTimer *timer = g_timer_new();
+    for (unsigned int i = 0; i < n; i++) {
+      int len = g_snprintf(buffer, sizeof(buffer), "/var/log/app/%u.log", i);
+      strs[i] = g_strndup(buffer, len);
+      bytes += len + 1;
+      // glibc chunk: 8 bytes header, 16 bytes alignment, 32 bytes minimum.
+      malloced += MAX(32, (len + 1 + 8 + 15) & ~15);
+    }
+    for (unsigned int i = 0; i < n; i++) {
+      g_free(strs[i]);
+    }
+    double each = g_timer_elapsed(timer, NULL);
+    g_timer_start(timer);
+    rofi_string_arena *arena = rofi_string_arena_new();
+    for (unsigned int i = 0; i < n; i++) {
+      int len = g_snprintf(buffer, sizeof(buffer), "/var/log/app/%u.log", i);
+      strs[i] = rofi_string_arena_add(arena, buffer, len);
+    }
+    gsize arena_size = rofi_string_arena_get_size(arena);
+    rofi_string_arena_free(arena);
+    double arena_time = g_timer_elapsed(timer, NULL);
+    g_timer_destroy(timer);
+    g_free(strs);
+    printf("string arena: %u strings, %" G_GSIZE_FORMAT " bytes of data, "
+           "%" G_GSIZE_FORMAT " bytes malloc (estimated) in %.3fms, "
+           "%" G_GSIZE_FORMAT " bytes arena in %.3fms\n",
+           n, bytes, malloced, each * 1000.0, arena_size, arena_time * 1000.0);
+    TASSERT(arena_size < malloced);
+  }
+  /**
+   * Batch claiming benchmark: threads claim batches of rows with an atomic
+   * counter until none are left. This models the scheme only, it does not run
+   * the view's filter code. Reports the time for 1 to 32 threads.
+   */
+  {
+    filter_bench fb = {0};
+    fb.n = 1000000;
+    fb.lines = g_malloc_n(fb.n, sizeof(char *));
+    fb.match = g_malloc0_n(fb.n, sizeof(gint));
+    rofi_string_arena *arena = rofi_string_arena_new();
+    char buffer[64];
+    for (unsigned int i = 0; i < fb.n; i++) {
+      int len = g_snprintf(buffer, sizeof(buffer),
+                           "/usr/share/applications/app-%u.desktop", i);
+      fb.lines[i] = rofi_string_arena_add(arena, buffer, len);
+    }
+    fb.tokens = helper_tokenize("app-12 desktop", FALSE);
+    unsigned int expected = 0;
+    for (unsigned int nt = 1; nt <= 32; nt *= 2) {
+      GThread *threads[32];
+      fb.next = 0;
+      fb.found = 0;
+      GTimer *timer = g_timer_new();
+      for (unsigned int t = 0; t < nt; t++) {
+        threads[t] = g_thread_new("filter-bench", filter_bench_thread, &fb);
+      }
+      for (unsigned int t = 0; t < nt; t++) {
+        g_thread_join(threads[t]);
+      }
+      double elapsed = g_timer_elapsed(timer, NULL);
+      g_timer_destroy(timer);
+      printf("batch claiming: %u rows, %2u threads in %.3fms\n", fb.n, nt,
+             elapsed * 1000.0);
+      if (nt == 1) {
+        expected = (unsigned int)fb.found;
+      }
+      TASSERTE((unsigned int)fb.found, expected);
+    }
+    helper_tokenize_free(fb.tokens);
+    rofi_string_arena_free(arena);
+    g_free(fb.match);
+    g_free(fb.lines);
+  }
+
   /**
    * Case sensitivity
    */
@@ -274,4 +642,22 @@ int main(int argc, char **argv) {
   printf("%s\n", a);
   TASSERT(g_utf8_collate(a, "rofi-sensible-terminal -e aap") == 0);
   g_free(a);
+
+  /**
+   * Blur
+   */
+  {
+    double mean = 0;
+    // In this thread, split in slices, and on a worker pool.
+    config.threads = 1;
+    TASSERT(test_blur_compare(160, 120, 10, &mean) <= 4 && mean < 1.0);
+    config.threads = 3;
+    TASSERT(test_blur_compare(97, 61, 5, &mean) <= 10 && mean < 1.0);
+    tpool = g_thread_pool_new(test_call_thread, NULL, 3, FALSE, NULL);
+    TASSERT(test_blur_compare(160, 120, 20, &mean) <= 4 && mean < 1.0);
+    TASSERT(test_blur_compare(203, 33, 3, &mean) <= 16 && mean < 1.0);
+    g_thread_pool_free(tpool, FALSE, TRUE);
+    tpool = NULL;
+    config.threads = 0;
+  }
 }
@@ -234,6 +234,88 @@ START_TEST(test_tokenizer_match_glob_multiple_ci_star) {
 }
 END_TEST
 
+START_TEST(test_tokenizer_match_glob_single_ci_question_star) {
+  config.matching_method = MM_GLOB;
+  rofi_int_matcher **tokens = helper_tokenize("n?o*m?es", FALSE);
+  ck_assert_int_eq(helper_token_match(tokens, "aap noot mies"), TRUE);
+  ck_assert_int_eq(helper_token_match(tokens, "aap NOOT MIES"), TRUE);
+  ck_assert_int_eq(helper_token_match(tokens, "aap n oot mies"), FALSE);
+  ck_assert_int_eq(
+      helper_token_match(tokens, "aap n\xc3\xb6ot m\xc3\xaf" "es"), TRUE);
+  ck_assert_int_eq(helper_token_match(tokens, "mies noot"), FALSE);
+  ck_assert_int_eq(helper_token_match(tokens, "noot\nmies"), FALSE);
+  ck_assert_int_eq(helper_token_match(tokens, "aap\nnoot mies"), TRUE);
+  ck_assert_int_eq(helper_token_match(tokens, "noot\nmies\nnoot mies"), TRUE);
+  helper_tokenize_free(tokens);
+}
+END_TEST
+
+START_TEST(test_tokenizer_match_prefix_single_ci) {
+  config.matching_method = MM_PREFIX;
+  rofi_int_matcher **tokens = helper_tokenize("noot", FALSE);
+  ck_assert_int_eq(helper_token_match(tokens, "aap noot mies"), TRUE);
+  ck_assert_int_eq(helper_token_match(tokens, "aap Noot mies"), TRUE);
+  ck_assert_int_eq(helper_token_match(tokens, "aapnoot mies"), FALSE);
+  ck_assert_int_eq(helper_token_match(tokens, "aapnoot noot"), TRUE);
+  ck_assert_int_eq(helper_token_match(tokens, "aap_noot mies"), FALSE);
+  ck_assert_int_eq(helper_token_match(tokens, "aap-noot mies"), TRUE);
+  ck_assert_int_eq(helper_token_match(tokens, "nootap mies"), TRUE);
+  helper_tokenize_free(tokens);
+}
+END_TEST
+
+START_TEST(test_tokenizer_match_prefix_single_cs) {
+  config.matching_method = MM_PREFIX;
+  rofi_int_matcher **tokens = helper_tokenize("Noot", TRUE);
+  ck_assert_int_eq(helper_token_match(tokens, "aap noot mies"), FALSE);
+  ck_assert_int_eq(helper_token_match(tokens, "aap Noot mies"), TRUE);
+  ck_assert_int_eq(helper_token_match(tokens, "aapNoot mies"), FALSE);
+  helper_tokenize_free(tokens);
+}
+END_TEST
+
+START_TEST(test_tokenizer_match_prefix_non_word) {
+  config.matching_method = MM_PREFIX;
+  rofi_int_matcher **tokens = helper_tokenize("-noot", FALSE);
+  // Leading '-' negates.
+  ck_assert_int_eq(helper_token_match(tokens, "aap noot mies"), FALSE);
+  ck_assert_int_eq(helper_token_match(tokens, "aap mies"), TRUE);
+  helper_tokenize_free(tokens);
+  tokens = helper_tokenize(".noot", FALSE);
+  ck_assert_int_eq(helper_token_match(tokens, "aap.noot mies"), TRUE);
+  ck_assert_int_eq(helper_token_match(tokens, "aap .noot mies"), FALSE);
+  helper_tokenize_free(tokens);
+}
+END_TEST
+
+START_TEST(test_tokenizer_match_normal_normalize) {
+  config.matching_method = MM_NORMAL;
+  config.normalize_match = TRUE;
+  rofi_int_matcher **tokens = helper_tokenize("noot", FALSE);
+  ck_assert_int_eq(helper_token_match(tokens, "aap n\xc3\xb6ot mies"), TRUE);
+  ck_assert_int_eq(helper_token_match(tokens, "aap n\xc3\xb6\xc3\xb6t"), TRUE);
+  ck_assert_int_eq(helper_token_match(tokens, "aap m\xc3\xaf" "es"), FALSE);
+  ck_assert_int_eq(helper_token_match(tokens, "aap noot mies"), TRUE);
+  rofi_normalize_cache *cache = rofi_normalize_cache_new(2);
+  helper_token_match_set_row(cache, 0);
+  ck_assert_int_eq(helper_token_match(tokens, "aap n\xc3\xb6ot mies"), TRUE);
+  // Second lookup is served from the cache.
+  ck_assert_int_eq(helper_token_match(tokens, "aap n\xc3\xb6ot mies"), TRUE);
+  // A row can match more than one string.
+  ck_assert_int_eq(helper_token_match(tokens, "aap m\xc3\xaf" "es"), FALSE);
+  helper_token_match_set_row(cache, 1);
+  ck_assert_int_eq(helper_token_match(tokens, "aap m\xc3\xaf" "es"), FALSE);
+  ck_assert_int_eq(helper_token_match(tokens, "n\xc3\xb6ot"), TRUE);
+  // Out of range rows are not cached.
+  helper_token_match_set_row(cache, 2);
+  ck_assert_int_eq(helper_token_match(tokens, "n\xc3\xb6ot"), TRUE);
+  helper_token_match_set_row(NULL, 0);
+  rofi_normalize_cache_free(cache);
+  helper_tokenize_free(tokens);
+  config.normalize_match = FALSE;
+}
+END_TEST
+
 START_TEST(test_tokenizer_match_fuzzy_single_ci) {
   config.matching_method = MM_FUZZY;
   rofi_int_matcher **tokens = helper_tokenize("noot", FALSE);
@@ -390,6 +472,93 @@ START_TEST(test_tokenizer_match_regex_single_two_word_till_end) {
 }
 END_TEST
 
+/**
+ * @param tokens The tokens to match with the regex engine only.
+ * @param input The string to match against.
+ *
+ * Match the tokens like helper_token_match(), but without the native
+ * matchers.
+ *
+ * @returns TRUE when matches, FALSE otherwise
+ */
+static int bench_regex_match(rofi_int_matcher *const *tokens,
+                             const char *input) {
+  int match = TRUE;
+  for (int j = 0; match && tokens[j]; j++) {
+    match = g_regex_match(tokens[j]->regex, input, 0, NULL);
+    match ^= tokens[j]->invert;
+  }
+  return match;
+}
+
+/**
+ * @param method The matching method to benchmark.
+ * @param pattern The user input.
+ *
+ * Time the native matchers against the regex engine on the same input, and
+ * check both agree on every row.
+ */
+static void bench_matcher(MatchingMethod method, const char *pattern) {
+  static const char *const words[] = {
+      "firefox", "Terminal", "gnome-control-center", "libre_office",
+      "Visual Studio Code", "nautilus", "org.gnome.Settings", "Noot mies"};
+  const unsigned int num_rows = 4096;
+  const unsigned int rounds = 50;
+  char **rows = g_malloc0_n(num_rows + 1, sizeof(char *));
+  for (unsigned int i = 0; i < num_rows; i++) {
+    rows[i] = g_strdup_printf("%s %u %s", words[i % G_N_ELEMENTS(words)], i,
+                              words[(i / 7) % G_N_ELEMENTS(words)]);
+  }
+  config.matching_method = method;
+  rofi_int_matcher **tokens = helper_tokenize(pattern, FALSE);
+  unsigned int native_hits = 0, regex_hits = 0;
+
+  GTimer *timer = g_timer_new();
+  for (unsigned int r = 0; r < rounds; r++) {
+    for (unsigned int i = 0; i < num_rows; i++) {
+      native_hits += helper_token_match(tokens, rows[i]);
+    }
+  }
+  double native_time = g_timer_elapsed(timer, NULL);
+  g_timer_start(timer);
+  for (unsigned int r = 0; r < rounds; r++) {
+    for (unsigned int i = 0; i < num_rows; i++) {
+      regex_hits += bench_regex_match(tokens, rows[i]);
+    }
+  }
+  double regex_time = g_timer_elapsed(timer, NULL);
+  g_timer_destroy(timer);
+
+  printf("Matching '%s' against %u rows: native %.3fms, regex %.3fms\n",
+         pattern, num_rows, native_time * 1000.0 / rounds,
+         regex_time * 1000.0 / rounds);
+  ck_assert_uint_eq(native_hits, regex_hits);
+  for (unsigned int i = 0; i < num_rows; i++) {
+    ck_assert_int_eq(helper_token_match(tokens, rows[i]),
+                     bench_regex_match(tokens, rows[i]));
+  }
+  helper_tokenize_free(tokens);
+  g_strfreev(rows);
+}
+
+START_TEST(test_tokenizer_bench_normal) {
+  bench_matcher(MM_NORMAL, "gnome set");
+  bench_matcher(MM_NORMAL, "no-match");
+}
+END_TEST
+
+START_TEST(test_tokenizer_bench_prefix) {
+  bench_matcher(MM_PREFIX, "gno cod");
+  bench_matcher(MM_PREFIX, "mies");
+}
+END_TEST
+
+START_TEST(test_tokenizer_bench_glob) {
+  bench_matcher(MM_GLOB, "g*e set?ings");
+  bench_matcher(MM_GLOB, "*office");
+}
+END_TEST
+
 static Suite *helper_tokenizer_suite(void) {
   Suite *s;
 
@@ -409,6 +578,7 @@ static Suite *helper_tokenizer_suite(void) {
     tcase_add_test(tc_normal, test_tokenizer_match_normal_multiple_ci);
     tcase_add_test(tc_normal, test_tokenizer_match_normal_single_ci_negate);
     tcase_add_test(tc_normal, test_tokenizer_match_normal_multiple_ci_negate);
+    tcase_add_test(tc_normal, test_tokenizer_match_normal_normalize);
     suite_add_tcase(s, tc_normal);
   }
   {
@@ -419,8 +589,16 @@ static Suite *helper_tokenizer_suite(void) {
     tcase_add_test(tc_glob, test_tokenizer_match_glob_single_ci_question);
     tcase_add_test(tc_glob, test_tokenizer_match_glob_single_ci_star);
     tcase_add_test(tc_glob, test_tokenizer_match_glob_multiple_ci_star);
+    tcase_add_test(tc_glob, test_tokenizer_match_glob_single_ci_question_star);
     suite_add_tcase(s, tc_glob);
   }
+  {
+    TCase *tc_prefix = tcase_create("Prefix");
+    tcase_add_test(tc_prefix, test_tokenizer_match_prefix_single_ci);
+    tcase_add_test(tc_prefix, test_tokenizer_match_prefix_single_cs);
+    tcase_add_test(tc_prefix, test_tokenizer_match_prefix_non_word);
+    suite_add_tcase(s, tc_prefix);
+  }
   {
     TCase *tc_fuzzy = tcase_create("Fuzzy");
     tcase_add_test(tc_fuzzy, test_tokenizer_match_fuzzy_single_ci);
@@ -441,6 +619,13 @@ static Suite *helper_tokenizer_suite(void) {
     tcase_add_test(tc_regex, test_tokenizer_match_regex_multiple_ci);
     suite_add_tcase(s, tc_regex);
   }
+  {
+    TCase *tc_bench = tcase_create("Benchmark");
+    tcase_add_test(tc_bench, test_tokenizer_bench_normal);
+    tcase_add_test(tc_bench, test_tokenizer_bench_prefix);
+    tcase_add_test(tc_bench, test_tokenizer_bench_glob);
+    suite_add_tcase(s, tc_bench);
+  }
 
   return s;
 }
@@ -40,11 +40,13 @@ static unsigned int test = 0;
         printf ( "Test %u passed (%s)\n", ++test, # a ); \
 }
 
-const char *file = "text";
+const char *file    = "text";
+const char *journal = "text.journal";
 
 static void history_test ( void )
 {
     unlink ( file );
+    unlink ( journal );
 
     // Empty list.
     unsigned int length = 0;
@@ -114,12 +116,89 @@ static void history_test ( void )
 
     g_strfreev ( retv );
 
+    unlink ( file );
+    unlink ( journal );
+}
+
+static void history_import_test ( void )
+{
+    unlink ( file );
+    unlink ( journal );
+
+    // History file in the text format.
+    const char *text = "3 noot\n1 mies\n0 aap\n";
+    TASSERT ( g_file_set_contents ( file, text, -1, NULL ) );
+
+    unsigned int length = 0;
+    char         **retv = history_get_list ( file, &length );
+    TASSERT ( length == 3 );
+    TASSERT ( strcmp ( retv[0], "noot" ) == 0 );
+    TASSERT ( strcmp ( retv[1], "mies" ) == 0 );
+    TASSERT ( strcmp ( retv[2], "aap" ) == 0 );
+    g_strfreev ( retv );
+
+    // Updates go into the journal, the history file is left alone.
+    history_set ( file, "mies" );
+    history_set ( file, "mies" );
+    history_set ( file, "wim" );
+    history_remove ( file, "aap" );
+
+    char *contents = NULL;
+    TASSERT ( g_file_get_contents ( file, &contents, NULL, NULL ) );
+    TASSERT ( strcmp ( contents, text ) == 0 );
+    g_free ( contents );
+    TASSERT ( g_file_test ( journal, G_FILE_TEST_EXISTS ) );
+
+    // Equal use-count keeps the order it was reached in.
+    retv = history_get_list ( file, &length );
+    TASSERT ( length == 3 );
+    TASSERT ( strcmp ( retv[0], "noot" ) == 0 );
+    TASSERT ( strcmp ( retv[1], "mies" ) == 0 );
+    TASSERT ( strcmp ( retv[2], "wim" ) == 0 );
+    g_strfreev ( retv );
+
+    unlink ( file );
+    unlink ( journal );
+}
+
+static void history_compact_test ( void )
+{
+    unlink ( file );
+    unlink ( journal );
+
+    // Grow the journal until it gets folded into the history file.
+    unsigned int iter = 0;
+    history_set ( file, "aap" );
+    while ( g_file_test ( journal, G_FILE_TEST_EXISTS ) && iter < 100000 ) {
+        char *p = g_strdup_printf ( "aap%u", iter++ % 50 );
+        history_set ( file, p );
+        g_free ( p );
+    }
+    TASSERT ( !g_file_test ( journal, G_FILE_TEST_EXISTS ) );
+
+    // Compacted file is in the text format.
+    char *contents = NULL;
+    TASSERT ( g_file_get_contents ( file, &contents, NULL, NULL ) );
+    char **lines = g_strsplit ( contents, "\n", -1 );
+    TASSERT ( g_strv_length ( lines ) == 26 );
+    TASSERT ( g_ascii_isdigit ( lines[0][0] ) );
+    TASSERT ( strcmp ( lines[25], "" ) == 0 );
+    g_strfreev ( lines );
+    g_free ( contents );
+
+    unsigned int length = 0;
+    char         **retv = history_get_list ( file, &length );
+    TASSERT ( length == 25 );
+    g_strfreev ( retv );
+
     unlink ( file );
 }
 
 int main ( G_GNUC_UNUSED int argc, G_GNUC_UNUSED char **argv )
 {
     history_test ();
+    history_import_test ();
+    history_compact_test ();
 
     return 0;
 }
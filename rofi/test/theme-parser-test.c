@@ -235,6 +235,78 @@ START_TEST(test_properties_boolean_reference) {
 }
 END_TEST
 
+START_TEST(test_properties_boolean_reparse) {
+  widget wid;
+  wid.name = "blaat";
+  wid.state = NULL;
+  rofi_theme_parse_string("* { test: true; } blaat.selected { test2: true; }");
+  ck_assert_int_eq(rofi_theme_get_boolean(&wid, "test", FALSE), TRUE);
+  ck_assert_int_eq(rofi_theme_get_boolean(&wid, "test2", FALSE), FALSE);
+  wid.state = "selected";
+  ck_assert_int_eq(rofi_theme_get_boolean(&wid, "test2", FALSE), TRUE);
+  // Lookups done before must not hide properties parsed later.
+  rofi_theme_parse_string("blaat { test: false; test2: true; }");
+  ck_assert_int_eq(rofi_theme_get_boolean(&wid, "test", TRUE), FALSE);
+  wid.state = NULL;
+  ck_assert_int_eq(rofi_theme_get_boolean(&wid, "test", TRUE), FALSE);
+  ck_assert_int_eq(rofi_theme_get_boolean(&wid, "test2", FALSE), TRUE);
+}
+END_TEST
+
+/**
+ * Style cache benchmark, reports the time per lookup walking the theme tree
+ * the way the getters did before the cache, and through the cache. The widget
+ * changes on every lookup.
+ */
+START_TEST(test_properties_style_cache_timing) {
+  const char *names[] = {"window",    "mainbox",       "inputbar",
+                         "prompt",    "entry",         "listview",
+                         "element",   "element-text",  "message",
+                         "textbox",   "mode-switcher", "button",
+                         "sidebar",   "scrollbar",     "num-rows"};
+  const unsigned int num_names = G_N_ELEMENTS(names);
+  GString *str = g_string_new("* { spacing: 2; }");
+  for (unsigned int i = 0; i < num_names; i++) {
+    g_string_append_printf(str, " %s { padding: %u; }", names[i], i);
+    g_string_append_printf(str, " %s.selected { border: %u; }", names[i],
+                           i + 1);
+  }
+  rofi_theme_parse_string(str->str);
+  g_string_free(str, TRUE);
+
+  widget wids[G_N_ELEMENTS(names)];
+  for (unsigned int i = 0; i < num_names; i++) {
+    wids[i].name = (char *)names[i];
+    wids[i].state = (i % 2) ? "selected" : NULL;
+  }
+  const unsigned int rounds = 2000;
+  long walk_sum = 0, cache_sum = 0;
+  GTimer *timer = g_timer_new();
+  for (unsigned int r = 0; r < rounds; r++) {
+    for (unsigned int i = 0; i < num_names; i++) {
+      ThemeWidget *twid =
+          rofi_theme_find_widget(wids[i].name, wids[i].state, FALSE);
+      Property *p = rofi_theme_find_property(twid, P_INTEGER, "spacing", FALSE);
+      walk_sum += p ? p->value.i : 0;
+    }
+  }
+  double walk = g_timer_elapsed(timer, NULL);
+  g_timer_start(timer);
+  for (unsigned int r = 0; r < rounds; r++) {
+    for (unsigned int i = 0; i < num_names; i++) {
+      cache_sum += rofi_theme_get_integer(&wids[i], "spacing", 0);
+    }
+  }
+  double cached = g_timer_elapsed(timer, NULL);
+  g_timer_destroy(timer);
+  printf("style lookup: %.1fns tree walk, %.1fns cached\n",
+         walk * 1e9 / (rounds * num_names),
+         cached * 1e9 / (rounds * num_names));
+  ck_assert_int_eq(walk_sum, 2 * rounds * num_names);
+  ck_assert_int_eq(walk_sum, cache_sum);
+}
+END_TEST
+
 START_TEST(test_properties_distance_em) {
   widget wid;
   wid.name = "blaat";
@@ -1787,8 +1859,16 @@ static Suite *theme_parser_suite(void) {
                               theme_parser_teardown);
     tcase_add_test(tc_prop_bool, test_properties_boolean);
     tcase_add_test(tc_prop_bool, test_properties_boolean_reference);
+    tcase_add_test(tc_prop_bool, test_properties_boolean_reparse);
     suite_add_tcase(s, tc_prop_bool);
   }
+  {
+    TCase *tc_style_cache = tcase_create("StyleCache");
+    tcase_add_checked_fixture(tc_style_cache, theme_parser_setup,
+                              theme_parser_teardown);
+    tcase_add_test(tc_style_cache, test_properties_style_cache_timing);
+    suite_add_tcase(s, tc_style_cache);
+  }
   {
     TCase *tc_prop_distance = tcase_create("PropertiesDistance");
     tcase_add_checked_fixture(tc_prop_distance, theme_parser_setup,